@@ -1,312 +1,218 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
 
-#define MAX_CASES 16
-#define MAX_PATH 256
-#define MAX_EXPERTS 8
-#define MAX_SHARED 2
-#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#include "moe_cpu.h"
+#include "moe_stack.h"
+#include "moe_io.h"
+#include "timer.h"
 
-static float sigmoid(float x) {
-    return 1.0f / (1.0f + expf(-x));
-}
-
-static float* load_f32(const char* path, size_t expected_elems) {
-    FILE* f = fopen(path, "rb");
-    if (!f) {
-        fprintf(stderr, "Failed to open %s\n", path);
-        exit(1);
-    }
-    float* buf = (float*)malloc(expected_elems * sizeof(float));
-    if (!buf) {
-        fprintf(stderr, "OOM loading %s\n", path);
-        exit(1);
-    }
-    size_t n = fread(buf, sizeof(float), expected_elems, f);
-    fclose(f);
-    if (n != expected_elems) {
-        fprintf(stderr, "Expected %zu floats in %s, got %zu\n", expected_elems, path, n);
-        exit(1);
-    }
-    return buf;
-}
-
-static int* load_i32(const char* path, size_t expected_elems) {
-    FILE* f = fopen(path, "rb");
-    if (!f) {
-        fprintf(stderr, "Failed to open %s\n", path);
-        exit(1);
-    }
-    int* buf = (int*)malloc(expected_elems * sizeof(int));
-    if (!buf) {
-        fprintf(stderr, "OOM loading %s\n", path);
-        exit(1);
-    }
-    size_t n = fread(buf, sizeof(int), expected_elems, f);
-    fclose(f);
-    if (n != expected_elems) {
-        fprintf(stderr, "Expected %zu ints in %s, got %zu\n", expected_elems, path, n);
-        exit(1);
-    }
-    return buf;
-}
+/* bf16 weights/activations vs fp32: same bound as the WMMA bf16 expert check */
+#define BF16_TOL 1e-2
 
-/* Very small parser for meta.json */
 typedef struct {
-    int hidden_size;
-    int intermediate_size;
-    int n_routed_experts;
-    int n_shared_experts;
-    int top_k;
-    float routed_scaling_factor;
-    int batch_size;
-    int seq_len;
-} Meta;
-
-static void parse_meta(const char* path, Meta* m) {
-    FILE* f = fopen(path, "r");
-    if (!f) {
-        fprintf(stderr, "Failed to open meta %s\n", path);
-        exit(1);
+    double fp32;        /* golden routing, fp32 */
+    double routed;      /* routing recomputed from router_weight.bin */
+    double bf16;        /* bf16 path vs golden */
+    double bf16_vs_f32; /* bf16 path vs fp32 path */
+    double ec;          /* expert-choice forward vs per-token reference */
+    int ec_capacity;
+    int ec_dropped;     /* tokens no expert picked */
+    int deterministic;  /* outputs bitwise equal across thread counts */
+} CaseDiffs;
+
+/* Thread counts the determinism check compares against 1 thread */
+static const int det_threads[] = { 2, 3, 4, 7 };
+#define DET_TOKENS 300
+
+/*
+ * Tiles the case inputs up to DET_TOKENS tokens (several combine blocks),
+ * routes them with the layer's router and checks that token-choice and
+ * expert-choice outputs are bitwise identical for every thread count.
+ */
+static int check_determinism(const MoeLayer* layer, const float* x, int N) {
+    const Meta* m = &layer->meta;
+    int H = m->hidden_size;
+    size_t NH = (size_t)DET_TOKENS * H;
+    float* xs = (float*)xmalloc(NH * sizeof(float), "det inputs");
+    float* ref_tc = (float*)xmalloc(NH * sizeof(float), "det ref tc");
+    float* ref_ec = (float*)xmalloc(NH * sizeof(float), "det ref ec");
+    float* got = (float*)xmalloc(NH * sizeof(float), "det out");
+    int ok = 1;
+
+    /* Distinct tokens: case rows, scaled per copy so routing varies */
+    for (int n = 0; n < DET_TOKENS; ++n)
+        for (int h = 0; h < H; ++h)
+            xs[(size_t)n * H + h] = x[(size_t)(n % N) * H + h] * (1.0f + 0.01f * (float)(n / N));
+
+    for (int i = -1; i < (int)(sizeof(det_threads) / sizeof(det_threads[0])); ++i) {
+        MoeWorkspace ws;
+        moe_workspace_init(&ws, m, DET_TOKENS, i < 0 ? 1 : det_threads[i]);
+        float* tc = i < 0 ? ref_tc : got;
+        moe_route(layer, &ws, xs, DET_TOKENS);
+        moe_layer_forward(layer, &ws, xs, DET_TOKENS, ws.topk_idx, ws.topk_w, tc);
+        if (i >= 0 && memcmp(tc, ref_tc, NH * sizeof(float)) != 0) ok = 0;
+
+        float* ec = i < 0 ? ref_ec : got;
+        moe_route_expert_choice(layer, &ws, xs, DET_TOKENS);
+        moe_layer_forward_expert_choice(layer, &ws, xs, DET_TOKENS, ws.capacity,
+                                        ws.ec_token, ws.ec_w, ec);
+        if (i >= 0 && memcmp(ec, ref_ec, NH * sizeof(float)) != 0) ok = 0;
+        moe_workspace_free(&ws);
     }
-    char buf[4096];  // larger buffer for safety
-    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
-    fclose(f);
-    buf[n] = '\0';
-
-    char* p;
-
-    p = strstr(buf, "\"hidden_size\"");
-    if (p) sscanf(p, "\"hidden_size\"%*[^0-9]%d", &m->hidden_size);
-
-    p = strstr(buf, "\"intermediate_size\"");
-    if (p) sscanf(p, "\"intermediate_size\"%*[^0-9]%d", &m->intermediate_size);
-
-    p = strstr(buf, "\"n_routed_experts\"");
-    if (p) sscanf(p, "\"n_routed_experts\"%*[^0-9]%d", &m->n_routed_experts);
-
-    p = strstr(buf, "\"n_shared_experts\"");
-    if (p) sscanf(p, "\"n_shared_experts\"%*[^0-9]%d", &m->n_shared_experts);
 
-    p = strstr(buf, "\"top_k\"");
-    if (p) sscanf(p, "\"top_k\"%*[^0-9]%d", &m->top_k);
-
-    p = strstr(buf, "\"routed_scaling_factor\"");
-    if (p) sscanf(p, "\"routed_scaling_factor\"%*[^0-9]%f", &m->routed_scaling_factor);
-
-    p = strstr(buf, "\"batch_size\"");
-    if (p) sscanf(p, "\"batch_size\"%*[^0-9]%d", &m->batch_size);
-
-    p = strstr(buf, "\"seq_len\"");
-    if (p) sscanf(p, "\"seq_len\"%*[^0-9]%d", &m->seq_len);
-
-    /* Validate we parsed everything */
-    if (m->hidden_size <= 0 || m->intermediate_size <= 0 || m->batch_size <= 0 || m->seq_len <= 0) {
-        fprintf(stderr, "Failed to parse valid config from %s\n", path);
-        exit(1);
-    }
+    free(xs);
+    free(ref_tc);
+    free(ref_ec);
+    free(got);
+    return ok;
 }
 
-/* Linear: out[N, out_dim] = in[N, in_dim] @ W[out_dim, in_dim]^T */
-static void linear_forward(const float* input, const float* weight, float* output,
-                          int N, int in_dim, int out_dim) {
+/*
+ * Expert-choice routing has no golden: check the grouped forward against a
+ * token-by-token reference built from the same ec_token/ec_w assignment.
+ */
+static double check_expert_choice(const MoeLayer* layer, MoeWorkspace* ws,
+                                  const float* x, int N, CaseDiffs* out) {
+    const Meta* m = &layer->meta;
+    int H = m->hidden_size, I = m->intermediate_size, E = m->n_routed_experts;
+    size_t NH = (size_t)N * H;
+
+    moe_route_expert_choice(layer, ws, x, N);
+    int C = ws->capacity;
+    float* got = (float*)xmalloc(NH * sizeof(float), "ec out");
+    moe_layer_forward_expert_choice(layer, ws, x, N, C, ws->ec_token, ws->ec_w, got);
+
+    float* ref = (float*)xmalloc(NH * sizeof(float), "ec ref");
+    float* y = (float*)xmalloc((size_t)H * sizeof(float), "ec y");
+    int* picks = (int*)calloc((size_t)N, sizeof(int));
+    memcpy(ref, x, NH * sizeof(float));
     for (int n = 0; n < N; ++n) {
-        const float* x = input + n * in_dim;
-        float* y = output + n * out_dim;
-        for (int o = 0; o < out_dim; ++o) {
-            const float* w = weight + o * in_dim;
-            float sum = 0.0f;
-            for (int i = 0; i < in_dim; ++i)
-                sum += x[i] * w[i];
-            y[o] = sum;
+        for (int s = 0; s < m->n_shared_experts; ++s) {
+            moe_expert_ref(&layer->shared[s], x + (size_t)n * H, y, H, I);
+            for (int h = 0; h < H; ++h) ref[(size_t)n * H + h] += y[h];
         }
     }
-}
-
-/* TinyMLP with SwiGLU */
-static void tiny_mlp_forward(const float* input, const float* w_gate, const float* w_up, 
-                            const float* w_down, float* output, int N, int H, int I) {
-    float* gate = (float*)malloc(N * I * sizeof(float));
-    float* up   = (float*)malloc(N * I * sizeof(float));
-    float* hid  = (float*)malloc(N * I * sizeof(float));
-    if (!gate || !up || !hid) {
-        fprintf(stderr, "OOM in tiny_mlp_forward\n");
-        exit(1);
-    }
-
-    linear_forward(input, w_gate, gate, N, H, I);
-    linear_forward(input, w_up, up, N, H, I);
-
-    for (int n = 0; n < N; ++n) {
-        for (int i = 0; i < I; ++i) {
-            float g = gate[n * I + i];
-            float u = up[n * I + i];
-            hid[n * I + i] = sigmoid(g) * u;
+    for (int e = 0; e < E; ++e) {
+        for (int c = 0; c < C; ++c) {
+            int n = ws->ec_token[e * C + c];
+            float w = ws->ec_w[e * C + c];
+            picks[n]++;
+            moe_expert_ref(&layer->experts[e], x + (size_t)n * H, y, H, I);
+            for (int h = 0; h < H; ++h) ref[(size_t)n * H + h] += w * y[h];
         }
     }
 
-    linear_forward(hid, w_down, output, N, I, H);
+    out->ec = max_abs_diff(got, ref, NH);
+    out->ec_capacity = C;
+    out->ec_dropped = 0;
+    for (int n = 0; n < N; ++n) out->ec_dropped += picks[n] == 0;
 
-    free(gate);
-    free(up);
-    free(hid);
+    free(got);
+    free(ref);
+    free(y);
+    free(picks);
+    return out->ec;
 }
 
-/* Run one case directory: returns max_abs_diff */
-static double run_case(const char* base_dir, const char* case_name) {
-    char path[MAX_PATH];
+/* Everything a case needs, read by the loader thread into pinned buffers */
+typedef struct {
+    char name[64];
+    char dir[MAX_PATH];
     Meta meta;
+    int N;
+    float* inputs;
+    float* expected;
+    int* topk_idx;
+    float* topk_w;
+    MoeLayer layer;
+    MoeLayer layer_h;
+} CaseData;
 
-    /* meta.json */
-    snprintf(path, sizeof(path), "%s/%s/meta.json", base_dir, case_name);
-    parse_meta(path, &meta);
-
-    int B = meta.batch_size;
-    int S = meta.seq_len;
-    int H = meta.hidden_size;
-    int I = meta.intermediate_size;
-    int E = meta.n_routed_experts;
-    int N_SHARED = meta.n_shared_experts;
-    int TOP_K = meta.top_k;
-
-    int N = B * S;
-
-    if (E > MAX_EXPERTS || N_SHARED > MAX_SHARED) {
-        fprintf(stderr, "Too many experts: E=%d, N_SHARED=%d\n", E, N_SHARED);
-        exit(1);
-    }
-
-    /* Load inputs/outputs/router data */
-    snprintf(path, sizeof(path), "%s/%s/inputs.bin", base_dir, case_name);
-    float* inputs = load_f32(path, (size_t)B * S * H);
-    snprintf(path, sizeof(path), "%s/%s/outputs.bin", base_dir, case_name);
-    float* expected = load_f32(path, (size_t)B * S * H);
-
-    snprintf(path, sizeof(path), "%s/%s/topk_indices.bin", base_dir, case_name);
-    int* topk_idx = load_i32(path, (size_t)B * S * TOP_K);
-    snprintf(path, sizeof(path), "%s/%s/topk_weights.bin", base_dir, case_name);
-    float* topk_w = load_f32(path, (size_t)B * S * TOP_K);
-
-    /* router weight (unused in forward) */
-    snprintf(path, sizeof(path), "%s/%s/router_weight.bin", base_dir, case_name);
-    float* router_weight = load_f32(path, (size_t)E * H);
-    (void)router_weight;
-
-    /* shared experts */
-    float* shared_gate[MAX_SHARED];
-    float* shared_up[MAX_SHARED];
-    float* shared_down[MAX_SHARED];
-
-    for (int s = 0; s < N_SHARED; ++s) {
-        snprintf(path, sizeof(path), "%s/%s/shared_%d_gate_proj_weight.bin", base_dir, case_name, s);
-        shared_gate[s] = load_f32(path, (size_t)I * H);
-        snprintf(path, sizeof(path), "%s/%s/shared_%d_up_proj_weight.bin", base_dir, case_name, s);
-        shared_up[s] = load_f32(path, (size_t)I * H);
-        snprintf(path, sizeof(path), "%s/%s/shared_%d_down_proj_weight.bin", base_dir, case_name, s);
-        shared_down[s] = load_f32(path, (size_t)H * I);
-    }
-
-    /* routed experts - FIXED: using fixed-size arrays */
-    float* expert_gate[MAX_EXPERTS];
-    float* expert_up[MAX_EXPERTS];
-    float* expert_down[MAX_EXPERTS];
-
-    for (int e = 0; e < E; ++e) {
-        snprintf(path, sizeof(path), "%s/%s/expert_%d_gate_proj_weight.bin", base_dir, case_name, e);
-        expert_gate[e] = load_f32(path, (size_t)I * H);
-        snprintf(path, sizeof(path), "%s/%s/expert_%d_up_proj_weight.bin", base_dir, case_name, e);
-        expert_up[e] = load_f32(path, (size_t)I * H);
-        snprintf(path, sizeof(path), "%s/%s/expert_%d_down_proj_weight.bin", base_dir, case_name, e);
-        expert_down[e] = load_f32(path, (size_t)H * I);
-    }
-
-    /* shared_out */
-    float* shared_out = (float*)calloc((size_t)N * H, sizeof(float));
-    float* tmp = (float*)malloc((size_t)N * H * sizeof(float));
-    if (!shared_out || !tmp) {
-        fprintf(stderr, "OOM shared/tmp\n");
-        exit(1);
-    }
-
-    for (int s = 0; s < N_SHARED; ++s) {
-        tiny_mlp_forward(inputs, shared_gate[s], shared_up[s], shared_down[s], tmp, N, H, I);
-        for (int i = 0; i < N * H; ++i)
-            shared_out[i] += tmp[i];
-    }
-
-    /* all expert outputs on all tokens */
-    float* expert_out = (float*)malloc((size_t)N * E * H * sizeof(float));
-    if (!expert_out) {
-        fprintf(stderr, "OOM expert_out\n");
-        exit(1);
-    }
-    for (int e = 0; e < E; ++e) {
-        tiny_mlp_forward(inputs, expert_gate[e], expert_up[e], expert_down[e], tmp, N, H, I);
-        for (int n = 0; n < N; ++n) {
-            float* dst = expert_out + (n * E * H + e * H);
-            float* src = tmp + n * H;
-            memcpy(dst, src, (size_t)H * sizeof(float));
-        }
-    }
-
-    /* combine routed */
-    float* routed_out = (float*)calloc((size_t)N * H, sizeof(float));
-    if (!routed_out) {
-        fprintf(stderr, "OOM routed_out\n");
-        exit(1);
-    }
+typedef struct {
+    CaseData* c;
+    const char* base_dir;
+    const char* name;
+} CaseLoadJob;
+
+static void* pinned_read(const char* dir, const char* file, size_t bytes) {
+    char path[MAX_PATH + 32];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    void* buf = moe_pinned_alloc(bytes, path);
+    moe_pread_file(path, buf, bytes);
+    return buf;
+}
 
-    for (int n = 0; n < N; ++n) {
-        for (int k = 0; k < TOP_K; ++k) {
-            int e_idx = topk_idx[n * TOP_K + k];
-            float w = topk_w[n * TOP_K + k];
-            const float* y = expert_out + (n * E * H + e_idx * H);
-            float* out = routed_out + n * H;
-            for (int h = 0; h < H; ++h)
-                out[h] += w * y[h];
-        }
-    }
+static void case_load(void* arg) {
+    CaseLoadJob* job = (CaseLoadJob*)arg;
+    CaseData* c = job->c;
+    char path[MAX_PATH + 32];
+
+    memset(c, 0, sizeof(*c));
+    snprintf(c->name, sizeof(c->name), "%s", job->name);
+    snprintf(c->dir, sizeof(c->dir), "%s/%s", job->base_dir, job->name);
+    snprintf(path, sizeof(path), "%s/meta.json", c->dir);
+    parse_meta(path, &c->meta);
+
+    int H = c->meta.hidden_size, K = c->meta.top_k;
+    c->N = c->meta.batch_size * c->meta.seq_len;
+    size_t NH = (size_t)c->N * H, NK = (size_t)c->N * K;
+
+    c->inputs   = (float*)pinned_read(c->dir, "inputs.bin", NH * sizeof(float));
+    c->expected = (float*)pinned_read(c->dir, "outputs.bin", NH * sizeof(float));
+    c->topk_idx = (int*)pinned_read(c->dir, "topk_indices.bin", NK * sizeof(int));
+    c->topk_w   = (float*)pinned_read(c->dir, "topk_weights.bin", NK * sizeof(float));
+
+    moe_layer_alloc(&c->layer, &c->meta, MOE_F32);
+    moe_layer_load(&c->layer, c->dir);
+    moe_layer_alloc(&c->layer_h, &c->meta, MOE_BF16);
+    moe_layer_load(&c->layer_h, c->dir);
+}
 
-    float* final_out = (float*)malloc((size_t)N * H * sizeof(float));
-    if (!final_out) {
-        fprintf(stderr, "OOM final_out\n");
-        exit(1);
-    }
-    for (int i = 0; i < N * H; ++i) {
-        final_out[i] = inputs[i] + shared_out[i] + routed_out[i];
-    }
+static void case_free(CaseData* c) {
+    size_t NH = (size_t)c->N * c->meta.hidden_size, NK = (size_t)c->N * c->meta.top_k;
+    moe_pinned_free(c->inputs, NH * sizeof(float));
+    moe_pinned_free(c->expected, NH * sizeof(float));
+    moe_pinned_free(c->topk_idx, NK * sizeof(int));
+    moe_pinned_free(c->topk_w, NK * sizeof(float));
+    moe_layer_free(&c->layer);
+    moe_layer_free(&c->layer_h);
+}
 
-    double max_abs_diff = 0.0;
-    for (int i = 0; i < N * H; ++i) {
-        double diff = fabs((double)final_out[i] - (double)expected[i]);
-        if (diff > max_abs_diff) max_abs_diff = diff;
-    }
+/* Run one loaded case in fp32 and bf16 */
+static void run_case(const CaseData* c, CaseDiffs* out) {
+    int H = c->meta.hidden_size;
+    int N = c->N;
+    const float* inputs = c->inputs;
+    const float* expected = c->expected;
+
+    MoeWorkspace ws;
+    moe_workspace_init(&ws, &c->meta, N, 0);
+
+    float* final_out = (float*)xmalloc((size_t)N * H * sizeof(float), "final_out");
+    float* bf16_out = (float*)xmalloc((size_t)N * H * sizeof(float), "bf16_out");
+    moe_layer_forward(&c->layer, &ws, inputs, N, c->topk_idx, c->topk_w, final_out);
+    moe_layer_forward(&c->layer_h, &ws, inputs, N, c->topk_idx, c->topk_w, bf16_out);
+    out->fp32 = max_abs_diff(final_out, expected, (size_t)N * H);
+    out->bf16 = max_abs_diff(bf16_out, expected, (size_t)N * H);
+    out->bf16_vs_f32 = max_abs_diff(bf16_out, final_out, (size_t)N * H);
+
+    check_expert_choice(&c->layer, &ws, inputs, N, out);
+    out->deterministic = check_determinism(&c->layer, inputs, N);
+
+    /* Same case through the stack executor, routing from router_weight.bin */
+    const char* dirs[1] = { c->dir };
+    MoeStack st;
+    moe_stack_init(&st, dirs, 1, N, 0, MOE_F32);
+    const float* stack_out = moe_stack_forward(&st, inputs, N, NULL);
+    out->routed = max_abs_diff(stack_out, expected, (size_t)N * H);
+    moe_stack_free(&st);
 
-    /* cleanup */
-    free(inputs);
-    free(expected);
-    free(topk_idx);
-    free(topk_w);
-    free(router_weight);
-    for (int s = 0; s < N_SHARED; ++s) {
-        free(shared_gate[s]);
-        free(shared_up[s]);
-        free(shared_down[s]);
-    }
-    for (int e = 0; e < E; ++e) {
-        free(expert_gate[e]);
-        free(expert_up[e]);
-        free(expert_down[e]);
-    }
-    free(shared_out);
-    free(tmp);
-    free(expert_out);
-    free(routed_out);
     free(final_out);
-
-    return max_abs_diff;
+    free(bf16_out);
+    moe_workspace_free(&ws);
 }
 
 int main() {
@@ -316,19 +222,65 @@ int main() {
     const char* cases[] = { "case_01", "case_02", "case_03" };
     const int num_cases = 3;
 
-    double global_max = 0.0;
+    double global_max = 0.0, bf16_max = 0.0;
     int all_ok = 1;
     const double tol = 1e-5;
 
+    /*
+     * Case i + 1 loads on the loader thread while case i computes, so the
+     * run takes about max(load, compute) per case instead of the sum.
+     */
+    static CaseData slots[2];
+    CaseLoadJob jobs[2];
+    MoeLoader loader;
+    double load_total = 0.0, wait_total = 0.0, compute_total = 0.0;
+    double t_begin = now();
+
+    moe_loader_init(&loader);
+    jobs[0] = (CaseLoadJob){ &slots[0], base_dir, cases[0] };
+    moe_loader_submit(&loader, case_load, &jobs[0]);
+
     for (int i = 0; i < num_cases; ++i) {
-        const char* name = cases[i];
-        double d = run_case(base_dir, name);
-        printf("Case %s: max abs diff = %.9f\n", name, d);
-        if (d > global_max) global_max = d;
-        if (d > tol) all_ok = 0;
+        CaseData* c = &slots[i & 1];
+        double t0 = now();
+        double load_ms = moe_loader_wait(&loader);
+        double wait_ms = (now() - t0) * 1e3;
+        if (i + 1 < num_cases) {
+            jobs[(i + 1) & 1] = (CaseLoadJob){ &slots[(i + 1) & 1], base_dir, cases[i + 1] };
+            moe_loader_submit(&loader, case_load, &jobs[(i + 1) & 1]);
+        }
+
+        CaseDiffs d;
+        t0 = now();
+        run_case(c, &d);
+        double compute_ms = (now() - t0) * 1e3;
+        case_free(c);
+
+        load_total += load_ms;
+        wait_total += wait_ms;
+        compute_total += compute_ms;
+
+        printf("Case %s: max abs diff = %.9f (self-routed: %.9f, bf16: %.6f, bf16 vs fp32: %.6f)\n",
+               c->name, d.fp32, d.routed, d.bf16, d.bf16_vs_f32);
+        printf("  expert-choice: C=%d, %d tokens unpicked, max abs diff vs reference = %.9f\n",
+               d.ec_capacity, d.ec_dropped, d.ec);
+        printf("  combine bitwise identical for 1/2/3/4/7 threads: %s\n",
+               d.deterministic ? "yes" : "NO");
+        printf("  stages: load %.3f ms (waited %.3f ms), compute %.3f ms\n",
+               load_ms, wait_ms, compute_ms);
+        if (!d.deterministic) all_ok = 0;
+        double m = MAX(MAX(d.fp32, d.routed), d.ec);
+        if (m > global_max) global_max = m;
+        if (d.bf16_vs_f32 > bf16_max) bf16_max = d.bf16_vs_f32;
+        if (m > tol || d.bf16_vs_f32 > BF16_TOL) all_ok = 0;
     }
+    moe_loader_destroy(&loader);
 
+    printf("Pipeline: load %.3f ms, compute %.3f ms, waited on loads %.3f ms, wall %.3f ms\n",
+           load_total, compute_total, wait_total, (now() - t_begin) * 1e3);
     printf("Global max abs diff = %.9f\n", global_max);
+    printf("bf16 (%s) max abs diff vs fp32 = %.6f (tol %.0e)\n",
+           bf16_kernel_name(), bf16_max, BF16_TOL);
     if (all_ok) {
         printf("All MoE tests PASSED.\n");
         return 0;
@@ -336,4 +288,4 @@ int main() {
         printf("Some MoE tests FAILED.\n");
         return 1;
     }
-}
\ No newline at end of file
+}
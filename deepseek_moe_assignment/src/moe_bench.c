@@ -0,0 +1,353 @@
+/*
+ * moe_bench.c
+ * Throughput benchmarks for the CPU MoE operator.
+ *
+ *   ./moe_bench stack [tokens] [max_layers]
+ *       Runs 1, 2, 4, ... max_layers synthetic MoE layers through the stack
+ *       executor, with and without next-layer weight prefetch, and reports
+ *       end-to-end tokens/s.
+ *
+ *   ./moe_bench bf16 [tokens] [layers]
+ *       Runs the same stack with fp32 and with bf16 expert weights and
+ *       activations, and reports expert compute time, tokens/s and the max
+ *       abs diff of the bf16 output against fp32.
+ *
+ *   ./moe_bench routing [tokens]
+ *       Token-choice top-k vs expert-choice routing on one layer, with the
+ *       tokens increasingly biased toward two experts. Reports the busiest
+ *       expert's load relative to a balanced split, unpicked tokens under
+ *       expert choice and route+forward time of each mode.
+ *
+ * Synthetic layers are written once to moe_bench_layers/layer_XX in the
+ * same format as the test cases, so weights really stream from disk.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "moe_cpu.h"
+#include "moe_stack.h"
+#include "moe_bf16.h"
+#include "timer.h"
+
+#define BENCH_DIR "moe_bench_layers"
+
+/* Bench model shape (all layers identical) */
+static const Meta bench_meta = {
+    .hidden_size = 64,
+    .intermediate_size = 128,
+    .n_routed_experts = 8,
+    .n_shared_experts = 1,
+    .top_k = 2,
+    .routed_scaling_factor = 2.5f,
+    .batch_size = 1,
+    .seq_len = 1,
+};
+
+static unsigned long long rng_state = 0x9E3779B97F4A7C15ull;
+
+static float frand_sym(void) {
+    rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (float)((rng_state >> 40) * (1.0 / 16777216.0)) * 2.0f - 1.0f;
+}
+
+static void mkdir_or_die(const char* dir) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s\n", dir);
+        exit(1);
+    }
+}
+
+static void write_rand(const char* dir, const char* name, size_t n, float scale) {
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        exit(1);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        float v = frand_sym() * scale;
+        fwrite(&v, sizeof(float), 1, f);
+    }
+    fclose(f);
+}
+
+/* Writes meta.json and weights for one layer unless they already exist. */
+static void write_synthetic_layer(const char* dir, const Meta* m) {
+    char path[MAX_PATH], name[64];
+    struct stat sb;
+
+    snprintf(path, sizeof(path), "%s/meta.json", dir);
+    if (stat(path, &sb) == 0) return;
+    mkdir_or_die(dir);
+
+    int H = m->hidden_size, I = m->intermediate_size;
+    float sh = 1.0f / sqrtf((float)H), si = 1.0f / sqrtf((float)I);
+
+    write_rand(dir, "router_weight.bin", (size_t)m->n_routed_experts * H, sh);
+    for (int s = 0; s < m->n_shared_experts; ++s) {
+        snprintf(name, sizeof(name), "shared_%d_gate_proj_weight.bin", s);
+        write_rand(dir, name, (size_t)I * H, sh);
+        snprintf(name, sizeof(name), "shared_%d_up_proj_weight.bin", s);
+        write_rand(dir, name, (size_t)I * H, sh);
+        snprintf(name, sizeof(name), "shared_%d_down_proj_weight.bin", s);
+        write_rand(dir, name, (size_t)H * I, si);
+    }
+    for (int e = 0; e < m->n_routed_experts; ++e) {
+        snprintf(name, sizeof(name), "expert_%d_gate_proj_weight.bin", e);
+        write_rand(dir, name, (size_t)I * H, sh);
+        snprintf(name, sizeof(name), "expert_%d_up_proj_weight.bin", e);
+        write_rand(dir, name, (size_t)I * H, sh);
+        snprintf(name, sizeof(name), "expert_%d_down_proj_weight.bin", e);
+        write_rand(dir, name, (size_t)H * I, si);
+    }
+
+    /* meta.json last, so a half-written layer is regenerated next time */
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        exit(1);
+    }
+    fprintf(f, "{\"hidden_size\": %d, \"intermediate_size\": %d, \"n_routed_experts\": %d, "
+               "\"n_shared_experts\": %d, \"top_k\": %d, \"routed_scaling_factor\": %.1f, "
+               "\"batch_size\": %d, \"seq_len\": %d}",
+            m->hidden_size, m->intermediate_size, m->n_routed_experts,
+            m->n_shared_experts, m->top_k, m->routed_scaling_factor,
+            m->batch_size, m->seq_len);
+    fclose(f);
+}
+
+static char** make_layer_dirs(int num_layers) {
+    char** dirs = (char**)xmalloc((size_t)num_layers * sizeof(char*), "layer dirs");
+    mkdir_or_die(BENCH_DIR);
+    for (int l = 0; l < num_layers; ++l) {
+        dirs[l] = (char*)xmalloc(MAX_PATH, "layer dir");
+        snprintf(dirs[l], MAX_PATH, "%s/layer_%02d", BENCH_DIR, l);
+        write_synthetic_layer(dirs[l], &bench_meta);
+    }
+    return dirs;
+}
+
+static float* make_tokens(int N, int H) {
+    float* x = (float*)xmalloc((size_t)N * H * sizeof(float), "bench tokens");
+    for (size_t i = 0; i < (size_t)N * H; ++i) x[i] = frand_sym();
+    return x;
+}
+
+/* Best-of-iters stack forward */
+static MoeStackStats time_stack(const char* const* dirs, int L, const float* x, int N,
+                                int prefetch, MoePrecision precision, int iters) {
+    MoeStack st;
+    MoeStackStats best = {0}, s;
+    moe_stack_init(&st, dirs, L, N, prefetch, precision);
+    moe_stack_forward(&st, x, N, NULL);  /* warmup: page cache, first touch */
+    for (int it = 0; it < iters; ++it) {
+        moe_stack_forward(&st, x, N, &s);
+        if (it == 0 || s.total_ms < best.total_ms) best = s;
+    }
+    moe_stack_free(&st);
+    return best;
+}
+
+static int bench_stack(int N, int max_layers) {
+    const int iters = 5;
+    int H = bench_meta.hidden_size;
+    char** dirs = make_layer_dirs(max_layers);
+    float* x = make_tokens(N, H);
+
+    printf("Stack benchmark: N=%d H=%d I=%d E=%d K=%d shared=%d\n", N, H,
+           bench_meta.intermediate_size, bench_meta.n_routed_experts,
+           bench_meta.top_k, bench_meta.n_shared_experts);
+    printf("%-7s %-11s %-11s %-11s %-11s %-12s %-11s\n",
+           "Layers", "sync ms", "prefetch ms", "load ms", "load wait", "tok/s", "tok-layers/s");
+    printf("%-7s %-11s %-11s %-11s %-11s %-12s %-11s\n",
+           "------", "-------", "-----------", "-------", "---------", "-----", "------------");
+
+    for (int L = 1; L <= max_layers; L *= 2) {
+        MoeStackStats sync = time_stack((const char* const*)dirs, L, x, N, 0, MOE_F32, iters);
+        MoeStackStats pre  = time_stack((const char* const*)dirs, L, x, N, 1, MOE_F32, iters);
+        double tps = N / (pre.total_ms / 1e3);
+        printf("%-7d %-11.3f %-11.3f %-11.3f %-11.3f %-12.0f %-11.0f\n",
+               L, sync.total_ms, pre.total_ms, pre.load_ms, pre.load_wait_ms, tps, tps * L);
+    }
+
+    for (int l = 0; l < max_layers; ++l) free(dirs[l]);
+    free(dirs);
+    free(x);
+    return 0;
+}
+
+/* Output of one stack forward, copied out of the stack's buffers */
+static float* stack_output(const char* const* dirs, int L, const float* x, int N,
+                           MoePrecision precision) {
+    MoeStack st;
+    size_t NH = (size_t)N * bench_meta.hidden_size;
+    float* out = (float*)xmalloc(NH * sizeof(float), "bench output");
+    moe_stack_init(&st, dirs, L, N, 0, precision);
+    memcpy(out, moe_stack_forward(&st, x, N, NULL), NH * sizeof(float));
+    moe_stack_free(&st);
+    return out;
+}
+
+static int bench_bf16(int N, int L) {
+    const int iters = 5;
+    int H = bench_meta.hidden_size;
+    char** dirs = make_layer_dirs(L);
+    const char* const* cdirs = (const char* const*)dirs;
+    float* x = make_tokens(N, H);
+
+    printf("bf16 benchmark: N=%d L=%d H=%d I=%d E=%d K=%d shared=%d kernel=%s\n", N, L, H,
+           bench_meta.intermediate_size, bench_meta.n_routed_experts,
+           bench_meta.top_k, bench_meta.n_shared_experts, bf16_kernel_name());
+    printf("%-9s %-11s %-11s %-12s\n", "Precision", "moe ms", "total ms", "tok/s");
+    printf("%-9s %-11s %-11s %-12s\n", "---------", "------", "--------", "-----");
+
+    MoeStackStats f = time_stack(cdirs, L, x, N, 1, MOE_F32, iters);
+    MoeStackStats h = time_stack(cdirs, L, x, N, 1, MOE_BF16, iters);
+    printf("%-9s %-11.3f %-11.3f %-12.0f\n", "fp32", f.moe_ms, f.total_ms, N / (f.total_ms / 1e3));
+    printf("%-9s %-11.3f %-11.3f %-12.0f\n", "bf16", h.moe_ms, h.total_ms, N / (h.total_ms / 1e3));
+
+    float* ref = stack_output(cdirs, L, x, N, MOE_F32);
+    float* out = stack_output(cdirs, L, x, N, MOE_BF16);
+    printf("Expert compute speedup: %.2fx, max abs diff vs fp32 after %d layers: %.6f\n",
+           f.moe_ms / h.moe_ms, L, max_abs_diff(out, ref, (size_t)N * H));
+
+    for (int l = 0; l < L; ++l) free(dirs[l]);
+    free(dirs);
+    free(x);
+    free(ref);
+    free(out);
+    return 0;
+}
+
+/* Best-of-iters route + forward; returns ms */
+static double time_routing(const MoeLayer* layer, MoeWorkspace* ws, const float* x, int N,
+                           float* out, int expert_choice, int iters) {
+    double best = 0.0;
+    for (int it = 0; it <= iters; ++it) {  /* iteration 0 is warmup */
+        double t0 = now();
+        if (expert_choice) {
+            moe_route_expert_choice(layer, ws, x, N);
+            moe_layer_forward_expert_choice(layer, ws, x, N, ws->capacity,
+                                            ws->ec_token, ws->ec_w, out);
+        } else {
+            moe_route(layer, ws, x, N);
+            moe_layer_forward(layer, ws, x, N, ws->topk_idx, ws->topk_w, out);
+        }
+        double ms = (now() - t0) * 1e3;
+        if (it == 1 || (it > 1 && ms < best)) best = ms;
+    }
+    return best;
+}
+
+static int bench_routing(int N) {
+    const int iters = 5;
+    const float skews[] = { 0.0f, 0.25f, 0.5f, 1.0f, 2.0f };
+    int H = bench_meta.hidden_size, E = bench_meta.n_routed_experts, K = bench_meta.top_k;
+    char** dirs = make_layer_dirs(1);
+    MoeLayer layer;
+    MoeWorkspace ws;
+    moe_layer_alloc(&layer, &bench_meta, MOE_F32);
+    moe_layer_load(&layer, dirs[0]);
+    moe_workspace_init(&ws, &bench_meta, N, 0);
+
+    float* noise = make_tokens(N, H);
+    float* x = (float*)xmalloc((size_t)N * H * sizeof(float), "bench skewed tokens");
+    float* out = (float*)xmalloc((size_t)N * H * sizeof(float), "bench out");
+
+    /* Skew direction: router rows of experts 0 and 1, unit length */
+    float* u = (float*)xmalloc((size_t)H * sizeof(float), "skew dir");
+    double norm = 0.0;
+    for (int h = 0; h < H; ++h) {
+        u[h] = layer.router[h] + layer.router[H + h];
+        norm += (double)u[h] * u[h];
+    }
+    for (int h = 0; h < H; ++h) u[h] = (float)(u[h] / sqrt(norm));
+
+    printf("Routing benchmark: N=%d H=%d I=%d E=%d K=%d shared=%d threads=%d\n", N, H,
+           bench_meta.intermediate_size, E, K, bench_meta.n_shared_experts, ws.num_threads);
+    printf("%-6s %-13s %-10s %-13s %-11s %-11s\n",
+           "Skew", "TC max/mean", "TC ms", "EC unpicked", "EC ms", "EC speedup");
+    printf("%-6s %-13s %-10s %-13s %-11s %-11s\n",
+           "----", "-----------", "-----", "-----------", "-----", "----------");
+
+    for (size_t si = 0; si < sizeof(skews) / sizeof(skews[0]); ++si) {
+        float a = skews[si] * sqrtf((float)H);
+        for (int n = 0; n < N; ++n)
+            for (int h = 0; h < H; ++h)
+                x[(size_t)n * H + h] = noise[(size_t)n * H + h] + a * u[h];
+
+        double tc = time_routing(&layer, &ws, x, N, out, 0, iters);
+        int load[MAX_EXPERTS] = {0}, busiest = 0;
+        for (int i = 0; i < N * K; ++i) load[ws.topk_idx[i]]++;
+        for (int e = 0; e < E; ++e) busiest = load[e] > busiest ? load[e] : busiest;
+
+        double ec = time_routing(&layer, &ws, x, N, out, 1, iters);
+        int C = ws.capacity, unpicked = 0;
+        char* picked = (char*)calloc((size_t)N, 1);
+        for (int i = 0; i < E * C; ++i) picked[ws.ec_token[i]] = 1;
+        for (int n = 0; n < N; ++n) unpicked += !picked[n];
+        free(picked);
+
+        char pct[16];
+        snprintf(pct, sizeof(pct), "%.1f%%", 100.0 * unpicked / N);
+        printf("%-6.2f %-13.2f %-10.3f %-13s %-11.3f %-11.2f\n", skews[si],
+               busiest / ((double)N * K / E), tc, pct, ec, tc / ec);
+    }
+
+    moe_workspace_free(&ws);
+    moe_layer_free(&layer);
+    free(dirs[0]);
+    free(dirs);
+    free(noise);
+    free(x);
+    free(out);
+    free(u);
+    return 0;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "usage: %s stack [tokens=128] [max_layers=16]\n", argv0);
+    fprintf(stderr, "       %s bf16 [tokens=512] [layers=4]\n", argv0);
+    fprintf(stderr, "       %s routing [tokens=1024]\n", argv0);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "stack") == 0) {
+        int N = argc > 2 ? atoi(argv[2]) : 128;
+        int L = argc > 3 ? atoi(argv[3]) : 16;
+        if (N <= 0 || L <= 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        return bench_stack(N, L);
+    }
+    if (strcmp(argv[1], "bf16") == 0) {
+        int N = argc > 2 ? atoi(argv[2]) : 512;
+        int L = argc > 3 ? atoi(argv[3]) : 4;
+        if (N <= 0 || L <= 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        return bench_bf16(N, L);
+    }
+    if (strcmp(argv[1], "routing") == 0) {
+        int N = argc > 2 ? atoi(argv[2]) : 1024;
+        if (N <= 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        return bench_routing(N);
+    }
+    usage(argv[0]);
+    return 1;
+}
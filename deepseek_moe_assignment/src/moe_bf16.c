@@ -0,0 +1,87 @@
+#define _POSIX_C_SOURCE 200809L
+#include "moe_bf16.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MOE_HAVE_X86 1
+#endif
+
+void f32_to_bf16_n(const float* src, bf16_t* dst, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = f32_to_bf16(src[i]);
+}
+
+static void linear_tile_bf16_emulated(const bf16_t* input, const bf16_t* weight, float* output,
+                                      int T, int in_dim, int out_dim) {
+    for (int o = 0; o < out_dim; ++o) {
+        const bf16_t* w = weight + (size_t)o * in_dim;
+        for (int t = 0; t < T; ++t) {
+            const bf16_t* x = input + (size_t)t * in_dim;
+            float sum = 0.0f;
+            for (int i = 0; i < in_dim; ++i)
+                sum += bf16_to_f32(x[i]) * bf16_to_f32(w[i]);
+            output[(size_t)t * out_dim + o] = sum;
+        }
+    }
+}
+
+#ifdef MOE_HAVE_X86
+/* 32 bf16 pairs per vdpbf16ps; the tail uses a masked load (zeros contribute nothing) */
+__attribute__((target("avx512f,avx512bw,avx512bf16")))
+static void linear_tile_bf16_avx512(const bf16_t* input, const bf16_t* weight, float* output,
+                                    int T, int in_dim, int out_dim) {
+    int main_len = in_dim & ~31;
+    __mmask32 tail = (__mmask32)((1ull << (in_dim - main_len)) - 1);
+
+    for (int o = 0; o < out_dim; ++o) {
+        const bf16_t* w = weight + (size_t)o * in_dim;
+        for (int t = 0; t < T; ++t) {
+            const bf16_t* x = input + (size_t)t * in_dim;
+            __m512 acc = _mm512_setzero_ps();
+            for (int i = 0; i < main_len; i += 32) {
+                __m512i a = _mm512_loadu_si512((const void*)(x + i));
+                __m512i b = _mm512_loadu_si512((const void*)(w + i));
+                acc = _mm512_dpbf16_ps(acc, (__m512bh)a, (__m512bh)b);
+            }
+            if (tail) {
+                __m512i a = _mm512_maskz_loadu_epi16(tail, x + main_len);
+                __m512i b = _mm512_maskz_loadu_epi16(tail, w + main_len);
+                acc = _mm512_dpbf16_ps(acc, (__m512bh)a, (__m512bh)b);
+            }
+            output[(size_t)t * out_dim + o] = _mm512_reduce_add_ps(acc);
+        }
+    }
+}
+#endif
+
+typedef void (*linear_bf16_fn)(const bf16_t*, const bf16_t*, float*, int, int, int);
+
+static linear_bf16_fn linear_impl = linear_tile_bf16_emulated;
+static const char* linear_name = "emulated";
+static pthread_once_t linear_once = PTHREAD_ONCE_INIT;
+
+static void select_kernel(void) {
+    const char* force = getenv("MOE_BF16_EMULATE");
+    if (force && atoi(force) != 0) return;
+#ifdef MOE_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bf16") && __builtin_cpu_supports("avx512bw")) {
+        linear_impl = linear_tile_bf16_avx512;
+        linear_name = "avx512bf16";
+    }
+#endif
+}
+
+void linear_tile_bf16(const bf16_t* input, const bf16_t* weight, float* output,
+                      int T, int in_dim, int out_dim) {
+    pthread_once(&linear_once, select_kernel);
+    linear_impl(input, weight, output, T, in_dim, out_dim);
+}
+
+const char* bf16_kernel_name(void) {
+    pthread_once(&linear_once, select_kernel);
+    return linear_name;
+}
@@ -0,0 +1,44 @@
+/*
+ * moe_bf16.h
+ * bf16 storage helpers and the bf16 x bf16 -> fp32 grouped linear.
+ *
+ * linear_tile_bf16 uses AVX-512-BF16 (vdpbf16ps) when the CPU has it and
+ * an emulated widening path (bf16 -> fp32, fp32 FMA) otherwise. Setting
+ * MOE_BF16_EMULATE=1 forces the emulated path.
+ */
+#ifndef MOE_BF16_H
+#define MOE_BF16_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint16_t bf16_t;
+
+/* Round-to-nearest-even; NaNs stay NaN */
+static inline bf16_t f32_to_bf16(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    if ((u & 0x7fffffffu) > 0x7f800000u)
+        return (bf16_t)((u >> 16) | 0x0040u);
+    u += 0x7fffu + ((u >> 16) & 1u);
+    return (bf16_t)(u >> 16);
+}
+
+static inline float bf16_to_f32(bf16_t h) {
+    uint32_t u = (uint32_t)h << 16;
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+void f32_to_bf16_n(const float* src, bf16_t* dst, size_t n);
+
+/* out[T, out_dim] (fp32) = in[T, in_dim] (bf16) @ W[out_dim, in_dim]^T (bf16), fp32 accumulation */
+void linear_tile_bf16(const bf16_t* input, const bf16_t* weight, float* output,
+                      int T, int in_dim, int out_dim);
+
+/* "avx512bf16" or "emulated" */
+const char* bf16_kernel_name(void);
+
+#endif
@@ -0,0 +1,722 @@
+#include "moe_cpu.h"
+#include "moe_parallel.h"
+#include "moe_io.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+static float sigmoid(float x) {
+    return 1.0f / (1.0f + expf(-x));
+}
+
+void* xmalloc(size_t bytes, const char* what) {
+    void* p = malloc(bytes ? bytes : 1);
+    if (!p) {
+        fprintf(stderr, "OOM %s\n", what);
+        exit(1);
+    }
+    return p;
+}
+
+void read_f32_into(const char* path, float* buf, size_t expected_elems) {
+    moe_pread_file(path, buf, expected_elems * sizeof(float));
+}
+
+float* load_f32(const char* path, size_t expected_elems) {
+    float* buf = (float*)xmalloc(expected_elems * sizeof(float), path);
+    read_f32_into(path, buf, expected_elems);
+    return buf;
+}
+
+int* load_i32(const char* path, size_t expected_elems) {
+    int* buf = (int*)xmalloc(expected_elems * sizeof(int), path);
+    moe_pread_file(path, buf, expected_elems * sizeof(int));
+    return buf;
+}
+
+void parse_meta(const char* path, Meta* m) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Failed to open meta %s\n", path);
+        exit(1);
+    }
+    char buf[4096];  // larger buffer for safety
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    char* p;
+
+    p = strstr(buf, "\"hidden_size\"");
+    if (p) sscanf(p, "\"hidden_size\"%*[^0-9]%d", &m->hidden_size);
+
+    p = strstr(buf, "\"intermediate_size\"");
+    if (p) sscanf(p, "\"intermediate_size\"%*[^0-9]%d", &m->intermediate_size);
+
+    p = strstr(buf, "\"n_routed_experts\"");
+    if (p) sscanf(p, "\"n_routed_experts\"%*[^0-9]%d", &m->n_routed_experts);
+
+    p = strstr(buf, "\"n_shared_experts\"");
+    if (p) sscanf(p, "\"n_shared_experts\"%*[^0-9]%d", &m->n_shared_experts);
+
+    p = strstr(buf, "\"top_k\"");
+    if (p) sscanf(p, "\"top_k\"%*[^0-9]%d", &m->top_k);
+
+    p = strstr(buf, "\"routed_scaling_factor\"");
+    if (p) sscanf(p, "\"routed_scaling_factor\"%*[^0-9]%f", &m->routed_scaling_factor);
+
+    p = strstr(buf, "\"batch_size\"");
+    if (p) sscanf(p, "\"batch_size\"%*[^0-9]%d", &m->batch_size);
+
+    p = strstr(buf, "\"seq_len\"");
+    if (p) sscanf(p, "\"seq_len\"%*[^0-9]%d", &m->seq_len);
+
+    /* Validate we parsed everything */
+    if (m->hidden_size <= 0 || m->intermediate_size <= 0 || m->batch_size <= 0 || m->seq_len <= 0) {
+        fprintf(stderr, "Failed to parse valid config from %s\n", path);
+        exit(1);
+    }
+    if (m->n_routed_experts > MAX_EXPERTS || m->n_shared_experts > MAX_SHARED) {
+        fprintf(stderr, "Too many experts: E=%d, N_SHARED=%d\n",
+                m->n_routed_experts, m->n_shared_experts);
+        exit(1);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Weights and workspace                                               */
+/* ------------------------------------------------------------------ */
+
+/* Carves consecutive 64-byte aligned pieces out of a layer's weight arena */
+typedef struct {
+    char* base;
+    size_t used;
+} Arena;
+
+static void* arena_take(Arena* a, size_t bytes) {
+    void* p = a->base ? a->base + a->used : NULL;
+    a->used += (bytes + 63) & ~(size_t)63;
+    return p;
+}
+
+/* With a->base == NULL this only measures the layout */
+static void layer_carve(MoeLayer* layer, Arena* a) {
+    const Meta* m = &layer->meta;
+    size_t IH = (size_t)m->intermediate_size * m->hidden_size;
+    size_t elem = layer->precision == MOE_BF16 ? sizeof(bf16_t) : sizeof(float);
+
+    layer->router = (float*)arena_take(a, (size_t)m->n_routed_experts * m->hidden_size * sizeof(float));
+    for (int v = 0; v < m->n_shared_experts + m->n_routed_experts; ++v) {
+        ExpertWeights* w = v < m->n_shared_experts ? &layer->shared[v]
+                                                   : &layer->experts[v - m->n_shared_experts];
+        void* gate = arena_take(a, IH * elem);
+        void* up = arena_take(a, IH * elem);
+        void* down = arena_take(a, IH * elem);
+        if (layer->precision == MOE_BF16) {
+            w->gate_h = (bf16_t*)gate;
+            w->up_h = (bf16_t*)up;
+            w->down_h = (bf16_t*)down;
+        } else {
+            w->gate = (float*)gate;
+            w->up = (float*)up;
+            w->down = (float*)down;
+        }
+    }
+    if (layer->precision == MOE_BF16)
+        layer->staging = (float*)arena_take(a, IH * sizeof(float));
+}
+
+void moe_layer_alloc(MoeLayer* layer, const Meta* meta, MoePrecision precision) {
+    memset(layer, 0, sizeof(*layer));
+    layer->meta = *meta;
+    layer->precision = precision;
+
+    Arena a = { NULL, 0 };
+    layer_carve(layer, &a);
+    layer->arena_bytes = a.used;
+    layer->arena = moe_pinned_alloc(a.used, "layer weights");
+
+    a.base = (char*)layer->arena;
+    a.used = 0;
+    layer_carve(layer, &a);
+}
+
+/* Read one [I, H] / [H, I] matrix into whichever precision the layer stores */
+static void load_matrix(MoeLayer* layer, const char* path, float* f32, bf16_t* h, size_t n) {
+    if (layer->precision == MOE_BF16) {
+        read_f32_into(path, layer->staging, n);
+        f32_to_bf16_n(layer->staging, h, n);
+    } else {
+        read_f32_into(path, f32, n);
+    }
+}
+
+static void load_expert(MoeLayer* layer, const char* dir, const char* kind, int idx,
+                        ExpertWeights* w) {
+    char path[MAX_PATH];
+    size_t IH = (size_t)layer->meta.intermediate_size * layer->meta.hidden_size;
+    snprintf(path, sizeof(path), "%s/%s_%d_gate_proj_weight.bin", dir, kind, idx);
+    load_matrix(layer, path, w->gate, w->gate_h, IH);
+    snprintf(path, sizeof(path), "%s/%s_%d_up_proj_weight.bin", dir, kind, idx);
+    load_matrix(layer, path, w->up, w->up_h, IH);
+    snprintf(path, sizeof(path), "%s/%s_%d_down_proj_weight.bin", dir, kind, idx);
+    load_matrix(layer, path, w->down, w->down_h, IH);
+}
+
+void moe_layer_load(MoeLayer* layer, const char* dir) {
+    char path[MAX_PATH];
+    const Meta* m = &layer->meta;
+
+    snprintf(path, sizeof(path), "%s/router_weight.bin", dir);
+    read_f32_into(path, layer->router, (size_t)m->n_routed_experts * m->hidden_size);
+
+    for (int s = 0; s < m->n_shared_experts; ++s)
+        load_expert(layer, dir, "shared", s, &layer->shared[s]);
+    for (int e = 0; e < m->n_routed_experts; ++e)
+        load_expert(layer, dir, "expert", e, &layer->experts[e]);
+}
+
+void moe_layer_free(MoeLayer* layer) {
+    moe_pinned_free(layer->arena, layer->arena_bytes);
+    memset(layer, 0, sizeof(*layer));
+}
+
+void moe_workspace_init(MoeWorkspace* ws, const Meta* meta, int max_tokens, int num_threads) {
+    size_t N = (size_t)max_tokens;
+    memset(ws, 0, sizeof(*ws));
+    ws->max_tokens = max_tokens;
+    ws->H = meta->hidden_size;
+    ws->I = meta->intermediate_size;
+    ws->E = meta->n_routed_experts;
+    ws->NS = meta->n_shared_experts;
+    ws->top_k = meta->top_k;
+    ws->num_threads = num_threads > 0 ? num_threads : moe_default_threads();
+    ws->pool = pool_create(ws->num_threads);
+
+    /* Expert-choice rounds C up, so it can exceed N * K by up to E - 1 rows */
+    size_t slots = (size_t)ws->NS + ws->top_k;
+    size_t R = N * slots + (size_t)ws->E;
+    size_t T = (size_t)ws->num_threads * MOE_TILE_ROWS;
+    size_t C = (size_t)moe_expert_capacity(max_tokens, ws->top_k, ws->E);
+    MoeDispatch* d = &ws->plan;
+    d->row_token  = (int*)xmalloc(R * sizeof(int), "plan row_token");
+    d->row_w      = (float*)xmalloc(R * sizeof(float), "plan row_w");
+    d->token_offsets = (int*)xmalloc((N + 1) * sizeof(int), "plan token_offsets");
+    d->token_rows = (int*)xmalloc(R * sizeof(int), "plan token_rows");
+    d->tasks      = (MoeTask*)xmalloc((R / MOE_TILE_ROWS + MAX_VEXPERTS + 1) * sizeof(MoeTask),
+                                      "plan tasks");
+
+    ws->y_rows    = (float*)xmalloc(R * ws->H * sizeof(float), "ws y_rows");
+    ws->tile_x    = (float*)xmalloc(T * ws->H * sizeof(float), "ws tile_x");
+    ws->tile_gate = (float*)xmalloc(T * ws->I * sizeof(float), "ws tile_gate");
+    ws->tile_up   = (float*)xmalloc(T * ws->I * sizeof(float), "ws tile_up");
+    ws->tile_xh   = (bf16_t*)xmalloc(T * ws->H * sizeof(bf16_t), "ws tile_xh");
+    ws->tile_hh   = (bf16_t*)xmalloc(T * ws->I * sizeof(bf16_t), "ws tile_hh");
+    ws->scores    = (float*)xmalloc(N * ws->E * sizeof(float), "ws scores");
+    ws->topk_idx  = (int*)xmalloc(N * ws->top_k * sizeof(int), "ws topk_idx");
+    ws->topk_w    = (float*)xmalloc(N * ws->top_k * sizeof(float), "ws topk_w");
+    ws->ec_token  = (int*)xmalloc((size_t)ws->E * C * sizeof(int), "ws ec_token");
+    ws->ec_w      = (float*)xmalloc((size_t)ws->E * C * sizeof(float), "ws ec_w");
+    ws->ec_cand   = (MoeCandidate*)xmalloc(N * sizeof(MoeCandidate), "ws ec_cand");
+}
+
+void moe_workspace_free(MoeWorkspace* ws) {
+    pool_destroy(ws->pool);
+    free(ws->plan.row_token);
+    free(ws->plan.row_w);
+    free(ws->plan.token_offsets);
+    free(ws->plan.token_rows);
+    free(ws->plan.tasks);
+    free(ws->y_rows);
+    free(ws->tile_x);
+    free(ws->tile_gate);
+    free(ws->tile_up);
+    free(ws->tile_xh);
+    free(ws->tile_hh);
+    free(ws->scores);
+    free(ws->topk_idx);
+    free(ws->topk_w);
+    free(ws->ec_token);
+    free(ws->ec_w);
+    free(ws->ec_cand);
+    memset(ws, 0, sizeof(*ws));
+}
+
+/* ------------------------------------------------------------------ */
+/* Kernels                                                             */
+/* ------------------------------------------------------------------ */
+
+/* Linear: out[N, out_dim] = in[N, in_dim] @ W[out_dim, in_dim]^T */
+static void linear_forward(const float* input, const float* weight, float* output,
+                          int N, int in_dim, int out_dim) {
+    for (int n = 0; n < N; ++n) {
+        const float* x = input + (size_t)n * in_dim;
+        float* y = output + (size_t)n * out_dim;
+        for (int o = 0; o < out_dim; ++o) {
+            const float* w = weight + (size_t)o * in_dim;
+            float sum = 0.0f;
+            for (int i = 0; i < in_dim; ++i)
+                sum += x[i] * w[i];
+            y[o] = sum;
+        }
+    }
+}
+
+/*
+ * Grouped linear over a tile: out[T, out_dim] = in[T, in_dim] @ W^T.
+ * Each weight row is reused across the whole tile before moving on.
+ */
+static void linear_tile(const float* input, const float* weight, float* output,
+                        int T, int in_dim, int out_dim) {
+    for (int o = 0; o < out_dim; ++o) {
+        const float* w = weight + (size_t)o * in_dim;
+        for (int t = 0; t < T; ++t) {
+            const float* x = input + (size_t)t * in_dim;
+            float sum = 0.0f;
+            for (int i = 0; i < in_dim; ++i)
+                sum += x[i] * w[i];
+            output[(size_t)t * out_dim + o] = sum;
+        }
+    }
+}
+
+/* TinyMLP with SwiGLU on one tile of T gathered rows */
+static void tiny_mlp_tile(const float* input, const ExpertWeights* w,
+                          float* gate, float* up, float* output, int T, int H, int I) {
+    linear_tile(input, w->gate, gate, T, H, I);
+    linear_tile(input, w->up, up, T, H, I);
+
+    for (size_t i = 0; i < (size_t)T * I; ++i)
+        gate[i] = sigmoid(gate[i]) * up[i];
+
+    linear_tile(gate, w->down, output, T, I, H);
+}
+
+/* bf16 variant: bf16 input and hidden, fp32 accumulation and SwiGLU */
+static void tiny_mlp_tile_bf16(const bf16_t* input, const ExpertWeights* w,
+                               float* gate, float* up, bf16_t* hid, float* output,
+                               int T, int H, int I) {
+    linear_tile_bf16(input, w->gate_h, gate, T, H, I);
+    linear_tile_bf16(input, w->up_h, up, T, H, I);
+
+    for (size_t i = 0; i < (size_t)T * I; ++i)
+        hid[i] = f32_to_bf16(sigmoid(gate[i]) * up[i]);
+
+    linear_tile_bf16(hid, w->down_h, output, T, I, H);
+}
+
+void moe_expert_ref(const ExpertWeights* w, const float* x, float* y, int H, int I) {
+    float* hid = (float*)xmalloc((size_t)2 * I * sizeof(float), "expert ref hidden");
+    float* up = hid + I;
+    linear_forward(x, w->gate, hid, 1, H, I);
+    linear_forward(x, w->up, up, 1, H, I);
+    for (int i = 0; i < I; ++i)
+        hid[i] = sigmoid(hid[i]) * up[i];
+    linear_forward(hid, w->down, y, 1, I, H);
+    free(hid);
+}
+
+/* ws->scores[N, E] = softmax over experts of x @ W_r^T */
+static void router_scores(const MoeLayer* layer, MoeWorkspace* ws, const float* x, int N) {
+    int H = ws->H, E = ws->E;
+
+    linear_forward(x, layer->router, ws->scores, N, H, E);
+
+    for (int n = 0; n < N; ++n) {
+        float* s = ws->scores + (size_t)n * E;
+        float mx = s[0];
+        for (int e = 1; e < E; ++e) mx = s[e] > mx ? s[e] : mx;
+        float sum = 0.0f;
+        for (int e = 0; e < E; ++e) {
+            s[e] = expf(s[e] - mx);
+            sum += s[e];
+        }
+        for (int e = 0; e < E; ++e) s[e] /= sum;
+    }
+}
+
+void moe_route(const MoeLayer* layer, MoeWorkspace* ws, const float* x, int N) {
+    int E = ws->E, K = ws->top_k;
+    float scale = layer->meta.routed_scaling_factor;
+
+    router_scores(layer, ws, x, N);
+
+    for (int n = 0; n < N; ++n) {
+        const float* s = ws->scores + (size_t)n * E;
+
+        /* Selection by repeated max: K and E are tiny */
+        unsigned taken = 0;
+        for (int k = 0; k < K; ++k) {
+            int best = -1;
+            for (int e = 0; e < E; ++e)
+                if (!(taken & (1u << e)) && (best < 0 || s[e] > s[best])) best = e;
+            taken |= 1u << best;
+            ws->topk_idx[n * K + k] = best;
+            ws->topk_w[n * K + k] = s[best] * scale;
+        }
+    }
+}
+
+int moe_expert_capacity(int N, int top_k, int E) {
+    int C = (N * top_k + E - 1) / E;
+    return C < N ? C : N;
+}
+
+/* Higher score first, lower token index on ties: a strict total order */
+static int candidate_before(const MoeCandidate* x, const MoeCandidate* y) {
+    if (x->score != y->score) return x->score > y->score;
+    return x->token < y->token;
+}
+
+static void swap_candidates(MoeCandidate* a, int i, int j) {
+    MoeCandidate t = a[i];
+    a[i] = a[j];
+    a[j] = t;
+}
+
+/*
+ * Quickselect: reorders a[0..n) so that a[0..k) are the k candidates that
+ * come first under candidate_before, in no particular order. Expected O(n).
+ */
+static void select_top(MoeCandidate* a, int n, int k) {
+    int lo = 0, hi = n - 1;
+    if (k >= n) return;
+    while (lo < hi) {
+        /* Median of three to the end as the pivot */
+        int mid = lo + (hi - lo) / 2;
+        if (candidate_before(&a[mid], &a[lo])) swap_candidates(a, mid, lo);
+        if (candidate_before(&a[hi], &a[lo])) swap_candidates(a, hi, lo);
+        if (candidate_before(&a[mid], &a[hi])) swap_candidates(a, mid, hi);
+        int store = lo;
+        for (int i = lo; i < hi; ++i)
+            if (candidate_before(&a[i], &a[hi])) swap_candidates(a, i, store++);
+        swap_candidates(a, store, hi);
+        /* a[lo..store) before the pivot at store, a(store..hi] after it */
+        if (store == k || store == k - 1) return;
+        if (store < k) lo = store + 1;
+        else hi = store - 1;
+    }
+}
+
+static int cmp_candidate_token(const void* a, const void* b) {
+    const MoeCandidate* x = (const MoeCandidate*)a;
+    const MoeCandidate* y = (const MoeCandidate*)b;
+    return (x->token > y->token) - (x->token < y->token);
+}
+
+void moe_route_expert_choice(const MoeLayer* layer, MoeWorkspace* ws, const float* x, int N) {
+    int E = ws->E;
+    int C = moe_expert_capacity(N, ws->top_k, E);
+    float scale = layer->meta.routed_scaling_factor;
+    MoeCandidate* cand = ws->ec_cand;
+
+    router_scores(layer, ws, x, N);
+
+    for (int e = 0; e < E; ++e) {
+        for (int n = 0; n < N; ++n) {
+            cand[n].score = ws->scores[(size_t)n * E + e];
+            cand[n].token = n;
+        }
+        select_top(cand, N, C);
+        /* Picked tokens in ascending order, so the gather walks x forward */
+        qsort(cand, (size_t)C, sizeof(MoeCandidate), cmp_candidate_token);
+        for (int c = 0; c < C; ++c) {
+            ws->ec_token[e * C + c] = cand[c].token;
+            ws->ec_w[e * C + c] = cand[c].score * scale;
+        }
+    }
+    ws->capacity = C;
+}
+
+static void build_tasks(MoeDispatch* d, int V) {
+    /* Tiles handed out round-robin across experts, so shared tiles interleave with routed ones */
+    int next[MAX_VEXPERTS];
+    memcpy(next, d->offsets, (size_t)V * sizeof(int));
+    d->num_tasks = 0;
+    for (int remaining = 1; remaining;) {
+        remaining = 0;
+        for (int v = 0; v < V; ++v) {
+            if (next[v] >= d->offsets[v + 1]) continue;
+            MoeTask* t = &d->tasks[d->num_tasks++];
+            t->vexpert = v;
+            t->row_begin = next[v];
+            t->row_end = next[v] + MOE_TILE_ROWS < d->offsets[v + 1]
+                       ? next[v] + MOE_TILE_ROWS : d->offsets[v + 1];
+            next[v] = t->row_end;
+            remaining = 1;
+        }
+    }
+}
+
+/*
+ * Counting sort of (token, slot) pairs by virtual expert. Shared slots
+ * come first in each token's slot list, so token_rows[n, s] for s < NS is
+ * the shared row and token_rows[n, NS + k] the k-th routed row. Rows of
+ * one expert keep ascending token order.
+ */
+static void moe_dispatch(MoeWorkspace* ws, int N, const int* topk_idx, const float* topk_w) {
+    MoeDispatch* d = &ws->plan;
+    int NS = ws->NS, K = ws->top_k, E = ws->E;
+    int V = NS + E, S = NS + K;
+    int cursor[MAX_VEXPERTS];
+
+    d->num_rows = N * S;
+    for (int n = 0; n <= N; ++n) d->token_offsets[n] = n * S;
+
+    memset(d->offsets, 0, sizeof(d->offsets));
+    for (int s = 0; s < NS; ++s) d->offsets[s + 1] = N;
+    for (int i = 0; i < N * K; ++i) {
+        int e = topk_idx[i];
+        if (e < 0 || e >= E) {
+            fprintf(stderr, "moe_dispatch: expert index %d out of range\n", e);
+            exit(1);
+        }
+        d->offsets[NS + e + 1]++;
+    }
+    for (int v = 0; v < V; ++v) d->offsets[v + 1] += d->offsets[v];
+    memcpy(cursor, d->offsets, (size_t)V * sizeof(int));
+
+    for (int n = 0; n < N; ++n) {
+        for (int j = 0; j < S; ++j) {
+            int v = j < NS ? j : NS + topk_idx[n * K + (j - NS)];
+            int r = cursor[v]++;
+            d->row_token[r] = n;
+            d->row_w[r] = j < NS ? 1.0f : topk_w[n * K + (j - NS)];
+            d->token_rows[n * S + j] = r;
+        }
+    }
+
+    build_tasks(d, V);
+}
+
+/*
+ * Expert-choice plan: shared rows cover every token, routed expert e owns
+ * exactly C rows. The per-token inverse is built by counting rows per
+ * token; rows are visited in expert order, so shared rows come first.
+ */
+static void moe_dispatch_expert_choice(MoeWorkspace* ws, int N, int C,
+                                       const int* ec_token, const float* ec_w) {
+    MoeDispatch* d = &ws->plan;
+    int NS = ws->NS, E = ws->E, V = NS + E;
+    int r = 0;
+
+    if (C < 0 || C > N || (size_t)E * C > (size_t)N * ws->top_k + E) {
+        fprintf(stderr, "moe_dispatch_expert_choice: capacity %d does not fit the workspace\n", C);
+        exit(1);
+    }
+
+    d->offsets[0] = 0;
+    for (int s = 0; s < NS; ++s) {
+        for (int n = 0; n < N; ++n, ++r) {
+            d->row_token[r] = n;
+            d->row_w[r] = 1.0f;
+        }
+        d->offsets[s + 1] = r;
+    }
+    for (int e = 0; e < E; ++e) {
+        for (int c = 0; c < C; ++c, ++r) {
+            int n = ec_token[e * C + c];
+            if (n < 0 || n >= N) {
+                fprintf(stderr, "moe_dispatch_expert_choice: token index %d out of range\n", n);
+                exit(1);
+            }
+            d->row_token[r] = n;
+            d->row_w[r] = ec_w[e * C + c];
+        }
+        d->offsets[NS + e + 1] = r;
+    }
+    d->num_rows = r;
+
+    memset(d->token_offsets, 0, (size_t)(N + 1) * sizeof(int));
+    for (int i = 0; i < r; ++i) d->token_offsets[d->row_token[i] + 1]++;
+    for (int n = 0; n < N; ++n) d->token_offsets[n + 1] += d->token_offsets[n];
+    for (int i = 0; i < r; ++i) {
+        int n = d->row_token[i];
+        d->token_rows[d->token_offsets[n]++] = i;
+    }
+    /* Filling advanced every start to the next token's start; shift back */
+    for (int n = N; n > 0; --n) d->token_offsets[n] = d->token_offsets[n - 1];
+    d->token_offsets[0] = 0;
+
+    build_tasks(d, V);
+}
+
+typedef struct {
+    const MoeLayer* layer;
+    MoeWorkspace* ws;
+    const float* x;
+} GroupedCtx;
+
+static void grouped_task(void* arg, int task, int thread) {
+    GroupedCtx* c = (GroupedCtx*)arg;
+    MoeWorkspace* ws = c->ws;
+    const MoeTask* t = &ws->plan.tasks[task];
+    int H = ws->H, I = ws->I, NS = ws->NS;
+    int T = t->row_end - t->row_begin;
+    const ExpertWeights* w = t->vexpert < NS ? &c->layer->shared[t->vexpert]
+                                             : &c->layer->experts[t->vexpert - NS];
+
+    const int* rows = ws->plan.row_token + t->row_begin;
+    float* gate = ws->tile_gate + (size_t)thread * MOE_TILE_ROWS * I;
+    float* up = ws->tile_up + (size_t)thread * MOE_TILE_ROWS * I;
+    float* y = ws->y_rows + (size_t)t->row_begin * H;
+
+    if (c->layer->precision == MOE_BF16) {
+        bf16_t* xt = ws->tile_xh + (size_t)thread * MOE_TILE_ROWS * H;
+        for (int i = 0; i < T; ++i)
+            f32_to_bf16_n(c->x + (size_t)rows[i] * H, xt + (size_t)i * H, (size_t)H);
+        tiny_mlp_tile_bf16(xt, w, gate, up, ws->tile_hh + (size_t)thread * MOE_TILE_ROWS * I,
+                           y, T, H, I);
+        return;
+    }
+
+    float* xt = ws->tile_x + (size_t)thread * MOE_TILE_ROWS * H;
+    for (int i = 0; i < T; ++i)
+        memcpy(xt + (size_t)i * H, c->x + (size_t)rows[i] * H, (size_t)H * sizeof(float));
+    tiny_mlp_tile(xt, w, gate, up, y, T, H, I);
+}
+
+/*
+ * o[h] += w * y[h]. Fixed 8-wide blocks are SLP-vectorized at -O2; each
+ * element sees the same single multiply-add whichever path handles it.
+ */
+static void axpy_row(float* restrict o, const float* restrict y, float w, int H) {
+    int h = 0;
+    for (; h + 8 <= H; h += 8)
+        for (int i = 0; i < 8; ++i)
+            o[h + i] += w * y[h + i];
+    for (; h < H; ++h)
+        o[h] += w * y[h];
+}
+
+typedef struct {
+    const MoeWorkspace* ws;
+    const float* x;
+    float* out;
+    int N;
+} CombineCtx;
+
+/*
+ * Segmented reduction for tokens [task * MOE_COMBINE_TOKENS, ...): each
+ * token owns its output row and adds its rows in token_rows order, so
+ * there are no shared writes and the summation order does not depend on
+ * which thread runs the block.
+ */
+static void combine_task(void* arg, int task, int thread) {
+    CombineCtx* c = (CombineCtx*)arg;
+    const MoeDispatch* d = &c->ws->plan;
+    int H = c->ws->H;
+    int n0 = task * MOE_COMBINE_TOKENS;
+    int n1 = n0 + MOE_COMBINE_TOKENS < c->N ? n0 + MOE_COMBINE_TOKENS : c->N;
+    (void)thread;
+
+    for (int n = n0; n < n1; ++n) {
+        float* o = c->out + (size_t)n * H;
+        memcpy(o, c->x + (size_t)n * H, (size_t)H * sizeof(float));
+        for (int j = d->token_offsets[n]; j < d->token_offsets[n + 1]; ++j) {
+            int r = d->token_rows[j];
+            axpy_row(o, c->ws->y_rows + (size_t)r * H, d->row_w[r], H);
+        }
+    }
+}
+
+/* Grouped pass over the planned tiles, then combine per token */
+static void run_plan(const MoeLayer* layer, MoeWorkspace* ws, const float* x, int N,
+                     float* out) {
+    /* One grouped pass over shared and routed tiles */
+    GroupedCtx ctx = { layer, ws, x };
+    pool_run(ws->pool, ws->plan.num_tasks, grouped_task, &ctx);
+
+    /* Combine: residual + shared + routed, parallel over token blocks */
+    CombineCtx cc = { ws, x, out, N };
+    pool_run(ws->pool, (N + MOE_COMBINE_TOKENS - 1) / MOE_COMBINE_TOKENS, combine_task, &cc);
+}
+
+void moe_layer_forward(const MoeLayer* layer, MoeWorkspace* ws,
+                       const float* x, int N,
+                       const int* topk_idx, const float* topk_w,
+                       float* out) {
+    if (N > ws->max_tokens) {
+        fprintf(stderr, "moe_layer_forward: %d tokens exceeds workspace (%d)\n",
+                N, ws->max_tokens);
+        exit(1);
+    }
+
+    moe_dispatch(ws, N, topk_idx, topk_w);
+    run_plan(layer, ws, x, N, out);
+}
+
+void moe_layer_forward_expert_choice(const MoeLayer* layer, MoeWorkspace* ws,
+                                     const float* x, int N, int capacity,
+                                     const int* ec_token, const float* ec_w,
+                                     float* out) {
+    if (N > ws->max_tokens) {
+        fprintf(stderr, "moe_layer_forward_expert_choice: %d tokens exceeds workspace (%d)\n",
+                N, ws->max_tokens);
+        exit(1);
+    }
+
+    moe_dispatch_expert_choice(ws, N, capacity, ec_token, ec_w);
+    run_plan(layer, ws, x, N, out);
+}
+
+void moe_rows_forward(const MoeLayer* layer, MoeWorkspace* ws, const float* x, int R,
+                      const int* row_token, const int* row_vexpert, float* y) {
+    MoeDispatch* d = &ws->plan;
+    int V = ws->NS + ws->E, H = ws->H;
+    int cursor[MAX_VEXPERTS];
+
+    if (R < 0 || (size_t)R > (size_t)ws->max_tokens * (ws->NS + ws->top_k) + ws->E) {
+        fprintf(stderr, "moe_rows_forward: %d rows exceeds workspace\n", R);
+        exit(1);
+    }
+
+    /* Counting sort by virtual expert; token_rows[r] is row r's sorted slot */
+    memset(d->offsets, 0, sizeof(d->offsets));
+    for (int r = 0; r < R; ++r) {
+        int v = row_vexpert[r];
+        if (v < 0 || v >= V) {
+            fprintf(stderr, "moe_rows_forward: virtual expert %d out of range\n", v);
+            exit(1);
+        }
+        d->offsets[v + 1]++;
+    }
+    for (int v = 0; v < V; ++v) d->offsets[v + 1] += d->offsets[v];
+    memcpy(cursor, d->offsets, (size_t)V * sizeof(int));
+    for (int r = 0; r < R; ++r) {
+        int slot = cursor[row_vexpert[r]]++;
+        d->row_token[slot] = row_token ? row_token[r] : r;
+        d->row_w[slot] = 1.0f;
+        d->token_rows[r] = slot;
+    }
+    d->num_rows = R;
+    build_tasks(d, V);
+
+    GroupedCtx ctx = { layer, ws, x };
+    pool_run(ws->pool, d->num_tasks, grouped_task, &ctx);
+    for (int r = 0; r < R; ++r)
+        memcpy(y + (size_t)r * H, ws->y_rows + (size_t)d->token_rows[r] * H,
+               (size_t)H * sizeof(float));
+}
+
+void rmsnorm_forward(const float* x, float* y, int N, int H, float eps) {
+    for (int n = 0; n < N; ++n) {
+        const float* xr = x + (size_t)n * H;
+        float* yr = y + (size_t)n * H;
+        float ss = 0.0f;
+        for (int h = 0; h < H; ++h) ss += xr[h] * xr[h];
+        float inv = 1.0f / sqrtf(ss / H + eps);
+        for (int h = 0; h < H; ++h) yr[h] = xr[h] * inv;
+    }
+}
+
+double max_abs_diff(const float* a, const float* b, size_t n) {
+    double m = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double d = fabs((double)a[i] - (double)b[i]);
+        if (d > m) m = d;
+    }
+    return m;
+}
@@ -0,0 +1,215 @@
+/*
+ * moe_cpu.h
+ * DeepSeekV3 MoE operator on CPU: test-case I/O, weights, scratch
+ * workspace and the per-layer forward used by the runner and the bench.
+ */
+#ifndef MOE_CPU_H
+#define MOE_CPU_H
+
+#include <stddef.h>
+
+#include "moe_bf16.h"
+
+#define MAX_PATH 256
+#define MAX_EXPERTS 8
+#define MAX_SHARED 2
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+/* Very small parser for meta.json */
+typedef struct {
+    int hidden_size;
+    int intermediate_size;
+    int n_routed_experts;
+    int n_shared_experts;
+    int top_k;
+    float routed_scaling_factor;
+    int batch_size;
+    int seq_len;
+} Meta;
+
+/*
+ * Storage precision of expert weights and of the activations between the
+ * expert GEMMs (gathered input, SwiGLU hidden). Accumulation, the router,
+ * expert outputs and the combine always stay fp32.
+ */
+typedef enum {
+    MOE_F32 = 0,
+    MOE_BF16 = 1,
+} MoePrecision;
+
+/* One SwiGLU MLP: gate/up [I, H], down [H, I]; only one precision is populated */
+typedef struct {
+    float* gate;
+    float* up;
+    float* down;
+    bf16_t* gate_h;
+    bf16_t* up_h;
+    bf16_t* down_h;
+} ExpertWeights;
+
+/*
+ * All weights of one MoE layer, laid out exactly as in a case directory.
+ * Every tensor lives in one pinned arena (see moe_io.h).
+ */
+typedef struct {
+    Meta meta;
+    MoePrecision precision;
+    float* router;                        /* [E, H], always fp32 */
+    ExpertWeights shared[MAX_SHARED];
+    ExpertWeights experts[MAX_EXPERTS];
+    float* staging;                       /* [I * H] fp32 read buffer for bf16 layers */
+    void* arena;
+    size_t arena_bytes;
+} MoeLayer;
+
+/*
+ * Shared experts run as always-selected pseudo-experts with weight 1.0,
+ * so a layer has MAX_VEXPERTS virtual experts: ids [0, NS) are shared,
+ * [NS, NS + E) are routed expert e = id - NS.
+ */
+#define MAX_VEXPERTS (MAX_SHARED + MAX_EXPERTS)
+
+/* Rows per grouped-GEMM task; small enough to interleave shared and routed work */
+#define MOE_TILE_ROWS 16
+
+/* Tokens per combine task */
+#define MOE_COMBINE_TOKENS 32
+
+typedef struct ThreadPool ThreadPool;
+
+/* One grouped-execution task: rows [row_begin, row_end) of virtual expert vexpert */
+typedef struct {
+    int vexpert;
+    int row_begin;
+    int row_end;
+} MoeTask;
+
+/*
+ * Dispatch plan for one forward: the (token, expert) rows, counting-sorted
+ * by virtual expert. Row r of the expert-sorted order reads token
+ * row_token[r] and is combined with weight row_w[r]. The inverse is kept
+ * per token in CSR form, since under expert-choice routing a token can be
+ * picked by any number of experts (including none).
+ */
+typedef struct {
+    int num_rows;                         /* R */
+    int offsets[MAX_VEXPERTS + 1];        /* rows of vexpert v: [offsets[v], offsets[v+1]) */
+    int* row_token;                       /* [R] */
+    float* row_w;                         /* [R] */
+    int* token_offsets;                   /* [N + 1] rows of token n: token_rows[token_offsets[n]..] */
+    int* token_rows;                      /* [R] inverse permutation, shared rows first */
+    MoeTask* tasks;
+    int num_tasks;
+} MoeDispatch;
+
+/* Score and token of one expert-choice candidate */
+typedef struct {
+    float score;
+    int token;
+} MoeCandidate;
+
+/*
+ * Scratch buffers for one layer forward, sized once for max_tokens.
+ * A stack of layers with identical shapes reuses the same workspace, so
+ * nothing is allocated on the per-layer path.
+ */
+typedef struct {
+    int max_tokens;
+    int H, I, E, NS, top_k;
+    ThreadPool* pool;
+    int num_threads;
+    MoeDispatch plan;
+    float* y_rows;      /* [R, H] expert outputs in expert-sorted row order */
+    float* tile_x;      /* [threads, TILE, H] gathered task inputs */
+    float* tile_gate;   /* [threads, TILE, I] */
+    float* tile_up;     /* [threads, TILE, I] */
+    bf16_t* tile_xh;    /* [threads, TILE, H] bf16 gathered inputs */
+    bf16_t* tile_hh;    /* [threads, TILE, I] bf16 SwiGLU hidden */
+    float* scores;      /* [N, E] router probabilities */
+    int*   topk_idx;    /* [N, K] */
+    float* topk_w;      /* [N, K] */
+    int    capacity;    /* expert-choice tokens per expert from the last moe_route_expert_choice */
+    int*   ec_token;    /* [E, C] tokens picked by each expert, ascending */
+    float* ec_w;        /* [E, C] */
+    MoeCandidate* ec_cand; /* [N] selection scratch */
+} MoeWorkspace;
+
+float* load_f32(const char* path, size_t expected_elems);
+int*   load_i32(const char* path, size_t expected_elems);
+void   read_f32_into(const char* path, float* buf, size_t expected_elems);
+void   parse_meta(const char* path, Meta* m);
+void*  xmalloc(size_t bytes, const char* what);
+
+/* Allocate weight buffers for the shapes in *meta (contents undefined). */
+void moe_layer_alloc(MoeLayer* layer, const Meta* meta, MoePrecision precision);
+/*
+ * Read a layer's weights from dir into buffers allocated by moe_layer_alloc.
+ * bf16 layers convert each fp32 file once, here, not per forward.
+ */
+void moe_layer_load(MoeLayer* layer, const char* dir);
+void moe_layer_free(MoeLayer* layer);
+
+/* num_threads <= 0 picks moe_default_threads(). */
+void moe_workspace_init(MoeWorkspace* ws, const Meta* meta, int max_tokens, int num_threads);
+void moe_workspace_free(MoeWorkspace* ws);
+
+/*
+ * Router: softmax(x @ W_r^T) over experts, keep the top_k probabilities
+ * scaled by routed_scaling_factor. Results land in ws->topk_idx/topk_w.
+ */
+void moe_route(const MoeLayer* layer, MoeWorkspace* ws, const float* x, int N);
+
+/*
+ * Expert-choice routing: same softmax scores as moe_route, but each routed
+ * expert picks its top-C tokens (C = moe_expert_capacity), weighted by
+ * score * routed_scaling_factor. Every expert gets exactly C rows; a token
+ * may be picked by several experts or by none. Ties go to the lower token
+ * index. Results land in ws->ec_token/ec_w, C in ws->capacity.
+ */
+int  moe_expert_capacity(int N, int top_k, int E);
+void moe_route_expert_choice(const MoeLayer* layer, MoeWorkspace* ws, const float* x, int N);
+
+/*
+ * out = x + sum(shared experts) + sum_k topk_w[n,k] * expert_{topk_idx[n,k]}(x).
+ *
+ * Dispatch counting-sorts every (token, slot) pair by virtual expert; one
+ * grouped pass over all shared and routed row tiles runs on the pool;
+ * the combine then adds residual, shared and routed rows per token, in
+ * token_rows order, in parallel over tokens. The output is bitwise
+ * identical for any thread count. out must not alias x.
+ */
+void moe_layer_forward(const MoeLayer* layer, MoeWorkspace* ws,
+                       const float* x, int N,
+                       const int* topk_idx, const float* topk_w,
+                       float* out);
+
+/*
+ * out = x + sum(shared experts) + sum over the experts e that picked token n
+ * of ec_w[e, c] * expert_e(x). Tokens nobody picked get only x + shared.
+ */
+void moe_layer_forward_expert_choice(const MoeLayer* layer, MoeWorkspace* ws,
+                                     const float* x, int N, int capacity,
+                                     const int* ec_token, const float* ec_w,
+                                     float* out);
+
+/*
+ * Row-level grouped execution for callers that do their own dispatch (the
+ * expert-parallel runtime): y[r] = v(x[row_token[r]]) with v the virtual
+ * expert row_vexpert[r] (ids as for MAX_VEXPERTS, shared first), for
+ * r < R. row_token == NULL reads x[r]. No residual and no weights. R may
+ * be up to max_tokens * (n_shared + top_k) + n_routed of the workspace.
+ * Each row's result depends only on its input, not on R, the row order
+ * or the thread count.
+ */
+void moe_rows_forward(const MoeLayer* layer, MoeWorkspace* ws, const float* x, int R,
+                      const int* row_token, const int* row_vexpert, float* y);
+
+/* Single-token fp32 expert reference: y[H] = down(sigmoid(gate x) * up x) */
+void moe_expert_ref(const ExpertWeights* w, const float* x, float* y, int H, int I);
+
+/* y = x / sqrt(mean(x^2) + eps), per token (unit gain). In-place safe. */
+void rmsnorm_forward(const float* x, float* y, int N, int H, float eps);
+
+double max_abs_diff(const float* a, const float* b, size_t n);
+
+#endif
@@ -0,0 +1,138 @@
+#define _POSIX_C_SOURCE 200809L
+#include "moe_io.h"
+#include "timer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MOE_PAGE 4096
+
+void moe_pread_file(const char* path, void* buf, size_t bytes) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        fprintf(stderr, "Failed to stat %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    if ((size_t)sb.st_size != bytes) {
+        fprintf(stderr, "Expected %zu bytes in %s, got %lld\n", bytes, path,
+                (long long)sb.st_size);
+        exit(1);
+    }
+    posix_fadvise(fd, 0, (off_t)bytes, POSIX_FADV_SEQUENTIAL);
+
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t n = pread(fd, (char*)buf + done, bytes - done, (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            fprintf(stderr, "Read error on %s after %zu of %zu bytes: %s\n", path, done,
+                    bytes, strerror(errno));
+            exit(1);
+        }
+        if (n == 0) {
+            /* Truncated since the fstat above */
+            fprintf(stderr, "Unexpected end of %s after %zu of %zu bytes\n", path, done, bytes);
+            exit(1);
+        }
+        done += (size_t)n;
+    }
+    close(fd);
+}
+
+void* moe_pinned_alloc(size_t bytes, const char* what) {
+    void* p = NULL;
+    size_t len = bytes ? bytes : 1;
+    if (posix_memalign(&p, MOE_PAGE, len) != 0) {
+        fprintf(stderr, "OOM %s\n", what);
+        exit(1);
+    }
+    /* Locking is an optimization only: small RLIMIT_MEMLOCK just leaves it pageable */
+    (void)mlock(p, len);
+    return p;
+}
+
+void moe_pinned_free(void* p, size_t bytes) {
+    if (!p) return;
+    munlock(p, bytes ? bytes : 1);
+    free(p);
+}
+
+static void* loader_main(void* arg) {
+    MoeLoader* ld = (MoeLoader*)arg;
+    pthread_mutex_lock(&ld->mu);
+    for (;;) {
+        while (!ld->fn && !ld->shutdown)
+            pthread_cond_wait(&ld->cv, &ld->mu);
+        if (ld->shutdown) break;
+        moe_load_fn fn = ld->fn;
+        void* job = ld->arg;
+        pthread_mutex_unlock(&ld->mu);
+
+        double t0 = now();
+        fn(job);
+        double ms = (now() - t0) * 1e3;
+
+        pthread_mutex_lock(&ld->mu);
+        ld->busy_ms = ms;
+        ld->fn = NULL;
+        ld->running = 0;
+        pthread_cond_broadcast(&ld->cv);
+    }
+    pthread_mutex_unlock(&ld->mu);
+    return NULL;
+}
+
+void moe_loader_init(MoeLoader* ld) {
+    memset(ld, 0, sizeof(*ld));
+    pthread_mutex_init(&ld->mu, NULL);
+    pthread_cond_init(&ld->cv, NULL);
+    if (pthread_create(&ld->thread, NULL, loader_main, ld) != 0) {
+        fprintf(stderr, "Failed to start loader thread\n");
+        exit(1);
+    }
+}
+
+void moe_loader_destroy(MoeLoader* ld) {
+    moe_loader_wait(ld);
+    pthread_mutex_lock(&ld->mu);
+    ld->shutdown = 1;
+    pthread_cond_broadcast(&ld->cv);
+    pthread_mutex_unlock(&ld->mu);
+    pthread_join(ld->thread, NULL);
+    pthread_mutex_destroy(&ld->mu);
+    pthread_cond_destroy(&ld->cv);
+}
+
+void moe_loader_submit(MoeLoader* ld, moe_load_fn fn, void* arg) {
+    pthread_mutex_lock(&ld->mu);
+    if (ld->running) {
+        fprintf(stderr, "moe_loader_submit: previous job still pending\n");
+        exit(1);
+    }
+    ld->fn = fn;
+    ld->arg = arg;
+    ld->running = 1;
+    pthread_cond_broadcast(&ld->cv);
+    pthread_mutex_unlock(&ld->mu);
+}
+
+double moe_loader_wait(MoeLoader* ld) {
+    pthread_mutex_lock(&ld->mu);
+    while (ld->running)
+        pthread_cond_wait(&ld->cv, &ld->mu);
+    double ms = ld->busy_ms;
+    ld->busy_ms = 0.0;
+    pthread_mutex_unlock(&ld->mu);
+    return ms;
+}
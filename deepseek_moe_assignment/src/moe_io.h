@@ -0,0 +1,47 @@
+/*
+ * moe_io.h
+ * Tensor file I/O for the runner and the stack executor.
+ *
+ * Files are read with pread straight into the destination buffer (no stdio
+ * copy). Weight and case buffers come from moe_pinned_alloc: page aligned
+ * and, when RLIMIT_MEMLOCK allows, locked so compute never faults them in.
+ * MoeLoader is one persistent background thread that runs a single load
+ * job at a time, so the next case or layer reads while the current one
+ * computes.
+ */
+#ifndef MOE_IO_H
+#define MOE_IO_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/* Read exactly bytes from path into buf; exits if the file size differs. */
+void moe_pread_file(const char* path, void* buf, size_t bytes);
+
+/* Page-aligned, best-effort mlock'ed buffer; free with moe_pinned_free. */
+void* moe_pinned_alloc(size_t bytes, const char* what);
+void  moe_pinned_free(void* p, size_t bytes);
+
+typedef void (*moe_load_fn)(void* arg);
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    moe_load_fn fn;         /* pending or running job, NULL when idle */
+    void* arg;
+    int running;
+    int shutdown;
+    double busy_ms;         /* time spent in the last job */
+} MoeLoader;
+
+void moe_loader_init(MoeLoader* ld);
+void moe_loader_destroy(MoeLoader* ld);
+
+/* Start fn(arg) on the loader thread; the previous job must have been waited for. */
+void moe_loader_submit(MoeLoader* ld, moe_load_fn fn, void* arg);
+
+/* Block until the submitted job finishes; returns its run time in ms. */
+double moe_loader_wait(MoeLoader* ld);
+
+#endif
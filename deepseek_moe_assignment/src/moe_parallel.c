@@ -0,0 +1,144 @@
+#define _POSIX_C_SOURCE 200809L
+#include "moe_parallel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct ThreadPool {
+    int num_threads;
+    pthread_t* workers;           /* num_threads - 1 */
+
+    pthread_mutex_t mu;
+    pthread_cond_t start_cv;
+    pthread_cond_t done_cv;
+    unsigned long generation;     /* bumped once per pool_run */
+    int busy;                     /* workers still inside the current run */
+    int shutdown;
+
+    pool_fn fn;
+    void* ctx;
+    int num_tasks;
+    atomic_int next_task;
+};
+
+static void drain(ThreadPool* p, int thread) {
+    for (;;) {
+        int t = atomic_fetch_add(&p->next_task, 1);
+        if (t >= p->num_tasks) break;
+        p->fn(p->ctx, t, thread);
+    }
+}
+
+typedef struct {
+    ThreadPool* pool;
+    int thread;
+} WorkerArg;
+
+static void* worker_main(void* arg) {
+    WorkerArg wa = *(WorkerArg*)arg;
+    ThreadPool* p = wa.pool;
+    free(arg);
+
+    unsigned long seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&p->mu);
+        while (p->generation == seen && !p->shutdown)
+            pthread_cond_wait(&p->start_cv, &p->mu);
+        if (p->shutdown) {
+            pthread_mutex_unlock(&p->mu);
+            return NULL;
+        }
+        seen = p->generation;
+        pthread_mutex_unlock(&p->mu);
+
+        drain(p, wa.thread);
+
+        pthread_mutex_lock(&p->mu);
+        if (--p->busy == 0)
+            pthread_cond_signal(&p->done_cv);
+        pthread_mutex_unlock(&p->mu);
+    }
+}
+
+ThreadPool* pool_create(int num_threads) {
+    ThreadPool* p = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    if (!p) {
+        fprintf(stderr, "OOM thread pool\n");
+        exit(1);
+    }
+    p->num_threads = num_threads < 1 ? 1 : num_threads;
+    pthread_mutex_init(&p->mu, NULL);
+    pthread_cond_init(&p->start_cv, NULL);
+    pthread_cond_init(&p->done_cv, NULL);
+    atomic_init(&p->next_task, 0);
+
+    p->workers = (pthread_t*)calloc((size_t)p->num_threads, sizeof(pthread_t));
+    for (int t = 1; t < p->num_threads; ++t) {
+        WorkerArg* wa = (WorkerArg*)malloc(sizeof(WorkerArg));
+        if (!wa) {
+            fprintf(stderr, "OOM thread pool\n");
+            exit(1);
+        }
+        wa->pool = p;
+        wa->thread = t;
+        if (pthread_create(&p->workers[t - 1], NULL, worker_main, wa) != 0) {
+            fprintf(stderr, "Failed to start pool worker %d\n", t);
+            exit(1);
+        }
+    }
+    return p;
+}
+
+void pool_destroy(ThreadPool* p) {
+    if (!p) return;
+    pthread_mutex_lock(&p->mu);
+    p->shutdown = 1;
+    pthread_cond_broadcast(&p->start_cv);
+    pthread_mutex_unlock(&p->mu);
+    for (int t = 1; t < p->num_threads; ++t)
+        pthread_join(p->workers[t - 1], NULL);
+    pthread_mutex_destroy(&p->mu);
+    pthread_cond_destroy(&p->start_cv);
+    pthread_cond_destroy(&p->done_cv);
+    free(p->workers);
+    free(p);
+}
+
+int pool_size(const ThreadPool* p) {
+    return p ? p->num_threads : 1;
+}
+
+void pool_run(ThreadPool* p, int num_tasks, pool_fn fn, void* ctx) {
+    if (num_tasks <= 0) return;
+    if (!p || p->num_threads == 1 || num_tasks == 1) {
+        for (int t = 0; t < num_tasks; ++t) fn(ctx, t, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&p->mu);
+    p->fn = fn;
+    p->ctx = ctx;
+    p->num_tasks = num_tasks;
+    atomic_store(&p->next_task, 0);
+    p->busy = p->num_threads - 1;
+    p->generation++;
+    pthread_cond_broadcast(&p->start_cv);
+    pthread_mutex_unlock(&p->mu);
+
+    drain(p, 0);
+
+    pthread_mutex_lock(&p->mu);
+    while (p->busy > 0)
+        pthread_cond_wait(&p->done_cv, &p->mu);
+    pthread_mutex_unlock(&p->mu);
+}
+
+int moe_default_threads(void) {
+    const char* env = getenv("MOE_THREADS");
+    if (env && atoi(env) > 0) return atoi(env);
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
@@ -0,0 +1,23 @@
+/*
+ * moe_parallel.h
+ * Minimal persistent pthread pool. pool_run() hands out task indices
+ * 0..num_tasks-1 dynamically (atomic counter) to the workers and the
+ * calling thread, and returns when every task has finished.
+ */
+#ifndef MOE_PARALLEL_H
+#define MOE_PARALLEL_H
+
+typedef void (*pool_fn)(void* ctx, int task, int thread);
+
+typedef struct ThreadPool ThreadPool;
+
+/* num_threads counts the caller; 1 means run everything inline. */
+ThreadPool* pool_create(int num_threads);
+void pool_destroy(ThreadPool* pool);
+int  pool_size(const ThreadPool* pool);
+void pool_run(ThreadPool* pool, int num_tasks, pool_fn fn, void* ctx);
+
+/* MOE_THREADS from the environment, else the number of online CPUs. */
+int moe_default_threads(void);
+
+#endif
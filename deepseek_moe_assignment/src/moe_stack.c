@@ -0,0 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+#include "moe_stack.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RMSNORM_EPS 1e-6f
+
+static void load_job(void* arg) {
+    MoeStack* st = (MoeStack*)arg;
+    moe_layer_load(&st->slots[st->load_slot], st->layer_dirs[st->load_layer]);
+}
+
+static int same_shape(const Meta* a, const Meta* b) {
+    return a->hidden_size == b->hidden_size &&
+           a->intermediate_size == b->intermediate_size &&
+           a->n_routed_experts == b->n_routed_experts &&
+           a->n_shared_experts == b->n_shared_experts &&
+           a->top_k == b->top_k;
+}
+
+void moe_stack_init(MoeStack* st, const char* const* layer_dirs, int num_layers,
+                    int max_tokens, int prefetch, MoePrecision precision) {
+    char path[MAX_PATH];
+    memset(st, 0, sizeof(*st));
+    if (num_layers <= 0) {
+        fprintf(stderr, "moe_stack_init: need at least one layer\n");
+        exit(1);
+    }
+    st->num_layers = num_layers;
+    st->layer_dirs = layer_dirs;
+    st->prefetch = prefetch;
+    st->max_tokens = max_tokens;
+    st->resident[0] = st->resident[1] = -1;
+
+    snprintf(path, sizeof(path), "%s/meta.json", layer_dirs[0]);
+    parse_meta(path, &st->meta);
+    for (int l = 1; l < num_layers; ++l) {
+        Meta m = {0};
+        snprintf(path, sizeof(path), "%s/meta.json", layer_dirs[l]);
+        parse_meta(path, &m);
+        if (!same_shape(&m, &st->meta)) {
+            fprintf(stderr, "Layer %d (%s) shape differs from layer 0\n", l, layer_dirs[l]);
+            exit(1);
+        }
+    }
+
+    moe_layer_alloc(&st->slots[0], &st->meta, precision);
+    moe_layer_alloc(&st->slots[1], &st->meta, precision);
+    moe_workspace_init(&st->ws, &st->meta, max_tokens, 0);
+    if (prefetch)
+        moe_loader_init(&st->loader);
+    size_t NH = (size_t)max_tokens * st->meta.hidden_size;
+    st->act[0] = (float*)xmalloc(NH * sizeof(float), "stack act[0]");
+    st->act[1] = (float*)xmalloc(NH * sizeof(float), "stack act[1]");
+}
+
+void moe_stack_free(MoeStack* st) {
+    if (st->prefetch)
+        moe_loader_destroy(&st->loader);
+    moe_layer_free(&st->slots[0]);
+    moe_layer_free(&st->slots[1]);
+    moe_workspace_free(&st->ws);
+    free(st->act[0]);
+    free(st->act[1]);
+    memset(st, 0, sizeof(*st));
+}
+
+/* Read layer into slot on the loader thread, unless it is already there */
+static void load_start(MoeStack* st, int slot, int layer) {
+    if (st->resident[slot] == layer) return;
+    st->load_slot = slot;
+    st->load_layer = layer;
+    st->resident[slot] = layer;
+    st->loading = 1;
+    moe_loader_submit(&st->loader, load_job, st);
+}
+
+/* Block until the loader job (if any) is done */
+static void load_wait(MoeStack* st, MoeStackStats* s) {
+    if (!st->loading) return;
+    double t0 = now();
+    s->load_ms += moe_loader_wait(&st->loader);
+    s->load_wait_ms += (now() - t0) * 1e3;
+    st->loading = 0;
+}
+
+/* Read layer into slot on this thread, unless it is already there */
+static void load_now(MoeStack* st, int slot, int layer, MoeStackStats* s) {
+    if (st->resident[slot] == layer) return;
+    double t0 = now();
+    moe_layer_load(&st->slots[slot], st->layer_dirs[layer]);
+    double ms = (now() - t0) * 1e3;
+    s->load_wait_ms += ms;
+    s->load_ms += ms;
+    st->resident[slot] = layer;
+}
+
+const float* moe_stack_forward(MoeStack* st, const float* x, int N, MoeStackStats* stats) {
+    MoeStackStats s = {0};
+    int H = st->meta.hidden_size;
+    int L = st->num_layers;
+    int first = st->first_slot;
+    /* Layer 0 of the next forward goes into the slot the last layer does
+     * not use; with L <= 2 every layer keeps its slot */
+    int next_first = L > 2 ? (first + L) & 1 : first;
+    double t_begin = now(), t0;
+
+    /* Layer 0: prefetched during the previous forward, resident, or read now */
+    load_wait(st, &s);
+    load_now(st, first, 0, &s);
+
+    for (int l = 0; l < L; ++l) {
+        MoeLayer* layer = &st->slots[(first + l) & 1];
+
+        if (st->prefetch) {
+            if (l + 1 < L)
+                load_start(st, (first + l + 1) & 1, l + 1);
+            else
+                load_start(st, next_first, 0);
+        }
+
+        const float* in = x;
+        if (l > 0) {
+            float* prev = st->act[(l - 1) & 1];
+            t0 = now();
+            rmsnorm_forward(prev, prev, N, H, RMSNORM_EPS);
+            s.norm_ms += (now() - t0) * 1e3;
+            in = prev;
+        }
+
+        t0 = now();
+        moe_route(layer, &st->ws, in, N);
+        s.route_ms += (now() - t0) * 1e3;
+
+        t0 = now();
+        moe_layer_forward(layer, &st->ws, in, N, st->ws.topk_idx, st->ws.topk_w, st->act[l & 1]);
+        s.moe_ms += (now() - t0) * 1e3;
+
+        if (l + 1 < L) {
+            if (st->prefetch)
+                load_wait(st, &s);
+            else
+                load_now(st, (first + l + 1) & 1, l + 1, &s);
+        }
+    }
+    st->first_slot = next_first;
+
+    s.total_ms = (now() - t_begin) * 1e3;
+    if (stats) *stats = s;
+    return st->act[(L - 1) & 1];
+}
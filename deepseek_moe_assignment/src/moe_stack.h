@@ -0,0 +1,57 @@
+/*
+ * moe_stack.h
+ * Executes L MoE layers back to back with an RMSNorm between them.
+ *
+ * Activations ping-pong between two preallocated buffers and all layers
+ * share one MoeWorkspace. Layer weights stream from their directories
+ * through two weight slots: while layer l computes out of one slot, the
+ * loader thread reads layer l+1 into the other, and while the last layer
+ * computes it reads layer 0 for the next forward. Layers alternate slots
+ * across forwards too, so with an odd L layer 0 switches slot each call.
+ * With L <= 2 both layers stay resident and later forwards load nothing.
+ */
+#ifndef MOE_STACK_H
+#define MOE_STACK_H
+
+#include "moe_cpu.h"
+#include "moe_io.h"
+
+typedef struct {
+    double load_ms;        /* time spent reading weights, overlapped or not */
+    double load_wait_ms;   /* compute thread blocked on weights */
+    double route_ms;
+    double moe_ms;
+    double norm_ms;
+    double total_ms;
+} MoeStackStats;
+
+typedef struct {
+    int num_layers;
+    const char* const* layer_dirs;
+    int prefetch;
+    int max_tokens;
+    Meta meta;
+    MoeLayer slots[2];      /* slot (first_slot + l) & 1 holds layer l */
+    int resident[2];        /* layer each slot holds (or is loading), -1: none */
+    int first_slot;         /* slot of layer 0 in the next forward */
+    MoeLoader loader;       /* reads layer l + 1 while layer l computes */
+    int loading;            /* a loader job has not been waited for */
+    int load_slot;          /* the loader job: slot load_slot <- layer load_layer */
+    int load_layer;
+    MoeWorkspace ws;
+    float* act[2];          /* layer l writes act[l & 1] */
+} MoeStack;
+
+/* All layer directories must describe the same shapes. */
+void moe_stack_init(MoeStack* st, const char* const* layer_dirs, int num_layers,
+                    int max_tokens, int prefetch, MoePrecision precision);
+void moe_stack_free(MoeStack* st);
+
+/*
+ * Run the stack on x [N, H]. Routing for every layer is computed from that
+ * layer's router weights. Returns a pointer to the last layer's output,
+ * which stays valid until the next call. stats may be NULL.
+ */
+const float* moe_stack_forward(MoeStack* st, const float* x, int N, MoeStackStats* stats);
+
+#endif
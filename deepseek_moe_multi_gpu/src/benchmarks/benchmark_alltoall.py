@@ -0,0 +1,116 @@
+"""
+All-to-all latency: gloo p2p (all_to_all_p2p) vs the shared-memory rings
+of libmoe_native, for several rank counts and per-peer message sizes.
+Also times the full EP forward (run_case) with each backend.
+
+Writes benchmarks/alltoall_results.json.
+"""
+import os
+import sys
+import time
+import json
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+
+import torch
+import torch.distributed as dist
+import torch.multiprocessing as mp
+
+import moe_native
+from moe_ep_distributed import all_to_all, run_case
+
+RANKS = [2, 4, 8]
+SIZES = [1 << 10, 64 << 10, 1 << 20, 4 << 20]   # bytes per peer
+
+
+def bench_rank(rank, world_size, backend, sizes, iters, port, comm_name, queue):
+    comm = None
+    if backend == "shm":
+        comm = moe_native.ShmComm(comm_name, rank, world_size)
+    else:
+        os.environ["MASTER_ADDR"] = "localhost"
+        os.environ["MASTER_PORT"] = str(port)
+        dist.init_process_group(backend="gloo", rank=rank, world_size=world_size)
+
+    def barrier():
+        if comm is not None:
+            comm.barrier()
+        else:
+            dist.barrier()
+
+    results = []
+    for nbytes in sizes:
+        send_list = [torch.full((nbytes // 4,), float(rank)) for _ in range(world_size)]
+        times = []
+        for it in range(iters + 3):
+            barrier()
+            t0 = time.perf_counter()
+            recv_list = all_to_all(send_list, rank, world_size, comm)
+            if it >= 3:
+                times.append((time.perf_counter() - t0) * 1e6)
+        assert all(recv_list[r][0].item() == r for r in range(world_size))
+        times.sort()
+        results.append(times[len(times) // 2])
+
+    if rank == 0:
+        queue.put(results)
+    if comm is not None:
+        comm.close()
+    else:
+        dist.destroy_process_group()
+
+
+def bench(world_size, backend, sizes, iters, run_id):
+    ctx   = mp.get_context("spawn")
+    queue = ctx.Queue()
+    name  = f"/moe_bench_{os.getpid()}_{run_id}"
+    procs = [ctx.Process(target=bench_rank,
+                         args=(r, world_size, backend, sizes, iters,
+                               29600 + run_id, name, queue))
+             for r in range(world_size)]
+    for p in procs:
+        p.start()
+    results = queue.get()
+    for p in procs:
+        p.join()
+    return results
+
+
+def bench_ep(test_dir, backend, iters=3):
+    times = []
+    for _ in range(iters):
+        t0 = time.perf_counter()
+        run_case(test_dir, world_size=2, backend=backend)
+        times.append((time.perf_counter() - t0) * 1000)
+    return sum(times) / len(times)
+
+
+def main():
+    if not moe_native.available():
+        sys.exit("libmoe_native not built: cmake -S moe_cpu -B moe_cpu/build "
+                 "&& cmake --build moe_cpu/build")
+
+    print(f"{'ranks':>6} {'bytes/peer':>11} {'gloo us':>10} {'shm us':>10} {'speedup':>8}")
+    print("-" * 50)
+    rows, run_id = [], 0
+    for W in RANKS:
+        gloo = bench(W, "gloo", SIZES, 20, run_id)
+        shm  = bench(W, "shm",  SIZES, 20, run_id + 1)
+        run_id += 2
+        for nbytes, g, s in zip(SIZES, gloo, shm):
+            print(f"{W:>6} {nbytes:>11} {g:>10.1f} {s:>10.1f} {g / s:>7.1f}x")
+            rows.append({"ranks": W, "bytes_per_peer": nbytes,
+                         "gloo_us": round(g, 1), "shm_us": round(s, 1)})
+
+    test_dir = os.path.join(os.path.dirname(__file__), "..", "tests", "case_01")
+    ep = {b: round(bench_ep(test_dir, b), 1) for b in ("gloo", "shm")}
+    print(f"\nEP forward, case_01, 2 ranks: gloo {ep['gloo']} ms, shm {ep['shm']} ms")
+
+    out_path = os.path.join(os.path.dirname(__file__), "alltoall_results.json")
+    with open(out_path, "w") as f:
+        json.dump({"alltoall": rows, "ep_forward_ms": ep}, f, indent=2)
+    print("\nSaved alltoall_results.json")
+
+
+if __name__ == "__main__":
+    main()
@@ -7,7 +7,7 @@ sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
 
 import torch
 from generate_tests import TinyConfig, TinyMoE, set_deterministic
-from moe_ep_distributed import run_case
+from moe_ep_distributed import EPRuntime, load_case, run_case
 
 
 def bench_baseline(model, x, warmup=5, iters=30):
@@ -22,7 +22,8 @@ def bench_baseline(model, x, warmup=5, iters=30):
     return elapsed / iters * 1000
 
 
-def bench_ep(test_dir, world_size=2, iters=3):
+def bench_ep_cold(test_dir, world_size=2, iters=3):
+    """Spawn, load, one forward, tear down: the old per-call cost."""
     times = []
     for _ in range(iters):
         t0 = time.perf_counter()
@@ -31,6 +32,37 @@ def bench_ep(test_dir, world_size=2, iters=3):
     return sum(times) / len(times)
 
 
+def bench_ep(test_dir, world_size=2, warmup=3, iters=30):
+    """(startup ms, steady-state ms per forward) of a persistent EPRuntime."""
+    _, inputs, _, topk_idx, topk_w = load_case(test_dir)
+    with EPRuntime(test_dir, world_size=world_size) as rt:
+        for _ in range(warmup):
+            rt.forward(inputs, topk_idx, topk_w)
+        t0 = time.perf_counter()
+        for _ in range(iters):
+            rt.forward(inputs, topk_idx, topk_w)
+        steady = (time.perf_counter() - t0) / iters * 1000
+    return rt.startup_ms, steady
+
+
+def bench_ep_tokens(test_dir, token_counts, world_size=2, iters=10):
+    """Steady-state EP forward ms for synthetic batches of each size."""
+    cfg, _, _, _, _ = load_case(test_dir)
+    H, E, K = cfg["hidden_size"], cfg["n_routed_experts"], cfg["top_k"]
+    results = []
+    with EPRuntime(test_dir, world_size=world_size) as rt:
+        for n in token_counts:
+            x     = torch.randn(n, H)
+            idx   = torch.rand(n, E).topk(K, dim=1).indices.int()
+            w     = torch.rand(n, K)
+            rt.forward(x, idx, w)
+            t0 = time.perf_counter()
+            for _ in range(iters):
+                rt.forward(x, idx, w)
+            results.append((time.perf_counter() - t0) / iters * 1000)
+    return results
+
+
 def main():
     config = TinyConfig()
     config.hidden_size            = 64
@@ -63,18 +95,36 @@ def main():
     test_dir = os.path.join(
         os.path.dirname(__file__), "..", "tests", "case_01"
     )
-    ep_ms  = bench_ep(test_dir, world_size=2, iters=3)
-    ep_tps = (2 * 3) / (ep_ms / 1000)
-    print(f"  avg latency : {ep_ms:.1f} ms")
-    print(f"  throughput  : {ep_tps:.0f} tok/s")
+    _, inputs, _, _, _ = load_case(test_dir)
+    tokens = inputs.shape[0]
+    cold_ms = bench_ep_cold(test_dir, world_size=2, iters=3)
+    startup_ms, ep_ms = bench_ep(test_dir, world_size=2)
+    ep_tps = tokens / (ep_ms / 1000)
+    print(f"  cold forward (spawn + load + forward) : {cold_ms:.1f} ms")
+    print(f"  runtime startup                       : {startup_ms:.1f} ms")
+    print(f"  steady-state forward                  : {ep_ms:.2f} ms")
+    print(f"  steady-state throughput               : {ep_tps:.0f} tok/s")
+
+    print("\nEP steady-state vs batch size (case_01 weights):")
+    print(f"{'Tokens':>8} {'ms':>10} {'tok/s':>12}")
+    print("-" * 35)
+    token_counts = [64, 256, 1024, 4096]
+    scaling = []
+    for n, ms in zip(token_counts, bench_ep_tokens(test_dir, token_counts)):
+        print(f"{n:>8} {ms:>10.3f} {n / (ms / 1000):>12.0f}")
+        scaling.append({"tokens": n, "ms": round(ms, 3),
+                        "tps": round(n / (ms / 1000), 1)})
 
     os.makedirs("benchmarks", exist_ok=True)
     results = {
         "baseline": baseline_results,
         "ep_distributed": {
-            "ms": round(ep_ms, 1),
+            "cold_ms": round(cold_ms, 1),
+            "startup_ms": round(startup_ms, 1),
+            "ms": round(ep_ms, 3),
             "tps": round(ep_tps, 1)
-        }
+        },
+        "ep_scaling": scaling
     }
     out_path = os.path.join(
         os.path.dirname(__file__), "..", "benchmarks", "comparison_results.json"
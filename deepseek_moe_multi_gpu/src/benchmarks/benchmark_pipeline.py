@@ -0,0 +1,72 @@
+"""
+Chunked EP pipeline: steady-state forward latency of a persistent
+EPRuntime for several chunk counts, plus a Chrome trace of one pipelined
+forward (open benchmarks/ep_pipeline_trace.json in chrome://tracing or
+ui.perfetto.dev; each rank is a process with "compute" and "comm" lanes).
+
+Writes benchmarks/pipeline_results.json.
+"""
+import os
+import sys
+import time
+import json
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+
+import torch
+
+from moe_ep_distributed import EPRuntime, load_case, write_trace
+
+CHUNKS = [1, 2, 4, 8, 16]
+TOKENS = [1024, 8192]
+
+
+def bench(rt, x, idx, w, num_chunks, warmup=2, iters=10):
+    for _ in range(warmup):
+        rt.forward(x, idx, w, num_chunks=num_chunks)
+    t0 = time.perf_counter()
+    for _ in range(iters):
+        rt.forward(x, idx, w, num_chunks=num_chunks)
+    return (time.perf_counter() - t0) / iters * 1000
+
+
+def main():
+    test_dir = os.path.join(os.path.dirname(__file__), "..", "tests", "case_01")
+    cfg, _, _, _, _ = load_case(test_dir)
+    H, E, K = cfg["hidden_size"], cfg["n_routed_experts"], cfg["top_k"]
+    world_size = int(os.environ.get("WORLD_SIZE", 2))
+
+    torch.manual_seed(0)
+    rows = []
+    with EPRuntime(test_dir, world_size=world_size) as rt:
+        print(f"EP pipeline, {world_size} ranks, backend={rt.backend}")
+        print(f"{'tokens':>8} {'chunks':>7} {'ms':>10} {'vs 1':>7}")
+        print("-" * 36)
+        for n in TOKENS:
+            x   = torch.randn(n, H)
+            idx = torch.rand(n, E).topk(K, dim=1).indices.int()
+            w   = torch.rand(n, K)
+            ref = rt.forward(x, idx, w, num_chunks=1)
+            base = None
+            for c in CHUNKS:
+                out = rt.forward(x, idx, w, num_chunks=c)
+                assert (out - ref).abs().max().item() < 1e-5
+                ms = bench(rt, x, idx, w, c)
+                base = base or ms
+                print(f"{n:>8} {c:>7} {ms:>10.3f} {base / ms:>6.2f}x")
+                rows.append({"tokens": n, "chunks": c, "ms": round(ms, 3)})
+
+        # Trace one 4-chunk forward of the larger batch
+        rt.forward(x, idx, w, num_chunks=4, trace=True)
+        trace_path = os.path.join(os.path.dirname(__file__), "ep_pipeline_trace.json")
+        write_trace(trace_path, rt.last_trace)
+        print(f"\nTrace of a 4-chunk forward: {trace_path}")
+
+    out_path = os.path.join(os.path.dirname(__file__), "pipeline_results.json")
+    with open(out_path, "w") as f:
+        json.dump({"world_size": world_size, "backend": rt.backend, "sweep": rows}, f, indent=2)
+    print("Saved pipeline_results.json")
+
+
+if __name__ == "__main__":
+    main()
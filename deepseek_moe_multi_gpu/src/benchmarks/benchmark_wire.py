@@ -0,0 +1,132 @@
+"""
+EP wire formats: bytes per all-to-all, codec throughput and accuracy.
+
+1. Bytes: one rank's dispatch + combine for a DeepSeek-V3-sized layer
+   (H=7168, top-8 of 256 experts, W ranks, uniform routing) in the old
+   layout (3 + H fp32 per slot, every peer padded to the global
+   max_slots) and in the compact one (int32 expert id + encoded row,
+   exact sizes). Pure Python.
+2. Codec: libmoe_native encode + decode throughput per format.
+3. Accuracy and steady-state forward time of every test case per format
+   through EPRuntime (needs torch).
+
+Writes benchmarks/wire_results.json.
+"""
+import os
+import sys
+import time
+import json
+import ctypes
+import random
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+
+import moe_native
+
+H, E, K   = 7168, 256, 8
+TOKENS    = 4096          # per rank
+FORMATS   = ("fp32", "bf16", "fp8")
+
+
+def dispatch_counts(world_size, seed=0):
+    """counts[s][d]: rows rank s sends rank d, uniform top-K routing."""
+    rng = random.Random(seed)
+    counts = [[0] * world_size for _ in range(world_size)]
+    for s in range(world_size):
+        for _ in range(TOKENS):
+            for e in rng.sample(range(E), K):
+                counts[s][e % world_size] += 1
+    return counts
+
+
+def wire_bytes(world_size):
+    """Bytes rank 0 sends per forward (dispatch + combine), per layout."""
+    counts = dispatch_counts(world_size)
+    max_slots = max(max(row) for row in counts)
+    # Old layout: [tok, expert, w, embed] out, [tok, w, out] back, all fp32
+    padded = world_size * max_slots * 4 * ((3 + H) + (2 + H))
+    sent, received = sum(counts[0]), sum(counts[s][0] for s in range(world_size))
+    out = {"padded_fp32": padded}
+    for fmt in FORMATS:
+        row = moe_native.wire_row_bytes(fmt, H)
+        out[fmt] = sent * (4 + row) + received * row
+    return out
+
+
+def codec_gbps(fmt, rows=4096, iters=5):
+    """fp32 GB/s through encode + decode of rows x H."""
+    lib = moe_native.load()
+    n = rows * H
+    x = (ctypes.c_float * n)(*[(i % 97) * 0.01 - 0.5 for i in range(n)])
+    y = (ctypes.c_float * n)()
+    buf = (ctypes.c_uint8 * (rows * moe_native.wire_row_bytes(fmt, H)))()
+    code = moe_native.WIRE_FORMATS[fmt]
+    best = float("inf")
+    for _ in range(iters):
+        t0 = time.perf_counter()
+        lib.moe_encode_rows(x, rows, H, code, buf, 0)
+        lib.moe_decode_rows(buf, rows, H, code, y, 0)
+        best = min(best, time.perf_counter() - t0)
+    return 2 * n * 4 / best / 1e9
+
+
+def bench_cases(iters=20):
+    import torch
+    from moe_ep_distributed import EPRuntime, load_case
+    test_root = os.path.join(os.path.dirname(__file__), "..", "tests")
+    cases = sorted(d for d in os.listdir(test_root) if d.startswith("case_"))
+    rows = []
+    for fmt in FORMATS:
+        errs, times = [], []
+        for case in cases:
+            test_dir = os.path.join(test_root, case)
+            _, inputs, expected, idx, w = load_case(test_dir)
+            with EPRuntime(test_dir, world_size=2, wire=fmt) as rt:
+                out = rt.forward(inputs, idx, w)
+                errs.append((out - expected).abs().max().item())
+                t0 = time.perf_counter()
+                for _ in range(iters):
+                    rt.forward(inputs, idx, w)
+                times.append((time.perf_counter() - t0) / iters * 1000)
+        rows.append({"wire": fmt, "max_err": max(errs), "forward_ms": sum(times) / len(times)})
+        print(f"  {fmt:<5} max err vs fp32 golden {max(errs):.3e}   "
+              f"forward {rows[-1]['forward_ms']:.2f} ms")
+    return rows
+
+
+def main():
+    if not moe_native.available():
+        sys.exit("libmoe_native not built: cmake -S moe_cpu -B moe_cpu/build "
+                 "&& cmake --build moe_cpu/build")
+    results = {"bytes": {}, "codec_gbps": {}}
+    print(f"Bytes sent per rank per forward (dispatch + combine), H={H}, "
+          f"top-{K} of {E}, {TOKENS} tokens/rank:")
+    print(f"{'W':>3} {'padded fp32':>12} " + " ".join(f"{f:>14}" for f in FORMATS))
+    for W in (2, 4, 8):
+        b = wire_bytes(W)
+        results["bytes"][W] = b
+        base = b["padded_fp32"]
+        print(f"{W:>3} {base / 2**20:>9.1f} MiB " +
+              " ".join(f"{b[f] / 2**20:>7.1f} ({base / b[f]:.1f}x)" for f in FORMATS))
+
+    print("\nCodec encode + decode throughput (GB/s of fp32):")
+    for fmt in FORMATS:
+        results["codec_gbps"][fmt] = codec_gbps(fmt)
+        print(f"  {fmt:<5} {results['codec_gbps'][fmt]:.2f}")
+
+    try:
+        import torch  # noqa: F401
+    except ImportError:
+        print("\ntorch not installed: skipping the test-case accuracy run")
+    else:
+        print("\nTest cases, world_size=2:")
+        results["cases"] = bench_cases()
+
+    out_path = os.path.join(os.path.dirname(__file__), "wire_results.json")
+    with open(out_path, "w") as f:
+        json.dump(results, f, indent=2)
+    print("\nSaved wire_results.json")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,80 @@
+"""
+EP cluster sizing report from the cost simulator (ep_sim.py): predicted
+all-to-all volume, compute balance and step time of a DeepSeek-V3 MoE
+layer (E=256, top-8, H=7168) for 8..64 ranks, each placement strategy and
+the bf16 / fp8 wire formats, at a fixed 2048 tokens per rank. Needs
+libmoe_native, not torch.
+
+    python ep_sim_report.py                 # synthetic Zipf traces
+    python ep_sim_report.py trace.json      # replay a save_trace file
+                                            # (its own token count)
+
+The synthetic routing is Zipf(0.8) over the experts, reshuffled every 6
+steps so the planners also serve stale steps. Writes
+benchmarks/ep_sim_report.json.
+"""
+import os
+import sys
+import json
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+
+import moe_native
+from ep_sim import DEEPSEEK_V3, PRESETS, LayerShape, load_trace, simulate, synthetic_trace
+
+E, K            = 256, 8
+TOKENS_PER_RANK = 2048
+STEPS           = 13
+SKEW            = 0.8
+WORLD_SIZES     = (8, 16, 32, 64)
+STRATEGIES      = ("round_robin", "planned", "replicated")
+TOPOLOGIES      = ("nvlink-ib400", "pcie-roce100")
+
+
+def main():
+    if not moe_native.available():
+        sys.exit("libmoe_native not built: cmake -S moe_cpu -B moe_cpu/build "
+                 "&& cmake --build moe_cpu/build")
+    trace_path = sys.argv[1] if len(sys.argv) > 1 else None
+    rows = []
+    print(f"{'topology':<13} {'W':>3} {'wire':<5} {'strategy':<12} {'disp us':>8} "
+          f"{'comb us':>8} {'comp us':>8} {'imbal':>6} {'step p50':>9} {'step p99':>9} "
+          f"{'overlap':>8} {'inter GB':>9}")
+    print("-" * 112)
+    t0 = time.perf_counter()
+    for W in WORLD_SIZES:
+        if trace_path:
+            trace = load_trace(trace_path)
+        else:
+            trace = synthetic_trace(E, K, W * TOKENS_PER_RANK, STEPS, skew=SKEW,
+                                    drift_every=6, seed=W)
+        for topo_name in TOPOLOGIES:
+            for wire in ("bf16", "fp8"):
+                layer = LayerShape(DEEPSEEK_V3.hidden, DEEPSEEK_V3.intermediate,
+                                   DEEPSEEK_V3.shared_intermediate, wire,
+                                   DEEPSEEK_V3.rank_tflops)
+                for strategy in STRATEGIES:
+                    s = simulate(trace, W, PRESETS[topo_name], layer, strategy)["summary"]
+                    rows.append({"topology": topo_name, "world_size": W, "wire": wire,
+                                 "strategy": strategy, **s})
+                    print(f"{topo_name:<13} {W:>3} {wire:<5} {strategy:<12} "
+                          f"{s['dispatch_us']['mean']:>8.0f} {s['combine_us']['mean']:>8.0f} "
+                          f"{s['max_compute_us']['mean']:>8.0f} {s['compute_imbalance']:>6.2f} "
+                          f"{s['step_us']['p50']:>9.0f} {s['step_us']['p99']:>9.0f} "
+                          f"{s['overlap_us']['mean']:>8.0f} {s['inter_gb']:>9.2f}")
+    print(f"\n{len(rows)} configurations simulated in {time.perf_counter() - t0:.1f} s")
+    report = {"config": {"E": E, "K": K, "tokens_per_rank": TOKENS_PER_RANK, "steps": STEPS,
+                         "trace": trace_path or f"synthetic zipf {SKEW}, drift every 6",
+                         "layer": DEEPSEEK_V3.as_tuple()[:3],
+                         "rank_tflops": DEEPSEEK_V3.rank_tflops,
+                         "topologies": {n: PRESETS[n].as_tuple() for n in TOPOLOGIES}},
+              "runs": rows}
+    out_path = os.path.join(os.path.dirname(__file__), "ep_sim_report.json")
+    with open(out_path, "w") as f:
+        json.dump(report, f, indent=2)
+    print("Saved ep_sim_report.json")
+
+
+if __name__ == "__main__":
+    main()
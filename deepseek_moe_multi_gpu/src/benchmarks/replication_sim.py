@@ -0,0 +1,156 @@
+"""
+Hot-expert replication simulator: step-time distribution of EP under
+skewed synthetic routing for three policies, all scored with the cost
+model of placement.h (straggler rank: tokens computed + comm_weight *
+tokens received from other ranks). Needs libmoe_native, not torch.
+
+  round-robin   expert e on rank e % W, never changed
+  placement     PlacementPlanner replanning every `replan_every` steps
+  replication   the same, plus copies of the `replicate_top` hottest
+                experts; remote tokens of a replicated expert are split
+                over its copies, local ones stay home (assign_replicas)
+
+Routing is Zipf(skew) over the experts with a "burst": one expert takes
+an extra `burst` share of every rank's tokens. In the steady runs the
+popularity never changes; in the drifting runs the popularity and the
+burst move every `drift_every` steps, so the tail also holds the steps
+served by a stale plan. Step costs are also reported relative to a
+perfectly balanced step (total tokens / W), so 1.0 means no straggler.
+Steps before the first replan (all policies still round-robin) are not
+scored.
+
+Writes benchmarks/replication_report.json.
+"""
+import os
+import sys
+import json
+import math
+import random
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+
+import moe_native
+from placement import PlacementPlanner, round_robin
+
+E, W, K, N   = 32, 8, 4, 2048
+COMM_WEIGHT  = 0.1
+
+
+def make_weights(skew, hot, burst, seed):
+    """Zipf(skew) popularity, shuffled, with expert `hot` boosted so it
+    gets about `burst` of the routing mass on its own."""
+    rng = random.Random(seed)
+    popularity = [1.0 / (i + 1) ** skew for i in range(E)]
+    rng.shuffle(popularity)
+    total = sum(popularity)
+    popularity[hot] += total * burst / (1.0 - burst)
+    return popularity
+
+
+def sample_counts(weights, rng):
+    """(load[E], traffic[W][E]) of N tokens split evenly over W ranks,
+    each routed to K distinct experts (Gumbel top-k)."""
+    logw = [math.log(w) for w in weights]
+    traffic = [[0.0] * E for _ in range(W)]
+    for t in range(N):
+        r = t * W // N
+        keys = [lw - math.log(-math.log(rng.random() or 1e-300)) for lw in logw]
+        for e in sorted(range(E), key=keys.__getitem__, reverse=True)[:K]:
+            traffic[r][e] += 1.0
+    load = [sum(traffic[r][e] for r in range(W)) for e in range(E)]
+    return load, traffic
+
+
+def percentile(values, q):
+    s = sorted(values)
+    return s[min(len(s) - 1, int(math.ceil(q / 100.0 * len(s))) - 1)]
+
+
+def summarize(costs, ideal):
+    rel = [c / i for c, i in zip(costs, ideal)]
+    return {"mean": round(sum(costs) / len(costs), 1),
+            "p50": round(percentile(costs, 50), 1),
+            "p99": round(percentile(costs, 99), 1),
+            "p99_rel": round(percentile(rel, 99), 3),
+            "mean_rel": round(sum(rel) / len(rel), 3)}
+
+
+def run(skew, burst, drift_every, steps=300, replan_every=2, replicate_top=4):
+    rng = random.Random(int(skew * 100 + burst * 1000) + drift_every)
+    placement = PlacementPlanner(E, W, comm_weight=COMM_WEIGHT, decay=0.7)
+    replicated = PlacementPlanner(E, W, comm_weight=COMM_WEIGHT, decay=0.7,
+                                  replicate_top=replicate_top)
+    rr = round_robin(E, W)
+    costs = {"round_robin": [], "placement": [], "replication": []}
+    ideal, adopted, copies = [], {"placement": 0, "replication": 0}, []
+    for step in range(steps):
+        if step == 0 or (drift_every and step % drift_every == 0):
+            hot = rng.randrange(E)
+            weights = make_weights(skew, hot, burst, seed=step)
+        load, traffic = sample_counts(weights, rng)
+        if step < replan_every:
+            placement.observe(load, traffic)
+            replicated.observe(load, traffic)
+            if step + 1 == replan_every:
+                placement.replan()
+                replicated.replan()
+            continue
+        ideal.append(sum(load) / W)
+
+        costs["round_robin"].append(
+            moe_native.placement_stats(load, W, rr, traffic, COMM_WEIGHT)["max_cost"])
+        costs["placement"].append(
+            moe_native.placement_stats(load, W, placement.table, traffic,
+                                       COMM_WEIGHT)["max_cost"])
+        reps = replicated.replicas or [[r] for r in replicated.table]
+        costs["replication"].append(
+            moe_native.replica_stats(load, W, reps, traffic, COMM_WEIGHT)["max_cost"])
+        copies.append(sum(len(c) for c in reps) - E)
+
+        for name, planner in (("placement", placement), ("replication", replicated)):
+            planner.observe(load, traffic)
+            if (step + 1) % replan_every == 0:
+                adopted[name] += planner.replan()
+
+    result = {"skew": skew, "burst": burst, "steps": steps, "drift_every": drift_every,
+              "replan_every": replan_every, "replicate_top": replicate_top,
+              "tables_adopted": adopted,
+              "mean_extra_copies": round(sum(copies) / len(copies), 2)}
+    for name, c in costs.items():
+        result[name] = summarize(c, ideal)
+    return result
+
+
+def main():
+    if not moe_native.available():
+        sys.exit("libmoe_native not built: cmake -S moe_cpu -B moe_cpu/build "
+                 "&& cmake --build moe_cpu/build")
+    print(f"Step cost under skewed routing, E={E} W={W} K={K} N={N}/step, "
+          f"comm_weight={COMM_WEIGHT}")
+    print("(straggler cost in token units; rel = straggler / perfectly balanced step)")
+    print(f"{'skew':>5} {'burst':>6} {'drift':>6} | {'policy':<12} {'mean':>7} {'p50':>7} "
+          f"{'p99':>7} {'p99 rel':>8}")
+    print("-" * 71)
+    rows = []
+    for drift_every in (0, 25):
+        for skew, burst in ((0.8, 0.0), (0.8, 0.1), (1.2, 0.1), (1.2, 0.2)):
+            r = run(skew, burst, drift_every)
+            rows.append(r)
+            for name in ("round_robin", "placement", "replication"):
+                s = r[name]
+                print(f"{skew:>5} {burst:>6} {drift_every or '-':>6} | {name:<12} "
+                      f"{s['mean']:>7.0f} {s['p50']:>7.0f} {s['p99']:>7.0f} "
+                      f"{s['p99_rel']:>8.2f}")
+            gain = r["placement"]["p99"] / r["replication"]["p99"]
+            print(f"{'':>19} | p99 gain of replication over placement: {gain:.2f}x "
+                  f"({r['mean_extra_copies']} extra copies on average)")
+    report = {"config": {"E": E, "W": W, "K": K, "N": N, "comm_weight": COMM_WEIGHT},
+              "runs": rows}
+    out_path = os.path.join(os.path.dirname(__file__), "replication_report.json")
+    with open(out_path, "w") as f:
+        json.dump(report, f, indent=2)
+    print("\nSaved replication_report.json")
+
+
+if __name__ == "__main__":
+    main()
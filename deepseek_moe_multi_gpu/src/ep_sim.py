@@ -0,0 +1,226 @@
+"""
+Expert-parallel communication cost simulator, for sizing EP deployments
+from routing traces on one CPU (libmoe_native, no torch, no GPUs).
+
+A trace is a sequence of steps, each the [N, K] topk_indices of one
+global batch. Every step is split over the ranks as moe_ep_distributed
+does it and pushed through the same dispatch code (assign_replicas +
+build_plan, called by moe_cpu/ep_sim.h), which gives the rows each rank
+sends every other rank. Those are costed on a two-level topology with an
+alpha-beta model per link class, plus a flop-rate model of the expert
+compute; see ep_sim.h for the formulas.
+
+    trace = synthetic_trace(E, K, tokens=W * 2048, steps=20, skew=1.0)
+    run = simulate(trace, W, PRESETS["nvlink-ib400"], DEEPSEEK_V3,
+                   strategy="replicated")
+    run["summary"]["step_us"]["p99"], run["summary"]["inter_gb"], ...
+
+Strategies:
+  round_robin   expert e on rank e % W
+  planned       PlacementPlanner replanning every replan_every steps
+  replicated    the same plus copies of the replicate_top hottest experts
+
+Traces come from synthetic_trace, a generated test case (load_trace on
+tests/case_XX) or a JSON file written by save_trace:
+    {"num_experts": E, "top_k": K, "steps": [[e, e, ...], ...]}
+"""
+import os
+import json
+import math
+import array
+import bisect
+import ctypes
+import random
+
+import moe_native
+from placement import PlacementPlanner, round_robin
+
+
+class Topology:
+    """Two-level cluster: ranks_per_node ranks per node, GB/s per rank and
+    direction, latency per collective round of each link class."""
+
+    def __init__(self, ranks_per_node, intra_gbps, intra_latency_us, inter_gbps,
+                 inter_latency_us):
+        self.ranks_per_node = ranks_per_node
+        self.intra_gbps = intra_gbps
+        self.intra_latency_us = intra_latency_us
+        self.inter_gbps = inter_gbps
+        self.inter_latency_us = inter_latency_us
+
+    def as_tuple(self):
+        return (self.ranks_per_node, self.intra_gbps, self.intra_latency_us,
+                self.inter_gbps, self.inter_latency_us)
+
+
+# Achieved (not nominal) all-to-all bandwidths
+PRESETS = {
+    # 8 GPUs per node on NVLink, one 400 Gb/s InfiniBand NIC per GPU
+    "nvlink-ib400": Topology(8, 150.0, 3.0, 40.0, 10.0),
+    # 8 GPUs per node on PCIe 4.0, one 100 Gb/s RoCE NIC per GPU
+    "pcie-roce100": Topology(8, 20.0, 5.0, 10.0, 20.0),
+    # Ranks as processes of one host through shm_comm (README all-to-all
+    # table); ranks_per_node >= world_size keeps everything intra-node
+    "cpu-shm": Topology(1024, 4.5, 40.0, 4.5, 40.0),
+}
+
+
+class LayerShape:
+    """One MoE layer: hidden size, routed and (total) shared expert
+    intermediate sizes, wire format of the activations, achieved TFLOP/s
+    per rank."""
+
+    def __init__(self, hidden, intermediate, shared_intermediate, wire="bf16",
+                 rank_tflops=400.0):
+        if wire not in moe_native.WIRE_FORMATS:
+            raise ValueError(f"unknown wire format {wire!r}")
+        self.hidden = hidden
+        self.intermediate = intermediate
+        self.shared_intermediate = shared_intermediate
+        self.wire = wire
+        self.rank_tflops = rank_tflops
+
+    def as_tuple(self):
+        return (self.hidden, self.intermediate, self.shared_intermediate, self.wire,
+                self.rank_tflops)
+
+
+DEEPSEEK_V3 = LayerShape(7168, 2048, 2048)
+
+
+class Trace:
+    """steps: list of array('i') holding [N * top_k] expert ids each."""
+
+    def __init__(self, num_experts, top_k, steps):
+        self.num_experts = num_experts
+        self.top_k = top_k
+        self.steps = [s if isinstance(s, array.array) else array.array("i", s) for s in steps]
+        for s in self.steps:
+            if len(s) % top_k:
+                raise ValueError("trace step length is not a multiple of top_k")
+
+
+def synthetic_trace(num_experts, top_k, tokens, steps, skew=1.0, drift_every=0, seed=0):
+    """Zipf(skew) expert popularity, reshuffled every drift_every steps
+    (0 = never); each token picks top_k distinct experts with probability
+    proportional to popularity."""
+    rng = random.Random(seed)
+    popularity = [1.0 / (i + 1) ** skew for i in range(num_experts)]
+    out = []
+    for step in range(steps):
+        if step == 0 or (drift_every and step % drift_every == 0):
+            rng.shuffle(popularity)
+            cum = []
+            total = 0.0
+            for p in popularity:
+                total += p
+                cum.append(total)
+        ids = array.array("i", bytes(4 * tokens * top_k))
+        i = 0
+        for _ in range(tokens):
+            picked = set()
+            while len(picked) < top_k:
+                e = bisect.bisect_right(cum, rng.random() * total)
+                if e < num_experts and e not in picked:
+                    picked.add(e)
+                    ids[i] = e
+                    i += 1
+        out.append(ids)
+    return Trace(num_experts, top_k, out)
+
+
+def load_trace(path):
+    """A generated test case directory (one step) or a save_trace JSON file."""
+    if os.path.isdir(path):
+        with open(os.path.join(path, "meta.json")) as f:
+            cfg = json.load(f)
+        ids = array.array("i")
+        with open(os.path.join(path, "topk_indices.bin"), "rb") as f:
+            ids.frombytes(f.read())
+        return Trace(cfg["n_routed_experts"], cfg["top_k"], [ids])
+    with open(path) as f:
+        data = json.load(f)
+    return Trace(data["num_experts"], data["top_k"], data["steps"])
+
+
+def save_trace(trace, path):
+    with open(path, "w") as f:
+        json.dump({"num_experts": trace.num_experts, "top_k": trace.top_k,
+                   "steps": [s.tolist() for s in trace.steps]}, f)
+
+
+def routing_counts(ids, top_k, num_experts, world_size):
+    """(load[E], traffic[W][E]) of one step under the EP data-parallel split."""
+    n = len(ids) // top_k
+    per_rank = (n + world_size - 1) // world_size
+    traffic = [[0] * num_experts for _ in range(world_size)]
+    for r in range(world_size):
+        row = traffic[r]
+        for e in ids[min(r * per_rank, n) * top_k:min((r + 1) * per_rank, n) * top_k]:
+            row[e] += 1
+    load = [sum(traffic[r][e] for r in range(world_size)) for e in range(num_experts)]
+    return load, traffic
+
+
+def percentile(values, q):
+    s = sorted(values)
+    return s[min(len(s) - 1, max(0, int(math.ceil(q / 100.0 * len(s))) - 1))]
+
+
+def simulate(trace, world_size, topology, layer, strategy="round_robin", replan_every=1,
+             replicate_top=4, comm_weight=0.1, warmup=1):
+    """
+    Replays trace on world_size ranks. Placement strategies see only the
+    steps before the one they serve; the first `warmup` steps only feed
+    them and are not scored (all strategies start round-robin). Returns
+    {"steps": [per-step prediction], "summary": {...}}.
+    """
+    if strategy not in ("round_robin", "planned", "replicated"):
+        raise ValueError(f"unknown strategy {strategy!r}")
+    E, K, W = trace.num_experts, trace.top_k, world_size
+    planner = None
+    if strategy != "round_robin":
+        planner = PlacementPlanner(E, W, comm_weight=comm_weight, decay=0.7,
+                                   replicate_top=replicate_top if strategy == "replicated" else 0)
+    table = round_robin(E, W)
+    steps = []
+    for i, ids in enumerate(trace.steps):
+        if planner is not None:
+            replicas = planner.replicas or [[r] for r in planner.table]
+        else:
+            replicas = [[r] for r in table]
+        if i >= warmup:
+            buf = (ctypes.c_int * len(ids)).from_buffer(ids)
+            p = moe_native.simulate_step(buf, K, replicas, W, layer.as_tuple(),
+                                         topology.as_tuple())
+            p["copies"] = sum(len(c) for c in replicas)
+            steps.append(p)
+        if planner is not None:
+            planner.observe(*routing_counts(ids, K, E, W))
+            if (i + 1) % replan_every == 0:
+                planner.replan()
+    if not steps:
+        raise ValueError("trace has no steps past the warmup")
+    return {"steps": steps, "summary": summarize(steps, W)}
+
+
+def summarize(steps, world_size):
+    def dist(key):
+        v = [p[key] for p in steps]
+        return {"mean": sum(v) / len(v), "p50": percentile(v, 50), "p99": percentile(v, 99)}
+
+    imbalance = []
+    for p in steps:
+        mean = sum(p["compute_us"]) / world_size
+        imbalance.append(p["max_compute_us"] / mean if mean > 0 else 1.0)
+    n = len(steps)
+    return {"steps": n,
+            "step_us": dist("step_us"),
+            "overlap_us": dist("overlap_us"),
+            "dispatch_us": dist("dispatch_us"),
+            "combine_us": dist("combine_us"),
+            "max_compute_us": dist("max_compute_us"),
+            "compute_imbalance": sum(imbalance) / n,
+            "intra_gb": sum(p["intra_bytes"] for p in steps) / n / 1e9,
+            "inter_gb": sum(p["inter_bytes"] for p in steps) / n / 1e9,
+            "mean_copies": sum(p["copies"] for p in steps) / n}
@@ -0,0 +1,93 @@
+// Latency/bandwidth of ShmComm::alltoallv with forked ranks.
+//
+//   bench_alltoall [ranks=2,4,8] [bytes=1024,65536,1048576,4194304] [iters=50]
+//
+// Every rank sends `bytes` to every peer. Reported time is the median over
+// iterations of rank 0's wall time per collective (ranks are lined up with
+// a barrier first); GB/s counts all W*(W-1) messages.
+
+#include "fork_ranks.h"
+#include "shm_comm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+std::vector<long> parse_list(const char* s) {
+    std::vector<long> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) out.push_back(std::atol(item.c_str()));
+    return out;
+}
+
+double run(int W, size_t bytes, int iters, int run_id) {
+    // Rank 0 reports its median through a shared page
+    auto* result = static_cast<double*>(mmap(nullptr, 4096, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    *result = -1.0;
+    const std::string name =
+        "/moe_bench_" + std::to_string(getpid()) + "_" + std::to_string(run_id);
+
+    moe::fork_ranks(W, [&](int rank) {
+        moe::ShmComm comm(name, rank, W, moe::ShmComm::kDefaultRingBytes);
+        std::vector<std::vector<char>> send(W, std::vector<char>(bytes, char(rank)));
+        std::vector<std::vector<char>> recv(W, std::vector<char>(bytes));
+        std::vector<const void*> sp(W);
+        std::vector<void*> rp(W);
+        std::vector<size_t> counts(W, bytes);
+        for (int r = 0; r < W; ++r) {
+            sp[r] = send[r].data();
+            rp[r] = recv[r].data();
+        }
+        std::vector<double> us;
+        for (int it = 0; it < iters + 3; ++it) {
+            comm.barrier();
+            auto t0 = std::chrono::steady_clock::now();
+            comm.alltoallv(sp.data(), counts.data(), rp.data(), counts.data());
+            auto t1 = std::chrono::steady_clock::now();
+            if (it >= 3) us.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+        }
+        comm.barrier();
+        if (rank == 0) {
+            std::sort(us.begin(), us.end());
+            *result = us[us.size() / 2];
+        }
+        return 0;
+    });
+    double us = *result;
+    munmap(result, 4096);
+    return us;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::vector<long> ranks = parse_list(argc > 1 ? argv[1] : "2,4,8");
+    std::vector<long> sizes = parse_list(argc > 2 ? argv[2] : "1024,65536,1048576,4194304");
+    int iters = argc > 3 ? std::atoi(argv[3]) : 50;
+
+    std::printf("%6s %12s %12s %10s\n", "ranks", "bytes/peer", "us/iter", "GB/s");
+    int run_id = 0;
+    for (long W : ranks) {
+        for (long bytes : sizes) {
+            double us = run(static_cast<int>(W), static_cast<size_t>(bytes), iters, run_id++);
+            if (us < 0) {
+                std::fprintf(stderr, "run failed (ranks=%ld bytes=%ld)\n", W, bytes);
+                return 1;
+            }
+            double total = static_cast<double>(W) * (W - 1) * bytes;
+            std::printf("%6ld %12ld %12.1f %10.2f\n", W, bytes, us, total / us / 1e3);
+        }
+    }
+    return 0;
+}
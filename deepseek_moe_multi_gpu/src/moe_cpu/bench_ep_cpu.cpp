@@ -0,0 +1,200 @@
+// Strong scaling of the multi-process CPU EP runtime by rank count.
+//
+//   bench_ep_cpu [ranks=1,2,4,8] [tokens=2048] [iters=10] [wire=fp32|bf16|fp8]
+//
+// A synthetic layer (H=512, I=256, 8 routed experts, top-2, 1 shared
+// expert, seeded random weights and uniform routing) runs a fixed global
+// batch on W forked ranks with round-robin placement. Each rank uses
+// hardware_concurrency / W pool threads (at least one). Reported: median
+// over iterations of the slowest rank's forward time, throughput, speedup
+// over one rank and rank 0's phase breakdown.
+
+#include "ep_cpu.h"
+#include "fork_ranks.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kHidden = 512, kInter = 256, kExperts = 8, kTopK = 2, kShared = 1;
+
+struct Result {
+    double ms;               // median of the per-iteration slowest rank
+    moe::EpTimings phases;   // rank 0, last iteration
+};
+
+std::vector<long> parse_list(const char* s) {
+    std::vector<long> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) out.push_back(std::atol(item.c_str()));
+    return out;
+}
+
+void fill(float* p, size_t n, unsigned seed, float scale) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> u(-scale, scale);
+    for (size_t i = 0; i < n; ++i) p[i] = u(rng);
+}
+
+void fill_mlp(const ExpertWeights* w, unsigned seed) {
+    const size_t IH = static_cast<size_t>(kInter) * kHidden;
+    fill(w->gate, IH, seed * 3 + 0, 0.05f);
+    fill(w->up, IH, seed * 3 + 1, 0.05f);
+    fill(w->down, IH, seed * 3 + 2, 0.05f);
+}
+
+// Same tokens and routing on every rank; each rank uses its own slice
+void make_batch(int N, std::vector<float>& x, std::vector<int>& idx, std::vector<float>& w) {
+    x.resize(static_cast<size_t>(N) * kHidden);
+    fill(x.data(), x.size(), 12345, 1.0f);
+    idx.resize(static_cast<size_t>(N) * kTopK);
+    w.resize(idx.size());
+    std::mt19937 rng(777);
+    for (int t = 0; t < N; ++t) {
+        int a = static_cast<int>(rng() % kExperts), b = static_cast<int>(rng() % (kExperts - 1));
+        if (b >= a) ++b;
+        idx[t * kTopK] = a;
+        idx[t * kTopK + 1] = b;
+        w[t * kTopK] = 0.6f;
+        w[t * kTopK + 1] = 0.4f;
+    }
+}
+
+Result run(int W, int N, int iters, moe::WireFormat wire, int run_id) {
+    // [iters] per-rank times, then rank 0's phases
+    const size_t slots = static_cast<size_t>(iters) * W;
+    const size_t page = ((slots + 8) * sizeof(double) + 4095) & ~size_t(4095);
+    auto* shared = static_cast<double*>(
+        mmap(nullptr, page, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    std::fill(shared, shared + slots + 8, -1.0);
+    const std::string name =
+        "/moe_bench_ep_" + std::to_string(getpid()) + "_" + std::to_string(run_id);
+    const unsigned hc = std::max(1u, std::thread::hardware_concurrency());
+    const int threads = std::max(1, static_cast<int>(hc) / W);
+
+    const bool ok = moe::fork_ranks(W, [&](int rank) {
+        Meta m;
+        std::memset(&m, 0, sizeof(m));
+        m.hidden_size = kHidden;
+        m.intermediate_size = kInter;
+        m.n_routed_experts = kExperts;
+        m.n_shared_experts = kShared;
+        m.top_k = kTopK;
+        m.batch_size = 1;
+        m.seq_len = N;
+        std::vector<int> owner(kExperts);
+        for (int e = 0; e < kExperts; ++e) owner[e] = moe::round_robin_owner(e, W);
+
+        MoeLayer layer;
+        moe_layer_alloc(&layer, &m, MOE_F32);
+        for (int s = 0; s < kShared; ++s) fill_mlp(&layer.shared[s], 100 + s);
+        for (int e = 0; e < kExperts; ++e)
+            if (owner[e] == rank) fill_mlp(&layer.experts[e], e);
+
+        std::vector<float> x, w;
+        std::vector<int> idx;
+        make_batch(N, x, idx, w);
+        const int per_rank = (N + W - 1) / W;
+        const int b = std::min(rank * per_rank, N), n = std::min(b + per_rank, N) - b;
+        std::vector<float> out(static_cast<size_t>(std::max(n, 1)) * kHidden);
+
+        moe::ShmComm comm(name, rank, W);
+        {
+            moe::EpRank ep(comm, &layer, owner, N, wire, threads);
+            for (int it = -2; it < iters; ++it) {
+                comm.barrier();
+                auto t0 = std::chrono::steady_clock::now();
+                ep.forward(x.data() + static_cast<size_t>(b) * kHidden, n,
+                           idx.data() + static_cast<size_t>(b) * kTopK,
+                           w.data() + static_cast<size_t>(b) * kTopK, out.data());
+                auto t1 = std::chrono::steady_clock::now();
+                if (it >= 0)
+                    shared[static_cast<size_t>(it) * W + rank] =
+                        std::chrono::duration<double, std::milli>(t1 - t0).count();
+            }
+            if (rank == 0) {
+                const moe::EpTimings& p = ep.timings();
+                double* ph = shared + slots;
+                ph[0] = p.plan_ms;
+                ph[1] = p.dispatch_ms;
+                ph[2] = p.expert_ms;
+                ph[3] = p.shared_ms;
+                ph[4] = p.combine_ms;
+            }
+        }
+        moe_layer_free(&layer);
+        return 0;
+    });
+
+    Result res{-1.0, {}};
+    if (ok) {
+        std::vector<double> slowest(iters);
+        for (int it = 0; it < iters; ++it)
+            slowest[it] = *std::max_element(shared + static_cast<size_t>(it) * W,
+                                            shared + static_cast<size_t>(it + 1) * W);
+        std::sort(slowest.begin(), slowest.end());
+        res.ms = slowest[iters / 2];
+        const double* ph = shared + slots;
+        res.phases.plan_ms = ph[0];
+        res.phases.dispatch_ms = ph[1];
+        res.phases.expert_ms = ph[2];
+        res.phases.shared_ms = ph[3];
+        res.phases.combine_ms = ph[4];
+    }
+    munmap(shared, page);
+    return res;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::vector<long> ranks = parse_list(argc > 1 ? argv[1] : "1,2,4,8");
+    const int N = argc > 2 ? std::atoi(argv[2]) : 2048;
+    const int iters = std::max(1, argc > 3 ? std::atoi(argv[3]) : 10);
+    const char* wire_name = argc > 4 ? argv[4] : "fp32";
+    moe::WireFormat wire = moe::WireFormat::F32;
+    if (std::strcmp(wire_name, "bf16") == 0) wire = moe::WireFormat::BF16;
+    else if (std::strcmp(wire_name, "fp8") == 0) wire = moe::WireFormat::FP8_E4M3;
+    else if (std::strcmp(wire_name, "fp32") != 0) {
+        std::fprintf(stderr, "unknown wire format %s\n", wire_name);
+        return 2;
+    }
+
+    std::printf("CPU EP runtime: H=%d I=%d E=%d top-%d, %d tokens, %s wire, %u hw threads\n",
+                kHidden, kInter, kExperts, kTopK, N, wire_name,
+                std::thread::hardware_concurrency());
+    std::printf("%6s %10s %12s %8s | %7s %9s %8s %8s %8s\n", "ranks", "ms/fwd", "tok/s",
+                "speedup", "plan", "dispatch", "experts", "shared", "combine");
+    double base = 0.0;
+    int run_id = 0;
+    for (long W : ranks) {
+        if (W < 1 || W > kExperts) {
+            std::fprintf(stderr, "skipping %ld ranks (1..%d)\n", W, kExperts);
+            continue;
+        }
+        Result r = run(static_cast<int>(W), N, iters, wire, run_id++);
+        if (r.ms < 0) {
+            std::fprintf(stderr, "run failed (ranks=%ld)\n", W);
+            return 1;
+        }
+        if (base == 0.0) base = r.ms;
+        const moe::EpTimings& p = r.phases;
+        std::printf("%6ld %10.2f %12.0f %7.2fx | %7.2f %9.2f %8.2f %8.2f %8.2f\n", W, r.ms,
+                    N / r.ms * 1e3, base / r.ms, p.plan_ms, p.dispatch_ms, p.expert_ms,
+                    p.shared_ms, p.combine_ms);
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+// Flat vs two-level all-to-all on emulated nodes (HierComm).
+//
+//   bench_hier_alltoall [ranks=8] [ranks_per_node=4] [bytes=256,4096,65536,1048576]
+//                       [iters=20] [gbps=1] [message_us=100]
+//
+// Every rank sends `bytes` to every peer, the shape of an EP dispatch with
+// uniform routing (bytes = rows per peer x wire row bytes). Inter-node
+// messages pay the emulated link: message_us per message plus bytes at
+// gbps, serialized per node. Reported per mode: messages per collective
+// summed over ranks (intra / inter node), inter-node MB, and the median
+// over iterations of the slowest rank's wall time.
+
+#include "fork_ranks.h"
+#include "hier_comm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+struct Result {
+    double us = -1.0;
+    long intra_messages = 0, inter_messages = 0;
+    double inter_mb = 0.0;
+};
+
+std::vector<long> parse_list(const char* s) {
+    std::vector<long> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) out.push_back(std::atol(item.c_str()));
+    return out;
+}
+
+Result run(int W, int P, size_t bytes, int iters, moe::InterLink link, moe::HierComm::Mode mode,
+           int run_id) {
+    // [iters * W] per-rank times, then per-rank [intra msgs, inter msgs, inter bytes]
+    const size_t slots = static_cast<size_t>(iters) * W + 3 * W;
+    const size_t page = (slots * sizeof(double) + 4095) & ~size_t(4095);
+    auto* shared = static_cast<double*>(
+        mmap(nullptr, page, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    const std::string name =
+        "/moe_bench_hier_" + std::to_string(getpid()) + "_" + std::to_string(run_id);
+
+    const bool ok = moe::fork_ranks(W, [&](int rank) {
+        moe::ShmComm comm(name, rank, W);
+        moe::HierComm hier(comm, P, link, mode);
+        std::vector<std::vector<char>> send(W, std::vector<char>(bytes, char(rank)));
+        std::vector<std::vector<char>> recv(W, std::vector<char>(bytes));
+        std::vector<const void*> sp(W);
+        std::vector<void*> rp(W);
+        std::vector<size_t> counts(W, bytes);
+        for (int r = 0; r < W; ++r) {
+            sp[r] = send[r].data();
+            rp[r] = recv[r].data();
+        }
+        for (int it = -3; it < iters; ++it) {
+            comm.barrier();
+            if (it == 0) hier.reset_stats();
+            auto t0 = std::chrono::steady_clock::now();
+            hier.alltoallv(sp.data(), counts.data(), rp.data(), counts.data());
+            auto t1 = std::chrono::steady_clock::now();
+            if (it >= 0)
+                shared[static_cast<size_t>(it) * W + rank] =
+                    std::chrono::duration<double, std::micro>(t1 - t0).count();
+        }
+        double* st = shared + static_cast<size_t>(iters) * W + 3 * rank;
+        st[0] = static_cast<double>(hier.stats().intra_messages) / iters;
+        st[1] = static_cast<double>(hier.stats().inter_messages) / iters;
+        st[2] = static_cast<double>(hier.stats().inter_bytes) / iters;
+        comm.barrier();
+        return 0;
+    });
+
+    Result res;
+    if (ok) {
+        std::vector<double> slowest(iters);
+        for (int it = 0; it < iters; ++it)
+            slowest[it] = *std::max_element(shared + static_cast<size_t>(it) * W,
+                                            shared + static_cast<size_t>(it + 1) * W);
+        std::sort(slowest.begin(), slowest.end());
+        res.us = slowest[iters / 2];
+        double intra = 0, inter = 0, inter_bytes = 0;
+        for (int r = 0; r < W; ++r) {
+            const double* st = shared + static_cast<size_t>(iters) * W + 3 * r;
+            intra += st[0];
+            inter += st[1];
+            inter_bytes += st[2];
+        }
+        res.intra_messages = static_cast<long>(intra + 0.5);
+        res.inter_messages = static_cast<long>(inter + 0.5);
+        res.inter_mb = inter_bytes / 1e6;
+    }
+    munmap(shared, page);
+    return res;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const int W = argc > 1 ? std::atoi(argv[1]) : 8;
+    const int P = argc > 2 ? std::atoi(argv[2]) : 4;
+    std::vector<long> sizes = parse_list(argc > 3 ? argv[3] : "256,4096,65536,1048576");
+    const int iters = std::max(1, argc > 4 ? std::atoi(argv[4]) : 20);
+    moe::InterLink link;
+    link.gbps = argc > 5 ? std::atof(argv[5]) : 1.0;
+    link.message_us = argc > 6 ? std::atof(argv[6]) : 100.0;
+    if (W < 1 || P < 1 || W % P != 0) {
+        std::fprintf(stderr, "ranks must be a multiple of ranks_per_node\n");
+        return 2;
+    }
+
+    std::printf("%d ranks on %d emulated nodes, inter-node link %.1f GB/s + %.0f us/message\n",
+                W, W / P, link.gbps, link.message_us);
+    std::printf("%12s %6s %11s %11s %10s %12s %8s\n", "bytes/peer", "mode", "intra msgs",
+                "inter msgs", "inter MB", "us/iter", "speedup");
+    int run_id = 0;
+    for (long bytes : sizes) {
+        Result flat = run(W, P, static_cast<size_t>(bytes), iters, link,
+                          moe::HierComm::Mode::Flat, run_id++);
+        Result hier = run(W, P, static_cast<size_t>(bytes), iters, link,
+                          moe::HierComm::Mode::Hierarchical, run_id++);
+        if (flat.us < 0 || hier.us < 0) {
+            std::fprintf(stderr, "run failed (bytes=%ld)\n", bytes);
+            return 1;
+        }
+        std::printf("%12ld %6s %11ld %11ld %10.2f %12.1f %8s\n", bytes, "flat",
+                    flat.intra_messages, flat.inter_messages, flat.inter_mb, flat.us, "");
+        std::printf("%12s %6s %11ld %11ld %10.2f %12.1f %7.2fx\n", "", "2-lvl",
+                    hier.intra_messages, hier.inter_messages, hier.inter_mb, hier.us,
+                    flat.us / hier.us);
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "buffer_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace moe {
+
+namespace {
+
+constexpr size_t kAlign = 64;
+
+}  // namespace
+
+uint8_t* BufferPool::get(size_t slot, size_t bytes) {
+    if (slot >= slots_.size()) slots_.resize(slot + 1);
+    Slot& s = slots_[slot];
+    if (s.data && s.bytes >= bytes) return s.data;
+    const size_t want = std::max(bytes + bytes / 2, kAlign);
+    const size_t n = (want + kAlign - 1) / kAlign * kAlign;
+    void* p = std::aligned_alloc(kAlign, n);
+    if (!p) throw std::bad_alloc();
+    std::free(s.data);
+    s.data = static_cast<uint8_t*>(p);
+    s.bytes = n;
+    ++allocations_;
+    return s.data;
+}
+
+size_t BufferPool::total_bytes() const {
+    size_t n = 0;
+    for (const Slot& s : slots_) n += s.bytes;
+    return n;
+}
+
+void BufferPool::release() {
+    for (Slot& s : slots_) std::free(s.data);
+    slots_.clear();
+}
+
+size_t pack_offsets(const size_t* counts, int n, size_t* offsets) {
+    size_t at = 0;
+    for (int i = 0; i < n; ++i) {
+        offsets[i] = at;
+        at += counts[i];
+    }
+    return at;
+}
+
+}  // namespace moe
@@ -0,0 +1,46 @@
+#pragma once
+// Reusable byte buffers for per-step collectives.
+//
+// A BufferPool holds numbered slots that only grow. get(slot, n) returns
+// at least n bytes, reallocating only when the slot is too small (to 1.5x
+// the request, 64-byte aligned), so once a step has reached its high-water
+// mark the following steps allocate nothing. Contents are not preserved
+// when a slot grows.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace moe {
+
+class BufferPool {
+public:
+    BufferPool() = default;
+    ~BufferPool() { release(); }
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    uint8_t* get(size_t slot, size_t bytes);
+
+    size_t capacity(size_t slot) const {
+        return slot < slots_.size() ? slots_[slot].bytes : 0;
+    }
+    size_t total_bytes() const;
+    long allocations() const { return allocations_; }   // growths since construction
+
+    void release();
+
+private:
+    struct Slot {
+        uint8_t* data = nullptr;
+        size_t bytes = 0;
+    };
+    std::vector<Slot> slots_;
+    long allocations_ = 0;
+};
+
+// Exclusive prefix sum: offsets[r] = counts[0] + ... + counts[r-1];
+// returns the total. The layout of a contiguous all-to-all-v buffer.
+size_t pack_offsets(const size_t* counts, int n, size_t* offsets);
+
+}  // namespace moe
@@ -0,0 +1,261 @@
+// extern "C" wrappers over the C++ library; exceptions stop here.
+
+#include "moe_native.h"
+#include "dispatch.h"
+#include "ep_sim.h"
+#include "placement.h"
+#include "shm_comm.h"
+#include "wire.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct moe_plan {
+    moe::DispatchPlan plan;
+};
+
+struct moe_comm {
+    moe::ShmComm comm;
+};
+
+namespace {
+
+thread_local std::string g_last_error;
+
+template <class F>
+int guarded(F&& f) {
+    try {
+        f();
+        return 0;
+    } catch (const std::exception& e) {
+        g_last_error = e.what();
+    } catch (...) {
+        g_last_error = "unknown error";
+    }
+    return -1;
+}
+
+// Validated ReplicaTable from the CSR arrays of the C API
+moe::ReplicaTable replica_table(int num_experts, int world_size, const int* offsets,
+                                const int* ranks) {
+    if (num_experts <= 0 || world_size <= 0 || offsets[0] != 0)
+        throw std::invalid_argument("replicas: bad shape");
+    moe::ReplicaTable t;
+    t.num_experts = num_experts;
+    t.world_size = world_size;
+    t.offsets.assign(offsets, offsets + num_experts + 1);
+    for (int e = 0; e < num_experts; ++e) {
+        if (t.copies(e) < 1 || t.copies(e) > world_size)
+            throw std::invalid_argument("replicas: expert " + std::to_string(e) +
+                                        " needs 1.." + std::to_string(world_size) + " copies");
+        for (int v = offsets[e]; v < offsets[e + 1]; ++v) {
+            if (ranks[v] < 0 || ranks[v] >= world_size)
+                throw std::invalid_argument("replicas: rank " + std::to_string(ranks[v]) +
+                                            " out of range");
+            for (int u = offsets[e]; u < v; ++u)
+                if (ranks[u] == ranks[v])
+                    throw std::invalid_argument("replicas: expert " + std::to_string(e) +
+                                                " listed twice on rank " + std::to_string(ranks[v]));
+        }
+    }
+    t.ranks.assign(ranks, ranks + offsets[num_experts]);
+    return t;
+}
+
+}  // namespace
+
+extern "C" {
+
+const char* moe_last_error(void) { return g_last_error.c_str(); }
+
+moe_plan* moe_plan_create(void) {
+    try {
+        return new moe_plan();
+    } catch (...) {
+        g_last_error = "out of memory";
+        return nullptr;
+    }
+}
+
+void moe_plan_destroy(moe_plan* plan) { delete plan; }
+
+int moe_plan_build(moe_plan* plan, const int* topk_idx, const float* topk_w,
+                   int num_tokens, int top_k, int num_experts,
+                   const int* expert_to_rank, int world_size, int num_threads) {
+    return guarded([&] {
+        moe::build_plan(topk_idx, topk_w, num_tokens, top_k, num_experts, expert_to_rank,
+                        world_size, plan->plan, num_threads);
+    });
+}
+
+int moe_plan_num_rows(const moe_plan* plan) { return plan->plan.num_rows(); }
+const int* moe_plan_expert_rank(const moe_plan* plan) { return plan->plan.expert_rank.data(); }
+const int* moe_plan_expert_begin(const moe_plan* plan) { return plan->plan.expert_begin.data(); }
+const int* moe_plan_expert_count(const moe_plan* plan) { return plan->plan.expert_count.data(); }
+const int* moe_plan_rank_offsets(const moe_plan* plan) { return plan->plan.rank_offsets.data(); }
+const int* moe_plan_row_token(const moe_plan* plan) { return plan->plan.row_token.data(); }
+const int* moe_plan_row_expert(const moe_plan* plan) { return plan->plan.row_expert.data(); }
+const float* moe_plan_row_weight(const moe_plan* plan) { return plan->plan.row_weight.data(); }
+const int* moe_plan_slot_row(const moe_plan* plan) { return plan->plan.slot_row.data(); }
+
+int moe_gather(const moe_plan* plan, const float* x, int hidden, float* rows, int num_threads) {
+    return guarded([&] { moe::gather(plan->plan, x, hidden, rows, num_threads); });
+}
+
+int moe_scatter_weighted(const moe_plan* plan, const float* rows, int hidden, float* out,
+                         int accumulate, int use_weights, int num_threads) {
+    return guarded([&] {
+        moe::scatter_weighted(plan->plan, rows, hidden, out, accumulate != 0, use_weights != 0,
+                              num_threads);
+    });
+}
+
+int moe_place_experts(const double* load, int num_experts, int world_size,
+                      const double* traffic, double comm_weight, int max_experts_per_rank,
+                      int* expert_to_rank) {
+    return guarded([&] {
+        moe::PlacementOptions opts;
+        opts.comm_weight = comm_weight;
+        opts.max_experts_per_rank = max_experts_per_rank;
+        std::vector<int> owner = moe::plan_placement(load, num_experts, world_size, traffic, opts);
+        std::copy(owner.begin(), owner.end(), expert_to_rank);
+    });
+}
+
+int moe_placement_stats(const double* load, int num_experts, int world_size,
+                        const double* traffic, const int* expert_to_rank, double comm_weight,
+                        double* stats) {
+    return guarded([&] {
+        moe::PlacementStats s = moe::evaluate_placement(load, num_experts, world_size, traffic,
+                                                        expert_to_rank, comm_weight);
+        stats[0] = s.max_cost;
+        stats[1] = s.mean_cost;
+        stats[2] = s.max_load;
+        stats[3] = s.remote;
+    });
+}
+
+int moe_plan_replicas(const double* load, int num_experts, int world_size,
+                      const double* traffic, const int* expert_to_rank, int max_replicated,
+                      int max_copies, double comm_weight, int* offsets, int* ranks) {
+    return guarded([&] {
+        moe::ReplicaTable t = moe::plan_replicas(load, num_experts, world_size, traffic,
+                                                 expert_to_rank, max_replicated, max_copies,
+                                                 comm_weight);
+        std::copy(t.offsets.begin(), t.offsets.end(), offsets);
+        std::copy(t.ranks.begin(), t.ranks.end(), ranks);
+    });
+}
+
+int moe_replica_stats(const double* load, int num_experts, int world_size,
+                      const double* traffic, const int* offsets, const int* ranks,
+                      double comm_weight, double* stats) {
+    return guarded([&] {
+        moe::PlacementStats s = moe::evaluate_replicas(
+            load, traffic, replica_table(num_experts, world_size, offsets, ranks), comm_weight);
+        stats[0] = s.max_cost;
+        stats[1] = s.mean_cost;
+        stats[2] = s.max_load;
+        stats[3] = s.remote;
+    });
+}
+
+int moe_assign_replicas(const int* topk_idx, int num_tokens, int top_k, int num_experts,
+                        int world_size, const int* offsets, const int* ranks, int source_rank,
+                        int* virtual_idx) {
+    return guarded([&] {
+        moe::assign_replicas(topk_idx, num_tokens, top_k,
+                             replica_table(num_experts, world_size, offsets, ranks), source_rank,
+                             virtual_idx);
+    });
+}
+
+long moe_wire_row_bytes(int fmt, int hidden) {
+    long n = -1;
+    guarded([&] {
+        n = static_cast<long>(moe::wire_row_bytes(static_cast<moe::WireFormat>(fmt), hidden));
+    });
+    return n;
+}
+
+int moe_encode_rows(const float* x, long rows, int hidden, int fmt, void* out,
+                    int num_threads) {
+    return guarded([&] {
+        moe::encode_rows(x, rows, hidden, static_cast<moe::WireFormat>(fmt),
+                         static_cast<uint8_t*>(out), num_threads);
+    });
+}
+
+int moe_decode_rows(const void* in, long rows, int hidden, int fmt, float* out,
+                    int num_threads) {
+    return guarded([&] {
+        moe::decode_rows(static_cast<const uint8_t*>(in), rows, hidden,
+                         static_cast<moe::WireFormat>(fmt), out, num_threads);
+    });
+}
+
+int moe_simulate_step(const int* topk_idx, int num_tokens, int top_k, int num_experts,
+                      int world_size, const int* offsets, const int* ranks,
+                      const double* layer, const double* topology, long* send_rows,
+                      double* compute_us, double* stats, int num_threads) {
+    return guarded([&] {
+        moe::LayerShape shape;
+        shape.hidden = static_cast<int>(layer[0]);
+        shape.intermediate = static_cast<int>(layer[1]);
+        shape.shared_intermediate = static_cast<int>(layer[2]);
+        shape.wire = static_cast<moe::WireFormat>(static_cast<int>(layer[3]));
+        shape.rank_tflops = layer[4];
+        moe::Topology topo;
+        topo.world_size = world_size;
+        topo.ranks_per_node = static_cast<int>(topology[0]);
+        topo.intra_gbps = topology[1];
+        topo.intra_latency_us = topology[2];
+        topo.inter_gbps = topology[3];
+        topo.inter_latency_us = topology[4];
+
+        moe::StepPrediction p;
+        moe::simulate_step(topk_idx, num_tokens, top_k,
+                           replica_table(num_experts, world_size, offsets, ranks), shape, topo,
+                           p, num_threads);
+        std::copy(p.send_rows.begin(), p.send_rows.end(), send_rows);
+        std::copy(p.compute_us.begin(), p.compute_us.end(), compute_us);
+        const double s[8] = {p.dispatch_us, p.combine_us, p.max_compute_us, p.step_us,
+                             p.overlap_us,  p.intra_bytes, p.inter_bytes, 0.0};
+        std::copy(s, s + 8, stats);
+    });
+}
+
+moe_comm* moe_comm_create(const char* name, int rank, int world_size, size_t ring_bytes,
+                          double timeout_s) {
+    moe_comm* comm = nullptr;
+    guarded([&] {
+        comm = new moe_comm{moe::ShmComm(name, rank, world_size,
+                                         ring_bytes ? ring_bytes : moe::ShmComm::kDefaultRingBytes,
+                                         timeout_s)};
+    });
+    return comm;
+}
+
+void moe_comm_destroy(moe_comm* comm) { delete comm; }
+
+int moe_comm_alltoallv(moe_comm* comm, const void* const* send, const size_t* send_bytes,
+                       void* const* recv, const size_t* recv_bytes) {
+    return guarded([&] { comm->comm.alltoallv(send, send_bytes, recv, recv_bytes); });
+}
+
+int moe_comm_alltoallv_offsets(moe_comm* comm, const void* send, const size_t* send_bytes,
+                               const size_t* send_offsets, void* recv, const size_t* recv_bytes,
+                               const size_t* recv_offsets) {
+    return guarded([&] {
+        comm->comm.alltoallv(send, send_bytes, send_offsets, recv, recv_bytes, recv_offsets);
+    });
+}
+
+int moe_comm_barrier(moe_comm* comm) {
+    return guarded([&] { comm->comm.barrier(); });
+}
+
+}  // extern "C"
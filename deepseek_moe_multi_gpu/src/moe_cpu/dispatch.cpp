@@ -0,0 +1,179 @@
+#include "dispatch.h"
+#include "parallel.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace moe {
+
+namespace {
+
+constexpr long kPlanGrain = 4096;     // tokens per histogram chunk
+constexpr long kRowGrain = 256;       // rows per gather/scatter chunk
+
+int resolve_threads(int num_threads) {
+    return num_threads > 0 ? num_threads : default_threads();
+}
+
+// o[h] += w * y[h]; __restrict lets the compiler vectorize over H.
+inline void axpy(float* __restrict o, const float* __restrict y, float w, int hidden) {
+    for (int h = 0; h < hidden; ++h) o[h] += w * y[h];
+}
+
+}  // namespace
+
+void build_plan(const int* topk_idx, const float* topk_w, int num_tokens, int top_k,
+                int num_experts, const int* expert_to_rank, int world_size,
+                DispatchPlan& plan, int num_threads) {
+    if (num_tokens < 0 || top_k <= 0 || num_experts <= 0 || world_size <= 0)
+        throw std::invalid_argument("build_plan: bad shape");
+
+    const int N = num_tokens, K = top_k, E = num_experts, W = world_size;
+    plan.num_tokens = N;
+    plan.top_k = K;
+    plan.num_experts = E;
+    plan.world_size = W;
+
+    plan.expert_rank.resize(E);
+    for (int e = 0; e < E; ++e) {
+        int r = expert_to_rank ? expert_to_rank[e] : round_robin_owner(e, W);
+        if (r < 0 || r >= W)
+            throw std::invalid_argument("build_plan: expert " + std::to_string(e) +
+                                        " mapped to rank " + std::to_string(r));
+        plan.expert_rank[e] = r;
+    }
+
+    // Buckets are experts ordered by (rank, expert id)
+    std::vector<int> bucket_of(E), rank_begin(W + 1, 0);
+    for (int e = 0; e < E; ++e) rank_begin[plan.expert_rank[e] + 1]++;
+    for (int r = 0; r < W; ++r) rank_begin[r + 1] += rank_begin[r];
+    {
+        std::vector<int> next(rank_begin.begin(), rank_begin.end() - 1);
+        for (int e = 0; e < E; ++e) bucket_of[e] = next[plan.expert_rank[e]]++;
+    }
+
+    const int chunks = num_chunks(N, resolve_threads(num_threads), kPlanGrain);
+    std::vector<int> hist(static_cast<size_t>(chunks) * E, 0);
+    std::vector<char> bad(chunks, 0);
+    std::vector<int> bad_index(chunks, 0);
+
+    parallel_chunks(N, chunks, [&](long b, long e, int c) {
+        int* h = hist.data() + static_cast<size_t>(c) * E;
+        for (long i = b * K; i < e * K; ++i) {
+            int x = topk_idx[i];
+            if (x < 0 || x >= E) {
+                bad[c] = 1;
+                bad_index[c] = x;
+                return;
+            }
+            h[bucket_of[x]]++;
+        }
+    });
+    for (int c = 0; c < chunks; ++c)
+        if (bad[c])
+            throw std::invalid_argument("build_plan: expert index " +
+                                        std::to_string(bad_index[c]) + " out of range");
+
+    // Exclusive scan in (bucket, chunk) order: chunk c's rows of a bucket
+    // follow chunk c-1's, which keeps the sort stable for any chunking.
+    std::vector<int> start(hist.size());
+    std::vector<int> bucket_begin(E + 1, 0);
+    int running = 0;
+    for (int bk = 0; bk < E; ++bk) {
+        bucket_begin[bk] = running;
+        for (int c = 0; c < chunks; ++c) {
+            start[static_cast<size_t>(c) * E + bk] = running;
+            running += hist[static_cast<size_t>(c) * E + bk];
+        }
+    }
+    bucket_begin[E] = running;
+
+    const int R = N * K;
+    plan.row_token.resize(R);
+    plan.row_expert.resize(R);
+    plan.row_weight.resize(R);
+    plan.slot_row.resize(R);
+
+    parallel_chunks(N, chunks, [&](long b, long e, int c) {
+        int* cursor = start.data() + static_cast<size_t>(c) * E;
+        for (long i = b * K; i < e * K; ++i) {
+            int x = topk_idx[i];
+            int r = cursor[bucket_of[x]]++;
+            plan.row_token[r] = static_cast<int>(i / K);
+            plan.row_expert[r] = x;
+            plan.row_weight[r] = topk_w ? topk_w[i] : 1.0f;
+            plan.slot_row[i] = r;
+        }
+    });
+
+    plan.expert_begin.resize(E);
+    plan.expert_count.resize(E);
+    plan.rank_offsets.assign(W + 1, 0);
+    for (int e = 0; e < E; ++e) {
+        int bk = bucket_of[e];
+        plan.expert_begin[e] = bucket_begin[bk];
+        plan.expert_count[e] = bucket_begin[bk + 1] - bucket_begin[bk];
+        plan.rank_offsets[plan.expert_rank[e] + 1] += plan.expert_count[e];
+    }
+    for (int r = 0; r < W; ++r) plan.rank_offsets[r + 1] += plan.rank_offsets[r];
+}
+
+void assign_replicas(const int* topk_idx, int num_tokens, int top_k, const ReplicaTable& table,
+                     int source_rank, int* virtual_idx) {
+    const int E = table.num_experts;
+    if (source_rank < 0 || source_rank >= table.world_size)
+        throw std::invalid_argument("assign_replicas: bad source rank");
+
+    // Local copy of each expert on this rank, or -1
+    std::vector<int> local(E, -1), next(E, 0);
+    for (int e = 0; e < E; ++e) {
+        for (int v = table.offsets[e]; v < table.offsets[e + 1]; ++v)
+            if (table.ranks[v] == source_rank) local[e] = v;
+        next[e] = source_rank % table.copies(e);
+    }
+
+    const long R = static_cast<long>(num_tokens) * top_k;
+    for (long i = 0; i < R; ++i) {
+        const int e = topk_idx[i];
+        if (e < 0 || e >= E)
+            throw std::invalid_argument("assign_replicas: expert index " + std::to_string(e) +
+                                        " out of range");
+        if (local[e] >= 0) {
+            virtual_idx[i] = local[e];
+        } else {
+            virtual_idx[i] = table.offsets[e] + next[e];
+            if (++next[e] == table.copies(e)) next[e] = 0;
+        }
+    }
+}
+
+void gather(const DispatchPlan& plan, const float* x, int hidden, float* rows,
+            int num_threads) {
+    const size_t row_bytes = static_cast<size_t>(hidden) * sizeof(float);
+    parallel_for(plan.num_rows(), resolve_threads(num_threads), kRowGrain,
+                 [&](long b, long e, int) {
+        for (long r = b; r < e; ++r)
+            std::memcpy(rows + r * hidden,
+                        x + static_cast<size_t>(plan.row_token[r]) * hidden, row_bytes);
+    });
+}
+
+void scatter_weighted(const DispatchPlan& plan, const float* rows, int hidden, float* out,
+                      bool accumulate, bool use_weights, int num_threads) {
+    const int K = plan.top_k;
+    parallel_for(plan.num_tokens, resolve_threads(num_threads), kRowGrain / K + 1,
+                 [&](long b, long e, int) {
+        for (long n = b; n < e; ++n) {
+            float* o = out + n * hidden;
+            if (!accumulate) std::memset(o, 0, static_cast<size_t>(hidden) * sizeof(float));
+            for (int k = 0; k < K; ++k) {
+                int r = plan.slot_row[n * K + k];
+                float w = use_weights ? plan.row_weight[r] : 1.0f;
+                axpy(o, rows + static_cast<size_t>(r) * hidden, w, hidden);
+            }
+        }
+    });
+}
+
+}  // namespace moe
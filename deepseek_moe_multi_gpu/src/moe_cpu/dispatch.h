@@ -0,0 +1,70 @@
+#pragma once
+// Token permutation for expert-parallel MoE.
+//
+// A DispatchPlan counting-sorts the N*K (token, k) pairs of a top-k
+// routing by (owner rank, expert). Rows of one expert are contiguous, and
+// so are all rows bound for one rank, which makes the send buffer for
+// rank r the slice [rank_offsets[r], rank_offsets[r+1]) of the gathered
+// activations. Within an expert, rows keep ascending (token, k) order.
+//
+//   gather          : x[N, H]        -> rows[R, H]  (rows[r] = x[row_token[r]])
+//   scatter_weighted: rows[R, H], w  -> out[N, H]   (out[n] += sum_k w * rows[slot_row[n*K+k]])
+//
+// Both are parallel over rows/tokens with a fixed partition; the scatter
+// sums each token's K rows in k order, so results do not depend on the
+// thread count.
+
+#include "placement.h"
+
+#include <vector>
+
+namespace moe {
+
+struct DispatchPlan {
+    int num_tokens = 0;
+    int top_k = 0;
+    int num_experts = 0;
+    int world_size = 1;
+
+    std::vector<int> expert_rank;    // [E] owner rank of each expert
+    std::vector<int> expert_begin;   // [E] first row of expert e
+    std::vector<int> expert_count;   // [E] rows of expert e
+    std::vector<int> rank_offsets;   // [W + 1] rows bound for rank r
+    std::vector<int> row_token;      // [R] source token of row r
+    std::vector<int> row_expert;     // [R]
+    std::vector<float> row_weight;   // [R] routing weight (1.0 if none given)
+    std::vector<int> slot_row;       // [N * K] row of pair (n, k)
+
+    int num_rows() const { return num_tokens * top_k; }
+};
+
+// Owner of expert e when no placement table is given.
+inline int round_robin_owner(int e, int world_size) { return e % world_size; }
+
+// Builds plan from topk_idx[N, K] (and optional topk_w[N, K]).
+// expert_to_rank[E] may be null (round-robin). Throws std::invalid_argument
+// on out-of-range expert ids or ranks. num_threads <= 0 uses default_threads().
+void build_plan(const int* topk_idx, const float* topk_w, int num_tokens, int top_k,
+                int num_experts, const int* expert_to_rank, int world_size,
+                DispatchPlan& plan, int num_threads = 0);
+
+// Replicated experts: rewrites topk_idx[N, K] of source_rank's tokens to
+// virtual expert ids of table (positions in table.ranks). A token goes to
+// the copy on its own rank when there is one; the other tokens of an
+// expert take its copies in turn, starting at an offset of source_rank so
+// different sources do not all start on the same copy. Feed the result
+// to build_plan with table.num_virtual() experts and table.ranks as
+// expert_to_rank.
+void assign_replicas(const int* topk_idx, int num_tokens, int top_k, const ReplicaTable& table,
+                     int source_rank, int* virtual_idx);
+
+// rows[r, :] = x[row_token[r], :]
+void gather(const DispatchPlan& plan, const float* x, int hidden, float* rows,
+            int num_threads = 0);
+
+// out[n, :] (+)= sum_k w(n, k) * rows[slot_row[n*K + k], :]; w is row_weight,
+// or 1 when use_weights is false. accumulate=false overwrites out.
+void scatter_weighted(const DispatchPlan& plan, const float* rows, int hidden, float* out,
+                      bool accumulate, bool use_weights = true, int num_threads = 0);
+
+}  // namespace moe
@@ -0,0 +1,212 @@
+#include "ep_cpu.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace moe {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ms_since(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+void load_matrix(const std::string& path, float* dst, size_t n) {
+    read_f32_into(path.c_str(), dst, n);
+}
+
+void load_mlp(const std::string& dir, const std::string& prefix, const ExpertWeights* w,
+              size_t IH) {
+    load_matrix(dir + "/" + prefix + "_gate.bin", w->gate, IH);
+    load_matrix(dir + "/" + prefix + "_up.bin", w->up, IH);
+    load_matrix(dir + "/" + prefix + "_down.bin", w->down, IH);
+}
+
+}  // namespace
+
+void load_owned(MoeLayer* layer, const Meta* meta, const std::string& dir,
+                const std::vector<int>& expert_to_rank, int rank) {
+    moe_layer_alloc(layer, meta, MOE_F32);
+    const size_t IH = static_cast<size_t>(meta->intermediate_size) * meta->hidden_size;
+    load_matrix(dir + "/router_weight.bin", layer->router,
+                static_cast<size_t>(meta->n_routed_experts) * meta->hidden_size);
+    for (int s = 0; s < meta->n_shared_experts; ++s)
+        load_mlp(dir, "shared_" + std::to_string(s), &layer->shared[s], IH);
+    for (int e = 0; e < meta->n_routed_experts; ++e)
+        if (expert_to_rank[e] == rank)
+            load_mlp(dir, "expert_" + std::to_string(e), &layer->experts[e], IH);
+}
+
+EpRank::EpRank(ShmComm& comm, const MoeLayer* layer, std::vector<int> expert_to_rank,
+               int max_tokens, WireFormat wire, int num_threads)
+    : comm_(comm),
+      layer_(layer),
+      expert_to_rank_(std::move(expert_to_rank)),
+      wire_(wire),
+      num_threads_(num_threads) {
+    const Meta& m = layer->meta;
+    const int W = comm.world_size();
+    if (static_cast<int>(expert_to_rank_.size()) != m.n_routed_experts)
+        throw std::invalid_argument("EpRank: expert_to_rank must have one entry per expert");
+    for (int r : expert_to_rank_)
+        if (r < 0 || r >= W) throw std::invalid_argument("EpRank: owner rank out of range");
+    if (layer->precision != MOE_F32)
+        throw std::invalid_argument("EpRank: fp32 layers only");
+    wire_row_bytes(wire, m.hidden_size);  // validates the format
+    moe_workspace_init(&ws_, &m, std::max(max_tokens, 1), num_threads);
+    send_counts_.resize(W);
+    recv_counts_.resize(W);
+    count_bytes_.assign(W, sizeof(int));
+    count_offsets_.resize(W);
+    pack_offsets(count_bytes_.data(), W, count_offsets_.data());
+    send_bytes_.resize(W);
+    send_offsets_.resize(W);
+    recv_bytes_.resize(W);
+    recv_offsets_.resize(W);
+}
+
+EpRank::EpRank(HierComm& comm, const MoeLayer* layer, std::vector<int> expert_to_rank,
+               int max_tokens, WireFormat wire, int num_threads)
+    : EpRank(comm.comm(), layer, std::move(expert_to_rank), max_tokens, wire, num_threads) {
+    hier_ = &comm;
+}
+
+EpRank::~EpRank() { moe_workspace_free(&ws_); }
+
+void EpRank::alltoallv(const void* send, const size_t* send_bytes, const size_t* send_offsets,
+                       void* recv, const size_t* recv_bytes, const size_t* recv_offsets) {
+    if (hier_)
+        hier_->alltoallv(send, send_bytes, send_offsets, recv, recv_bytes, recv_offsets);
+    else
+        comm_.alltoallv(send, send_bytes, send_offsets, recv, recv_bytes, recv_offsets);
+}
+
+// moe_rows_forward takes up to max_tokens * (NS + K) + E rows; a skewed
+// step may receive more routed rows than the initial batch bound allows
+void EpRank::reserve_rows(int rows) {
+    const Meta& m = layer_->meta;
+    const long slots = m.n_shared_experts + m.top_k;
+    if (rows <= ws_.max_tokens * slots + m.n_routed_experts) return;
+    const int tokens = std::max(ws_.max_tokens * 2, static_cast<int>((rows + slots - 1) / slots));
+    moe_workspace_free(&ws_);
+    moe_workspace_init(&ws_, &m, tokens, num_threads_);
+}
+
+void EpRank::forward(const float* x, int num_tokens, const int* topk_idx, const float* topk_w,
+                     float* out) {
+    enum : size_t { kSendSlot = 0, kRecvSlot = 1 };
+    const Meta& m = layer_->meta;
+    const int W = comm_.world_size(), H = m.hidden_size, K = m.top_k, E = m.n_routed_experts;
+    const int NS = m.n_shared_experts, n = num_tokens;
+    const size_t row_bytes = wire_row_bytes(wire_, H);
+    timings_ = EpTimings{};
+
+    // ---- Plan, gather, exchange the exact row counts ----
+    auto t0 = Clock::now();
+    build_plan(topk_idx, topk_w, n, K, E, expert_to_rank_.data(), W, plan_, num_threads_);
+    const int R = plan_.num_rows();
+    rows_.resize(static_cast<size_t>(R) * H);
+    gather(plan_, x, H, rows_.data(), num_threads_);
+
+    for (int d = 0; d < W; ++d)
+        send_counts_[d] = plan_.rank_offsets[d + 1] - plan_.rank_offsets[d];
+    alltoallv(send_counts_.data(), count_bytes_.data(), count_offsets_.data(),
+              recv_counts_.data(), count_bytes_.data(), count_offsets_.data());
+    timings_.plan_ms = ms_since(t0);
+
+    // ---- Dispatch: [int32 expert ids | encoded rows] per peer, back to back ----
+    t0 = Clock::now();
+    const size_t msg_row = sizeof(int) + row_bytes;
+    int recv_total = 0;
+    for (int r = 0; r < W; ++r) {
+        send_bytes_[r] = static_cast<size_t>(send_counts_[r]) * msg_row;
+        recv_bytes_[r] = static_cast<size_t>(recv_counts_[r]) * msg_row;
+        recv_total += recv_counts_[r];
+    }
+    uint8_t* sbuf = pool_.get(kSendSlot, pack_offsets(send_bytes_.data(), W, send_offsets_.data()));
+    uint8_t* rbuf = pool_.get(kRecvSlot, pack_offsets(recv_bytes_.data(), W, recv_offsets_.data()));
+    for (int d = 0; d < W; ++d) {
+        const int b = plan_.rank_offsets[d], c = send_counts_[d];
+        uint8_t* msg = sbuf + send_offsets_[d];
+        std::memcpy(msg, plan_.row_expert.data() + b, static_cast<size_t>(c) * sizeof(int));
+        encode_rows(rows_.data() + static_cast<size_t>(b) * H, c, H, wire_,
+                    msg + static_cast<size_t>(c) * sizeof(int), num_threads_);
+    }
+    alltoallv(sbuf, send_bytes_.data(), send_offsets_.data(), rbuf, recv_bytes_.data(),
+              recv_offsets_.data());
+
+    recv_rows_.resize(static_cast<size_t>(recv_total) * H);
+    recv_vexpert_.resize(recv_total);
+    for (int s = 0, at = 0; s < W; at += recv_counts_[s], ++s) {
+        const int c = recv_counts_[s];
+        const uint8_t* msg = rbuf + recv_offsets_[s];
+        std::memcpy(recv_vexpert_.data() + at, msg, static_cast<size_t>(c) * sizeof(int));
+        for (int i = at; i < at + c; ++i) {
+            const int e = recv_vexpert_[i];
+            if (e < 0 || e >= E || !owns(e))
+                throw std::runtime_error("EpRank: received a row for expert " +
+                                         std::to_string(e) + " not owned by rank " +
+                                         std::to_string(comm_.rank()));
+            recv_vexpert_[i] = NS + e;
+        }
+        decode_rows(msg + static_cast<size_t>(c) * sizeof(int), c, H, wire_,
+                    recv_rows_.data() + static_cast<size_t>(at) * H, num_threads_);
+    }
+    timings_.dispatch_ms = ms_since(t0);
+
+    // ---- Owned experts on every received row ----
+    t0 = Clock::now();
+    reserve_rows(std::max(recv_total, n * NS));
+    expert_out_.resize(recv_rows_.size());
+    moe_rows_forward(layer_, &ws_, recv_rows_.data(), recv_total, nullptr,
+                     recv_vexpert_.data(), expert_out_.data());
+    timings_.expert_ms = ms_since(t0);
+
+    // ---- Combine: output rows back to their source, in received order.
+    // The replies land in plan order, so the receive buffer is the R rows.
+    t0 = Clock::now();
+    for (int r = 0; r < W; ++r) {
+        send_bytes_[r] = static_cast<size_t>(recv_counts_[r]) * row_bytes;
+        recv_bytes_[r] = static_cast<size_t>(send_counts_[r]) * row_bytes;
+    }
+    sbuf = pool_.get(kSendSlot, pack_offsets(send_bytes_.data(), W, send_offsets_.data()));
+    rbuf = pool_.get(kRecvSlot, pack_offsets(recv_bytes_.data(), W, recv_offsets_.data()));
+    encode_rows(expert_out_.data(), recv_total, H, wire_, sbuf, num_threads_);
+    alltoallv(sbuf, send_bytes_.data(), send_offsets_.data(), rbuf, recv_bytes_.data(),
+              recv_offsets_.data());
+    back_rows_.resize(static_cast<size_t>(R) * H);
+    decode_rows(rbuf, R, H, wire_, back_rows_.data(), num_threads_);
+    timings_.combine_ms = ms_since(t0);
+
+    // ---- Residual + shared experts, then the weighted routed rows ----
+    t0 = Clock::now();
+    shared_token_.resize(static_cast<size_t>(n) * NS);
+    shared_vexpert_.resize(shared_token_.size());
+    for (int t = 0; t < n; ++t)
+        for (int s = 0; s < NS; ++s) {
+            shared_token_[static_cast<size_t>(t) * NS + s] = t;
+            shared_vexpert_[static_cast<size_t>(t) * NS + s] = s;
+        }
+    shared_out_.resize(shared_token_.size() * H);
+    moe_rows_forward(layer_, &ws_, x, n * NS, shared_token_.data(), shared_vexpert_.data(),
+                     shared_out_.data());
+    for (int t = 0; t < n; ++t) {
+        float* o = out + static_cast<size_t>(t) * H;
+        std::memcpy(o, x + static_cast<size_t>(t) * H, static_cast<size_t>(H) * sizeof(float));
+        for (int s = 0; s < NS; ++s) {
+            const float* y = shared_out_.data() + (static_cast<size_t>(t) * NS + s) * H;
+            for (int h = 0; h < H; ++h) o[h] += y[h];
+        }
+    }
+    timings_.shared_ms = ms_since(t0);
+
+    t0 = Clock::now();
+    scatter_weighted(plan_, back_rows_.data(), H, out, true, true, num_threads_);
+    timings_.combine_ms += ms_since(t0);
+}
+
+}  // namespace moe
@@ -0,0 +1,103 @@
+#pragma once
+// Expert-parallel MoE forward on CPU, one process per rank.
+//
+// Same algorithm as moe_ep_distributed.py and moe_cuda/main.cu, with a
+// real all-to-all between ranks (ShmComm) in place of NCCL:
+//
+//   1. DP: each rank holds a contiguous slice of ceil(N / W) tokens
+//   2. build_plan sorts the slice's (token, k) pairs by (owner, expert)
+//      and gather packs the rows; the exact per-peer row counts are
+//      exchanged
+//   3. dispatch: rank s sends rank d the int32 expert ids of its rows,
+//      then the rows in the chosen wire format (wire.h). All peers'
+//      messages sit back to back in one pooled send buffer and arrive in
+//      one pooled receive buffer, each exactly sized (offset-addressed
+//      all-to-all-v)
+//   4. every rank runs its owned experts on all rows it received, through
+//      the grouped CPU kernels of the assignment runner
+//      (deepseek_moe_assignment/src/moe_cpu.h, moe_rows_forward)
+//   5. combine: the output rows go back in received order;
+//      out = x + shared experts + scatter_weighted(rows)
+//
+// Every rank loads the shared experts and only the routed experts it owns.
+// Built on a HierComm, the count exchange, dispatch and combine go through
+// its two-level all-to-all instead (emulated nodes, hier_comm.h).
+
+#include "buffer_pool.h"
+#include "dispatch.h"
+#include "hier_comm.h"
+#include "shm_comm.h"
+#include "wire.h"
+
+extern "C" {
+#include "moe_cpu.h"
+}
+
+#include <string>
+#include <vector>
+
+namespace moe {
+
+struct EpTimings {
+    double plan_ms = 0.0;       // build_plan, gather, count exchange
+    double dispatch_ms = 0.0;   // encode, all-to-all, decode
+    double expert_ms = 0.0;     // owned routed experts
+    double shared_ms = 0.0;
+    double combine_ms = 0.0;    // encode, all-to-all, decode, scatter
+};
+
+class EpRank {
+public:
+    // expert_to_rank: [E] owner of each routed expert. The layer must hold
+    // the shared experts and the experts this rank owns (load_owned);
+    // max_tokens sizes the expert workspace up front (a global batch). A
+    // step that receives more rows grows it instead of failing.
+    EpRank(ShmComm& comm, const MoeLayer* layer, std::vector<int> expert_to_rank,
+           int max_tokens, WireFormat wire = WireFormat::F32, int num_threads = 0);
+    EpRank(HierComm& comm, const MoeLayer* layer, std::vector<int> expert_to_rank,
+           int max_tokens, WireFormat wire = WireFormat::F32, int num_threads = 0);
+    ~EpRank();
+    EpRank(const EpRank&) = delete;
+    EpRank& operator=(const EpRank&) = delete;
+
+    // x, topk_idx, topk_w: this rank's num_tokens tokens; out [num_tokens, H].
+    // Collective: every rank calls it, possibly with 0 tokens.
+    void forward(const float* x, int num_tokens, const int* topk_idx, const float* topk_w,
+                 float* out);
+
+    const EpTimings& timings() const { return timings_; }
+    const BufferPool& buffers() const { return pool_; }
+    int workspace_tokens() const { return ws_.max_tokens; }
+    bool owns(int expert) const { return expert_to_rank_[expert] == comm_.rank(); }
+
+private:
+    void alltoallv(const void* send, const size_t* send_bytes, const size_t* send_offsets,
+                   void* recv, const size_t* recv_bytes, const size_t* recv_offsets);
+    void reserve_rows(int rows);
+
+    ShmComm& comm_;
+    HierComm* hier_ = nullptr;
+    const MoeLayer* layer_;
+    std::vector<int> expert_to_rank_;
+    WireFormat wire_;
+    int num_threads_;
+    MoeWorkspace ws_;
+    DispatchPlan plan_;
+    EpTimings timings_;
+
+    // Reused between forwards
+    std::vector<float> rows_, recv_rows_, expert_out_, back_rows_, shared_out_;
+    std::vector<int> recv_vexpert_, shared_token_, shared_vexpert_;
+    std::vector<int> send_counts_, recv_counts_;
+    std::vector<size_t> count_bytes_, count_offsets_;
+    std::vector<size_t> send_bytes_, send_offsets_, recv_bytes_, recv_offsets_;
+    BufferPool pool_;   // kSendSlot / kRecvSlot message buffers
+};
+
+// Test-case layer (generate_tests.py file names) with the router, the
+// shared experts and only the routed experts owned by rank; the others
+// stay allocated but unread. Exits on I/O errors like the runner.
+void load_owned(MoeLayer* layer, const Meta* meta, const std::string& dir,
+                const std::vector<int>& expert_to_rank, int rank);
+
+}  // namespace moe
@@ -0,0 +1,178 @@
+// Runs the generated test cases through the multi-process CPU EP runtime.
+//
+//   ep_cpu_cases [tests_dir=../tests] [world_size=2] [wire=fp32|bf16|fp8]
+//                [ranks_per_node=0]
+//
+// Forks world_size ranks that share one ShmComm. For every case_XX each
+// rank reads its DP slice and the experts it owns (placement planned from
+// the case's routing, as in moe_cuda/main.cu), runs EpRank::forward and
+// checks its slice against the golden output. Exit status 0 when every
+// case is within tolerance on every rank. ranks_per_node > 0 routes the
+// exchanges through HierComm's two-level all-to-all on emulated nodes
+// (unthrottled).
+
+#include "ep_cpu.h"
+#include "fork_ranks.h"
+#include "placement.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+struct WireSpec {
+    const char* name;
+    moe::WireFormat fmt;
+    double tol;   // same bounds as run_tests.py
+};
+
+const WireSpec kWires[] = {
+    {"fp32", moe::WireFormat::F32, 1e-5},
+    {"bf16", moe::WireFormat::BF16, 5e-3},
+    {"fp8", moe::WireFormat::FP8_E4M3, 5e-2},
+};
+
+std::vector<std::string> list_cases(const std::string& root) {
+    std::vector<std::string> cases;
+    if (DIR* d = opendir(root.c_str())) {
+        while (dirent* e = readdir(d))
+            if (std::strncmp(e->d_name, "case_", 5) == 0) cases.push_back(root + "/" + e->d_name);
+        closedir(d);
+    }
+    std::sort(cases.begin(), cases.end());
+    return cases;
+}
+
+std::vector<int> plan_for_case(const std::string& dir, const Meta& m, int W) {
+    const int N = m.batch_size * m.seq_len, K = m.top_k, E = m.n_routed_experts;
+    const int per_rank = (N + W - 1) / W;
+    int* idx = load_i32((dir + "/topk_indices.bin").c_str(), static_cast<size_t>(N) * K);
+    std::vector<double> load(E, 0.0), traffic(static_cast<size_t>(W) * E, 0.0);
+    for (int t = 0; t < N; ++t)
+        for (int k = 0; k < K; ++k) {
+            load[idx[t * K + k]] += 1.0;
+            traffic[static_cast<size_t>(t / per_rank) * E + idx[t * K + k]] += 1.0;
+        }
+    free(idx);
+    moe::PlacementOptions opts;
+    opts.comm_weight = 0.1;
+    return moe::plan_placement(load.data(), E, W, traffic.data(), opts);
+}
+
+// Max abs error of this rank's slice of one case
+double run_rank_case(moe::ShmComm& comm, moe::HierComm* hier, const std::string& dir,
+                     moe::WireFormat wire) {
+    Meta m;
+    std::memset(&m, 0, sizeof(m));
+    parse_meta((dir + "/meta.json").c_str(), &m);
+    const int W = comm.world_size(), rank = comm.rank();
+    const int N = m.batch_size * m.seq_len, H = m.hidden_size, K = m.top_k;
+    const int per_rank = (N + W - 1) / W;
+    const int b = std::min(rank * per_rank, N), n = std::min(b + per_rank, N) - b;
+
+    std::vector<int> owner = plan_for_case(dir, m, W);
+    MoeLayer layer;
+    moe::load_owned(&layer, &m, dir, owner, rank);
+
+    float* x = load_f32((dir + "/inputs.bin").c_str(), static_cast<size_t>(N) * H);
+    float* expected = load_f32((dir + "/outputs.bin").c_str(), static_cast<size_t>(N) * H);
+    int* idx = load_i32((dir + "/topk_indices.bin").c_str(), static_cast<size_t>(N) * K);
+    float* w = load_f32((dir + "/topk_weights.bin").c_str(), static_cast<size_t>(N) * K);
+
+    std::vector<float> out(static_cast<size_t>(std::max(n, 1)) * H);
+    double err;
+    {
+        // A one-token workspace makes the first forward grow it; the second
+        // must reuse every buffer of the first
+        std::unique_ptr<moe::EpRank> ep =
+            hier ? std::make_unique<moe::EpRank>(*hier, &layer, owner, 1, wire, 1)
+                 : std::make_unique<moe::EpRank>(comm, &layer, owner, 1, wire, 1);
+        long allocations = 0;
+        for (int step = 0; step < 2; ++step) {
+            ep->forward(x + static_cast<size_t>(b) * H, n, idx + static_cast<size_t>(b) * K,
+                        w + static_cast<size_t>(b) * K, out.data());
+            if (step == 1 && ep->buffers().allocations() != allocations)
+                throw std::runtime_error("second forward grew the message buffers");
+            allocations = ep->buffers().allocations();
+        }
+        err = max_abs_diff(out.data(), expected + static_cast<size_t>(b) * H,
+                           static_cast<size_t>(n) * H);
+    }
+    free(x);
+    free(expected);
+    free(idx);
+    free(w);
+    moe_layer_free(&layer);
+    return err;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const std::string root = argc > 1 ? argv[1] : "../tests";
+    const int W = argc > 2 ? std::atoi(argv[2]) : 2;
+    const WireSpec* wire = nullptr;
+    for (const WireSpec& s : kWires)
+        if (std::strcmp(argc > 3 ? argv[3] : "fp32", s.name) == 0) wire = &s;
+    const int ranks_per_node = argc > 4 ? std::atoi(argv[4]) : 0;
+    if (W < 1 || !wire || ranks_per_node < 0 || (ranks_per_node && W % ranks_per_node)) {
+        std::fprintf(stderr, "usage: ep_cpu_cases [tests_dir] [world_size>=1] [fp32|bf16|fp8] "
+                             "[ranks_per_node dividing world_size]\n");
+        return 2;
+    }
+    const std::vector<std::string> cases = list_cases(root);
+    if (cases.empty()) {
+        std::fprintf(stderr, "no case_* directories under %s\n", root.c_str());
+        return 1;
+    }
+
+    // errs[c * W + r], -1 until rank r finishes case c
+    const size_t page = (cases.size() * W * sizeof(double) + 4095) & ~size_t(4095);
+    auto* errs = static_cast<double*>(
+        mmap(nullptr, page, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    for (size_t i = 0; i < cases.size() * W; ++i) errs[i] = -1.0;
+    const std::string name = "/moe_ep_cpu_" + std::to_string(getpid());
+
+    bool ok = moe::fork_ranks(W, [&](int rank) {
+        moe::ShmComm comm(name, rank, W);
+        std::unique_ptr<moe::HierComm> hier;
+        if (ranks_per_node)
+            hier = std::make_unique<moe::HierComm>(comm, ranks_per_node, moe::InterLink{0, 0});
+        for (size_t c = 0; c < cases.size(); ++c)
+            errs[c * W + rank] = run_rank_case(comm, hier.get(), cases[c], wire->fmt);
+        return 0;
+    });
+
+    std::printf("CPU EP runtime, %d rank%s, %s wire (tol %.0e)", W, W > 1 ? "s" : "",
+                wire->name, wire->tol);
+    if (ranks_per_node)
+        std::printf(", two-level all-to-all over %d nodes", W / ranks_per_node);
+    std::printf("\n");
+    double global = 0.0;
+    for (size_t c = 0; c < cases.size(); ++c) {
+        double err = 0.0;
+        bool done = true;
+        for (int r = 0; r < W; ++r) {
+            done = done && errs[c * W + r] >= 0.0;
+            err = std::max(err, errs[c * W + r]);
+        }
+        const bool pass = done && err < wire->tol;
+        ok = ok && pass;
+        global = std::max(global, err);
+        std::printf("  %-8s max abs err %.3e  %s\n", cases[c].substr(root.size() + 1).c_str(),
+                    err, pass ? "PASS" : "FAIL");
+    }
+    std::printf("Global max abs error: %.3e -> %s\n", global, ok ? "ALL PASS" : "FAILED");
+    munmap(errs, page);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#include "ep_sim.h"
+#include "dispatch.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace moe {
+
+namespace {
+
+void check_topology(const Topology& topo) {
+    if (topo.world_size <= 0 || topo.ranks_per_node <= 0)
+        throw std::invalid_argument("ep_sim: bad topology shape");
+    if (!(topo.intra_gbps > 0.0) || !(topo.inter_gbps > 0.0) || topo.intra_latency_us < 0.0 ||
+        topo.inter_latency_us < 0.0)
+        throw std::invalid_argument("ep_sim: bandwidths must be > 0 and latencies >= 0");
+}
+
+}  // namespace
+
+double alltoall_us(const std::vector<double>& bytes, const Topology& topo) {
+    check_topology(topo);
+    const int W = topo.world_size, P = topo.ranks_per_node;
+    if (bytes.size() != static_cast<size_t>(W) * W)
+        throw std::invalid_argument("ep_sim: bytes must be [W * W]");
+
+    double slowest = 0.0;
+    for (int r = 0; r < W; ++r) {
+        double intra_out = 0.0, intra_in = 0.0, inter_out = 0.0, inter_in = 0.0;
+        for (int d = 0; d < W; ++d) {
+            if (d == r) continue;
+            const double out = bytes[static_cast<size_t>(r) * W + d];
+            const double in = bytes[static_cast<size_t>(d) * W + r];
+            if (d / P == r / P) {
+                intra_out += out;
+                intra_in += in;
+            } else {
+                inter_out += out;
+                inter_in += in;
+            }
+        }
+        const double intra = std::max(intra_out, intra_in), inter = std::max(inter_out, inter_in);
+        // GB/s -> bytes per us is gbps * 1e3
+        double t = std::max(intra / (topo.intra_gbps * 1e3), inter / (topo.inter_gbps * 1e3));
+        if (intra > 0.0) t += topo.intra_latency_us;
+        if (inter > 0.0) t += topo.inter_latency_us;
+        slowest = std::max(slowest, t);
+    }
+    return slowest;
+}
+
+void simulate_step(const int* topk_idx, int num_tokens, int top_k, const ReplicaTable& table,
+                   const LayerShape& shape, const Topology& topo, StepPrediction& out,
+                   int num_threads) {
+    check_topology(topo);
+    const int W = topo.world_size, K = top_k, N = num_tokens;
+    if (N < 0 || K <= 0 || table.world_size != W)
+        throw std::invalid_argument("ep_sim: bad step shape");
+    if (shape.hidden <= 0 || shape.intermediate <= 0 || shape.shared_intermediate < 0 ||
+        !(shape.rank_tflops > 0.0))
+        throw std::invalid_argument("ep_sim: bad layer shape");
+
+    // Same data-parallel split as moe_ep_forward
+    const int per_rank = (N + W - 1) / W;
+    std::vector<int> vidx;
+    DispatchPlan plan;
+    out.send_rows.assign(static_cast<size_t>(W) * W, 0);
+    for (int s = 0; s < W; ++s) {
+        const int b = std::min(s * per_rank, N), e = std::min(b + per_rank, N);
+        if (e == b) continue;
+        const int* idx = topk_idx + static_cast<size_t>(b) * K;
+        vidx.resize(static_cast<size_t>(e - b) * K);
+        assign_replicas(idx, e - b, K, table, s, vidx.data());
+        build_plan(vidx.data(), nullptr, e - b, K, table.num_virtual(), table.ranks.data(), W,
+                   plan, num_threads);
+        for (int d = 0; d < W; ++d)
+            out.send_rows[static_cast<size_t>(s) * W + d] =
+                plan.rank_offsets[d + 1] - plan.rank_offsets[d];
+    }
+
+    const double row = static_cast<double>(wire_row_bytes(shape.wire, shape.hidden));
+    const double id = sizeof(int);
+    std::vector<double> dispatch(out.send_rows.size()), combine(out.send_rows.size());
+    out.intra_bytes = out.inter_bytes = 0.0;
+    for (int s = 0; s < W; ++s)
+        for (int d = 0; d < W; ++d) {
+            const size_t sd = static_cast<size_t>(s) * W + d, ds = static_cast<size_t>(d) * W + s;
+            const double rows = static_cast<double>(out.send_rows[sd]);
+            dispatch[sd] = rows * (id + row);
+            combine[ds] = rows * row;
+            if (s == d) continue;
+            (s / topo.ranks_per_node == d / topo.ranks_per_node ? out.intra_bytes
+                                                                : out.inter_bytes) +=
+                dispatch[sd] + combine[ds];
+        }
+    out.dispatch_us = alltoall_us(dispatch, topo);
+    out.combine_us = alltoall_us(combine, topo);
+
+    // flops -> us at rank_tflops is flops / (tflops * 1e6)
+    const double per_row = 6.0 * shape.hidden * shape.intermediate;
+    const double per_token = 6.0 * shape.hidden * shape.shared_intermediate;
+    out.compute_us.assign(W, 0.0);
+    out.max_compute_us = 0.0;
+    for (int d = 0; d < W; ++d) {
+        double rows = 0.0;
+        for (int s = 0; s < W; ++s) rows += static_cast<double>(out.send_rows[static_cast<size_t>(s) * W + d]);
+        const int b = std::min(d * per_rank, N), e = std::min(b + per_rank, N);
+        out.compute_us[d] = (rows * per_row + (e - b) * per_token) / (shape.rank_tflops * 1e6);
+        out.max_compute_us = std::max(out.max_compute_us, out.compute_us[d]);
+    }
+    out.step_us = out.dispatch_us + out.max_compute_us + out.combine_us;
+    out.overlap_us = std::max(out.dispatch_us + out.combine_us, out.max_compute_us);
+}
+
+}  // namespace moe
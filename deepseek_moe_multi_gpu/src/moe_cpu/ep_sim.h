@@ -0,0 +1,68 @@
+#pragma once
+// Expert-parallel step cost model, for sizing clusters from routing traces.
+//
+// One step of a trace (topk_idx of every token in the global batch) is
+// split over the ranks the way moe_ep_distributed does it (contiguous
+// slices of ceil(N / W) tokens). Each slice goes through assign_replicas
+// and build_plan, the dispatch code the EP runtime uses, which gives the
+// exact rows every rank sends every other rank. Those counts are costed
+// on a two-level topology:
+//
+//   ranks r and d share a node when r / ranks_per_node == d / ranks_per_node
+//   all-to-all time of rank r = max(intra bytes / intra_gbps,
+//                                   inter bytes / inter_gbps)
+//                               + latency of each link class it uses
+//
+// with bytes = max(sent, received) per class (links are full duplex and
+// every rank has its own inter-node NIC), and the collective finishing
+// with its slowest rank. A dispatch row costs an int32 expert id plus one
+// wire row; a combine row one wire row (wire.h). Rows a rank keeps for
+// itself cost nothing. Compute is 6 * H * I flops per routed row plus
+// 6 * H * I_shared per token for the shared experts, at rank_tflops.
+
+#include "placement.h"
+#include "wire.h"
+
+#include <vector>
+
+namespace moe {
+
+struct Topology {
+    int world_size = 1;
+    int ranks_per_node = 8;
+    double intra_gbps = 150.0;        // per rank, per direction, GB/s
+    double intra_latency_us = 3.0;
+    double inter_gbps = 40.0;         // per rank NIC, per direction, GB/s
+    double inter_latency_us = 10.0;
+};
+
+struct LayerShape {
+    int hidden = 7168;
+    int intermediate = 2048;          // per routed expert
+    int shared_intermediate = 2048;   // all shared experts together, 0 = none
+    WireFormat wire = WireFormat::BF16;
+    double rank_tflops = 400.0;       // achieved, per rank
+};
+
+struct StepPrediction {
+    std::vector<long> send_rows;      // [W * W] rows rank s dispatches to rank d
+    std::vector<double> compute_us;   // [W]
+    double dispatch_us = 0.0;
+    double combine_us = 0.0;
+    double max_compute_us = 0.0;
+    double step_us = 0.0;             // dispatch + slowest compute + combine
+    double overlap_us = 0.0;          // max(dispatch + combine, slowest compute)
+    double intra_bytes = 0.0;         // dispatch + combine, all ranks
+    double inter_bytes = 0.0;
+};
+
+// topk_idx: [num_tokens, top_k] global expert ids of one step. Throws
+// std::invalid_argument on bad shapes or expert ids.
+void simulate_step(const int* topk_idx, int num_tokens, int top_k, const ReplicaTable& table,
+                   const LayerShape& shape, const Topology& topo, StepPrediction& out,
+                   int num_threads = 0);
+
+// All-to-all time (us) of bytes[W * W] (row s: bytes rank s sends each rank).
+double alltoall_us(const std::vector<double>& bytes, const Topology& topo);
+
+}  // namespace moe
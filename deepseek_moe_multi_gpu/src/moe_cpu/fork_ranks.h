@@ -0,0 +1,47 @@
+#pragma once
+// Forked ranks on one host: how the tests, benchmarks and ep_cpu_cases
+// start a world of ShmComm ranks without a launcher.
+
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace moe {
+
+// Runs fn(rank) in world_size child processes and waits for all of them.
+// A child exits with fn's return value, or 1 if fn throws (the message goes
+// to stderr). True if every child exited with status 0.
+inline bool fork_ranks(int world_size, const std::function<int(int)>& fn) {
+    std::fflush(stdout);  // children must not replay buffered output
+    std::fflush(stderr);
+    std::vector<pid_t> pids;
+    for (int rank = 0; rank < world_size; ++rank) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int status = 1;
+            try {
+                status = fn(rank);
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "rank %d: %s\n", rank, e.what());
+            }
+            std::fflush(stdout);
+            std::fflush(stderr);
+            _exit(status);
+        }
+        if (pid > 0) pids.push_back(pid);
+    }
+    bool ok = static_cast<int>(pids.size()) == world_size;
+    for (pid_t pid : pids) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    return ok;
+}
+
+}  // namespace moe
@@ -0,0 +1,239 @@
+#include "hier_comm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace moe {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;   // CLOCK_MONOTONIC: one timeline for all ranks
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Clock::now().time_since_epoch())
+        .count();
+}
+
+// insert, not resize + memcpy: no zero fill of the appended bytes
+void put_bytes(std::vector<uint8_t>& buf, const void* src, size_t n) {
+    if (n == 0) return;
+    const auto* p = static_cast<const uint8_t*>(src);
+    buf.insert(buf.end(), p, p + n);
+}
+
+// Block sizes go on the wire as uint64_t; size_t is the same type here
+static_assert(sizeof(size_t) == sizeof(uint64_t), "size_t must be 64-bit");
+
+void put_words(std::vector<uint8_t>& buf, const void* words, size_t n) {
+    put_bytes(buf, words, n * sizeof(uint64_t));
+}
+
+}  // namespace
+
+HierComm::HierComm(ShmComm& comm, int ranks_per_node, InterLink link, Mode mode)
+    : comm_(comm), ranks_per_node_(ranks_per_node), link_(link), mode_(mode) {
+    const int W = comm.world_size();
+    if (ranks_per_node <= 0 || W % ranks_per_node != 0)
+        throw std::invalid_argument("HierComm: world size " + std::to_string(W) +
+                                    " is not a multiple of ranks_per_node " +
+                                    std::to_string(ranks_per_node));
+    if (W / ranks_per_node > ShmComm::kScratchWords)
+        throw std::invalid_argument("HierComm: at most " +
+                                    std::to_string(ShmComm::kScratchWords) + " nodes");
+    out_.resize(W);
+    hop1_.resize(W);
+    hop2_.resize(W);
+    hop3_.resize(W);
+    round_send_.resize(W);
+    round_recv_.resize(W);
+    round_send_bytes_.resize(W);
+    round_recv_bytes_.resize(W);
+    cursor_.resize(ranks_per_node);
+    const int S = node_of(comm.rank()), L = comm.rank() % ranks_per_node;
+    for (int n = 0; n < num_nodes(); ++n)
+        if (n != S && proxy_local(S, n) == L) relay_nodes_.push_back(n);
+}
+
+void HierComm::exchange(const void* const* send, const size_t* send_bytes, void* const* recv,
+                        const size_t* recv_bytes) {
+    const int W = comm_.world_size(), me = comm_.rank(), node = node_of(me);
+    int64_t done_ns = 0;
+    for (int r = 0; r < W; ++r) {
+        if (r == me || send_bytes[r] == 0) continue;
+        if (node_of(r) == node) {
+            ++stats_.intra_messages;
+            stats_.intra_bytes += send_bytes[r];
+            continue;
+        }
+        ++stats_.inter_messages;
+        stats_.inter_bytes += send_bytes[r];
+
+        // Reserve the message's slot on this node's egress link
+        double cost_us = link_.message_us;
+        if (link_.gbps > 0) cost_us += static_cast<double>(send_bytes[r]) / (link_.gbps * 1e3);
+        const int64_t cost = static_cast<int64_t>(cost_us * 1e3);
+        if (cost <= 0) continue;
+        std::atomic<int64_t>& nic = comm_.scratch()[node];
+        const int64_t now = now_ns();
+        int64_t free_at = nic.load(std::memory_order_relaxed), end;
+        do {
+            end = std::max(free_at, now) + cost;
+        } while (!nic.compare_exchange_weak(free_at, end, std::memory_order_acq_rel));
+        done_ns = std::max(done_ns, end);
+    }
+    const int64_t wait = done_ns - now_ns();
+    if (wait > 0) std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+    ++stats_.rounds;
+    comm_.alltoallv(send, send_bytes, recv, recv_bytes);
+}
+
+void HierComm::exchange(const Buffers& send, Buffers& recv, const std::vector<size_t>& recv_bytes) {
+    const int W = comm_.world_size();
+    for (int r = 0; r < W; ++r) {
+        recv[r].resize(recv_bytes[r]);
+        round_send_[r] = send[r].data();
+        round_send_bytes_[r] = send[r].size();
+        round_recv_[r] = recv[r].data();
+    }
+    exchange(round_send_.data(), round_send_bytes_.data(), round_recv_.data(), recv_bytes.data());
+}
+
+void HierComm::alltoallv(const void* const* send, const size_t* send_bytes, void* const* recv,
+                         const size_t* recv_bytes) {
+    if (mode_ == Mode::Flat || num_nodes() == 1)
+        exchange(send, send_bytes, recv, recv_bytes);
+    else
+        hierarchical(send, send_bytes, recv, recv_bytes);
+}
+
+void HierComm::alltoallv(const void* send, const size_t* send_bytes,
+                         const size_t* send_offsets, void* recv, const size_t* recv_bytes,
+                         const size_t* recv_offsets) {
+    const int W = comm_.world_size();
+    send_ptrs_.resize(W);
+    recv_ptrs_.resize(W);
+    for (int r = 0; r < W; ++r) {
+        send_ptrs_[r] = static_cast<const char*>(send) + send_offsets[r];
+        recv_ptrs_[r] = static_cast<char*>(recv) + recv_offsets[r];
+    }
+    alltoallv(send_ptrs_.data(), send_bytes, recv_ptrs_.data(), recv_bytes);
+}
+
+void HierComm::hierarchical(const void* const* send, const size_t* send_bytes,
+                            void* const* recv, const size_t* recv_bytes) {
+    const int P = ranks_per_node_, M = num_nodes();
+    const int me = comm_.rank(), S = node_of(me), L = me % P, base = S * P;
+    const std::vector<int>& dst_nodes = relay_nodes_;
+    const std::vector<int>& src_nodes = relay_nodes_;
+    std::vector<size_t>& rb = round_recv_bytes_;
+    for (auto& b : out_) b.clear();
+
+    // ---- Round A, intra: block sizes for each sender proxy ----
+    for (int pl = 0; pl < P; ++pl)
+        for (int D = 0; D < M; ++D)
+            if (D != S && proxy_local(S, D) == pl) put_words(out_[base + pl], send_bytes + D * P, P);
+    std::fill(rb.begin(), rb.end(), 0);
+    for (int rl = 0; rl < P; ++rl) rb[base + rl] = dst_nodes.size() * P * sizeof(uint64_t);
+    exchange(out_, hop1_, rb);
+
+    // sizes_in_[(rl * M + D) * P + j]: rank base + rl -> D * P + j
+    sizes_in_.assign(static_cast<size_t>(P) * M * P, 0);
+    for (int rl = 0; rl < P; ++rl) {
+        const uint8_t* p = hop1_[base + rl].data();
+        for (int D : dst_nodes) {
+            std::memcpy(&sizes_in_[(static_cast<size_t>(rl) * M + D) * P], p,
+                        P * sizeof(uint64_t));
+            p += P * sizeof(uint64_t);
+        }
+    }
+
+    // ---- Round B: payload to the sender proxies (intra), the P x P size
+    // matrix of every relayed node pair to its receiver proxy (inter) ----
+    for (auto& b : out_) b.clear();
+    for (int pl = 0; pl < P; ++pl) {
+        std::vector<uint8_t>& msg = out_[base + pl];
+        put_bytes(msg, send[base + pl], send_bytes[base + pl]);
+        for (int D = 0; D < M; ++D)
+            if (D != S && proxy_local(S, D) == pl)
+                for (int j = 0; j < P; ++j)
+                    put_bytes(msg, send[D * P + j], send_bytes[D * P + j]);
+    }
+    for (int D : dst_nodes)
+        for (int rl = 0; rl < P; ++rl)
+            put_words(out_[D * P + L], &sizes_in_[(static_cast<size_t>(rl) * M + D) * P], P);
+    std::fill(rb.begin(), rb.end(), 0);
+    for (int rl = 0; rl < P; ++rl) {
+        size_t n = recv_bytes[base + rl];
+        for (int D : dst_nodes)
+            for (int j = 0; j < P; ++j) n += sizes_in_[(static_cast<size_t>(rl) * M + D) * P + j];
+        rb[base + rl] = n;
+    }
+    for (int Sp : src_nodes) rb[Sp * P + L] = static_cast<size_t>(P) * P * sizeof(uint64_t);
+    exchange(out_, hop1_, rb);
+
+    for (int rl = 0; rl < P; ++rl)
+        if (recv_bytes[base + rl])
+            std::memcpy(recv[base + rl], hop1_[base + rl].data(), recv_bytes[base + rl]);
+    // sizes_out_[(S' * P + rl) * P + j]: rank S' * P + rl -> base + j
+    sizes_out_.assign(static_cast<size_t>(M) * P * P, 0);
+    for (int Sp : src_nodes)
+        std::memcpy(&sizes_out_[static_cast<size_t>(Sp) * P * P], hop1_[Sp * P + L].data(),
+                    static_cast<size_t>(P) * P * sizeof(uint64_t));
+
+    // ---- Round C, inter: one message per relayed (S, D) pair ----
+    for (auto& b : out_) b.clear();
+    std::vector<size_t>& cursor = cursor_;
+    for (int rl = 0; rl < P; ++rl) cursor[rl] = recv_bytes[base + rl];
+    for (int D : dst_nodes) {
+        std::vector<uint8_t>& msg = out_[D * P + L];
+        for (int rl = 0; rl < P; ++rl)
+            for (int j = 0; j < P; ++j) {
+                const size_t n = sizes_in_[(static_cast<size_t>(rl) * M + D) * P + j];
+                put_bytes(msg, hop1_[base + rl].data() + cursor[rl], n);
+                cursor[rl] += n;
+            }
+    }
+    std::fill(rb.begin(), rb.end(), 0);
+    for (int Sp : src_nodes) {
+        size_t n = 0;
+        for (int i = 0; i < P * P; ++i) n += sizes_out_[static_cast<size_t>(Sp) * P * P + i];
+        rb[Sp * P + L] = n;
+    }
+    exchange(out_, hop2_, rb);
+
+    // ---- Round D, intra: receiver proxies hand out the blocks ----
+    for (auto& b : out_) b.clear();
+    for (int Sp : src_nodes) {
+        const uint8_t* msg = hop2_[Sp * P + L].data();
+        const uint64_t* sz = &sizes_out_[static_cast<size_t>(Sp) * P * P];
+        for (int rl = 0; rl < P; ++rl)
+            for (int j = 0; j < P; ++j) {
+                put_bytes(out_[base + j], msg, sz[rl * P + j]);
+                msg += sz[rl * P + j];
+            }
+    }
+    std::fill(rb.begin(), rb.end(), 0);
+    for (int ql = 0; ql < P; ++ql)
+        for (int Sp = 0; Sp < M; ++Sp)
+            if (Sp != S && proxy_local(Sp, S) == ql)
+                for (int rl = 0; rl < P; ++rl) rb[base + ql] += recv_bytes[Sp * P + rl];
+    exchange(out_, hop3_, rb);
+
+    for (int ql = 0; ql < P; ++ql) {
+        const uint8_t* msg = hop3_[base + ql].data();
+        for (int Sp = 0; Sp < M; ++Sp)
+            if (Sp != S && proxy_local(Sp, S) == ql)
+                for (int rl = 0; rl < P; ++rl) {
+                    const size_t n = recv_bytes[Sp * P + rl];
+                    if (n) std::memcpy(recv[Sp * P + rl], msg, n);
+                    msg += n;
+                }
+    }
+}
+
+}  // namespace moe
@@ -0,0 +1,121 @@
+#pragma once
+// Two-level all-to-all-v for expert parallelism across nodes.
+//
+// A flat all-to-all over W ranks on N nodes of P ranks each puts
+// P * (W - P) messages on every node's network link per collective, most
+// of them small once a batch is split W ways. HierComm routes the same
+// exchange in three hops so that every (node, destination node) pair
+// carries exactly one message:
+//
+//   1. intra-node: each rank hands the blocks for node D to the sender
+//      proxy of (S, D) on its own node S
+//   2. inter-node: the sender proxy ships all P x P blocks of (S, D) in one
+//      message to the receiver proxy of (S, D) on node D
+//   3. intra-node: the receiver proxy hands each rank of D its P blocks
+//
+// Both proxies of (S, D) have local index (S + D) % P, so each pair stays
+// on one rail (the same local rank, as with one NIC per GPU) and different
+// pairs spread over the ranks of a node. The proxies learn the block sizes
+// from a fixed-size layout exchange (one intra and one inter hop) run
+// ahead of the payload; the layout's inter hop shares a round with the
+// payload's first intra hop, so a collective is four ShmComm rounds.
+//
+// Nodes are emulated: ranks are processes on one host and rank r sits on
+// node r / ranks_per_node. Messages that leave a node pay an InterLink
+// cost on that node's egress link, which is serialized across the node's
+// ranks through a clock in the ShmComm scratch area: the sender sleeps
+// until its messages would have left the NIC. Intra-node messages run at
+// shared-memory speed. The same throttle applies in Mode::Flat, which is
+// ShmComm::alltoallv with the inter-node messages charged.
+
+#include "shm_comm.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace moe {
+
+// Emulated inter-node link of one node, per direction
+struct InterLink {
+    double gbps = 1.0;         // <= 0: unlimited bandwidth
+    double message_us = 20.0;  // per-message NIC cost (injection, completion)
+};
+
+// Messages and bytes this rank sent to other ranks (self copies excluded)
+struct CommStats {
+    long intra_messages = 0;
+    long inter_messages = 0;
+    uint64_t intra_bytes = 0;
+    uint64_t inter_bytes = 0;
+    long rounds = 0;   // ShmComm collectives issued
+};
+
+class HierComm {
+public:
+    enum class Mode { Flat, Hierarchical };
+
+    // world_size must be a multiple of ranks_per_node; the node count must
+    // fit the ShmComm scratch area. Collective like ShmComm's constructor
+    // only in that every rank must pass the same arguments.
+    HierComm(ShmComm& comm, int ranks_per_node, InterLink link = {},
+             Mode mode = Mode::Hierarchical);
+    HierComm(const HierComm&) = delete;
+    HierComm& operator=(const HierComm&) = delete;
+
+    int rank() const { return comm_.rank(); }
+    int world_size() const { return comm_.world_size(); }
+    int ranks_per_node() const { return ranks_per_node_; }
+    int num_nodes() const { return comm_.world_size() / ranks_per_node_; }
+    int node_of(int r) const { return r / ranks_per_node_; }
+    ShmComm& comm() const { return comm_; }
+
+    Mode mode() const { return mode_; }
+    void set_mode(Mode mode) { mode_ = mode; }   // same on every rank
+
+    // Same contracts as the two ShmComm::alltoallv forms
+    void alltoallv(const void* const* send, const size_t* send_bytes,
+                   void* const* recv, const size_t* recv_bytes);
+    void alltoallv(const void* send, const size_t* send_bytes, const size_t* send_offsets,
+                   void* recv, const size_t* recv_bytes, const size_t* recv_offsets);
+
+    const CommStats& stats() const { return stats_; }
+    void reset_stats() { stats_ = CommStats{}; }
+
+private:
+    using Buffers = std::vector<std::vector<uint8_t>>;
+
+    // One throttled, counted ShmComm round
+    void exchange(const void* const* send, const size_t* send_bytes, void* const* recv,
+                  const size_t* recv_bytes);
+    void exchange(const Buffers& send, Buffers& recv, const std::vector<size_t>& recv_bytes);
+    void hierarchical(const void* const* send, const size_t* send_bytes, void* const* recv,
+                      const size_t* recv_bytes);
+    int proxy_local(int src_node, int dst_node) const {
+        return (src_node + dst_node) % ranks_per_node_;
+    }
+
+    ShmComm& comm_;
+    int ranks_per_node_;
+    InterLink link_;
+    Mode mode_;
+    CommStats stats_;
+
+    // Nodes this rank relays for, as sender proxy of (S, D) and receiver
+    // proxy of (D, S); the same set, since proxy_local is symmetric
+    std::vector<int> relay_nodes_;
+
+    // Reused between collectives: a steady-state collective allocates
+    // nothing once the hop buffers have grown to its sizes
+    Buffers out_, hop1_, hop2_, hop3_;
+    std::vector<uint64_t> sizes_in_;    // [P][nodes][P] block sizes per source, as sender proxy
+    std::vector<uint64_t> sizes_out_;   // [nodes][P][P] block sizes per source node, as receiver proxy
+    std::vector<const void*> send_ptrs_;
+    std::vector<void*> recv_ptrs_;
+    std::vector<const void*> round_send_;   // per ShmComm round of hierarchical()
+    std::vector<void*> round_recv_;
+    std::vector<size_t> round_send_bytes_, round_recv_bytes_;
+    std::vector<size_t> cursor_;            // [P] read offset into each hop1_ block
+};
+
+}  // namespace moe
@@ -0,0 +1,106 @@
+/*
+ * moe_native.h
+ * C API of libmoe_native, loaded from Python with ctypes (moe_native.py).
+ *
+ * Functions return 0 on success and -1 on error; moe_last_error() then
+ * describes the failure. Pointers returned by moe_plan_* accessors stay
+ * valid until the next moe_plan_build or moe_plan_destroy on that plan.
+ */
+#ifndef MOE_NATIVE_H
+#define MOE_NATIVE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct moe_plan moe_plan;
+typedef struct moe_comm moe_comm;
+
+const char* moe_last_error(void);
+
+/* ---- Dispatch plan (dispatch.h) ---- */
+moe_plan* moe_plan_create(void);
+void moe_plan_destroy(moe_plan* plan);
+
+/* topk_w and expert_to_rank may be NULL; num_threads <= 0 uses MOE_THREADS */
+int moe_plan_build(moe_plan* plan, const int* topk_idx, const float* topk_w,
+                   int num_tokens, int top_k, int num_experts,
+                   const int* expert_to_rank, int world_size, int num_threads);
+
+int moe_plan_num_rows(const moe_plan* plan);
+const int*   moe_plan_expert_rank(const moe_plan* plan);   /* [E] */
+const int*   moe_plan_expert_begin(const moe_plan* plan);  /* [E] */
+const int*   moe_plan_expert_count(const moe_plan* plan);  /* [E] */
+const int*   moe_plan_rank_offsets(const moe_plan* plan);  /* [W + 1] */
+const int*   moe_plan_row_token(const moe_plan* plan);     /* [R] */
+const int*   moe_plan_row_expert(const moe_plan* plan);    /* [R] */
+const float* moe_plan_row_weight(const moe_plan* plan);    /* [R] */
+const int*   moe_plan_slot_row(const moe_plan* plan);      /* [N * K] */
+
+int moe_gather(const moe_plan* plan, const float* x, int hidden, float* rows, int num_threads);
+int moe_scatter_weighted(const moe_plan* plan, const float* rows, int hidden, float* out,
+                         int accumulate, int use_weights, int num_threads);
+
+/* ---- Expert placement (placement.h) ---- */
+/* traffic may be NULL; writes expert_to_rank[E] */
+int moe_place_experts(const double* load, int num_experts, int world_size,
+                      const double* traffic, double comm_weight, int max_experts_per_rank,
+                      int* expert_to_rank);
+/* stats[4] = {max_cost, mean_cost, max_load, remote} */
+int moe_placement_stats(const double* load, int num_experts, int world_size,
+                        const double* traffic, const int* expert_to_rank, double comm_weight,
+                        double* stats);
+
+/* Replicas in CSR form: expert e on ranks[offsets[e] .. offsets[e + 1]),
+ * primary first. ranks has room for E * W entries. */
+int moe_plan_replicas(const double* load, int num_experts, int world_size,
+                      const double* traffic, const int* expert_to_rank, int max_replicated,
+                      int max_copies, double comm_weight, int* offsets, int* ranks);
+int moe_replica_stats(const double* load, int num_experts, int world_size,
+                      const double* traffic, const int* offsets, const int* ranks,
+                      double comm_weight, double* stats);
+/* virtual_idx[N * K]: positions in ranks, see assign_replicas in dispatch.h */
+int moe_assign_replicas(const int* topk_idx, int num_tokens, int top_k, int num_experts,
+                        int world_size, const int* offsets, const int* ranks, int source_rank,
+                        int* virtual_idx);
+
+/* ---- Wire codecs (wire.h): fmt 0 = fp32, 1 = bf16, 2 = fp8-e4m3 ---- */
+/* bytes of one encoded row, or -1 for an unknown format */
+long moe_wire_row_bytes(int fmt, int hidden);
+int moe_encode_rows(const float* x, long rows, int hidden, int fmt, void* out,
+                    int num_threads);
+int moe_decode_rows(const void* in, long rows, int hidden, int fmt, float* out,
+                    int num_threads);
+
+/* ---- EP step cost model (ep_sim.h) ---- */
+/* layer[5]    = {hidden, intermediate, shared_intermediate, wire fmt, rank_tflops}
+ * topology[5] = {ranks_per_node, intra_gbps, intra_latency_us, inter_gbps,
+ *                inter_latency_us}
+ * Replicas as for moe_replica_stats. Writes send_rows[W * W], compute_us[W]
+ * and stats[8] = {dispatch_us, combine_us, max_compute_us, step_us,
+ * overlap_us, intra_bytes, inter_bytes, 0}. */
+int moe_simulate_step(const int* topk_idx, int num_tokens, int top_k, int num_experts,
+                      int world_size, const int* offsets, const int* ranks,
+                      const double* layer, const double* topology, long* send_rows,
+                      double* compute_us, double* stats, int num_threads);
+
+/* ---- Shared-memory all-to-all-v (shm_comm.h) ---- */
+/* ring_bytes == 0 uses the default; returns NULL on error */
+moe_comm* moe_comm_create(const char* name, int rank, int world_size, size_t ring_bytes,
+                          double timeout_s);
+void moe_comm_destroy(moe_comm* comm);
+int moe_comm_alltoallv(moe_comm* comm, const void* const* send, const size_t* send_bytes,
+                       void* const* recv, const size_t* recv_bytes);
+/* One contiguous buffer per side: rank r's block is at send + send_offsets[r] */
+int moe_comm_alltoallv_offsets(moe_comm* comm, const void* send, const size_t* send_bytes,
+                               const size_t* send_offsets, void* recv, const size_t* recv_bytes,
+                               const size_t* recv_offsets);
+int moe_comm_barrier(moe_comm* comm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
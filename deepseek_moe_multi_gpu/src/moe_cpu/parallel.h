@@ -0,0 +1,61 @@
+#pragma once
+// Static-partition parallel_for over std::thread.
+//
+// Work is split into contiguous chunks decided only by (n, chunks), so a
+// reduction that walks chunks in order gives the same result for any
+// thread count.
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace moe {
+
+// MOE_THREADS from the environment, else hardware_concurrency().
+inline int default_threads() {
+    if (const char* s = std::getenv("MOE_THREADS")) {
+        int n = std::atoi(s);
+        if (n > 0) return n;
+    }
+    unsigned hc = std::thread::hardware_concurrency();
+    return hc ? static_cast<int>(hc) : 1;
+}
+
+// Number of chunks for n items: at most num_threads, at least grain items each.
+inline int num_chunks(long n, int num_threads, long grain) {
+    if (n <= 0) return 1;
+    long by_grain = (n + grain - 1) / grain;
+    return static_cast<int>(std::max(1L, std::min<long>(num_threads, by_grain)));
+}
+
+// f(begin, end, chunk) for chunk in [0, chunks); chunk 0 runs on the caller.
+template <class F>
+void parallel_chunks(long n, int chunks, F&& f) {
+    auto range = [&](int c, long& b, long& e) {
+        b = n * c / chunks;
+        e = n * (c + 1) / chunks;
+    };
+    if (chunks <= 1) {
+        f(0L, n, 0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(chunks - 1);
+    for (int c = 1; c < chunks; ++c) {
+        long b, e;
+        range(c, b, e);
+        workers.emplace_back([&f, b, e, c] { f(b, e, c); });
+    }
+    long b, e;
+    range(0, b, e);
+    f(b, e, 0);
+    for (auto& w : workers) w.join();
+}
+
+template <class F>
+void parallel_for(long n, int num_threads, long grain, F&& f) {
+    parallel_chunks(n, num_chunks(n, num_threads, grain), std::forward<F>(f));
+}
+
+}  // namespace moe
@@ -0,0 +1,337 @@
+#include "placement.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace moe {
+
+namespace {
+
+// Cost matrix c[e * W + r]: what expert e adds to rank r
+std::vector<double> expert_costs(const double* load, int E, int W, const double* traffic,
+                                 double comm_weight) {
+    std::vector<double> c(static_cast<size_t>(E) * W);
+    for (int e = 0; e < E; ++e) {
+        for (int r = 0; r < W; ++r) {
+            double remote = traffic ? load[e] - traffic[static_cast<size_t>(r) * E + e]
+                                    : load[e] * (W - 1) / W;
+            c[static_cast<size_t>(e) * W + r] = load[e] + comm_weight * remote;
+        }
+    }
+    return c;
+}
+
+void check_inputs(const double* load, int E, int W, const double* traffic) {
+    if (E <= 0 || W <= 0) throw std::invalid_argument("placement: bad shape");
+    for (int e = 0; e < E; ++e)
+        if (!(load[e] >= 0.0))
+            throw std::invalid_argument("placement: negative load for expert " +
+                                        std::to_string(e));
+    if (traffic) {
+        for (int e = 0; e < E; ++e) {
+            double sum = 0.0;
+            for (int r = 0; r < W; ++r) sum += traffic[static_cast<size_t>(r) * E + e];
+            if (sum > load[e] * (1.0 + 1e-9) + 1e-9)
+                throw std::invalid_argument("placement: traffic exceeds load for expert " +
+                                            std::to_string(e));
+        }
+    }
+}
+
+}  // namespace
+
+std::vector<int> plan_placement(const double* load, int num_experts, int world_size,
+                                const double* traffic, const PlacementOptions& opts) {
+    const int E = num_experts, W = world_size;
+    check_inputs(load, E, W, traffic);
+    const int cap = opts.max_experts_per_rank > 0 ? opts.max_experts_per_rank : E;
+    if (static_cast<long>(cap) * W < E)
+        throw std::invalid_argument("placement: " + std::to_string(E) + " experts do not fit " +
+                                    std::to_string(W) + " ranks of " + std::to_string(cap));
+
+    const std::vector<double> c = expert_costs(load, E, W, traffic, opts.comm_weight);
+    auto cost = [&](int e, int r) { return c[static_cast<size_t>(e) * W + r]; };
+
+    // Greedy: heaviest experts first, each to the rank with the smallest
+    // resulting cost; ties prefer the cheaper (more local) rank, then the lower id
+    std::vector<int> order(E);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](int a, int b) { return load[a] > load[b]; });
+
+    std::vector<int> owner(E, -1), count(W, 0);
+    std::vector<double> rank_cost(W, 0.0);
+    for (int e : order) {
+        int best = -1;
+        for (int r = 0; r < W; ++r) {
+            if (count[r] >= cap) continue;
+            if (best < 0) {
+                best = r;
+                continue;
+            }
+            double a = rank_cost[r] + cost(e, r), b = rank_cost[best] + cost(e, best);
+            if (a < b || (a == b && cost(e, r) < cost(e, best))) best = r;
+        }
+        owner[e] = best;
+        count[best]++;
+        rank_cost[best] += cost(e, best);
+    }
+
+    // Local search on the straggler: move or swap one expert at a time as
+    // long as the straggler's cost drops and no other rank rises to it
+    const int max_steps = opts.max_refine_steps > 0 ? opts.max_refine_steps : 16 * E;
+    for (int step = 0; step < max_steps; ++step) {
+        const int top = static_cast<int>(
+            std::max_element(rank_cost.begin(), rank_cost.end()) - rank_cost.begin());
+        const double top_cost = rank_cost[top];
+
+        double best_pair = top_cost;
+        int best_e = -1, best_f = -1, best_q = -1;
+        for (int e = 0; e < E; ++e) {
+            if (owner[e] != top) continue;
+            for (int q = 0; q < W; ++q) {
+                if (q == top) continue;
+                // Move e to q
+                if (count[q] < cap) {
+                    double a = top_cost - cost(e, top), b = rank_cost[q] + cost(e, q);
+                    double m = std::max(a, b);
+                    if (m < best_pair - 1e-12) {
+                        best_pair = m;
+                        best_e = e, best_f = -1, best_q = q;
+                    }
+                }
+                // Swap e with some f on q
+                for (int f = 0; f < E; ++f) {
+                    if (owner[f] != q) continue;
+                    double a = top_cost - cost(e, top) + cost(f, top);
+                    double b = rank_cost[q] - cost(f, q) + cost(e, q);
+                    double m = std::max(a, b);
+                    if (m < best_pair - 1e-12) {
+                        best_pair = m;
+                        best_e = e, best_f = f, best_q = q;
+                    }
+                }
+            }
+        }
+        if (best_e < 0) break;
+
+        rank_cost[top] -= cost(best_e, top);
+        rank_cost[best_q] += cost(best_e, best_q);
+        owner[best_e] = best_q;
+        if (best_f >= 0) {
+            rank_cost[best_q] -= cost(best_f, best_q);
+            rank_cost[top] += cost(best_f, top);
+            owner[best_f] = top;
+        } else {
+            count[top]--;
+            count[best_q]++;
+        }
+    }
+    return owner;
+}
+
+int ReplicaTable::virtual_expert(int v) const {
+    return static_cast<int>(std::upper_bound(offsets.begin(), offsets.end(), v) -
+                            offsets.begin()) - 1;
+}
+
+bool ReplicaTable::hosts(int e, int rank) const {
+    for (int v = offsets[e]; v < offsets[e + 1]; ++v)
+        if (ranks[v] == rank) return true;
+    return false;
+}
+
+ReplicaTable ReplicaTable::single(const int* expert_to_rank, int num_experts, int world_size) {
+    ReplicaTable t;
+    t.num_experts = num_experts;
+    t.world_size = world_size;
+    t.offsets.resize(num_experts + 1);
+    t.ranks.assign(expert_to_rank, expert_to_rank + num_experts);
+    for (int e = 0; e <= num_experts; ++e) t.offsets[e] = e;
+    for (int r : t.ranks)
+        if (r < 0 || r >= world_size)
+            throw std::invalid_argument("placement: rank " + std::to_string(r) + " out of range");
+    return t;
+}
+
+namespace {
+
+// Per-rank cost with each expert's tokens split over its copies
+std::vector<double> replica_rank_costs(const double* load, const double* traffic,
+                                       const std::vector<std::vector<int>>& copies, int W,
+                                       double comm_weight, std::vector<double>* rank_load,
+                                       double* remote_total) {
+    const int E = static_cast<int>(copies.size());
+    std::vector<double> cost(W, 0.0);
+    if (rank_load) rank_load->assign(W, 0.0);
+    double remote = 0.0;
+    for (int e = 0; e < E; ++e) {
+        const auto& c = copies[e];
+        const double m = static_cast<double>(c.size());
+        for (int s = 0; s < W; ++s) {
+            double tokens = traffic ? traffic[static_cast<size_t>(s) * E + e] : load[e] / W;
+            if (tokens == 0.0) continue;
+            if (std::find(c.begin(), c.end(), s) != c.end()) {
+                cost[s] += tokens;
+                if (rank_load) (*rank_load)[s] += tokens;
+                continue;
+            }
+            for (int r : c) {
+                cost[r] += tokens / m * (1.0 + comm_weight);
+                if (rank_load) (*rank_load)[r] += tokens / m;
+            }
+            remote += tokens;
+        }
+    }
+    if (remote_total) *remote_total = remote;
+    return cost;
+}
+
+std::vector<std::vector<int>> to_lists(const ReplicaTable& t) {
+    std::vector<std::vector<int>> copies(t.num_experts);
+    for (int e = 0; e < t.num_experts; ++e)
+        copies[e].assign(t.ranks.begin() + t.offsets[e], t.ranks.begin() + t.offsets[e + 1]);
+    return copies;
+}
+
+ReplicaTable from_lists(const std::vector<std::vector<int>>& copies, int W) {
+    ReplicaTable t;
+    t.num_experts = static_cast<int>(copies.size());
+    t.world_size = W;
+    t.offsets.assign(1, 0);
+    for (const auto& c : copies) {
+        t.ranks.insert(t.ranks.end(), c.begin(), c.end());
+        t.offsets.push_back(static_cast<int>(t.ranks.size()));
+    }
+    return t;
+}
+
+double max_of(const std::vector<double>& v) { return *std::max_element(v.begin(), v.end()); }
+
+}  // namespace
+
+ReplicaTable plan_replicas(const double* load, int num_experts, int world_size,
+                           const double* traffic, const int* expert_to_rank,
+                           int max_replicated, int max_copies, double comm_weight) {
+    const int E = num_experts, W = world_size;
+    check_inputs(load, E, W, traffic);
+    std::vector<std::vector<int>> copies =
+        to_lists(ReplicaTable::single(expert_to_rank, E, W));
+
+    std::vector<int> order(E);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](int a, int b) { return load[a] > load[b]; });
+    order.resize(std::min(std::max(max_replicated, 0), E));
+    const int cap = std::min(max_copies, W);
+
+    // Moves are ranked by the straggler cost, then by the sum of squared
+    // rank costs: when several ranks tie for the maximum, relieving one of
+    // them is progress even if the maximum holds
+    auto score = [&](double* sq) {
+        std::vector<double> c = replica_rank_costs(load, traffic, copies, W, comm_weight,
+                                                   nullptr, nullptr);
+        *sq = 0.0;
+        for (double v : c) *sq += v * v;
+        return max_of(c);
+    };
+    auto better = [](double m, double sq, double best_m, double best_sq) {
+        const double tol = 1e-9 * std::max(best_m, 1.0);
+        return m < best_m - tol || (m <= best_m + tol && sq < best_sq * (1.0 - 1e-9));
+    };
+
+    double base_sq, best_sq;
+    const double base = score(&base_sq);
+    double best = base;
+    best_sq = base_sq;
+    std::vector<std::pair<int, int>> added;  // (expert, rank), in the order added
+    for (;;) {
+        // A move gives one expert copies on the n cheapest ranks that lack
+        // one, for the best n: a single copy on a busy rank often costs
+        // more than it saves, while several copies share the load
+        int best_e = -1;
+        std::vector<int> best_ranks;
+        double step_m = best, step_sq = best_sq;
+        for (int e : order) {
+            std::vector<int> trial;
+            while (static_cast<int>(copies[e].size()) < cap) {
+                std::vector<double> c = replica_rank_costs(load, traffic, copies, W,
+                                                           comm_weight, nullptr, nullptr);
+                int r = -1;
+                for (int q = 0; q < W; ++q)
+                    if (std::find(copies[e].begin(), copies[e].end(), q) == copies[e].end() &&
+                        (r < 0 || c[q] < c[r]))
+                        r = q;
+                copies[e].push_back(r);
+                trial.push_back(r);
+                double sq, m = score(&sq);
+                if (better(m, sq, step_m, step_sq)) {
+                    step_m = m, step_sq = sq;
+                    best_e = e, best_ranks = trial;
+                }
+            }
+            copies[e].resize(copies[e].size() - trial.size());
+        }
+        if (best_e < 0) break;
+        for (int r : best_ranks) {
+            copies[best_e].push_back(r);
+            added.emplace_back(best_e, r);
+        }
+        best = step_m, best_sq = step_sq;
+    }
+
+    // Copies that only evened out ranks below the straggler are dropped
+    // again, newest first, as long as the straggler cost does not rise
+    if (best >= base - 1e-9 * std::max(base, 1.0))
+        return ReplicaTable::single(expert_to_rank, E, W);
+    for (auto it = added.rbegin(); it != added.rend(); ++it) {
+        auto& c = copies[it->first];
+        auto pos = c.erase(std::find(c.begin(), c.end(), it->second));
+        double sq, m = score(&sq);
+        if (m > best + 1e-9 * std::max(best, 1.0)) c.insert(pos, it->second);
+    }
+    return from_lists(copies, W);
+}
+
+PlacementStats evaluate_replicas(const double* load, const double* traffic,
+                                 const ReplicaTable& table, double comm_weight) {
+    const int E = table.num_experts, W = table.world_size;
+    check_inputs(load, E, W, traffic);
+    std::vector<double> rank_load;
+    PlacementStats s;
+    std::vector<double> cost = replica_rank_costs(load, traffic, to_lists(table), W, comm_weight,
+                                                  &rank_load, &s.remote);
+    s.max_cost = max_of(cost);
+    s.mean_cost = std::accumulate(cost.begin(), cost.end(), 0.0) / W;
+    s.max_load = max_of(rank_load);
+    return s;
+}
+
+PlacementStats evaluate_placement(const double* load, int num_experts, int world_size,
+                                  const double* traffic, const int* expert_to_rank,
+                                  double comm_weight) {
+    const int E = num_experts, W = world_size;
+    check_inputs(load, E, W, traffic);
+    std::vector<double> rank_cost(W, 0.0), rank_load(W, 0.0);
+    PlacementStats s;
+    for (int e = 0; e < E; ++e) {
+        int r = expert_to_rank[e];
+        if (r < 0 || r >= W)
+            throw std::invalid_argument("placement: expert " + std::to_string(e) +
+                                        " mapped to rank " + std::to_string(r));
+        double remote = traffic ? load[e] - traffic[static_cast<size_t>(r) * E + e]
+                                : load[e] * (W - 1) / W;
+        rank_load[r] += load[e];
+        rank_cost[r] += load[e] + comm_weight * remote;
+        s.remote += remote;
+    }
+    s.max_cost = *std::max_element(rank_cost.begin(), rank_cost.end());
+    s.mean_cost = std::accumulate(rank_cost.begin(), rank_cost.end(), 0.0) / W;
+    s.max_load = *std::max_element(rank_load.begin(), rank_load.end());
+    return s;
+}
+
+}  // namespace moe
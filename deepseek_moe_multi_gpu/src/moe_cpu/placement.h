@@ -0,0 +1,79 @@
+#pragma once
+// Load-aware expert placement for expert parallelism.
+//
+// Rank r's step cost under a placement is modelled as
+//
+//   cost_r = sum over experts e on r of  load[e] + comm_weight * remote(e, r)
+//
+// where remote(e, r) is the number of e's tokens that come from other
+// ranks: load[e] - traffic[r][e] when the per-rank routing counts are
+// known, else load[e] * (W - 1) / W. plan_placement minimises the largest
+// cost_r: a longest-processing-time greedy pass assigns experts in
+// decreasing load to the rank whose cost grows the least, then a local
+// search moves or swaps experts off the most loaded rank while that
+// lowers it. With comm_weight > 0 ties and near-ties go to the rank that
+// already holds most of an expert's tokens.
+
+#include <vector>
+
+namespace moe {
+
+// Copies of each expert: expert e lives on ranks[offsets[e] .. offsets[e+1]),
+// primary owner first. A position v in ranks is a "virtual expert" (replica
+// v of expert virtual_expert(v) on rank ranks[v]), which lets the dispatch
+// plan route replicas like ordinary experts.
+struct ReplicaTable {
+    int num_experts = 0;
+    int world_size = 1;
+    std::vector<int> offsets;   // [E + 1]
+    std::vector<int> ranks;     // [V]
+
+    int copies(int e) const { return offsets[e + 1] - offsets[e]; }
+    int num_virtual() const { return static_cast<int>(ranks.size()); }
+    int virtual_expert(int v) const;
+    bool hosts(int e, int rank) const;
+
+    // One copy per expert, on expert_to_rank[e]
+    static ReplicaTable single(const int* expert_to_rank, int num_experts, int world_size);
+};
+
+struct PlacementOptions {
+    double comm_weight = 0.0;       // cost of one remote token relative to computing it
+    int max_experts_per_rank = 0;   // memory cap, 0 = unlimited
+    int max_refine_steps = 0;       // 0 = 16 * E
+};
+
+struct PlacementStats {
+    double max_cost = 0.0;    // straggler rank
+    double mean_cost = 0.0;
+    double max_load = 0.0;    // compute part only
+    double remote = 0.0;      // tokens crossing ranks, all ranks
+};
+
+// load: [E] tokens per expert; traffic: [W * E] tokens rank r routes to
+// expert e (row-major by rank) or nullptr. Returns expert -> rank.
+// Throws std::invalid_argument on bad shapes or an unsatisfiable cap.
+std::vector<int> plan_placement(const double* load, int num_experts, int world_size,
+                                const double* traffic, const PlacementOptions& opts = {});
+
+// Replicates the max_replicated most loaded experts, up to max_copies
+// copies each. Each step gives one expert copies on the cheapest ranks,
+// picking the expert and copy count that lower the straggler cost the
+// most, or failing that even out the ranks the most without raising it;
+// afterwards copies that do not help the straggler are dropped. Without a gain the table stays
+// single. Costs assume the split of assign_replicas (dispatch.h): tokens
+// stay on their own rank when it holds a copy, the rest spread evenly
+// over the copies. Without traffic, every rank is assumed to send
+// load[e] / W.
+ReplicaTable plan_replicas(const double* load, int num_experts, int world_size,
+                           const double* traffic, const int* expert_to_rank,
+                           int max_replicated, int max_copies, double comm_weight = 0.0);
+
+PlacementStats evaluate_replicas(const double* load, const double* traffic,
+                                 const ReplicaTable& table, double comm_weight);
+
+PlacementStats evaluate_placement(const double* load, int num_experts, int world_size,
+                                  const double* traffic, const int* expert_to_rank,
+                                  double comm_weight);
+
+}  // namespace moe
@@ -0,0 +1,340 @@
+#include "shm_comm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace moe {
+
+namespace {
+
+constexpr uint64_t kMagic = 0x6d6f655f73686d31ULL;  // "moe_shm1"
+constexpr int kSpins = 2000;                        // doorbell polls before sleeping
+constexpr long kSleepNs = 50 * 1000 * 1000;         // futex timeout between deadline checks
+
+using Clock = std::chrono::steady_clock;
+
+size_t round_up(size_t n, size_t a) { return (n + a - 1) / a * a; }
+
+std::runtime_error sys_error(const std::string& what) {
+    return std::runtime_error("ShmComm: " + what + ": " + std::strerror(errno));
+}
+
+void futex_wait(std::atomic<uint32_t>* addr, uint32_t expected) {
+    timespec ts{0, kSleepNs};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT, expected, &ts,
+            nullptr, 0);
+}
+
+void futex_wake(std::atomic<uint32_t>* addr, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE, count, nullptr,
+            nullptr, 0);
+}
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+double seconds_since(Clock::time_point t) {
+    return std::chrono::duration<double>(Clock::now() - t).count();
+}
+
+}  // namespace
+
+struct ShmComm::Header {
+    std::atomic<uint64_t> magic;
+    int world_size;
+    uint64_t ring_bytes;
+    alignas(64) std::atomic<uint32_t> barrier_count;
+    alignas(64) std::atomic<uint32_t> barrier_gen;
+};
+
+// Per-rank doorbell: bumped by peers, slept on by the owner.
+struct ShmComm::RankSync {
+    alignas(64) std::atomic<uint32_t> doorbell;
+    std::atomic<uint32_t> sleeping;
+};
+
+// head is written only by the producer, tail only by the consumer; both
+// count bytes since creation, the data follows the struct.
+struct ShmComm::Ring {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+
+    char* data() { return reinterpret_cast<char*>(this) + sizeof(Ring); }
+};
+
+namespace {
+
+constexpr size_t kHeaderBytes = 256;
+constexpr size_t kScratchBytes = ShmComm::kScratchWords * sizeof(int64_t);
+
+}  // namespace
+
+ShmComm::ShmComm(const std::string& name, int rank, int world_size, size_t ring_bytes,
+                 double timeout_s)
+    : name_(name[0] == '/' ? name : "/" + name),
+      rank_(rank),
+      world_size_(world_size),
+      ring_bytes_(round_up(std::max<size_t>(ring_bytes, 64), 64)),
+      ring_stride_(sizeof(Ring) + ring_bytes_),
+      timeout_s_(timeout_s) {
+    static_assert(sizeof(Header) <= kHeaderBytes, "header overflows its slot");
+    if (world_size <= 0 || rank < 0 || rank >= world_size)
+        throw std::invalid_argument("ShmComm: bad rank " + std::to_string(rank) +
+                                    " for world size " + std::to_string(world_size));
+    const size_t W = static_cast<size_t>(world_size);
+    map_bytes_ = kHeaderBytes + kScratchBytes + W * sizeof(RankSync) + W * W * ring_stride_;
+
+    int fd = -1;
+    const auto start = Clock::now();
+    if (rank == 0) {
+        shm_unlink(name_.c_str());  // stale segment of a crashed run
+        fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) throw sys_error("shm_open " + name_);
+        if (ftruncate(fd, static_cast<off_t>(map_bytes_)) != 0) {
+            int err = errno;
+            close(fd);
+            shm_unlink(name_.c_str());
+            errno = err;
+            throw sys_error("ftruncate");
+        }
+    } else {
+        // Wait for rank 0 to create and size the segment
+        for (;;) {
+            fd = shm_open(name_.c_str(), O_RDWR, 0600);
+            if (fd >= 0) {
+                struct stat st;
+                if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                    if (static_cast<size_t>(st.st_size) != map_bytes_) {
+                        close(fd);
+                        throw std::runtime_error("ShmComm: segment " + name_ +
+                                                 " has a different world size or ring size");
+                    }
+                    break;
+                }
+                close(fd);
+            } else if (errno != ENOENT) {
+                throw sys_error("shm_open " + name_);
+            }
+            if (seconds_since(start) > timeout_s_)
+                throw std::runtime_error("ShmComm: timed out waiting for rank 0 to create " +
+                                         name_);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void* p = mmap(nullptr, map_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        if (rank == 0) shm_unlink(name_.c_str());
+        throw sys_error("mmap");
+    }
+    base_ = static_cast<char*>(p);
+    auto* h = reinterpret_cast<Header*>(base_);
+
+    if (rank == 0) {
+        new (h) Header();
+        h->world_size = world_size;
+        h->ring_bytes = ring_bytes_;
+        for (int i = 0; i < kScratchWords; ++i) new (scratch() + i) std::atomic<int64_t>(0);
+        for (int r = 0; r < world_size; ++r) new (sync(r)) RankSync();
+        for (int s = 0; s < world_size; ++s)
+            for (int d = 0; d < world_size; ++d) new (ring(s, d)) Ring();
+        h->magic.store(kMagic, std::memory_order_release);
+    } else {
+        while (h->magic.load(std::memory_order_acquire) != kMagic) {
+            if (seconds_since(start) > timeout_s_) {
+                munmap(base_, map_bytes_);
+                throw std::runtime_error("ShmComm: timed out waiting for " + name_ +
+                                         " to be initialized");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (h->world_size != world_size || h->ring_bytes != ring_bytes_) {
+            munmap(base_, map_bytes_);
+            throw std::runtime_error("ShmComm: segment " + name_ +
+                                     " has a different world size or ring size");
+        }
+    }
+
+    try {
+        barrier();
+    } catch (...) {
+        if (rank == 0) shm_unlink(name_.c_str());
+        munmap(base_, map_bytes_);
+        throw;
+    }
+    // Everyone holds a mapping now; drop the name so no segment outlives us
+    if (rank == 0) shm_unlink(name_.c_str());
+}
+
+ShmComm::~ShmComm() {
+    if (base_) munmap(base_, map_bytes_);
+}
+
+std::atomic<int64_t>* ShmComm::scratch() const {
+    return reinterpret_cast<std::atomic<int64_t>*>(base_ + kHeaderBytes);
+}
+
+ShmComm::RankSync* ShmComm::sync(int r) const {
+    return reinterpret_cast<RankSync*>(base_ + kHeaderBytes + kScratchBytes) + r;
+}
+
+ShmComm::Ring* ShmComm::ring(int src, int dst) const {
+    char* rings = base_ + kHeaderBytes + kScratchBytes +
+                  static_cast<size_t>(world_size_) * sizeof(RankSync);
+    return reinterpret_cast<Ring*>(
+        rings + (static_cast<size_t>(src) * world_size_ + dst) * ring_stride_);
+}
+
+void ShmComm::ring_doorbell(int r) {
+    RankSync* s = sync(r);
+    s->doorbell.fetch_add(1, std::memory_order_seq_cst);
+    if (s->sleeping.load(std::memory_order_seq_cst)) futex_wake(&s->doorbell, 1);
+}
+
+void ShmComm::wait_doorbell(uint32_t seen) {
+    RankSync* s = sync(rank_);
+    for (int i = 0; i < kSpins; ++i) {
+        if (s->doorbell.load(std::memory_order_acquire) != seen) return;
+        cpu_relax();
+    }
+    // Announce the sleep before re-checking: a peer either sees sleeping
+    // and wakes us, or we see its doorbell bump inside futex_wait.
+    s->sleeping.fetch_add(1, std::memory_order_seq_cst);
+    futex_wait(&s->doorbell, seen);
+    s->sleeping.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+void ShmComm::alltoallv(const void* const* send, const size_t* send_bytes,
+                        void* const* recv, const size_t* recv_bytes) {
+    const int W = world_size_, me = rank_;
+    if (send_bytes[me] != recv_bytes[me])
+        throw std::invalid_argument("ShmComm::alltoallv: self send and receive sizes differ");
+    if (send_bytes[me]) std::memcpy(recv[me], send[me], send_bytes[me]);
+
+    // Bounded steps let the reader drain a ring while the writer refills it
+    const size_t cap = ring_bytes_;
+    const size_t step = std::max<size_t>(cap / 4, 64);
+    std::vector<size_t>& sent = sent_;
+    std::vector<size_t>& got = got_;
+    sent.assign(W, 0);
+    got.assign(W, 0);
+    int pending = 0;
+    for (int r = 0; r < W; ++r)
+        if (r != me) pending += (send_bytes[r] > 0) + (recv_bytes[r] > 0);
+
+    RankSync* mine = sync(me);
+    bool idle = false;
+    Clock::time_point idle_since;
+    while (pending > 0) {
+        const uint32_t seen = mine->doorbell.load(std::memory_order_acquire);
+        bool progress = false;
+
+        // Staggered peer order so ranks do not all hit rank 0 first
+        for (int i = 1; i < W; ++i) {
+            const int dst = (me + i) % W;
+            if (sent[dst] < send_bytes[dst]) {
+                Ring* q = ring(me, dst);
+                const uint64_t head = q->head.load(std::memory_order_relaxed);
+                const uint64_t tail = q->tail.load(std::memory_order_acquire);
+                const size_t n = std::min({cap - static_cast<size_t>(head - tail),
+                                           send_bytes[dst] - sent[dst], step});
+                if (n > 0) {
+                    const char* src = static_cast<const char*>(send[dst]) + sent[dst];
+                    const size_t off = head % cap, first = std::min(n, cap - off);
+                    std::memcpy(q->data() + off, src, first);
+                    std::memcpy(q->data(), src + first, n - first);
+                    q->head.store(head + n, std::memory_order_release);
+                    ring_doorbell(dst);
+                    sent[dst] += n;
+                    pending -= sent[dst] == send_bytes[dst];
+                    progress = true;
+                }
+            }
+
+            const int src = (me - i + W) % W;
+            if (got[src] < recv_bytes[src]) {
+                Ring* q = ring(src, me);
+                const uint64_t tail = q->tail.load(std::memory_order_relaxed);
+                const uint64_t head = q->head.load(std::memory_order_acquire);
+                const size_t n = std::min({static_cast<size_t>(head - tail),
+                                           recv_bytes[src] - got[src], step});
+                if (n > 0) {
+                    char* dst_buf = static_cast<char*>(recv[src]) + got[src];
+                    const size_t off = tail % cap, first = std::min(n, cap - off);
+                    std::memcpy(dst_buf, q->data() + off, first);
+                    std::memcpy(dst_buf + first, q->data(), n - first);
+                    q->tail.store(tail + n, std::memory_order_release);
+                    ring_doorbell(src);
+                    got[src] += n;
+                    pending -= got[src] == recv_bytes[src];
+                    progress = true;
+                }
+            }
+        }
+
+        if (progress) {
+            idle = false;
+            continue;
+        }
+        if (!idle) {
+            idle = true;
+            idle_since = Clock::now();
+        } else if (seconds_since(idle_since) > timeout_s_) {
+            throw std::runtime_error("ShmComm::alltoallv: no progress from peers for " +
+                                     std::to_string(timeout_s_) + " s");
+        }
+        wait_doorbell(seen);
+    }
+}
+
+void ShmComm::alltoallv(const void* send, const size_t* send_bytes, const size_t* send_offsets,
+                        void* recv, const size_t* recv_bytes, const size_t* recv_offsets) {
+    const int W = world_size_;
+    send_ptrs_.resize(W);
+    recv_ptrs_.resize(W);
+    for (int r = 0; r < W; ++r) {
+        send_ptrs_[r] = static_cast<const char*>(send) + send_offsets[r];
+        recv_ptrs_[r] = static_cast<char*>(recv) + recv_offsets[r];
+    }
+    alltoallv(send_ptrs_.data(), send_bytes, recv_ptrs_.data(), recv_bytes);
+}
+
+void ShmComm::barrier() {
+    auto* h = reinterpret_cast<Header*>(base_);
+    const uint32_t gen = h->barrier_gen.load(std::memory_order_acquire);
+    if (h->barrier_count.fetch_add(1, std::memory_order_acq_rel) ==
+        static_cast<uint32_t>(world_size_ - 1)) {
+        h->barrier_count.store(0, std::memory_order_relaxed);
+        h->barrier_gen.fetch_add(1, std::memory_order_release);
+        futex_wake(&h->barrier_gen, INT_MAX);
+        return;
+    }
+    const auto start = Clock::now();
+    while (h->barrier_gen.load(std::memory_order_acquire) == gen) {
+        if (seconds_since(start) > timeout_s_)
+            throw std::runtime_error("ShmComm::barrier: timed out");
+        futex_wait(&h->barrier_gen, gen);
+    }
+}
+
+}  // namespace moe
@@ -0,0 +1,86 @@
+#pragma once
+// All-to-all-v between processes on one host over POSIX shared memory.
+//
+// One segment holds a W x W grid of single-producer/single-consumer byte
+// rings; ring (s, d) carries everything rank s sends to rank d, so a
+// collective is just each rank streaming its W-1 outgoing buffers into
+// its rings while draining its W-1 incoming rings. Messages larger than a
+// ring are streamed through it with backpressure. Each rank has one futex
+// doorbell that peers bump whenever they add data to its inbound rings or
+// free space in its outbound ones; a rank with nothing to do sleeps on it.
+//
+// Every rank constructs a ShmComm with the same name, world size and ring
+// size. Rank 0 creates the segment and unlinks the name once all ranks are
+// attached, so nothing is left in /dev/shm after setup. Collectives must be
+// called in the same order on every rank with matching byte counts (the
+// same contract as MPI_Alltoallv); a peer that stops responding makes the
+// call throw after timeout_s.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace moe {
+
+class ShmComm {
+public:
+    static constexpr size_t kDefaultRingBytes = size_t(1) << 20;
+    static constexpr int kScratchWords = 64;
+
+    ShmComm(const std::string& name, int rank, int world_size,
+            size_t ring_bytes = kDefaultRingBytes, double timeout_s = 60.0);
+    ~ShmComm();
+    ShmComm(const ShmComm&) = delete;
+    ShmComm& operator=(const ShmComm&) = delete;
+
+    int rank() const { return rank_; }
+    int world_size() const { return world_size_; }
+    size_t ring_bytes() const { return ring_bytes_; }
+
+    // send[r] (send_bytes[r] bytes) goes to rank r; recv[r] receives
+    // recv_bytes[r] bytes from rank r. recv_bytes[r] must equal what rank r
+    // passes as send_bytes[rank()].
+    void alltoallv(const void* const* send, const size_t* send_bytes,
+                   void* const* recv, const size_t* recv_bytes);
+
+    // Offset-addressed form (MPI_Alltoallv): rank r's block is
+    // send_bytes[r] bytes at send + send_offsets[r], and rank r's data lands
+    // at recv + recv_offsets[r]. pack_offsets (buffer_pool.h) lays blocks
+    // out back to back.
+    void alltoallv(const void* send, const size_t* send_bytes, const size_t* send_offsets,
+                   void* recv, const size_t* recv_bytes, const size_t* recv_offsets);
+
+    void barrier();
+
+    // kScratchWords zero-initialized words in the segment, shared by all
+    // ranks, for protocols layered on the rings (hier_comm.h).
+    std::atomic<int64_t>* scratch() const;
+
+private:
+    struct Header;
+    struct RankSync;
+    struct Ring;
+
+    Ring* ring(int src, int dst) const;
+    RankSync* sync(int r) const;
+    void ring_doorbell(int r);
+    void wait_doorbell(uint32_t seen);
+
+    std::string name_;
+    int rank_;
+    int world_size_;
+    size_t ring_bytes_;
+    size_t ring_stride_;
+    double timeout_s_;
+    size_t map_bytes_ = 0;
+    char* base_ = nullptr;
+
+    // Reused by every collective
+    std::vector<size_t> sent_, got_;
+    std::vector<const void*> send_ptrs_;
+    std::vector<void*> recv_ptrs_;
+};
+
+}  // namespace moe
@@ -0,0 +1,79 @@
+#pragma once
+// Minimal test harness: CHECK records failures, TEST registers a case,
+// run_all() runs every case and returns the process exit code.
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace check {
+
+struct Case {
+    const char* name;
+    std::function<void()> fn;
+};
+
+inline std::vector<Case>& registry() {
+    static std::vector<Case> cases;
+    return cases;
+}
+
+inline int& failures() {
+    static int n = 0;
+    return n;
+}
+
+struct Register {
+    Register(const char* name, std::function<void()> fn) { registry().push_back({name, fn}); }
+};
+
+inline int run_all() {
+    int failed_cases = 0;
+    for (auto& c : registry()) {
+        int before = failures();
+        try {
+            c.fn();
+        } catch (const std::exception& e) {
+            std::printf("  unexpected exception: %s\n", e.what());
+            ++failures();
+        }
+        bool ok = failures() == before;
+        failed_cases += !ok;
+        std::printf("%-44s %s\n", c.name, ok ? "PASS" : "FAIL");
+    }
+    std::printf("%zu cases, %d failed\n", registry().size(), failed_cases);
+    return failed_cases ? 1 : 0;
+}
+
+}  // namespace check
+
+#define CHECK_CAT2(a, b) a##b
+#define CHECK_CAT(a, b) CHECK_CAT2(a, b)
+
+#define TEST(name)                                                           \
+    static void name();                                                      \
+    static check::Register CHECK_CAT(reg_, name)(#name, name);               \
+    static void name()
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++check::failures();                                             \
+        }                                                                    \
+    } while (0)
+
+#define CHECK_THROWS(expr)                                                   \
+    do {                                                                     \
+        bool thrown = false;                                                 \
+        try {                                                                \
+            expr;                                                            \
+        } catch (...) {                                                      \
+            thrown = true;                                                   \
+        }                                                                    \
+        if (!thrown) {                                                       \
+            std::printf("  %s:%d: %s did not throw\n", __FILE__, __LINE__, #expr); \
+            ++check::failures();                                             \
+        }                                                                    \
+    } while (0)
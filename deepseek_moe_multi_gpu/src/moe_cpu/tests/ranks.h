@@ -0,0 +1,44 @@
+#pragma once
+// Helpers for the collective tests: forked ranks that report CHECK
+// failures, unique shm names, and deterministic message sizes and bytes.
+
+#include "check.h"
+#include "fork_ranks.h"
+
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+
+#include <unistd.h>
+
+namespace ranks {
+
+inline std::string unique_name(const char* tag) {
+    static int counter = 0;
+    return "/moe_test_" + std::string(tag) + "_" + std::to_string(getpid()) + "_" +
+           std::to_string(counter++);
+}
+
+// fn(rank) on world_size forked ranks; true if none failed a CHECK or threw
+inline bool run_ranks(int world_size, const std::function<void(int)>& fn) {
+    return moe::fork_ranks(world_size, [&](int rank) {
+        fn(rank);
+        return check::failures() ? 1 : 0;
+    });
+}
+
+inline uint8_t pattern(int src, int dst, int iter, size_t i) {
+    return static_cast<uint8_t>(src * 131 + dst * 31 + iter * 7 + i * 13);
+}
+
+// Same seed on every rank, so each side knows the full size matrix; every
+// fifth (src, dst, iter) sends nothing
+inline size_t message_bytes(int src, int dst, int iter, size_t max_bytes,
+                            size_t min_bytes = 0) {
+    std::mt19937 rng(static_cast<unsigned>(src * 1000 + dst * 10 + iter));
+    size_t n = std::uniform_int_distribution<size_t>(min_bytes, max_bytes)(rng);
+    return (iter + src + dst) % 5 == 0 ? 0 : n;
+}
+
+}  // namespace ranks
@@ -0,0 +1,63 @@
+// Tests for the growing message buffer pool.
+
+#include "buffer_pool.h"
+#include "check.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+TEST(grows_only_past_capacity) {
+    moe::BufferPool pool;
+    uint8_t* a = pool.get(0, 1000);
+    CHECK(a != nullptr);
+    CHECK(pool.capacity(0) >= 1500);              // 1.5x headroom
+    CHECK(reinterpret_cast<uintptr_t>(a) % 64 == 0);
+    CHECK(pool.allocations() == 1);
+    CHECK(pool.get(0, 1400) == a);                 // fits: same buffer
+    CHECK(pool.get(0, 10) == a);                   // never shrinks
+    CHECK(pool.allocations() == 1);
+    pool.get(0, 5000);
+    CHECK(pool.allocations() == 2);
+    CHECK(pool.capacity(0) >= 7500);
+}
+
+TEST(slots_are_independent) {
+    moe::BufferPool pool;
+    uint8_t* a = pool.get(0, 256);
+    uint8_t* b = pool.get(3, 256);
+    CHECK(a != b);
+    std::memset(a, 1, 256);
+    std::memset(b, 2, 256);
+    CHECK(a[255] == 1 && b[0] == 2);
+    CHECK(pool.capacity(1) == 0);
+    CHECK(pool.total_bytes() == pool.capacity(0) + pool.capacity(3));
+}
+
+TEST(zero_bytes_gives_a_buffer) {
+    moe::BufferPool pool;
+    CHECK(pool.get(0, 0) != nullptr);
+    CHECK(pool.allocations() == 1);
+    pool.release();
+    CHECK(pool.total_bytes() == 0);
+}
+
+TEST(steady_state_allocates_nothing) {
+    // Step sizes wander below an early high-water mark
+    moe::BufferPool pool;
+    const size_t sizes[] = {4000, 3900, 100, 4100, 2000, 4500, 10, 3000};
+    for (size_t n : sizes) {
+        pool.get(0, n);
+        pool.get(1, n / 2);
+    }
+    CHECK(pool.allocations() == 2);
+}
+
+TEST(pack_offsets_prefix_sum) {
+    const size_t counts[] = {3, 0, 5, 1};
+    size_t offsets[4];
+    CHECK(moe::pack_offsets(counts, 4, offsets) == 9);
+    CHECK(offsets[0] == 0 && offsets[1] == 3 && offsets[2] == 3 && offsets[3] == 8);
+}
+
+int main() { return check::run_all(); }
@@ -0,0 +1,242 @@
+// Unit tests for the dispatch plan, gather and weighted scatter.
+
+#include "check.h"
+#include "dispatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Routing {
+    int N, K, E;
+    std::vector<int> idx;
+    std::vector<float> w;
+};
+
+// Distinct experts per token, like torch.topk over a softmax
+Routing random_routing(int N, int K, int E, unsigned seed) {
+    Routing r{N, K, E, std::vector<int>(static_cast<size_t>(N) * K),
+              std::vector<float>(static_cast<size_t>(N) * K)};
+    std::mt19937 rng(seed);
+    std::vector<int> perm(E);
+    for (int n = 0; n < N; ++n) {
+        for (int e = 0; e < E; ++e) perm[e] = e;
+        std::shuffle(perm.begin(), perm.end(), rng);
+        for (int k = 0; k < K; ++k) {
+            r.idx[n * K + k] = perm[k];
+            r.w[n * K + k] = std::uniform_real_distribution<float>(0.1f, 2.5f)(rng);
+        }
+    }
+    return r;
+}
+
+std::vector<float> random_x(int N, int H, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> d(-1.0f, 1.0f);
+    std::vector<float> x(static_cast<size_t>(N) * H);
+    for (auto& v : x) v = d(rng);
+    return x;
+}
+
+// Structural invariants every plan must satisfy
+void check_plan(const moe::DispatchPlan& p, const Routing& r, const int* owner) {
+    const int R = r.N * r.K;
+    CHECK(p.num_rows() == R);
+
+    std::vector<int> count(r.E, 0);
+    for (int i = 0; i < R; ++i) count[r.idx[i]]++;
+    for (int e = 0; e < r.E; ++e) {
+        CHECK(p.expert_count[e] == count[e]);
+        CHECK(p.expert_rank[e] == (owner ? owner[e] : e % p.world_size));
+        int prev = -1;
+        for (int row = p.expert_begin[e]; row < p.expert_begin[e] + p.expert_count[e]; ++row) {
+            CHECK(p.row_expert[row] == e);
+            CHECK(p.row_token[row] > prev);  // ascending tokens, a token at most once per expert
+            prev = p.row_token[row];
+            int rank = p.expert_rank[e];
+            CHECK(row >= p.rank_offsets[rank] && row < p.rank_offsets[rank + 1]);
+        }
+    }
+    CHECK(p.rank_offsets.front() == 0 && p.rank_offsets.back() == R);
+
+    for (int i = 0; i < R; ++i) {
+        int row = p.slot_row[i];
+        CHECK(row >= 0 && row < R);
+        CHECK(p.row_token[row] == i / r.K);
+        CHECK(p.row_expert[row] == r.idx[i]);
+        CHECK(p.row_weight[row] == r.w[i]);
+    }
+}
+
+bool same_plan(const moe::DispatchPlan& a, const moe::DispatchPlan& b) {
+    return a.row_token == b.row_token && a.row_expert == b.row_expert &&
+           a.row_weight == b.row_weight && a.slot_row == b.slot_row &&
+           a.expert_begin == b.expert_begin && a.rank_offsets == b.rank_offsets;
+}
+
+}  // namespace
+
+TEST(plan_round_robin) {
+    Routing r = random_routing(1000, 2, 8, 1);
+    moe::DispatchPlan p;
+    moe::build_plan(r.idx.data(), r.w.data(), r.N, r.K, r.E, nullptr, 3, p, 1);
+    check_plan(p, r, nullptr);
+}
+
+TEST(plan_placement_table) {
+    Routing r = random_routing(777, 3, 8, 2);
+    const int owner[8] = {1, 1, 0, 2, 2, 2, 0, 1};
+    moe::DispatchPlan p;
+    moe::build_plan(r.idx.data(), r.w.data(), r.N, r.K, r.E, owner, 3, p, 2);
+    check_plan(p, r, owner);
+    // Rank 0 owns experts 2 and 6: its slice holds exactly their rows, expert 2 first
+    CHECK(p.rank_offsets[1] - p.rank_offsets[0] == p.expert_count[2] + p.expert_count[6]);
+    CHECK(p.expert_begin[2] == 0 && p.expert_begin[6] == p.expert_count[2]);
+}
+
+TEST(plan_without_weights) {
+    Routing r = random_routing(50, 2, 4, 3);
+    moe::DispatchPlan p;
+    moe::build_plan(r.idx.data(), nullptr, r.N, r.K, r.E, nullptr, 2, p);
+    for (float w : p.row_weight) CHECK(w == 1.0f);
+}
+
+TEST(plan_independent_of_thread_count) {
+    // Large enough for several histogram chunks
+    Routing r = random_routing(30000, 2, 8, 4);
+    moe::DispatchPlan ref;
+    moe::build_plan(r.idx.data(), r.w.data(), r.N, r.K, r.E, nullptr, 4, ref, 1);
+    check_plan(ref, r, nullptr);
+    for (int t : {2, 3, 7}) {
+        moe::DispatchPlan p;
+        moe::build_plan(r.idx.data(), r.w.data(), r.N, r.K, r.E, nullptr, 4, p, t);
+        CHECK(same_plan(p, ref));
+    }
+}
+
+TEST(plan_empty) {
+    moe::DispatchPlan p;
+    moe::build_plan(nullptr, nullptr, 0, 2, 4, nullptr, 2, p);
+    CHECK(p.num_rows() == 0);
+    CHECK(p.rank_offsets.size() == 3 && p.rank_offsets[2] == 0);
+}
+
+TEST(plan_rejects_bad_input) {
+    std::vector<int> idx = {0, 1, 2, 4};
+    moe::DispatchPlan p;
+    CHECK_THROWS(moe::build_plan(idx.data(), nullptr, 2, 2, 4, nullptr, 2, p));
+    idx[3] = -1;
+    CHECK_THROWS(moe::build_plan(idx.data(), nullptr, 2, 2, 4, nullptr, 2, p));
+    idx[3] = 3;
+    const int owner[4] = {0, 1, 2, 0};
+    CHECK_THROWS(moe::build_plan(idx.data(), nullptr, 2, 2, 4, owner, 2, p));
+    CHECK_THROWS(moe::build_plan(idx.data(), nullptr, 2, 0, 4, nullptr, 2, p));
+}
+
+TEST(replicas_prefer_local_copy_then_split) {
+    // Expert 0 on ranks {0, 2}, expert 1 on {1}, expert 2 on {2, 0, 1}
+    const int owner[3] = {0, 1, 2};
+    moe::ReplicaTable t = moe::ReplicaTable::single(owner, 3, 3);
+    t.offsets = {0, 2, 3, 6};
+    t.ranks = {0, 2, 1, 2, 0, 1};
+
+    std::vector<int> idx(600);
+    for (size_t i = 0; i < idx.size(); ++i) idx[i] = static_cast<int>(i % 3);
+    std::vector<int> v(idx.size());
+
+    // Rank 0 holds copies of experts 0 and 2: those never leave it
+    moe::assign_replicas(idx.data(), 300, 2, t, 0, v.data());
+    for (size_t i = 0; i < idx.size(); ++i) {
+        CHECK(t.virtual_expert(v[i]) == idx[i]);
+        if (idx[i] != 1) CHECK(t.ranks[v[i]] == 0);
+    }
+
+    // Rank 1 has no copy of expert 0: its tokens alternate over ranks 0 and 2
+    moe::assign_replicas(idx.data(), 300, 2, t, 1, v.data());
+    int to_rank[3] = {0, 0, 0};
+    for (size_t i = 0; i < idx.size(); ++i)
+        if (idx[i] == 0) to_rank[t.ranks[v[i]]]++;
+    CHECK(to_rank[0] == 100 && to_rank[2] == 100 && to_rank[1] == 0);
+
+    // Virtual ids plug straight into build_plan
+    std::vector<float> w(idx.size(), 1.0f);
+    moe::DispatchPlan p;
+    moe::build_plan(v.data(), w.data(), 300, 2, t.num_virtual(), t.ranks.data(), 3, p);
+    CHECK(p.rank_offsets[1] - p.rank_offsets[0] == 100);
+    CHECK(p.rank_offsets[3] - p.rank_offsets[2] == 100);
+
+    CHECK_THROWS(moe::assign_replicas(idx.data(), 300, 2, t, 3, v.data()));
+    idx[5] = 3;
+    CHECK_THROWS(moe::assign_replicas(idx.data(), 300, 2, t, 0, v.data()));
+}
+
+TEST(gather_rows) {
+    const int H = 37;
+    Routing r = random_routing(300, 2, 8, 5);
+    std::vector<float> x = random_x(r.N, H, 6);
+    moe::DispatchPlan p;
+    moe::build_plan(r.idx.data(), r.w.data(), r.N, r.K, r.E, nullptr, 2, p);
+    std::vector<float> rows(static_cast<size_t>(p.num_rows()) * H);
+    moe::gather(p, x.data(), H, rows.data(), 3);
+    for (int row = 0; row < p.num_rows(); ++row)
+        CHECK(std::memcmp(&rows[static_cast<size_t>(row) * H],
+                          &x[static_cast<size_t>(p.row_token[row]) * H], H * sizeof(float)) == 0);
+}
+
+TEST(scatter_matches_reference) {
+    const int H = 64;
+    Routing r = random_routing(513, 2, 8, 7);
+    std::vector<float> x = random_x(r.N, H, 8);
+    moe::DispatchPlan p;
+    moe::build_plan(r.idx.data(), r.w.data(), r.N, r.K, r.E, nullptr, 2, p);
+
+    // Stand-in expert: y = (e + 1) * x
+    std::vector<float> rows(static_cast<size_t>(p.num_rows()) * H);
+    moe::gather(p, x.data(), H, rows.data());
+    for (int row = 0; row < p.num_rows(); ++row)
+        for (int h = 0; h < H; ++h) rows[static_cast<size_t>(row) * H + h] *= p.row_expert[row] + 1;
+
+    std::vector<float> out = x;  // accumulate onto the residual
+    moe::scatter_weighted(p, rows.data(), H, out.data(), true, true, 1);
+
+    double max_err = 0.0;
+    for (int n = 0; n < r.N; ++n) {
+        for (int h = 0; h < H; ++h) {
+            float ref = x[n * H + h];
+            for (int k = 0; k < r.K; ++k)
+                ref += r.w[n * r.K + k] * (r.idx[n * r.K + k] + 1) * x[n * H + h];
+            max_err = std::fmax(max_err, std::fabs(ref - out[n * H + h]));
+        }
+    }
+    CHECK(max_err < 1e-5);
+
+    // Overwrite mode, unweighted
+    std::vector<float> sum(x.size(), 123.0f);
+    moe::scatter_weighted(p, rows.data(), H, sum.data(), false, false);
+    for (int h = 0; h < H; ++h) {
+        float ref = 0.0f;
+        for (int k = 0; k < r.K; ++k) ref += (r.idx[k] + 1) * x[h];
+        CHECK(std::fabs(sum[h] - ref) < 1e-5f);
+    }
+}
+
+TEST(scatter_bitwise_across_threads) {
+    const int H = 96;
+    Routing r = random_routing(4000, 2, 8, 9);
+    std::vector<float> y = random_x(r.N * r.K, H, 10);
+    moe::DispatchPlan p;
+    moe::build_plan(r.idx.data(), r.w.data(), r.N, r.K, r.E, nullptr, 4, p);
+    std::vector<float> ref(static_cast<size_t>(r.N) * H);
+    moe::scatter_weighted(p, y.data(), H, ref.data(), false, true, 1);
+    for (int t : {2, 3, 8}) {
+        std::vector<float> out(ref.size());
+        moe::scatter_weighted(p, y.data(), H, out.data(), false, true, t);
+        CHECK(std::memcmp(out.data(), ref.data(), ref.size() * sizeof(float)) == 0);
+    }
+}
+
+int main() { return check::run_all(); }
@@ -0,0 +1,100 @@
+// Unit tests for the EP step cost model.
+
+#include "check.h"
+#include "ep_sim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+moe::Topology topology(int W, int per_node) {
+    moe::Topology t;
+    t.world_size = W;
+    t.ranks_per_node = per_node;
+    t.intra_gbps = 100.0;
+    t.intra_latency_us = 1.0;
+    t.inter_gbps = 10.0;
+    t.inter_latency_us = 5.0;
+    return t;
+}
+
+moe::ReplicaTable round_robin(int E, int W) {
+    std::vector<int> owner(E);
+    for (int e = 0; e < E; ++e) owner[e] = e % W;
+    return moe::ReplicaTable::single(owner.data(), E, W);
+}
+
+bool near(double a, double b) { return std::fabs(a - b) <= 1e-9 * std::max(1.0, std::fabs(b)); }
+
+}  // namespace
+
+TEST(alltoall_alpha_beta_per_link_class) {
+    // 4 ranks, 2 per node; rank 0 sends 1 MB to 1 (same node) and 2 (other)
+    auto topo = topology(4, 2);
+    std::vector<double> bytes(16, 0.0);
+    bytes[0 * 4 + 1] = 1e6;
+    bytes[0 * 4 + 2] = 1e6;
+    // intra 1e6 / 1e5 = 10 us, inter 1e6 / 1e4 = 100 us, + both latencies
+    CHECK(near(moe::alltoall_us(bytes, topo), 100.0 + 1.0 + 5.0));
+    // self traffic is free
+    std::vector<double> self(16, 0.0);
+    self[5] = 1e9;
+    CHECK(moe::alltoall_us(self, topo) == 0.0);
+    CHECK_THROWS(moe::alltoall_us(std::vector<double>(3, 0.0), topo));
+}
+
+TEST(rows_follow_the_dispatch_plan) {
+    // 4 tokens on 2 ranks (2 each), top-2 of 4 experts, round-robin owners
+    const int idx[] = {0, 1,  2, 3,  1, 3,  0, 2};
+    moe::LayerShape shape;
+    shape.hidden = 4;
+    shape.intermediate = 8;
+    shape.shared_intermediate = 0;
+    shape.wire = moe::WireFormat::F32;
+    shape.rank_tflops = 1.0;
+    auto topo = topology(2, 1);
+    moe::StepPrediction p;
+    moe::simulate_step(idx, 4, 2, round_robin(4, 2), shape, topo, p);
+    // rank 0 tokens route to {0,1,2,3}: experts 0,2 on rank 0, 1,3 on rank 1
+    CHECK(p.send_rows == (std::vector<long>{2, 2, 2, 2}));
+    // dispatch row = 4 B id + 16 B, combine 16 B; only the off-diagonal moves
+    CHECK(near(p.inter_bytes, 2 * 2 * (20.0 + 16.0)));
+    CHECK(p.intra_bytes == 0.0);
+    CHECK(near(p.dispatch_us, 2 * 20.0 / 1e4 + 5.0));
+    // each rank computes 4 rows of 6 * H * I flops at 1 TFLOP/s
+    CHECK(near(p.max_compute_us, 4 * 6.0 * 4 * 8 / 1e6));
+    CHECK(near(p.step_us, p.dispatch_us + p.max_compute_us + p.combine_us));
+}
+
+TEST(replicas_keep_hot_tokens_local) {
+    // Every token picks expert 0; with a copy on every rank nothing moves
+    const int W = 4, N = 64;
+    std::vector<int> idx(N, 0);
+    moe::LayerShape shape;
+    auto topo = topology(W, 2);
+    moe::StepPrediction single, copied;
+    moe::simulate_step(idx.data(), N, 1, round_robin(8, W), shape, topo, single);
+    moe::ReplicaTable t = round_robin(8, W);
+    t.ranks.insert(t.ranks.begin() + 1, {1, 2, 3});
+    for (int e = 1; e <= 8; ++e) t.offsets[e] += 3;
+    moe::simulate_step(idx.data(), N, 1, t, shape, topo, copied);
+    CHECK(single.inter_bytes > 0.0 && single.max_compute_us > copied.max_compute_us);
+    CHECK(copied.intra_bytes == 0.0 && copied.inter_bytes == 0.0);
+    CHECK(copied.dispatch_us == 0.0);
+    for (int r = 0; r < W; ++r) CHECK(copied.send_rows[r * W + r] == N / W);
+}
+
+TEST(rejects_bad_input) {
+    const int idx[] = {0, 9};
+    moe::StepPrediction p;
+    moe::LayerShape shape;
+    CHECK_THROWS(moe::simulate_step(idx, 2, 1, round_robin(4, 2), shape, topology(2, 1), p));
+    CHECK_THROWS(moe::simulate_step(idx, 1, 1, round_robin(4, 2), shape, topology(4, 1), p));
+    auto bad = topology(2, 1);
+    bad.inter_gbps = 0.0;
+    CHECK_THROWS(moe::simulate_step(idx, 1, 1, round_robin(4, 2), shape, bad, p));
+}
+
+int main() { return check::run_all(); }
@@ -0,0 +1,131 @@
+// Unit tests for the load-aware expert placement planner.
+
+#include "check.h"
+#include "dispatch.h"
+#include "placement.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+
+std::vector<int> round_robin(int E, int W) {
+    std::vector<int> owner(E);
+    for (int e = 0; e < E; ++e) owner[e] = moe::round_robin_owner(e, W);
+    return owner;
+}
+
+// Zipf-like loads: expert e gets ~ 1 / (rank + 1)^s tokens, shuffled
+std::vector<double> skewed_loads(int E, double s, unsigned seed) {
+    std::vector<double> load(E);
+    for (int e = 0; e < E; ++e) load[e] = std::floor(10000.0 / std::pow(e + 1.0, s));
+    std::shuffle(load.begin(), load.end(), std::mt19937(seed));
+    return load;
+}
+
+}  // namespace
+
+TEST(uniform_loads_balance_perfectly) {
+    std::vector<double> load(16, 100.0);
+    auto owner = moe::plan_placement(load.data(), 16, 4, nullptr);
+    auto s = moe::evaluate_placement(load.data(), 16, 4, nullptr, owner.data(), 0.0);
+    CHECK(s.max_load == 400.0);
+}
+
+TEST(never_worse_than_round_robin) {
+    for (double skew : {0.0, 0.5, 1.0, 1.5}) {
+        for (int W : {2, 4, 8}) {
+            const int E = 64;
+            auto load = skewed_loads(E, skew, 7 + W);
+            auto planned = moe::plan_placement(load.data(), E, W, nullptr);
+            auto rr = round_robin(E, W);
+            auto sp = moe::evaluate_placement(load.data(), E, W, nullptr, planned.data(), 0.0);
+            auto sr = moe::evaluate_placement(load.data(), E, W, nullptr, rr.data(), 0.0);
+            CHECK(sp.max_load <= sr.max_load);
+            // LPT bound: within 4/3 of the trivial lower bound
+            double lower = std::max(*std::max_element(load.begin(), load.end()),
+                                    sp.mean_cost);
+            CHECK(sp.max_load <= lower * 4.0 / 3.0 + 1e-9);
+        }
+    }
+}
+
+TEST(hot_expert_gets_a_rank_to_itself) {
+    std::vector<double> load = {1000, 10, 10, 10, 10, 10, 10, 10};
+    auto owner = moe::plan_placement(load.data(), 8, 2, nullptr);
+    for (int e = 1; e < 8; ++e) CHECK(owner[e] != owner[0]);
+}
+
+TEST(respects_expert_cap) {
+    auto load = skewed_loads(12, 1.2, 3);
+    moe::PlacementOptions opts;
+    opts.max_experts_per_rank = 3;
+    auto owner = moe::plan_placement(load.data(), 12, 4, nullptr, opts);
+    std::vector<int> count(4, 0);
+    for (int r : owner) count[r]++;
+    for (int c : count) CHECK(c == 3);
+    opts.max_experts_per_rank = 2;
+    CHECK_THROWS(moe::plan_placement(load.data(), 12, 4, nullptr, opts));
+}
+
+TEST(comm_term_keeps_experts_near_their_tokens) {
+    // Rank r sends all tokens of experts {r, r + 4}; loads are equal
+    const int E = 8, W = 4;
+    std::vector<double> load(E, 100.0), traffic(W * E, 0.0);
+    for (int e = 0; e < E; ++e) traffic[(e % W) * E + e] = 100.0;
+    // Permute ids so round-robin would not already match
+    std::vector<double> load_p(E), traffic_p(W * E);
+    const int perm[E] = {3, 6, 1, 4, 7, 0, 5, 2};
+    for (int e = 0; e < E; ++e) {
+        load_p[perm[e]] = load[e];
+        for (int r = 0; r < W; ++r) traffic_p[r * E + perm[e]] = traffic[r * E + e];
+    }
+    moe::PlacementOptions opts;
+    opts.comm_weight = 0.5;
+    auto owner = moe::plan_placement(load_p.data(), E, W, traffic_p.data(), opts);
+    auto s = moe::evaluate_placement(load_p.data(), E, W, traffic_p.data(), owner.data(), 0.5);
+    CHECK(s.remote == 0.0);
+    CHECK(s.max_load == 200.0);
+}
+
+TEST(replicas_split_a_hot_expert) {
+    // One expert carries half the tokens: no placement can balance it
+    const int E = 8, W = 4;
+    std::vector<double> load = {4000, 600, 600, 500, 500, 300, 300, 200};
+    auto owner = moe::plan_placement(load.data(), E, W, nullptr);
+    auto single = moe::ReplicaTable::single(owner.data(), E, W);
+    auto base = moe::evaluate_replicas(load.data(), nullptr, single, 0.0);
+    auto placed = moe::evaluate_placement(load.data(), E, W, nullptr, owner.data(), 0.0);
+    CHECK(std::fabs(base.max_cost - placed.max_cost) < 1e-6);
+
+    auto t = moe::plan_replicas(load.data(), E, W, nullptr, owner.data(), 1, W, 0.0);
+    CHECK(t.copies(0) > 1);
+    for (int e = 1; e < E; ++e) CHECK(t.copies(e) == 1);
+    CHECK(t.ranks[t.offsets[0]] == owner[0]);  // primary stays first
+    auto s = moe::evaluate_replicas(load.data(), nullptr, t, 0.0);
+    CHECK(s.max_load < base.max_load * 0.6);
+}
+
+TEST(replicas_only_when_they_help) {
+    std::vector<double> load(16, 100.0);
+    auto owner = round_robin(16, 4);
+    auto t = moe::plan_replicas(load.data(), 16, 4, nullptr, owner.data(), 4, 4, 0.1);
+    CHECK(t.num_virtual() == 16);
+    auto none = moe::plan_replicas(load.data(), 16, 4, nullptr, owner.data(), 0, 4, 0.1);
+    CHECK(none.ranks == owner);
+}
+
+TEST(rejects_bad_input) {
+    std::vector<double> load = {1, 2, -1};
+    CHECK_THROWS(moe::plan_placement(load.data(), 3, 2, nullptr));
+    load[2] = 1;
+    std::vector<double> traffic = {5, 0, 0, 0, 0, 0};  // more than load[0]
+    CHECK_THROWS(moe::plan_placement(load.data(), 3, 2, traffic.data()));
+    CHECK_THROWS(moe::plan_placement(load.data(), 3, 0, nullptr));
+    const int owner[3] = {0, 1, 2};
+    CHECK_THROWS(moe::evaluate_placement(load.data(), 3, 2, nullptr, owner, 0.0));
+}
+
+int main() { return check::run_all(); }
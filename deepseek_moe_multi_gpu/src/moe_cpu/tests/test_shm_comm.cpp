@@ -0,0 +1,123 @@
+// Tests for the shared-memory all-to-all-v; every rank is a forked process.
+
+#include "buffer_pool.h"
+#include "check.h"
+#include "ranks.h"
+#include "shm_comm.h"
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+
+namespace {
+
+using ranks::message_bytes;
+using ranks::pattern;
+using ranks::run_ranks;
+using ranks::unique_name;
+
+void exchange(const std::string& name, int world_size, size_t ring_bytes, size_t max_bytes,
+              int iters) {
+    CHECK(run_ranks(world_size, [&](int rank) {
+        moe::ShmComm comm(name, rank, world_size, ring_bytes, 10.0);
+        for (int it = 0; it < iters; ++it) {
+            std::vector<std::vector<uint8_t>> send(world_size), recv(world_size);
+            std::vector<const void*> sp(world_size);
+            std::vector<void*> rp(world_size);
+            std::vector<size_t> sb(world_size), rb(world_size);
+            for (int r = 0; r < world_size; ++r) {
+                sb[r] = message_bytes(rank, r, it, max_bytes);
+                rb[r] = message_bytes(r, rank, it, max_bytes);
+                send[r].resize(sb[r]);
+                for (size_t i = 0; i < sb[r]; ++i) send[r][i] = pattern(rank, r, it, i);
+                recv[r].assign(rb[r], 0);
+                sp[r] = send[r].data();
+                rp[r] = recv[r].data();
+            }
+            comm.alltoallv(sp.data(), sb.data(), rp.data(), rb.data());
+            for (int r = 0; r < world_size; ++r) {
+                bool same = true;
+                for (size_t i = 0; i < rb[r]; ++i)
+                    same = same && recv[r][i] == pattern(r, rank, it, i);
+                CHECK(same);
+            }
+        }
+        comm.barrier();
+    }));
+}
+
+}  // namespace
+
+TEST(single_rank) { exchange(unique_name("w1"), 1, 4096, 1000, 3); }
+
+TEST(messages_larger_than_ring) {
+    // 256-byte rings force wrap-around and backpressure on every message
+    exchange(unique_name("small"), 3, 256, 5000, 20);
+}
+
+TEST(four_ranks_large_messages) { exchange(unique_name("large"), 4, 64 << 10, 1 << 20, 4); }
+
+TEST(offset_addressed_exchange) {
+    // One contiguous buffer per side with exact, unpadded blocks; a guard
+    // byte past the last block must survive
+    const int W = 3, iters = 5;
+    const std::string name = unique_name("offsets");
+    CHECK(run_ranks(W, [&](int rank) {
+        moe::ShmComm comm(name, rank, W, 512, 10.0);
+        std::vector<size_t> sb(W), rb(W), so(W), ro(W);
+        for (int it = 0; it < iters; ++it) {
+            for (int r = 0; r < W; ++r) {
+                sb[r] = message_bytes(rank, r, it, 3000);
+                rb[r] = message_bytes(r, rank, it, 3000);
+            }
+            std::vector<uint8_t> send(moe::pack_offsets(sb.data(), W, so.data()));
+            std::vector<uint8_t> recv(moe::pack_offsets(rb.data(), W, ro.data()) + 1, 0xAB);
+            for (int r = 0; r < W; ++r)
+                for (size_t i = 0; i < sb[r]; ++i) send[so[r] + i] = pattern(rank, r, it, i);
+            comm.alltoallv(send.data(), sb.data(), so.data(), recv.data(), rb.data(), ro.data());
+            bool same = true;
+            for (int r = 0; r < W; ++r)
+                for (size_t i = 0; i < rb[r]; ++i)
+                    same = same && recv[ro[r] + i] == pattern(r, rank, it, i);
+            CHECK(same);
+            CHECK(recv.back() == 0xAB);
+        }
+        comm.barrier();
+    }));
+}
+
+TEST(barrier_orders_ranks) {
+    // Each rank bumps a counter in an anonymous shared page between barriers
+    auto* counter = static_cast<std::atomic<int>*>(mmap(nullptr, 4096, PROT_READ | PROT_WRITE,
+                                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    new (counter) std::atomic<int>(0);
+    const int W = 3;
+    std::string name = unique_name("barrier");
+    CHECK(run_ranks(W, [&](int rank) {
+        moe::ShmComm comm(name, rank, W, 4096, 10.0);
+        for (int round = 1; round <= 5; ++round) {
+            counter->fetch_add(1);
+            comm.barrier();
+            CHECK(counter->load() == round * W);
+            comm.barrier();
+        }
+    }));
+    munmap(counter, 4096);
+}
+
+TEST(missing_peer_times_out) {
+    std::string name = unique_name("timeout");
+    CHECK_THROWS(moe::ShmComm(name, 0, 2, 4096, 0.2));
+    CHECK(shm_unlink(name.c_str()) != 0);  // nothing left behind
+}
+
+TEST(rejects_bad_rank) {
+    CHECK_THROWS(moe::ShmComm(unique_name("bad"), 2, 2));
+    CHECK_THROWS(moe::ShmComm(unique_name("bad"), 0, 0));
+}
+
+int main() { return check::run_all(); }
@@ -0,0 +1,109 @@
+// Unit tests for the EP wire codecs.
+
+#include "check.h"
+#include "wire.h"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace {
+
+std::vector<float> random_rows(long rows, int H, float scale, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> d(0.0f, scale);
+    std::vector<float> x(static_cast<size_t>(rows) * H);
+    for (float& v : x) v = d(rng);
+    return x;
+}
+
+std::vector<float> round_trip(const std::vector<float>& x, long rows, int H,
+                              moe::WireFormat fmt, int threads = 1) {
+    std::vector<uint8_t> buf(rows * moe::wire_row_bytes(fmt, H));
+    std::vector<float> y(x.size());
+    moe::encode_rows(x.data(), rows, H, fmt, buf.data(), threads);
+    moe::decode_rows(buf.data(), rows, H, fmt, y.data(), threads);
+    return y;
+}
+
+}  // namespace
+
+TEST(row_bytes) {
+    CHECK(moe::wire_row_bytes(moe::WireFormat::F32, 7168) == 28672);
+    CHECK(moe::wire_row_bytes(moe::WireFormat::BF16, 7168) == 14336);
+    CHECK(moe::wire_row_bytes(moe::WireFormat::FP8_E4M3, 7168) == 7172);
+    CHECK_THROWS(moe::wire_row_bytes(static_cast<moe::WireFormat>(3), 8));
+}
+
+TEST(f32_is_exact) {
+    auto x = random_rows(100, 33, 3.0f, 1);
+    CHECK(round_trip(x, 100, 33, moe::WireFormat::F32) == x);
+}
+
+TEST(bf16_rounds_to_nearest_even) {
+    CHECK(moe::f32_to_bf16(1.0f) == 0x3f80);
+    // 1 + 2^-8 is halfway between 1 and 1 + 2^-7: ties go to the even 1.0
+    CHECK(moe::f32_to_bf16(1.00390625f) == 0x3f80);
+    CHECK(moe::f32_to_bf16(1.01171875f) == 0x3f82);
+    CHECK(std::isnan(moe::bf16_to_f32(moe::f32_to_bf16(NAN))));
+    auto x = random_rows(300, 64, 5.0f, 2);
+    auto y = round_trip(x, 300, 64, moe::WireFormat::BF16);
+    for (size_t i = 0; i < x.size(); ++i)
+        CHECK(std::fabs(y[i] - x[i]) <= std::fabs(x[i]) * (1.0f / 256.0f));
+}
+
+TEST(e4m3_table_round_trips) {
+    // Every finite code decodes to a value that encodes back to it
+    for (int b = 0; b < 256; ++b) {
+        float v = moe::e4m3_to_f32(static_cast<uint8_t>(b));
+        if (std::isnan(v)) {
+            CHECK((b & 0x7f) == 0x7f);
+            continue;
+        }
+        uint8_t back = moe::f32_to_e4m3(v);
+        CHECK(back == b || (v == 0.0f && (back & 0x7f) == 0));
+    }
+    CHECK(moe::e4m3_to_f32(0x7e) == 448.0f);
+    CHECK(moe::e4m3_to_f32(0x01) == std::ldexp(1.0f, -9));
+    CHECK(moe::f32_to_e4m3(1e6f) == 0x7e);     // saturates
+    CHECK(moe::f32_to_e4m3(-1e6f) == 0xfe);
+    CHECK(moe::f32_to_e4m3(1.0625f) == 0x38);  // tie between 1 and 1.125 -> even
+    CHECK(moe::f32_to_e4m3(1.1875f) == 0x3a);  // tie between 1.125 and 1.25 -> even
+}
+
+TEST(fp8_per_row_scale) {
+    // Rows of very different magnitude keep the same relative accuracy
+    const int H = 128;
+    std::vector<float> x = random_rows(4, H, 1.0f, 3);
+    const float mags[4] = {1e-4f, 1.0f, 37.0f, 5e4f};
+    for (int r = 0; r < 4; ++r)
+        for (int i = 0; i < H; ++i) x[r * H + i] *= mags[r];
+    auto y = round_trip(x, 4, H, moe::WireFormat::FP8_E4M3);
+    for (int r = 0; r < 4; ++r) {
+        float amax = 0.0f;
+        for (int i = 0; i < H; ++i) amax = std::fmax(amax, std::fabs(x[r * H + i]));
+        for (int i = 0; i < H; ++i) {
+            const float a = x[r * H + i], b = y[r * H + i];
+            // Half a step of 3 mantissa bits, or of the subnormal grid
+            CHECK(std::fabs(b - a) <= std::fmax(std::fabs(a) / 16.0f,
+                                                amax / 448.0f * std::ldexp(1.0f, -10)) * 1.0001f);
+        }
+        CHECK(std::fabs(y[r * H]) > 0.0f || x[r * H] == 0.0f);
+    }
+    // All-zero rows stay zero
+    std::vector<float> z(H, 0.0f);
+    for (float v : round_trip(z, 1, H, moe::WireFormat::FP8_E4M3)) CHECK(v == 0.0f);
+}
+
+TEST(codecs_independent_of_thread_count) {
+    const long rows = 3000;
+    const int H = 40;
+    auto x = random_rows(rows, H, 2.0f, 4);
+    for (auto fmt : {moe::WireFormat::BF16, moe::WireFormat::FP8_E4M3}) {
+        auto ref = round_trip(x, rows, H, fmt, 1);
+        CHECK(round_trip(x, rows, H, fmt, 3) == ref);
+    }
+}
+
+int main() { return check::run_all(); }
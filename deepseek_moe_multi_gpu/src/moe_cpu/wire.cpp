@@ -0,0 +1,186 @@
+#include "wire.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace moe {
+
+namespace {
+
+constexpr long kRowGrain = 256;
+constexpr float kE4M3Max = 448.0f;
+
+std::array<float, 256> make_e4m3_table() {
+    std::array<float, 256> t{};
+    for (int b = 0; b < 256; ++b) {
+        const int e = (b >> 3) & 0xf, m = b & 7;
+        float v;
+        if (e == 15 && m == 7)
+            v = std::numeric_limits<float>::quiet_NaN();
+        else if (e == 0)
+            v = std::ldexp(static_cast<float>(m), -9);
+        else
+            v = std::ldexp(1.0f + m / 8.0f, e - 7);
+        t[b] = (b & 0x80) ? -v : v;
+    }
+    return t;
+}
+
+const std::array<float, 256>& e4m3_table() {
+    static const std::array<float, 256> t = make_e4m3_table();
+    return t;
+}
+
+// The public scalar conversions are exported, hence interposable under
+// -fPIC and never inlined; the row loops use these internal copies
+inline uint16_t to_bf16(float f) {
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    // Branch-free so the row loops vectorize; NaNs keep a mantissa bit
+    const uint32_t nan = (u >> 16) | 0x0040u;
+    const uint32_t rounded = (u + 0x7fffu + ((u >> 16) & 1u)) >> 16;
+    return static_cast<uint16_t>((u & 0x7fffffffu) > 0x7f800000u ? nan : rounded);
+}
+
+inline float from_bf16(uint16_t h) {
+    uint32_t u = static_cast<uint32_t>(h) << 16;
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+inline uint8_t to_e4m3(float f) {
+    // Branch-free (selects only) so the row loop vectorizes
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    const uint32_t sign = (u >> 24) & 0x80u;
+    u &= 0x7fffffffu;
+
+    // Normal range: round the mantissa to 3 bits, nearest even; a carry
+    // bumps the exponent
+    const uint32_t r = u + 0x7ffffu + ((u >> 20) & 1u);
+    const int32_t e = static_cast<int32_t>(r >> 23) - 127 + 7;
+    const uint32_t normal = (static_cast<uint32_t>(e) << 3) | ((r >> 20) & 7u);
+    // Subnormal range, steps of 2^-9: adding 2^23 rounds |f| * 512 to an
+    // integer, nearest even; 8 is the smallest normal
+    float a;
+    std::memcpy(&a, &u, sizeof(a));
+    const float t = a * 512.0f + 8388608.0f;
+    uint32_t tb;
+    std::memcpy(&tb, &t, sizeof(tb));
+    const uint32_t sub = tb - 0x4b000000u;
+
+    // Range checks on the bits: |f| < 2^-6, |f| >= 448, NaN
+    const uint32_t is_sub = u < 0x3c800000u;
+    const uint32_t sat = (u >= 0x43e00000u) | ((is_sub ^ 1u) & ((e > 15) | (normal > 0x7eu)));
+    const uint32_t nan = u > 0x7f800000u;
+    uint32_t q = is_sub ? sub : normal;
+    q = sat ? 0x7eu : q;
+    q = nan ? 0x7fu : q;
+    return static_cast<uint8_t>(sign | q);
+}
+
+// [scale][hidden e4m3 values]. A function of its own so the row loop
+// sees plain arguments: byte stores through dst may alias anything the
+// encode_rows lambda reads through its captures
+void encode_e4m3_row(const float* src, int hidden, uint8_t* dst) {
+    // Largest |x| through the bit patterns, which order like the values
+    // (NaN above inf) and reduce as integers
+    uint32_t amax_bits = 0;
+    for (int i = 0; i < hidden; ++i) {
+        uint32_t b;
+        std::memcpy(&b, src + i, sizeof(b));
+        amax_bits = std::max(amax_bits, b & 0x7fffffffu);
+    }
+    float amax;
+    std::memcpy(&amax, &amax_bits, sizeof(amax));
+    const float scale = amax > 0.0f && std::isfinite(amax) ? amax / kE4M3Max : 1.0f;
+    const float inv = 1.0f / scale;
+    std::memcpy(dst, &scale, sizeof(scale));
+    uint8_t* q = dst + sizeof(scale);
+    for (int i = 0; i < hidden; ++i) q[i] = to_e4m3(src[i] * inv);
+}
+
+}  // namespace
+
+uint16_t f32_to_bf16(float f) { return to_bf16(f); }
+
+float bf16_to_f32(uint16_t h) { return from_bf16(h); }
+
+uint8_t f32_to_e4m3(float f) { return to_e4m3(f); }
+
+float e4m3_to_f32(uint8_t b) { return e4m3_table()[b]; }
+
+size_t wire_row_bytes(WireFormat fmt, int hidden) {
+    const size_t h = static_cast<size_t>(hidden);
+    switch (fmt) {
+    case WireFormat::F32: return 4 * h;
+    case WireFormat::BF16: return 2 * h;
+    case WireFormat::FP8_E4M3: return sizeof(float) + h;
+    }
+    throw std::invalid_argument("wire: unknown format " +
+                                std::to_string(static_cast<int>(fmt)));
+}
+
+void encode_rows(const float* x, long rows, int hidden, WireFormat fmt, uint8_t* out,
+                 int num_threads) {
+    const size_t row_bytes = wire_row_bytes(fmt, hidden);
+    const int threads = num_threads > 0 ? num_threads : default_threads();
+    parallel_for(rows, threads, kRowGrain, [&](long b, long e, int) {
+        for (long r = b; r < e; ++r) {
+            const float* src = x + r * hidden;
+            uint8_t* dst = out + r * row_bytes;
+            switch (fmt) {
+            case WireFormat::F32:
+                std::memcpy(dst, src, row_bytes);
+                break;
+            case WireFormat::BF16: {
+                uint16_t* h = reinterpret_cast<uint16_t*>(dst);
+                for (int i = 0; i < hidden; ++i) h[i] = to_bf16(src[i]);
+                break;
+            }
+            case WireFormat::FP8_E4M3:
+                encode_e4m3_row(src, hidden, dst);
+                break;
+            }
+        }
+    });
+}
+
+void decode_rows(const uint8_t* in, long rows, int hidden, WireFormat fmt, float* out,
+                 int num_threads) {
+    const size_t row_bytes = wire_row_bytes(fmt, hidden);
+    const int threads = num_threads > 0 ? num_threads : default_threads();
+    const std::array<float, 256>& lut = e4m3_table();
+    parallel_for(rows, threads, kRowGrain, [&](long b, long e, int) {
+        for (long r = b; r < e; ++r) {
+            const uint8_t* src = in + r * row_bytes;
+            float* dst = out + r * hidden;
+            switch (fmt) {
+            case WireFormat::F32:
+                std::memcpy(dst, src, row_bytes);
+                break;
+            case WireFormat::BF16: {
+                const uint16_t* h = reinterpret_cast<const uint16_t*>(src);
+                for (int i = 0; i < hidden; ++i) dst[i] = from_bf16(h[i]);
+                break;
+            }
+            case WireFormat::FP8_E4M3: {
+                float scale;
+                std::memcpy(&scale, src, sizeof(scale));
+                const uint8_t* q = src + sizeof(scale);
+                for (int i = 0; i < hidden; ++i) dst[i] = lut[q[i]] * scale;
+                break;
+            }
+            }
+        }
+    });
+}
+
+}  // namespace moe
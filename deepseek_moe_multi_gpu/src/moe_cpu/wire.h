@@ -0,0 +1,40 @@
+#pragma once
+// Activation codecs for the EP all-to-all wire format.
+//
+// A message is a run of rows, one per (token, expert) pair, each encoded
+// on its own so rows can be split between ranks at any boundary:
+//
+//   F32      : H fp32 values                               (4H bytes)
+//   BF16     : H bf16 values, round-to-nearest-even         (2H bytes)
+//   FP8_E4M3 : fp32 scale, then H e4m3 values of x / scale (4 + H bytes)
+//
+// The fp8 scale is the row's absolute maximum / 448 (the largest finite
+// e4m3 value), so every row uses the full e4m3 range. e4m3 is the "fn"
+// variant (no infinities, 0x7f / 0xff are NaN); conversion rounds to
+// nearest even and saturates. Encode and decode are parallel over rows.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace moe {
+
+enum class WireFormat { F32 = 0, BF16 = 1, FP8_E4M3 = 2 };
+
+// Bytes of one encoded row of `hidden` values.
+size_t wire_row_bytes(WireFormat fmt, int hidden);
+
+// x[rows, hidden] -> out[rows * wire_row_bytes(fmt, hidden)]
+void encode_rows(const float* x, long rows, int hidden, WireFormat fmt, uint8_t* out,
+                 int num_threads = 0);
+
+// Inverse of encode_rows, up to rounding.
+void decode_rows(const uint8_t* in, long rows, int hidden, WireFormat fmt, float* out,
+                 int num_threads = 0);
+
+// Scalar conversions, exposed for tests.
+uint16_t f32_to_bf16(float f);
+float bf16_to_f32(uint16_t h);
+uint8_t f32_to_e4m3(float f);
+float e4m3_to_f32(uint8_t b);
+
+}  // namespace moe
@@ -3,15 +3,14 @@
  *
  * Strategy:
  *   - Data Parallelism  : batch split evenly across GPUs
- *   - Expert Parallelism: each GPU owns a subset of routed experts
- *     Communication:
- *       1. All-gather hidden states so every GPU sees all tokens
- *       2. Each GPU runs its local experts on ALL tokens
- *       3. Each GPU computes weighted sum for its own slice of tokens
- *          using routed outputs from other GPUs (already gathered)
- *
- *   This is the "replicated routing + partitioned expert compute" pattern,
- *   equivalent to the all-gather variant of EP used in many real systems.
+ *   - Expert Parallelism: each GPU owns a subset of routed experts, chosen
+ *     by the load-aware planner in moe_cpu/placement.h
+ *     Per DP slice:
+ *       1. Counting-sort the slice's (token, k) pairs by (owner GPU, expert)
+ *          with the shared host library (moe_cpu/dispatch.h) and gather
+ *          the activations into expert-contiguous rows
+ *       2. Each expert's owner GPU runs it on exactly its rows
+ *       3. A weighted scatter adds the expert rows back onto their tokens
  *
  * Test:  reads tests/case_XX/ written by generate_tests.py
  * Build: see build instructions in README
@@ -26,6 +25,10 @@
 
 #include "moe_kernels.cuh"
 #include "nccl_utils.cuh"
+#include "dispatch.h"
+#include "placement.h"
+
+#include <vector>
 
 // -----------------------------------------------------------------------
 // Config
@@ -168,12 +171,48 @@ double run_case_multigpu(
         h_e_down[e] = load_f32(path, (size_t)H * I);
     }
 
+    // ----------------------------------------------------------------
+    // EP placement: balance the observed per-expert token counts across
+    // GPUs (moe_cpu/placement.h) instead of e % world_size. The traffic
+    // term keeps experts near the DP slice that routes to them.
+    // ----------------------------------------------------------------
+    int tokens_per_rank = ((B + world_size - 1) / world_size) * S;
+    std::vector<double> load(E, 0.0), traffic((size_t)world_size * E, 0.0);
+    for (int t = 0; t < N; t++) {
+        int src = t / tokens_per_rank;
+        for (int k = 0; k < K; k++) {
+            int e = h_topk_idx[t * K + k];
+            load[e] += 1.0;
+            traffic[(size_t)src * E + e] += 1.0;
+        }
+    }
+    moe::PlacementOptions place_opts;
+    place_opts.comm_weight = 0.1;
+    std::vector<int> expert_to_rank =
+        moe::plan_placement(load.data(), E, world_size, traffic.data(), place_opts);
+    printf("  placement:");
+    for (int e = 0; e < E; e++) printf(" e%d->%d", e, expert_to_rank[e]);
+    printf("\n");
+
+    // Expert weights are uploaded once per case to their owner GPU
+    int num_gpus = 1;
+    CUDA_CHECK(cudaGetDeviceCount(&num_gpus));
+    float* d_e_gate[MAX_EXPERTS], *d_e_up[MAX_EXPERTS], *d_e_down[MAX_EXPERTS];
+    for (int e = 0; e < E; e++) {
+        CUDA_CHECK(cudaSetDevice(expert_to_rank[e] % num_gpus));
+        CUDA_CHECK(cudaMalloc(&d_e_gate[e], (size_t)I * H * sizeof(float)));
+        CUDA_CHECK(cudaMalloc(&d_e_up[e],   (size_t)I * H * sizeof(float)));
+        CUDA_CHECK(cudaMalloc(&d_e_down[e], (size_t)H * I * sizeof(float)));
+        CUDA_CHECK(cudaMemcpy(d_e_gate[e], h_e_gate[e], (size_t)I*H*sizeof(float), cudaMemcpyHostToDevice));
+        CUDA_CHECK(cudaMemcpy(d_e_up[e],   h_e_up[e],   (size_t)I*H*sizeof(float), cudaMemcpyHostToDevice));
+        CUDA_CHECK(cudaMemcpy(d_e_down[e], h_e_down[e], (size_t)H*I*sizeof(float), cudaMemcpyHostToDevice));
+    }
+
     // ----------------------------------------------------------------
     // Per-rank forward pass
     // ----------------------------------------------------------------
     // DP: split batch evenly
     int B_per_rank = (B + world_size - 1) / world_size;
-    // EP: each rank owns experts where expert_id % world_size == rank
 
     // We'll accumulate final output on rank 0 via all_reduce
     float* h_final = (float*)calloc(N * H, sizeof(float));
@@ -240,50 +279,46 @@ double run_case_multigpu(
             CUDA_CHECK(cudaFree(d_sd));
         }
 
-        // ---- Expert Parallelism: this rank runs experts where e%world_size==rank ----
-        float* d_routed_out;
-        CUDA_CHECK(cudaMalloc(&d_routed_out, (size_t)N_local * H * sizeof(float)));
-        CUDA_CHECK(cudaMemset(d_routed_out, 0, (size_t)N_local * H * sizeof(float)));
-
-        for (int e = rank; e < E; e += world_size) {
-            // Upload this expert's weights
-            float *d_eg, *d_eu, *d_ed;
-            CUDA_CHECK(cudaMalloc(&d_eg, (size_t)I * H * sizeof(float)));
-            CUDA_CHECK(cudaMalloc(&d_eu, (size_t)I * H * sizeof(float)));
-            CUDA_CHECK(cudaMalloc(&d_ed, (size_t)H * I * sizeof(float)));
-            CUDA_CHECK(cudaMemcpy(d_eg, h_e_gate[e], (size_t)I*H*sizeof(float), cudaMemcpyHostToDevice));
-            CUDA_CHECK(cudaMemcpy(d_eu, h_e_up[e],   (size_t)I*H*sizeof(float), cudaMemcpyHostToDevice));
-            CUDA_CHECK(cudaMemcpy(d_ed, h_e_down[e], (size_t)H*I*sizeof(float), cudaMemcpyHostToDevice));
-
-            run_mlp_device(d_inputs, d_eg, d_eu, d_ed,
-                           d_mlp_tmp, d_scratch, N_local, H, I, s.stream);
-
-            // For each token, if expert e is in its topk, accumulate weighted output
-            // We do this on host (small size) then add back
-            CUDA_CHECK(cudaStreamSynchronize(s.stream));
-            float* h_mlp_out = (float*)malloc((size_t)N_local * H * sizeof(float));
-            CUDA_CHECK(cudaMemcpy(h_mlp_out, d_mlp_tmp,
-                                  (size_t)N_local * H * sizeof(float),
-                                  cudaMemcpyDeviceToHost));
-
-            // Accumulate into h_final (host-side for simplicity at this toy size)
-            for (int t = 0; t < N_local; t++) {
-                for (int ki = 0; ki < K; ki++) {
-                    int gidx = (tok_start + t) * K + ki;
-                    if (h_topk_idx[gidx] == e) {
-                        float w = h_topk_w[gidx];
-                        for (int h = 0; h < H; h++) {
-                            h_final[(tok_start + t) * H + h] += w * h_mlp_out[t * H + h];
-                        }
-                    }
-                }
-            }
-            free(h_mlp_out);
-
-            CUDA_CHECK(cudaFree(d_eg));
-            CUDA_CHECK(cudaFree(d_eu));
-            CUDA_CHECK(cudaFree(d_ed));
+        // ---- Expert Parallelism: dispatch this slice's rows to the expert owners ----
+        moe::DispatchPlan plan;
+        moe::build_plan(h_topk_idx + tok_start * K, h_topk_w + tok_start * K,
+                        N_local, K, E, expert_to_rank.data(), world_size, plan);
+        int R = plan.num_rows();
+        float* h_rows   = (float*)malloc((size_t)R * H * sizeof(float));
+        float* h_y_rows = (float*)malloc((size_t)R * H * sizeof(float));
+        moe::gather(plan, h_inputs + (size_t)tok_start * H, H, h_rows);
+
+        for (int e = 0; e < E; e++) {
+            int rows = plan.expert_count[e];
+            if (rows == 0) continue;
+            int owner = plan.expert_rank[e];
+            size_t off = (size_t)plan.expert_begin[e] * H;
+            CUDA_CHECK(cudaSetDevice(owner % num_gpus));
+            cudaStream_t os = states[owner].stream;
+
+            float *d_rows, *d_y, *d_escratch;
+            CUDA_CHECK(cudaMalloc(&d_rows, (size_t)rows * H * sizeof(float)));
+            CUDA_CHECK(cudaMalloc(&d_y,    (size_t)rows * H * sizeof(float)));
+            CUDA_CHECK(cudaMalloc(&d_escratch, (size_t)rows * I * 3 * sizeof(float)));
+            CUDA_CHECK(cudaMemcpyAsync(d_rows, h_rows + off, (size_t)rows * H * sizeof(float),
+                                       cudaMemcpyHostToDevice, os));
+
+            run_mlp_device(d_rows, d_e_gate[e], d_e_up[e], d_e_down[e],
+                           d_y, d_escratch, rows, H, I, os);
+
+            CUDA_CHECK(cudaMemcpyAsync(h_y_rows + off, d_y, (size_t)rows * H * sizeof(float),
+                                       cudaMemcpyDeviceToHost, os));
+            CUDA_CHECK(cudaStreamSynchronize(os));
+            CUDA_CHECK(cudaFree(d_rows));
+            CUDA_CHECK(cudaFree(d_y));
+            CUDA_CHECK(cudaFree(d_escratch));
         }
+        CUDA_CHECK(cudaSetDevice(rank));
+
+        // Weighted scatter back onto this slice's tokens (fixed k order per token)
+        moe::scatter_weighted(plan, h_y_rows, H, h_final + (size_t)tok_start * H, true);
+        free(h_rows);
+        free(h_y_rows);
 
         // Copy shared_out back to host and add to h_final
         float* h_sh_out = (float*)malloc((size_t)N_local * H * sizeof(float));
@@ -306,7 +341,13 @@ double run_case_multigpu(
         CUDA_CHECK(cudaFree(d_scratch));
         CUDA_CHECK(cudaFree(d_shared_out));
         CUDA_CHECK(cudaFree(d_mlp_tmp));
-        CUDA_CHECK(cudaFree(d_routed_out));
+    }
+
+    for (int e = 0; e < E; e++) {
+        CUDA_CHECK(cudaSetDevice(expert_to_rank[e] % num_gpus));
+        CUDA_CHECK(cudaFree(d_e_gate[e]));
+        CUDA_CHECK(cudaFree(d_e_up[e]));
+        CUDA_CHECK(cudaFree(d_e_down[e]));
     }
 
     // NCCL all_reduce to gather contributions from all ranks
@@ -1,10 +1,19 @@
 import os
 import json
+import itertools
+import collections
+import contextlib
+import queue
+import time
 import numpy as np
 import torch
 import torch.nn as nn
 import torch.distributed as dist
 import torch.multiprocessing as mp
+from concurrent.futures import ThreadPoolExecutor
+
+import moe_native
+from placement import PlacementPlanner, round_robin
 
 
 # -----------------------------------------------------------------------
@@ -34,258 +43,806 @@ class TinyMLP(nn.Module):
 # returns recv_list[r] = tensor received from rank r
 # -----------------------------------------------------------------------
 
-def all_to_all_p2p(send_list, rank, world_size):
-    recv_list = [torch.zeros_like(send_list[r]) for r in range(world_size)]
+def all_to_all_p2p_start(send_list, rank, world_size, recv_list=None):
+    """
+    Posts the sends and receives; the returned callable waits for them.
+    recv_list gives the receive buffers when sizes differ per peer (by
+    default each one is shaped like the matching send); empty messages
+    are skipped, as both ends know their size.
+    """
+    if recv_list is None:
+        recv_list = [torch.zeros_like(send_list[r]) for r in range(world_size)]
     reqs = []
 
     # Post all sends and receives
     for r in range(world_size):
         if r != rank:
-            reqs.append(dist.isend(send_list[r].contiguous(), dst=r))
-            reqs.append(dist.irecv(recv_list[r], src=r))
+            if send_list[r].numel() > 0:
+                reqs.append(dist.isend(send_list[r].contiguous(), dst=r))
+            if recv_list[r].numel() > 0:
+                reqs.append(dist.irecv(recv_list[r], src=r))
 
     # Copy own data locally (no communication needed)
     recv_list[rank].copy_(send_list[rank])
 
     # Wait for all transfers to complete
-    for req in reqs:
-        req.wait()
+    def wait():
+        for req in reqs:
+            req.wait()
+        return recv_list
+
+    return wait
+
 
-    return recv_list
+def all_to_all_p2p(send_list, rank, world_size, recv_list=None):
+    return all_to_all_p2p_start(send_list, rank, world_size, recv_list)()
 
 
 # -----------------------------------------------------------------------
-# One rank's MoE EP forward pass
+# Collectives used by the forward pass. With a moe_native.ShmComm they go
+# through per-pair shared-memory rings; without one, through gloo.
 # -----------------------------------------------------------------------
 
-def moe_ep_forward_rank(rank, world_size, cfg, test_dir, result_queue):
-    os.environ["MASTER_ADDR"] = "localhost"
-    os.environ["MASTER_PORT"] = "29500"
+def all_to_all(send_list, rank, world_size, comm=None, recv_list=None):
+    if comm is None:
+        return all_to_all_p2p(send_list, rank, world_size, recv_list)
+    send_list = [s.contiguous() for s in send_list]
+    if recv_list is None:
+        recv_list = [torch.empty_like(s) for s in send_list]
+    return comm.all_to_all(send_list, recv_list)
+
+
+def all_to_all_start(send_list, rank, world_size, comm=None, executor=None,
+                     timeline=None, label=("all_to_all", 0), recv_list=None):
+    """
+    Starts an all-to-all and returns a callable that waits for recv_list.
+    gloo requests are asynchronous already; a ShmComm call runs on the
+    single executor thread (ctypes drops the GIL), which also keeps the
+    collectives in the same order on every rank.
+    """
+    timeline = timeline or Timeline(rank, enabled=False)
+    if comm is None:
+        t0   = time.perf_counter()
+        wait = all_to_all_p2p_start(send_list, rank, world_size, recv_list)
+
+        def finish():
+            recv_list = wait()
+            timeline.add(*label, "comm", t0, time.perf_counter())
+            return recv_list
+        return finish
+
+    def job():
+        with timeline.span(*label, lane="comm"):
+            return all_to_all(send_list, rank, world_size, comm, recv_list)
+
+    if executor is None:
+        recv_list = job()
+        return lambda: recv_list
+    return executor.submit(job).result
+
+
+# -----------------------------------------------------------------------
+# Offset-addressed all-to-all-v: every rank's messages sit back to back in
+# one send buffer and arrive back to back in one receive buffer, each at
+# the exact byte count both ends know from the count exchange. The
+# buffers come from a BufferPool that lives as long as the runtime, so a
+# step that fits earlier ones allocates no message memory.
+# -----------------------------------------------------------------------
+
+class BufferPool:
+    """Named uint8 buffers that only grow (to 1.5x the request) and are
+    reused across steps; get() returns a view of exactly nbytes."""
+
+    def __init__(self):
+        self.buffers = {}
+        self.allocations = 0
+
+    def get(self, name, nbytes):
+        buf = self.buffers.get(name)
+        if buf is None or buf.numel() < nbytes:
+            buf = torch.empty(max(nbytes + nbytes // 2, 64), dtype=torch.uint8)
+            self.buffers[name] = buf
+            self.allocations += 1
+        return buf[:nbytes]
+
+    def tensor(self, name, shape, dtype=torch.float32):
+        """get() viewed as an uninitialised tensor of shape and dtype."""
+        info = torch.finfo(dtype) if dtype.is_floating_point else torch.iinfo(dtype)
+        numel = int(np.prod(shape))
+        return self.get(name, numel * info.bits // 8).view(dtype).view(shape)
+
+    def total_bytes(self):
+        return sum(b.numel() for b in self.buffers.values())
+
+
+def split_bytes(buf, counts):
+    """Views of buf for consecutive blocks of counts[r] bytes."""
+    out, at = [], 0
+    for n in counts:
+        out.append(buf[at:at + n])
+        at += n
+    return out
+
+
+def all_to_all_v(send, send_bytes, recv, recv_bytes, rank, world_size, comm=None):
+    if comm is None:
+        all_to_all_p2p(split_bytes(send, send_bytes), rank, world_size,
+                       split_bytes(recv, recv_bytes))
+        return recv
+    return comm.all_to_all_v(send, send_bytes, recv, recv_bytes)
+
+
+def all_to_all_v_start(send, send_bytes, recv, recv_bytes, rank, world_size, comm=None,
+                       executor=None, timeline=None, label=("all_to_all", 0)):
+    """all_to_all_v as all_to_all_start runs all_to_all; the callable
+    returns recv."""
+    timeline = timeline or Timeline(rank, enabled=False)
+    if comm is None:
+        t0   = time.perf_counter()
+        wait = all_to_all_p2p_start(split_bytes(send, send_bytes), rank, world_size,
+                                    split_bytes(recv, recv_bytes))
+
+        def finish():
+            wait()
+            timeline.add(*label, "comm", t0, time.perf_counter())
+            return recv
+        return finish
+
+    def job():
+        with timeline.span(*label, lane="comm"):
+            return all_to_all_v(send, send_bytes, recv, recv_bytes, rank, world_size, comm)
+
+    if executor is None:
+        job()
+        return lambda: recv
+    return executor.submit(job).result
+
+
+def all_gather(tensor, world_size, comm=None):
+    if comm is None:
+        gathered = [torch.zeros_like(tensor) for _ in range(world_size)]
+        dist.all_gather(gathered, tensor)
+        return gathered
+    return comm.all_gather(tensor)
+
+
+# -----------------------------------------------------------------------
+# Per-rank timeline in Chrome trace format (chrome://tracing, Perfetto).
+# Timestamps are perf_counter (CLOCK_MONOTONIC), shared by all ranks.
+# -----------------------------------------------------------------------
+
+class Timeline:
+    def __init__(self, rank, enabled=True):
+        self.rank    = rank
+        self.enabled = enabled
+        self.events  = []
+
+    def add(self, name, chunk, lane, t0, t1):
+        if self.enabled:
+            self.events.append({"name": f"{name} {chunk}", "cat": name, "ph": "X",
+                                "ts": t0 * 1e6, "dur": (t1 - t0) * 1e6,
+                                "pid": self.rank, "tid": lane})
+
+    @contextlib.contextmanager
+    def span(self, name, chunk, lane="compute"):
+        t0 = time.perf_counter()
+        try:
+            yield
+        finally:
+            self.add(name, chunk, lane, t0, time.perf_counter())
+
+
+def write_trace(path, events):
+    with open(path, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+
+
+# -----------------------------------------------------------------------
+# Rank setup: communicator and resident weights
+# -----------------------------------------------------------------------
+
+def load_f32(test_dir, name, shape):
+    return np.fromfile(os.path.join(test_dir, name + ".bin"), dtype=np.float32).reshape(shape)
+
+
+def load_i32(test_dir, name, shape):
+    return np.fromfile(os.path.join(test_dir, name + ".bin"), dtype=np.int32).reshape(shape)
+
+
+def load_mlp(test_dir, prefix, H, I):
+    mlp = TinyMLP(H, I)
+    mlp.load_weights(
+        load_f32(test_dir, f"{prefix}_gate", (I, H)),
+        load_f32(test_dir, f"{prefix}_up",   (I, H)),
+        load_f32(test_dir, f"{prefix}_down", (H, I))
+    )
+    return mlp.eval()
+
+
+def load_shared_experts(test_dir, cfg):
+    H, I = cfg["hidden_size"], cfg["intermediate_size"]
+    return [load_mlp(test_dir, f"shared_{si}", H, I)
+            for si in range(cfg["n_shared_experts"])]
 
+
+def load_owned_experts(test_dir, cfg, rank, placement, resident=None, replicas=None):
+    """
+    Routed experts placement assigns to rank, plus the replicas it hosts;
+    ones already resident are kept.
+    """
+    H, I = cfg["hidden_size"], cfg["intermediate_size"]
+    resident = resident or {}
+    hosts = [rank in replicas[e] if replicas else placement[e] == rank
+             for e in range(cfg["n_routed_experts"])]
+    return {e: resident[e] if e in resident else load_mlp(test_dir, f"expert_{e}", H, I)
+            for e in range(cfg["n_routed_experts"]) if hosts[e]}
+
+
+def init_comm(rank, world_size, comm_name, port=29500):
+    """comm_name selects the shared-memory backend; no gloo group is needed then."""
+    if comm_name is not None:
+        return moe_native.ShmComm(comm_name, rank, world_size)
+    os.environ["MASTER_ADDR"] = "localhost"
+    os.environ["MASTER_PORT"] = str(port)
     dist.init_process_group(
         backend="gloo",
         rank=rank,
         world_size=world_size
     )
+    return None
+
+
+def close_comm(comm):
+    if comm is not None:
+        comm.close()
+    else:
+        dist.destroy_process_group()
+
+
+# -----------------------------------------------------------------------
+# One rank's MoE EP forward pass. Every rank passes the full batch and
+# gets the full [N, H] output back.
+# -----------------------------------------------------------------------
+
+def plan_chunk(x, topk_idx, topk_w, E, world_size, placement, use_native,
+               replicas=None, rank=0):
+    """
+    Dispatch order for one chunk of local tokens: the (token, k) pairs
+    sorted by (owner rank, expert), so the rows bound for each rank are
+    one contiguous slice. Expert e is owned by rank placement[e].
+
+    With replicas (needs libmoe_native) expert e runs on every rank in
+    replicas[e]: this rank's tokens use its own copy when it has one and
+    spread over the copies otherwise. The plan is then over virtual
+    experts (one per copy); row_expert is mapped back to real experts.
+    """
+    K = topk_idx.shape[1]
+    if use_native:
+        # Counting-sort plan in libmoe_native
+        if replicas is not None:
+            vidx, vrank, vexpert = moe_native.assign_replicas(topk_idx, replicas,
+                                                              world_size, rank)
+            plan = moe_native.DispatchPlan(vidx, topk_w, len(vrank), world_size,
+                                           expert_to_rank=vrank)
+            row_expert = torch.as_tensor(vexpert, dtype=torch.long)[plan.row_expert.long()]
+        else:
+            plan = moe_native.DispatchPlan(topk_idx, topk_w, E, world_size,
+                                           expert_to_rank=placement)
+            row_expert = plan.row_expert.long()
+        return dict(plan=plan,
+                    row_token=plan.row_token.long(),
+                    row_expert=row_expert,
+                    row_weight=plan.row_weight,
+                    rows=plan.gather(x),
+                    send_count=plan.send_counts())
+    flat_expert = topk_idx.reshape(-1).long()
+    flat_token  = torch.arange(x.shape[0]).repeat_interleave(K)
+    owner       = torch.as_tensor(placement, dtype=torch.long)[flat_expert]
+    order       = torch.argsort(owner * E + flat_expert, stable=True)
+    row_token   = flat_token[order]
+    return dict(plan=None,
+                row_token=row_token,
+                row_expert=flat_expert[order],
+                row_weight=topk_w.reshape(-1)[order],
+                rows=x.index_select(0, row_token),
+                send_count=torch.bincount(owner, minlength=world_size).tolist())
+
+
+# -----------------------------------------------------------------------
+# Wire format. A dispatch message to one rank is
+#     int32 expert id x n | n encoded rows
+# and the combine reply is the n encoded expert outputs in the order
+# received. Every rank knows n for every pair from the count exchange, so
+# messages are sent at their exact size. Token ids and routing weights
+# never travel: the sender keeps them (row_token / row_weight) and the
+# reply comes back row for row. Rows are fp32, bf16 or fp8-e4m3 with a
+# per-row fp32 scale (moe_cpu/wire.h).
+# -----------------------------------------------------------------------
+
+WIRE_FORMATS = ("fp32", "bf16", "fp8")
+E4M3_MAX     = 448.0
+
+
+def wire_row_bytes(wire, H):
+    return {"fp32": 4 * H, "bf16": 2 * H, "fp8": 4 + H}[wire]
+
 
-    torch.manual_seed(0)
-
-    H     = cfg["hidden_size"]
-    I     = cfg["intermediate_size"]
-    E     = cfg["n_routed_experts"]
-    NS    = cfg["n_shared_experts"]
-    K     = cfg["top_k"]
-    B     = cfg["batch_size"]
-    S     = cfg["seq_len"]
-    N     = B * S
-
-    def lf(name, shape):
-        path = os.path.join(test_dir, name + ".bin")
-        arr  = np.fromfile(path, dtype=np.float32)
-        return arr.reshape(shape)
-
-    def li(name, shape):
-        path = os.path.join(test_dir, name + ".bin")
-        arr  = np.fromfile(path, dtype=np.int32)
-        return arr.reshape(shape)
-
-    inputs   = torch.from_numpy(lf("inputs",       (N, H)))
-    expected = torch.from_numpy(lf("outputs",      (N, H)))
-    topk_idx = torch.from_numpy(li("topk_indices", (N, K)))
-    topk_w   = torch.from_numpy(lf("topk_weights", (N, K)))
-
-    # Load shared experts
-    shared_experts = []
-    for si in range(NS):
-        mlp = TinyMLP(H, I)
-        mlp.load_weights(
-            lf(f"shared_{si}_gate", (I, H)),
-            lf(f"shared_{si}_up",   (I, H)),
-            lf(f"shared_{si}_down", (H, I))
-        )
-        mlp.eval()
-        shared_experts.append(mlp)
-
-    # Load all routed experts
-    all_experts = []
-    for e in range(E):
-        mlp = TinyMLP(H, I)
-        mlp.load_weights(
-            lf(f"expert_{e}_gate", (I, H)),
-            lf(f"expert_{e}_up",   (I, H)),
-            lf(f"expert_{e}_down", (H, I))
-        )
-        mlp.eval()
-        all_experts.append(mlp)
+def encode_rows(x, wire, use_native, out=None):
+    """x [R, H] float32 -> uint8 [R, wire_row_bytes(wire, H)], written to
+    out (a slice of a send buffer) when given."""
+    if use_native:
+        return moe_native.encode_rows(x, wire, out=out)
+    x = x.contiguous()
+    if wire == "fp32":
+        enc = x.view(torch.uint8)
+    elif wire == "bf16":
+        enc = x.to(torch.bfloat16).view(torch.uint8)
+    else:
+        amax  = x.abs().amax(dim=1, keepdim=True)
+        scale = torch.where(amax > 0, amax / E4M3_MAX, torch.ones_like(amax))
+        q     = (x / scale).clamp(-E4M3_MAX, E4M3_MAX).to(torch.float8_e4m3fn)
+        enc   = torch.cat([scale.view(torch.uint8), q.view(torch.uint8)], dim=1)
+    return enc if out is None else out.copy_(enc)
+
+
+def decode_rows(buf, H, wire, use_native, out=None):
+    """Inverse of encode_rows: uint8 [R, row_bytes] -> float32 [R, H]."""
+    if use_native:
+        return moe_native.decode_rows(buf, H, wire, out=out)
+    buf = buf.contiguous()
+    if wire == "fp32":
+        dec = buf.view(torch.float32)
+    elif wire == "bf16":
+        dec = buf.view(torch.bfloat16).float()
+    else:
+        scale = buf[:, :4].contiguous().view(torch.float32)
+        dec   = buf[:, 4:].contiguous().view(torch.float8_e4m3fn).float() * scale
+    if out is not None:
+        return out.copy_(dec)
+    return dec.clone() if wire == "fp32" else dec
+
+
+def run_local_experts(recv_expert, rows, experts, E):
+    """Each owned expert runs once on all the rows [n, H] it received."""
+    out        = torch.empty_like(rows)
+    by_expert  = torch.argsort(recv_expert, stable=True)
+    per_expert = torch.bincount(recv_expert, minlength=E).tolist()
+    with torch.no_grad():
+        for e_id, idx in enumerate(by_expert.split(per_expert)):
+            if idx.numel() > 0:
+                out[idx] = experts[e_id](rows[idx])
+    return out
+
+
+def moe_ep_forward(rank, world_size, cfg, inputs, topk_idx, topk_w,
+                   shared_experts, experts, comm=None, num_chunks=1,
+                   executor=None, timeline=None, placement=None, replicas=None,
+                   wire="fp32", pool=None):
+    """
+    placement[e] is the rank owning expert e (default e % world_size);
+    experts must hold exactly this rank's experts. replicas optionally
+    lists every rank holding a copy of each expert (see plan_chunk); then
+    experts holds all copies on this rank. num_chunks splits the local
+    tokens into micro-chunks that are pipelined: chunk c+1's dispatch is
+    in flight while chunk c runs its experts and chunk c-1's results are
+    combined. wire picks the activation format on the wire (fp32, bf16 or
+    fp8); fp32 is exact. pool holds the message buffers between calls (a
+    fresh BufferPool when omitted).
+    """
+    H = cfg["hidden_size"]
+    E = cfg["n_routed_experts"]
+    K = cfg["top_k"]
+    N = inputs.shape[0]
+    timeline  = timeline or Timeline(rank, enabled=False)
+    placement = placement or round_robin(E, world_size)
+    pool      = pool if pool is not None else BufferPool()
 
     # ----------------------------------------------------------------
     # Data Parallelism: split tokens across ranks
     # ----------------------------------------------------------------
     tokens_per_rank = (N + world_size - 1) // world_size
-    tok_start = rank * tokens_per_rank
+    tok_start = min(rank * tokens_per_rank, N)
     tok_end   = min(tok_start + tokens_per_rank, N)
     N_local   = tok_end - tok_start
 
     local_inputs   = inputs[tok_start:tok_end]
+    use_native     = moe_native.available()
     local_topk_idx = topk_idx[tok_start:tok_end]
     local_topk_w   = topk_w[tok_start:tok_end]
 
-    # ----------------------------------------------------------------
-    # Dispatch: build per-destination send buffers
-    # Expert e is owned by rank: e % world_size
-    # ----------------------------------------------------------------
-    send_tok_ids    = [[] for _ in range(world_size)]
-    send_expert_ids = [[] for _ in range(world_size)]
-    send_weights    = [[] for _ in range(world_size)]
-    send_embeds     = [[] for _ in range(world_size)]
-
-    for t in range(N_local):
-        for ki in range(K):
-            e_id  = local_topk_idx[t, ki].item()
-            owner = e_id % world_size
-            send_tok_ids[owner].append(t)
-            send_expert_ids[owner].append(e_id)
-            send_weights[owner].append(local_topk_w[t, ki].item())
-            send_embeds[owner].append(local_inputs[t].clone())
-
-    # Exchange send counts so all ranks agree on buffer sizes
-    local_send_counts = torch.tensor(
-        [len(send_tok_ids[r]) for r in range(world_size)], dtype=torch.int32
-    )
-    gathered_counts = [torch.zeros(world_size, dtype=torch.int32)
-                       for _ in range(world_size)]
-    dist.all_gather(gathered_counts, local_send_counts)
-    # gathered_counts[r][s] = how many slots rank r sends to rank s
-
-    max_slots = max(c.max().item() for c in gathered_counts)
-    max_slots = max(int(max_slots), 1)
-
-    # Pack into [world_size, max_slots, SLOT] tensor
-    SLOT = 3 + H
-    send_tensor = torch.zeros(world_size, max_slots, SLOT)
-    for r in range(world_size):
-        for si in range(len(send_tok_ids[r])):
-            send_tensor[r, si, 0] = float(send_tok_ids[r][si])
-            send_tensor[r, si, 1] = float(send_expert_ids[r][si])
-            send_tensor[r, si, 2] = send_weights[r][si]
-            send_tensor[r, si, 3:] = send_embeds[r][si]
-
-    # All-to-all dispatch using p2p (gloo compatible)
-    send_list = [send_tensor[r].contiguous() for r in range(world_size)]
-    recv_list = all_to_all_p2p(send_list, rank, world_size)
+    # Every rank must run the same number of collectives, so the chunk
+    # count comes from the global batch, not from N_local
+    C      = max(1, min(num_chunks, tokens_per_rank))
+    bounds = [N_local * c // C for c in range(C + 1)]
 
     # ----------------------------------------------------------------
-    # Local expert compute on received tokens
+    # Dispatch plans for all chunks, then one count exchange:
+    # gathered_counts[r][c][s] = slots rank r sends to rank s in chunk c
     # ----------------------------------------------------------------
-    # gathered_counts[src_rank][rank] = how many slots src_rank sent to me
-    expert_results = []
-    with torch.no_grad():
-        for r in range(world_size):
-            n_recv = int(gathered_counts[r][rank].item())
-            for si in range(n_recv):
-                slot        = recv_list[r][si]
-                tok_id_orig = int(slot[0].item())
-                e_id        = int(slot[1].item())
-                w           = slot[2].item()
-                embed       = slot[3:].unsqueeze(0)
-                out         = all_experts[e_id](embed).squeeze(0)
-                expert_results.append((r, tok_id_orig, w, out))
+    chunks = []
+    for c in range(C):
+        b, e = bounds[c], bounds[c + 1]
+        with timeline.span("plan", c):
+            chunks.append(plan_chunk(local_inputs[b:e], local_topk_idx[b:e],
+                                     local_topk_w[b:e], E, world_size, placement,
+                                     use_native, replicas, rank))
+    local_send_counts = torch.tensor([ch["send_count"] for ch in chunks],
+                                     dtype=torch.int32).reshape(C, world_size)
+    gathered_counts = all_gather(local_send_counts, world_size, comm)
+
+    if wire not in WIRE_FORMATS:
+        raise ValueError(f"unknown wire format {wire!r}")
+    row_bytes = wire_row_bytes(wire, H)
+
+    msg_row = 4 + row_bytes
+
+    def start_dispatch(c):
+        ch = chunks[c]
+        ch["recv_count"] = [int(gathered_counts[r][c][rank]) for r in range(world_size)]
+        with timeline.span("pack", c):
+            # [int32 expert ids | encoded rows] per peer, back to back
+            send_bytes = [n * msg_row for n in ch["send_count"]]
+            recv_bytes = [n * msg_row for n in ch["recv_count"]]
+            send = pool.get(("dispatch_send", c), sum(send_bytes))
+            recv = pool.get(("dispatch_recv", c), sum(recv_bytes))
+            ids  = ch["row_expert"].to(torch.int32)
+            at = row = 0
+            for n in ch["send_count"]:
+                send[at:at + 4 * n].copy_(ids[row:row + n].view(torch.uint8))
+                encode_rows(ch["rows"][row:row + n], wire, use_native,
+                            out=send[at + 4 * n:at + n * msg_row].view(n, row_bytes))
+                at  += n * msg_row
+                row += n
+        ch["dispatch"] = all_to_all_v_start(send, send_bytes, recv, recv_bytes, rank,
+                                            world_size, comm, executor, timeline,
+                                            ("dispatch", c))
+
+    def compute_and_return(c):
+        ch = chunks[c]
+        recv = ch.pop("dispatch")()
+        with timeline.span("experts", c):
+            counts      = ch["recv_count"]
+            total       = sum(counts)
+            recv_expert = pool.tensor(("recv_expert", c), (total,), torch.int32)
+            rows        = pool.tensor(("recv_rows", c), (total, H))
+            at = row = 0
+            for n in counts:
+                # Byte copy: a peer's block need not be 4-byte aligned
+                recv_expert[row:row + n].view(torch.uint8).copy_(recv[at:at + 4 * n])
+                decode_rows(recv[at + 4 * n:at + n * msg_row].view(n, row_bytes), H, wire,
+                            use_native, out=rows[row:row + n])
+                at  += n * msg_row
+                row += n
+            expert_out = run_local_experts(recv_expert.long(), rows, experts, E)
+            # Results go back in the order received, so every source gets
+            # exactly the rows it sent and no count exchange is needed;
+            # they arrive in plan order, one contiguous block of rows
+            back_bytes = [n * row_bytes for n in counts]
+            recv_bytes = [n * row_bytes for n in ch["send_count"]]
+            back = pool.get(("combine_send", c), sum(back_bytes))
+            encode_rows(expert_out, wire, use_native, out=back.view(total, row_bytes))
+            back_recv = pool.get(("combine_recv", c), sum(recv_bytes))
+        ch["combine"] = all_to_all_v_start(back, back_bytes, back_recv, recv_bytes, rank,
+                                           world_size, comm, executor, timeline,
+                                           ("combine", c))
+
+    routed_out = pool.tensor("routed_out", (N_local, H)).zero_()
+
+    def finish_combine(c):
+        ch = chunks[c]
+        back_recv = ch.pop("combine")()
+        with timeline.span("scatter", c):
+            # Replies line up with the chunk's row_token / row_weight
+            back_rows = decode_rows(back_recv.view(-1, row_bytes), H, wire, use_native)
+            out = routed_out[bounds[c]:bounds[c + 1]]
+            if ch["plan"] is not None:
+                ch["plan"].scatter(back_rows, out=out)
+            else:
+                out.index_add_(0, ch["row_token"],
+                               back_rows * ch["row_weight"].unsqueeze(1))
 
     # ----------------------------------------------------------------
-    # Combine: send results back to token owners
-    # ----------------------------------------------------------------
-    RSLOT = 2 + H
-    back_counters    = [0] * world_size
-    back_send_tensor = torch.zeros(world_size, max_slots, RSLOT)
-
-    for (src_rank, tok_id_orig, w, out) in expert_results:
-        si = back_counters[src_rank]
-        if si < max_slots:
-            back_send_tensor[src_rank, si, 0] = float(tok_id_orig)
-            back_send_tensor[src_rank, si, 1] = w
-            back_send_tensor[src_rank, si, 2:] = out.detach()
-            back_counters[src_rank] += 1
-
-    back_send_counts_t = torch.tensor(back_counters, dtype=torch.int32)
-    all_back_counts    = [torch.zeros(world_size, dtype=torch.int32)
-                          for _ in range(world_size)]
-    dist.all_gather(all_back_counts, back_send_counts_t)
-
-    back_send_list = [back_send_tensor[r].contiguous() for r in range(world_size)]
-    back_recv_list = all_to_all_p2p(back_send_list, rank, world_size)
-
+    # Pipeline: dispatch(c+1) | experts(c) | combine(c-1)
     # ----------------------------------------------------------------
-    # Accumulate routed output for local tokens
-    # ----------------------------------------------------------------
-    routed_out = torch.zeros(N_local, H)
-    for r in range(world_size):
-        n_back = int(all_back_counts[r][rank].item())
-        for si in range(n_back):
-            slot        = back_recv_list[r][si]
-            tok_id_orig = int(slot[0].item())
-            w           = slot[1].item()
-            out         = slot[2:]
-            if 0 <= tok_id_orig < N_local:
-                routed_out[tok_id_orig] += w * out
+    start_dispatch(0)
 
-    # ----------------------------------------------------------------
-    # Shared experts: replicated on all ranks, run on local tokens
-    # ----------------------------------------------------------------
-    shared_out = torch.zeros(N_local, H)
-    with torch.no_grad():
+    # Shared experts: replicated on all ranks, run on local tokens while
+    # the first dispatch is in flight
+    shared_out = pool.tensor("shared_out", (N_local, H)).zero_()
+    with torch.no_grad(), timeline.span("shared", 0):
         for se in shared_experts:
             shared_out += se(local_inputs)
 
+    for c in range(C):
+        if c + 1 < C:
+            start_dispatch(c + 1)
+        compute_and_return(c)
+        if c > 0:
+            finish_combine(c - 1)
+    finish_combine(C - 1)
+
     # ----------------------------------------------------------------
     # Final output = residual + shared + routed
     # ----------------------------------------------------------------
-    local_final = local_inputs + shared_out + routed_out  # [N_local, H]
+    padded = pool.tensor("padded", (tokens_per_rank, H))
+    padded[N_local:].zero_()
+    local_final = torch.add(local_inputs, shared_out, out=padded[:N_local])  # [N_local, H]
+    local_final += routed_out
 
     # ----------------------------------------------------------------
-    # Gather all ranks' outputs on rank 0 and compare
+    # Gather all ranks' outputs
     # ----------------------------------------------------------------
-    padded = torch.zeros(tokens_per_rank, H)
-    padded[:N_local] = local_final
-    gathered = [torch.zeros(tokens_per_rank, H) for _ in range(world_size)]
-    dist.all_gather(gathered, padded)
-
-    if rank == 0:
-        full_out = torch.cat(gathered, dim=0)[:N]
-        max_err  = (full_out - expected).abs().max().item()
-        result_queue.put(max_err)
-    else:
-        result_queue.put(None)
-
-    dist.destroy_process_group()
+    gathered = all_gather(padded, world_size, comm)
+    return torch.cat(gathered, dim=0)[:N]
 
 
 # -----------------------------------------------------------------------
-# Public API: run one test case across world_size simulated ranks
+# Persistent EP runtime: ranks start once, keep their experts resident and
+# serve forward requests from a queue until closed.
 # -----------------------------------------------------------------------
 
-def run_case(test_dir, world_size=2):
-    with open(os.path.join(test_dir, "meta.json")) as f:
-        cfg = json.load(f)
+def ep_worker(rank, world_size, cfg, test_dir, comm_name, port, placement, replicas,
+              requests, results):
+    try:
+        comm = init_comm(rank, world_size, comm_name, port)
+        shared_experts = load_shared_experts(test_dir, cfg)
+        experts = load_owned_experts(test_dir, cfg, rank, placement, replicas=replicas)
+    except Exception as e:
+        results.put(("error", rank, repr(e)))
+        raise
+    # One thread drives the shared-memory collectives of pipelined chunks
+    executor = ThreadPoolExecutor(max_workers=1) if comm is not None else None
+    # Message buffers persist across forwards
+    pool = BufferPool()
+    results.put(("ready", rank, None))
 
-    ctx          = mp.get_context("spawn")
-    result_queue = ctx.Queue()
-
-    procs = []
-    for rank in range(world_size):
-        p = ctx.Process(
-            target=moe_ep_forward_rank,
-            args=(rank, world_size, cfg, test_dir, result_queue)
-        )
-        p.start()
-        procs.append(p)
+    with torch.no_grad():
+        while True:
+            req = requests.get()
+            if req is None:
+                break
+            if req[0] == "place":
+                # New expert -> rank table: load newly owned experts, drop the rest
+                _, placement, replicas = req
+                experts = load_owned_experts(test_dir, cfg, rank, placement, experts,
+                                             replicas)
+                results.put(("placed", rank, None))
+                continue
+            _, inputs, topk_idx, topk_w, num_chunks, trace, wire = req
+            timeline = Timeline(rank, enabled=trace)
+            out = moe_ep_forward(rank, world_size, cfg, inputs, topk_idx, topk_w,
+                                 shared_experts, experts, comm, num_chunks,
+                                 executor, timeline, placement, replicas, wire, pool)
+            if rank == 0:
+                results.put(("output", rank, out))
+            if trace:
+                results.put(("trace", rank, timeline.events))
+
+    if executor is not None:
+        executor.shutdown()
+    close_comm(comm)
 
-    for p in procs:
-        p.join()
 
-    results = []
-    while not result_queue.empty():
-        r = result_queue.get()
-        if r is not None:
-            results.append(r)
+# -----------------------------------------------------------------------
+# Public API
+# -----------------------------------------------------------------------
 
-    return results[0] if results else float("inf")
\ No newline at end of file
+def routing_counts(topk_idx, num_experts, world_size):
+    """
+    (load[E], traffic[W][E]) of one batch under the DP split of
+    moe_ep_forward: tokens per expert, and per source rank.
+    """
+    N = topk_idx.shape[0]
+    tokens_per_rank = (N + world_size - 1) // world_size
+    src   = torch.arange(N).div(max(tokens_per_rank, 1), rounding_mode="floor")
+    src   = src.unsqueeze(1).expand_as(topk_idx).reshape(-1)
+    flat  = topk_idx.reshape(-1).long()
+    pairs = torch.bincount(src * num_experts + flat,
+                           minlength=world_size * num_experts)
+    traffic = pairs.reshape(world_size, num_experts).double()
+    return traffic.sum(0).tolist(), traffic.tolist()
+
+
+_comm_ids = itertools.count()
+
+
+def default_backend():
+    """MOE_EP_BACKEND=shm|gloo; shm whenever libmoe_native is built."""
+    return os.environ.get("MOE_EP_BACKEND",
+                          "shm" if moe_native.available() else "gloo")
+
+
+class EPRuntime:
+    """
+    world_size EP ranks serving the model stored in test_dir. Startup
+    (process spawn, communicator setup, expert loading) happens once in
+    the constructor and is recorded in startup_ms; forward() then only
+    pays for dispatch, expert compute and combine.
+
+    placement is an expert -> rank table (default e % world_size) and can
+    be changed with set_placement(). replicas optionally adds copies of
+    hot experts on other ranks (one rank list per expert, the placement
+    owner first); tokens then prefer the copy on their own rank. With
+    rebalance_every=n the runtime feeds each forward's routing counts to a
+    PlacementPlanner and adopts its table every n forwards when it is
+    clearly better; replicate_top > 0 lets the planner also replicate up to
+    that many of the hottest experts, max_copies copies each (0 = any rank).
+    wire is the all-to-all activation format: fp32 (exact), bf16 or fp8.
+
+        with EPRuntime(test_dir, world_size=2) as rt:
+            out = rt.forward(inputs, topk_idx, topk_w)
+    """
+
+    def __init__(self, test_dir, world_size=2, backend=None, port=29500,
+                 num_chunks=1, placement=None, rebalance_every=0, comm_weight=0.1,
+                 timeout_s=120.0, replicas=None, replicate_top=0, max_copies=0,
+                 wire="fp32"):
+        with open(os.path.join(test_dir, "meta.json")) as f:
+            self.cfg = json.load(f)
+        E = self.cfg["n_routed_experts"]
+        self.placement  = self._check_placement(placement or round_robin(E, world_size),
+                                                world_size)
+        self.replicas   = self._check_replicas(replicas, world_size)
+        self.planner    = None
+        self.rebalance_every = rebalance_every
+        self._forwards  = 0
+        if (rebalance_every or self.replicas) and not moe_native.available():
+            raise RuntimeError("rebalancing and replication need libmoe_native")
+        if rebalance_every:
+            self.planner = PlacementPlanner(E, world_size, comm_weight=comm_weight,
+                                            table=self.placement,
+                                            replicate_top=replicate_top,
+                                            max_copies=max_copies, replicas=self.replicas)
+        self.world_size = world_size
+        self.num_chunks = num_chunks
+        if wire not in WIRE_FORMATS:
+            raise ValueError(f"unknown wire format {wire!r}")
+        self.wire       = wire
+        self.timeout_s  = timeout_s
+        self.last_trace = None
+        self._stash     = collections.defaultdict(collections.deque)
+
+        self.backend = backend or default_backend()
+        comm_name = None
+        if self.backend == "shm":
+            comm_name = f"/moe_ep_{os.getpid()}_{next(_comm_ids)}"
+        elif self.backend != "gloo":
+            raise ValueError(f"unknown backend {self.backend!r}")
+
+        t0 = time.perf_counter()
+        ctx = mp.get_context("spawn")
+        self._requests = [ctx.Queue() for _ in range(world_size)]
+        self._results  = ctx.Queue()
+        self._procs    = []
+        for rank in range(world_size):
+            p = ctx.Process(
+                target=ep_worker,
+                args=(rank, world_size, self.cfg, test_dir, comm_name, port,
+                      self.placement, self.replicas, self._requests[rank], self._results)
+            )
+            p.start()
+            self._procs.append(p)
+
+        try:
+            for _ in range(world_size):
+                self._get("ready")
+        except Exception:
+            self.close()
+            raise
+        self.startup_ms = (time.perf_counter() - t0) * 1000
+
+    def _get(self, kind):
+        # Messages of other kinds (e.g. traces racing an output) are stashed
+        if self._stash[kind]:
+            return self._stash[kind].popleft()
+        deadline = time.perf_counter() + self.timeout_s
+        while True:
+            try:
+                tag, rank, payload = self._results.get(timeout=1.0)
+            except queue.Empty:
+                dead = [p.pid for p in self._procs if not p.is_alive()]
+                if dead or time.perf_counter() > deadline:
+                    raise RuntimeError(f"EP ranks did not respond (dead pids: {dead})")
+                continue
+            if tag == "error":
+                raise RuntimeError(f"EP rank {rank} failed: {payload}")
+            if tag != kind:
+                self._stash[tag].append(payload)
+                continue
+            return payload
+
+    def forward(self, inputs, topk_idx, topk_w, num_chunks=None, trace=False, wire=None):
+        """
+        Routed + shared + residual output [N, H] for inputs [N, H].
+        num_chunks and wire override the runtime's pipeline depth and wire
+        format for this call; with trace=True every rank's timeline events
+        end up in last_trace.
+        """
+        num_chunks = num_chunks or self.num_chunks
+        wire = wire or self.wire
+        if wire not in WIRE_FORMATS:
+            raise ValueError(f"unknown wire format {wire!r}")
+        req = ("forward", inputs.contiguous(), topk_idx.contiguous(), topk_w.contiguous(),
+               num_chunks, trace, wire)
+        for q in self._requests:
+            q.put(req)
+        out = self._get("output")
+        if trace:
+            self.last_trace = [ev for _ in range(self.world_size)
+                               for ev in self._get("trace")]
+
+        if self.planner is not None:
+            self.planner.observe(*routing_counts(topk_idx, self.cfg["n_routed_experts"],
+                                                 self.world_size))
+            self._forwards += 1
+            if self._forwards % self.rebalance_every == 0 and self.planner.replan():
+                self.set_placement(self.planner.table, self.planner.replicas)
+        return out
+
+    def _check_placement(self, placement, world_size):
+        placement = [int(r) for r in placement]
+        if len(placement) != self.cfg["n_routed_experts"] or \
+                any(r < 0 or r >= world_size for r in placement):
+            raise ValueError(f"bad placement {placement} for {world_size} ranks")
+        return placement
+
+    def _check_replicas(self, replicas, world_size):
+        if replicas is None:
+            return None
+        replicas = [[int(r) for r in copies] for copies in replicas]
+        if len(replicas) != self.cfg["n_routed_experts"] or any(
+                not copies or copies[0] != owner or len(set(copies)) != len(copies) or
+                any(r < 0 or r >= world_size for r in copies)
+                for copies, owner in zip(replicas, self.placement)):
+            raise ValueError(f"bad replicas {replicas} for placement {self.placement}")
+        return replicas
+
+    def set_placement(self, placement, replicas=None):
+        """
+        Moves experts to a new expert -> rank table (and replica lists,
+        which start with that owner); waits for every rank.
+        """
+        self.placement = self._check_placement(placement, self.world_size)
+        self.replicas  = self._check_replicas(replicas, self.world_size)
+        if self.replicas and not moe_native.available():
+            raise RuntimeError("replication needs libmoe_native")
+        for q in self._requests:
+            q.put(("place", self.placement, self.replicas))
+        for _ in range(self.world_size):
+            self._get("placed")
+
+    def close(self):
+        for q, p in zip(self._requests, self._procs):
+            if p.is_alive():
+                q.put(None)
+        for p in self._procs:
+            p.join(timeout=10)
+            if p.is_alive():
+                p.terminate()
+        self._procs = []
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+def load_case(test_dir):
+    """(cfg, inputs, expected, topk_idx, topk_w) of a generated test case."""
+    with open(os.path.join(test_dir, "meta.json")) as f:
+        cfg = json.load(f)
+    N, H, K = cfg["batch_size"] * cfg["seq_len"], cfg["hidden_size"], cfg["top_k"]
+    return (cfg,
+            torch.from_numpy(load_f32(test_dir, "inputs",       (N, H))),
+            torch.from_numpy(load_f32(test_dir, "outputs",      (N, H))),
+            torch.from_numpy(load_i32(test_dir, "topk_indices", (N, K))),
+            torch.from_numpy(load_f32(test_dir, "topk_weights", (N, K))))
+
+
+def run_case(test_dir, world_size=2, backend=None, wire="fp32"):
+    """Max abs error of one EP forward against the case's expected output."""
+    _, inputs, expected, topk_idx, topk_w = load_case(test_dir)
+    with EPRuntime(test_dir, world_size=world_size, backend=backend, wire=wire) as rt:
+        out = rt.forward(inputs, topk_idx, topk_w)
+    return (out - expected).abs().max().item()
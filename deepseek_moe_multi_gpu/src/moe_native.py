@@ -0,0 +1,440 @@
+"""
+ctypes bindings for libmoe_native (src/moe_cpu), the host-side MoE library
+shared with moe_cuda/main.cu: the token dispatch plan, the expert placement
+and replication planners, the wire codecs, the EP step cost model
+(ep_sim.py) and the shared-memory all-to-all used by moe_ep_distributed.py.
+
+Build once:
+    cmake -S moe_cpu -B moe_cpu/build && cmake --build moe_cpu/build
+
+The library is looked up at $MOE_NATIVE_LIB, then moe_cpu/build/. All
+tensor arguments are CPU torch tensors; they are made contiguous and cast
+to int32/float32 as needed.
+"""
+import ctypes
+import os
+
+_HERE = os.path.dirname(os.path.abspath(__file__))
+_DEFAULT_LIB = os.path.join(_HERE, "moe_cpu", "build", "libmoe_native.so")
+
+_lib = None
+
+
+def load():
+    global _lib
+    if _lib is not None:
+        return _lib
+    path = os.environ.get("MOE_NATIVE_LIB", _DEFAULT_LIB)
+    if not os.path.exists(path):
+        raise OSError(f"{path} not found; build it with "
+                      f"'cmake -S moe_cpu -B moe_cpu/build && cmake --build moe_cpu/build'")
+    lib = ctypes.CDLL(path)
+    _declare(lib)
+    _lib = lib
+    return lib
+
+
+def available():
+    try:
+        load()
+        return True
+    except OSError:
+        return False
+
+
+_p = ctypes.c_void_p
+_i = ctypes.c_int
+
+
+def _declare(lib):
+    lib.moe_last_error.restype = ctypes.c_char_p
+    lib.moe_plan_create.restype = _p
+    lib.moe_plan_destroy.argtypes = [_p]
+    lib.moe_plan_build.argtypes = [_p, _p, _p, _i, _i, _i, _p, _i, _i]
+    lib.moe_plan_num_rows.argtypes = [_p]
+    for name in ("expert_rank", "expert_begin", "expert_count", "rank_offsets",
+                 "row_token", "row_expert", "row_weight", "slot_row"):
+        fn = getattr(lib, "moe_plan_" + name)
+        fn.argtypes = [_p]
+        fn.restype = _p
+    lib.moe_gather.argtypes = [_p, _p, _i, _p, _i]
+    lib.moe_scatter_weighted.argtypes = [_p, _p, _i, _p, _i, _i, _i]
+    lib.moe_place_experts.argtypes = [_p, _i, _i, _p, ctypes.c_double, _i, _p]
+    lib.moe_placement_stats.argtypes = [_p, _i, _i, _p, _p, ctypes.c_double, _p]
+    lib.moe_plan_replicas.argtypes = [_p, _i, _i, _p, _p, _i, _i, ctypes.c_double, _p, _p]
+    lib.moe_replica_stats.argtypes = [_p, _i, _i, _p, _p, _p, ctypes.c_double, _p]
+    lib.moe_assign_replicas.argtypes = [_p, _i, _i, _i, _i, _p, _p, _i, _p]
+    lib.moe_wire_row_bytes.restype = ctypes.c_long
+    lib.moe_wire_row_bytes.argtypes = [_i, _i]
+    lib.moe_encode_rows.argtypes = [_p, ctypes.c_long, _i, _i, _p, _i]
+    lib.moe_decode_rows.argtypes = [_p, ctypes.c_long, _i, _i, _p, _i]
+    lib.moe_simulate_step.argtypes = [_p, _i, _i, _i, _i, _p, _p, _p, _p, _p, _p, _p, _i]
+    lib.moe_comm_create.restype = _p
+    lib.moe_comm_create.argtypes = [ctypes.c_char_p, _i, _i, ctypes.c_size_t, ctypes.c_double]
+    lib.moe_comm_destroy.argtypes = [_p]
+    lib.moe_comm_alltoallv.argtypes = [_p, _p, _p, _p, _p]
+    lib.moe_comm_alltoallv_offsets.argtypes = [_p, _p, _p, _p, _p, _p, _p]
+    lib.moe_comm_barrier.argtypes = [_p]
+
+
+def _check(status):
+    if status != 0:
+        raise RuntimeError(_lib.moe_last_error().decode())
+
+
+def _ptr(t):
+    return ctypes.c_void_p(t.data_ptr()) if t is not None else None
+
+
+def _as(t, dtype):
+    return t.detach().to(dtype).contiguous()
+
+
+def _copy_out(addr, n, ctype, dtype):
+    import torch
+    if n == 0:
+        return torch.empty(0, dtype=dtype)
+    buf = (ctype * n).from_address(addr)
+    return torch.frombuffer(buf, dtype=dtype).clone()
+
+
+class DispatchPlan:
+    """
+    Counting-sort dispatch of the (token, k) pairs in topk_idx [N, K] by
+    (owner rank, expert). Rows bound for rank r are
+    [rank_offsets[r], rank_offsets[r + 1]); rows of expert e are
+    [expert_begin[e], expert_begin[e] + expert_count[e]).
+
+    expert_to_rank: optional [E] placement table, default e % world_size.
+    """
+
+    def __init__(self, topk_idx, topk_w, num_experts, world_size,
+                 expert_to_rank=None, num_threads=0):
+        import torch
+        lib = load()
+        self._lib = lib
+        self._handle = lib.moe_plan_create()
+        if not self._handle:
+            raise MemoryError(lib.moe_last_error().decode())
+
+        idx = _as(topk_idx, torch.int32)
+        w = _as(topk_w, torch.float32) if topk_w is not None else None
+        owner = _as(torch.as_tensor(expert_to_rank), torch.int32) \
+            if expert_to_rank is not None else None
+        self.num_tokens, self.top_k = idx.shape
+        self.num_experts = num_experts
+        self.world_size = world_size
+        self.num_threads = num_threads
+        _check(lib.moe_plan_build(self._handle, _ptr(idx), _ptr(w), self.num_tokens,
+                                  self.top_k, num_experts, _ptr(owner), world_size,
+                                  num_threads))
+        self.num_rows = lib.moe_plan_num_rows(self._handle)
+
+        E, W, R = num_experts, world_size, self.num_rows
+        ci, cf, i32 = ctypes.c_int, ctypes.c_float, torch.int32
+        h = self._handle
+        self.expert_rank = _copy_out(lib.moe_plan_expert_rank(h), E, ci, i32)
+        self.expert_begin = _copy_out(lib.moe_plan_expert_begin(h), E, ci, i32)
+        self.expert_count = _copy_out(lib.moe_plan_expert_count(h), E, ci, i32)
+        self.rank_offsets = _copy_out(lib.moe_plan_rank_offsets(h), W + 1, ci, i32)
+        self.row_token = _copy_out(lib.moe_plan_row_token(h), R, ci, i32)
+        self.row_expert = _copy_out(lib.moe_plan_row_expert(h), R, ci, i32)
+        self.row_weight = _copy_out(lib.moe_plan_row_weight(h), R, cf, torch.float32)
+        self.slot_row = _copy_out(lib.moe_plan_slot_row(h), R, ci, i32)
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            self._lib.moe_plan_destroy(self._handle)
+            self._handle = None
+
+    def send_counts(self):
+        """Rows bound for each rank, as a Python list."""
+        return (self.rank_offsets[1:] - self.rank_offsets[:-1]).tolist()
+
+    def gather(self, x):
+        """rows[r] = x[row_token[r]] for x [N, H]; returns [R, H] float32."""
+        import torch
+        x = _as(x, torch.float32)
+        rows = torch.empty(self.num_rows, x.shape[1], dtype=torch.float32)
+        _check(self._lib.moe_gather(self._handle, _ptr(x), x.shape[1], _ptr(rows),
+                                    self.num_threads))
+        return rows
+
+    def scatter(self, rows, out=None, weighted=True):
+        """
+        out[n] += sum_k w(n, k) * rows[slot_row[n, k]] (w = 1 if not weighted).
+        With out=None a zero [N, H] tensor is created. out must be a
+        contiguous float32 tensor; it is updated in place and returned.
+        """
+        import torch
+        rows = _as(rows, torch.float32)
+        H = rows.shape[1]
+        accumulate = out is not None
+        if out is None:
+            out = torch.empty(self.num_tokens, H, dtype=torch.float32)
+        if out.dtype != torch.float32 or not out.is_contiguous():
+            raise ValueError("out must be a contiguous float32 tensor")
+        _check(self._lib.moe_scatter_weighted(self._handle, _ptr(rows), H, _ptr(out),
+                                              int(accumulate), int(weighted),
+                                              self.num_threads))
+        return out
+
+
+def _doubles(values):
+    values = [float(v) for v in values]
+    return (ctypes.c_double * len(values))(*values)
+
+
+def _traffic(traffic, world_size, num_experts):
+    if traffic is None:
+        return None
+    flat = [v for row in traffic for v in row]
+    if len(flat) != world_size * num_experts:
+        raise ValueError("traffic must be [world_size][num_experts]")
+    return _doubles(flat)
+
+
+def plan_placement(expert_load, world_size, traffic=None, comm_weight=0.0, max_experts_per_rank=0):
+    """
+    Expert -> rank table minimising the most loaded rank (placement.h).
+    expert_load: per-expert token counts; traffic: optional [world_size][E] counts
+    of tokens each rank routes to each expert. Plain Python sequences; the
+    result is a list of ints.
+    """
+    lib = load()
+    E = len(expert_load)
+    out = (ctypes.c_int * E)()
+    _check(lib.moe_place_experts(_doubles(expert_load), E, world_size,
+                                 _traffic(traffic, world_size, E), comm_weight,
+                                 max_experts_per_rank, out))
+    return list(out)
+
+
+def placement_stats(expert_load, world_size, expert_to_rank, traffic=None,
+                    comm_weight=0.0):
+    """dict(max_cost, mean_cost, max_load, remote) of a placement."""
+    lib = load()
+    E = len(expert_load)
+    owner = (ctypes.c_int * E)(*expert_to_rank)
+    stats = (ctypes.c_double * 4)()
+    _check(lib.moe_placement_stats(_doubles(expert_load), E, world_size,
+                                   _traffic(traffic, world_size, E), owner, comm_weight,
+                                   stats))
+    return dict(zip(("max_cost", "mean_cost", "max_load", "remote"), stats))
+
+
+WIRE_FORMATS = {"fp32": 0, "bf16": 1, "fp8": 2}
+
+
+def wire_row_bytes(fmt, hidden):
+    """Bytes of one row of `hidden` values in wire format fmt (wire.h)."""
+    n = load().moe_wire_row_bytes(WIRE_FORMATS[fmt], hidden)
+    if n < 0:
+        raise RuntimeError(_lib.moe_last_error().decode())
+    return n
+
+
+def _check_out(out, shape, dtype):
+    if out.dtype != dtype or tuple(out.shape) != shape or not out.is_contiguous():
+        raise ValueError(f"out must be a contiguous {dtype} tensor of shape {shape}")
+
+
+def encode_rows(x, fmt, num_threads=0, out=None):
+    """x [R, H] -> uint8 [R, wire_row_bytes(fmt, H)]; fmt is fp32, bf16 or fp8.
+    out: optional contiguous destination of that shape (e.g. a slice of a
+    send buffer)."""
+    import torch
+    lib = load()
+    x = _as(x, torch.float32)
+    shape = (x.shape[0], wire_row_bytes(fmt, x.shape[1]))
+    if out is None:
+        out = torch.empty(shape, dtype=torch.uint8)
+    else:
+        _check_out(out, shape, torch.uint8)
+    _check(lib.moe_encode_rows(_ptr(x), x.shape[0], x.shape[1], WIRE_FORMATS[fmt], _ptr(out),
+                               num_threads))
+    return out
+
+
+def decode_rows(buf, hidden, fmt, num_threads=0, out=None):
+    """uint8 [R, wire_row_bytes(fmt, hidden)] -> float32 [R, hidden], into
+    out when given."""
+    import torch
+    lib = load()
+    buf = buf.contiguous()
+    if out is None:
+        out = torch.empty(buf.shape[0], hidden, dtype=torch.float32)
+    else:
+        _check_out(out, (buf.shape[0], hidden), torch.float32)
+    _check(lib.moe_decode_rows(_ptr(buf), buf.shape[0], hidden, WIRE_FORMATS[fmt], _ptr(out),
+                               num_threads))
+    return out
+
+
+def _csr(replicas):
+    """ctypes (offsets, ranks) of a replica list [[rank, ...] per expert]."""
+    offsets, ranks = [0], []
+    for copies in replicas:
+        ranks.extend(copies)
+        offsets.append(len(ranks))
+    return (ctypes.c_int * len(offsets))(*offsets), (ctypes.c_int * max(len(ranks), 1))(*ranks)
+
+
+def plan_replicas(expert_load, world_size, expert_to_rank, traffic=None, max_replicated=1,
+                  max_copies=0, comm_weight=0.0):
+    """
+    Extra copies of the hottest experts on top of a placement (placement.h).
+    Returns one list of ranks per expert, the expert_to_rank owner first;
+    max_copies=0 allows a copy on every rank.
+    """
+    lib = load()
+    E = len(expert_load)
+    offsets = (ctypes.c_int * (E + 1))()
+    ranks = (ctypes.c_int * (E * world_size))()
+    _check(lib.moe_plan_replicas(_doubles(expert_load), E, world_size,
+                                 _traffic(traffic, world_size, E),
+                                 (ctypes.c_int * E)(*expert_to_rank), max_replicated,
+                                 max_copies or world_size, comm_weight, offsets, ranks))
+    return [list(ranks[offsets[e]:offsets[e + 1]]) for e in range(E)]
+
+
+def replica_stats(expert_load, world_size, replicas, traffic=None, comm_weight=0.0):
+    """placement_stats for a replica list, with tokens split as assign_replicas does."""
+    lib = load()
+    E = len(expert_load)
+    offsets, ranks = _csr(replicas)
+    stats = (ctypes.c_double * 4)()
+    _check(lib.moe_replica_stats(_doubles(expert_load), E, world_size,
+                                 _traffic(traffic, world_size, E), offsets, ranks,
+                                 comm_weight, stats))
+    return dict(zip(("max_cost", "mean_cost", "max_load", "remote"), stats))
+
+
+def assign_replicas(topk_idx, replicas, world_size, source_rank):
+    """
+    Rewrites source_rank's topk_idx [N, K] to virtual experts, one per
+    (expert, copy): the local copy when source_rank holds one, else the
+    copies in turn. Returns (virtual_idx [N, K] int32, virtual_rank,
+    virtual_expert); pass virtual_idx to DispatchPlan with
+    len(virtual_rank) experts and expert_to_rank=virtual_rank.
+    """
+    import torch
+    lib = load()
+    idx = _as(topk_idx, torch.int32)
+    out = torch.empty_like(idx)
+    offsets, ranks = _csr(replicas)
+    _check(lib.moe_assign_replicas(_ptr(idx), idx.shape[0], idx.shape[1], len(replicas),
+                                   world_size, offsets, ranks, source_rank, _ptr(out)))
+    virtual_rank = [r for copies in replicas for r in copies]
+    virtual_expert = [e for e, copies in enumerate(replicas) for _ in copies]
+    return out, virtual_rank, virtual_expert
+
+
+def simulate_step(topk_idx, top_k, replicas, world_size, layer, topology, num_threads=0):
+    """
+    Predicted cost of one EP step (ep_sim.h). topk_idx: flat sequence of
+    the step's [N * top_k] expert ids (any int sequence or ctypes array);
+    replicas: one rank list per expert; layer: (hidden, intermediate,
+    shared_intermediate, wire format name, rank_tflops); topology:
+    (ranks_per_node, intra_gbps, intra_latency_us, inter_gbps,
+    inter_latency_us). Returns a dict of the timings in us, the bytes, the
+    [W][W] dispatch row counts and the per-rank compute us.
+    """
+    lib = load()
+    if not isinstance(topk_idx, ctypes.Array):
+        topk_idx = (ctypes.c_int * len(topk_idx))(*topk_idx)
+    W, E = world_size, len(replicas)
+    hidden, inter, shared, wire, tflops = layer
+    offsets, ranks = _csr(replicas)
+    send_rows = (ctypes.c_long * (W * W))()
+    compute_us = (ctypes.c_double * W)()
+    stats = (ctypes.c_double * 8)()
+    _check(lib.moe_simulate_step(topk_idx, len(topk_idx) // top_k, top_k, E, W, offsets, ranks,
+                                 _doubles([hidden, inter, shared, WIRE_FORMATS[wire], tflops]),
+                                 _doubles(topology), send_rows, compute_us, stats,
+                                 num_threads))
+    out = dict(zip(("dispatch_us", "combine_us", "max_compute_us", "step_us", "overlap_us",
+                    "intra_bytes", "inter_bytes"), stats))
+    out["send_rows"] = [list(send_rows[s * W:(s + 1) * W]) for s in range(W)]
+    out["compute_us"] = list(compute_us)
+    return out
+
+
+class ShmComm:
+    """
+    All-to-all-v between the processes of one host through per-pair
+    shared-memory rings (shm_comm.h). Every rank opens it with the same
+    name, which must be unique to the group; rank 0 creates the segment.
+    ring_bytes=0 uses the library default (1 MiB per rank pair).
+    """
+
+    def __init__(self, name, rank, world_size, ring_bytes=0, timeout_s=60.0):
+        lib = load()
+        self._lib = lib
+        self._handle = lib.moe_comm_create(name.encode(), rank, world_size, ring_bytes,
+                                           timeout_s)
+        if not self._handle:
+            raise RuntimeError(lib.moe_last_error().decode())
+        self.rank = rank
+        self.world_size = world_size
+
+    def close(self):
+        if getattr(self, "_handle", None):
+            self._lib.moe_comm_destroy(self._handle)
+            self._handle = None
+
+    __del__ = close
+
+    def all_to_all(self, send_list, recv_list):
+        """
+        Rank r receives send_list[rank] of this rank into its recv_list[rank].
+        All tensors are contiguous CPU tensors; recv_list[r] must have the
+        byte size rank r sends here. Returns recv_list.
+        """
+        W = self.world_size
+        ptrs, sizes = ctypes.c_void_p * W, ctypes.c_size_t * W
+        for t in list(send_list) + list(recv_list):
+            if not t.is_contiguous():
+                raise ValueError("all_to_all needs contiguous tensors")
+        send_p = ptrs(*[t.data_ptr() for t in send_list])
+        send_b = sizes(*[t.numel() * t.element_size() for t in send_list])
+        recv_p = ptrs(*[t.data_ptr() for t in recv_list])
+        recv_b = sizes(*[t.numel() * t.element_size() for t in recv_list])
+        _check(self._lib.moe_comm_alltoallv(self._handle, send_p, send_b, recv_p, recv_b))
+        return recv_list
+
+    def all_to_all_v(self, send, send_bytes, recv, recv_bytes):
+        """
+        Offset-addressed all-to-all-v over two contiguous CPU tensors. The
+        block for rank r is send_bytes[r] bytes of send, blocks packed back
+        to back from offset 0; rank r's block lands in recv at the prefix
+        sum of recv_bytes. Counts must match pairwise across ranks (they
+        come from a count exchange). Returns recv.
+        """
+        W = self.world_size
+        sizes = ctypes.c_size_t * W
+        if len(send_bytes) != W or len(recv_bytes) != W:
+            raise ValueError("all_to_all_v needs one byte count per rank")
+        for t, counts in ((send, send_bytes), (recv, recv_bytes)):
+            if not t.is_contiguous():
+                raise ValueError("all_to_all_v needs contiguous tensors")
+            if sum(counts) > t.numel() * t.element_size():
+                raise ValueError("all_to_all_v counts overflow the buffer")
+        send_off, recv_off = [0] * W, [0] * W
+        for r in range(1, W):
+            send_off[r] = send_off[r - 1] + send_bytes[r - 1]
+            recv_off[r] = recv_off[r - 1] + recv_bytes[r - 1]
+        _check(self._lib.moe_comm_alltoallv_offsets(
+            self._handle, send.data_ptr(), sizes(*send_bytes), sizes(*send_off),
+            recv.data_ptr(), sizes(*recv_bytes), sizes(*recv_off)))
+        return recv
+
+    def all_gather(self, tensor):
+        """Every rank's tensor (same shape everywhere), indexed by rank."""
+        import torch
+        tensor = tensor.contiguous()
+        recv = [torch.empty_like(tensor) for _ in range(self.world_size)]
+        return self.all_to_all([tensor] * self.world_size, recv)
+
+    def barrier(self):
+        _check(self._lib.moe_comm_barrier(self._handle))
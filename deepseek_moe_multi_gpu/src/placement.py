@@ -0,0 +1,89 @@
+"""
+Expert placement for the EP runtime: routing statistics and when to
+replan. The planner itself (greedy bin packing + local search with a
+communication term) is placement.h in libmoe_native, shared with
+moe_cuda/main.cu.
+
+Offline:  table = moe_native.plan_placement(load, world_size, traffic)
+Online :  planner = PlacementPlanner(E, W); planner.observe(load, traffic)
+          per step; planner.replan() returns True when it adopted a new
+          table (planner.table).
+
+With replicate_top > 0 the planner also copies the hottest experts onto
+other ranks (moe_native.plan_replicas); planner.replicas is then one rank
+list per expert, owner first, else None.
+"""
+import moe_native
+
+
+def round_robin(num_experts, world_size):
+    return [e % world_size for e in range(num_experts)]
+
+
+class RoutingStats:
+    """Exponentially decayed per-expert and per-(rank, expert) token counts."""
+
+    def __init__(self, num_experts, world_size, decay=0.9):
+        self.decay   = decay
+        self.load    = [0.0] * num_experts
+        self.traffic = [[0.0] * num_experts for _ in range(world_size)]
+        self.steps   = 0
+
+    def observe(self, load, traffic):
+        d = self.decay
+        self.load = [d * a + b for a, b in zip(self.load, load)]
+        self.traffic = [[d * a + b for a, b in zip(row, new)]
+                        for row, new in zip(self.traffic, traffic)]
+        self.steps += 1
+
+
+class PlacementPlanner:
+    """
+    Keeps an expert -> rank table in line with recent routing. A new table
+    is adopted only if it lowers the modelled straggler cost by at least
+    min_gain, since moving an expert means reloading its weights.
+    """
+
+    def __init__(self, num_experts, world_size, comm_weight=0.1,
+                 max_experts_per_rank=0, decay=0.9, min_gain=0.05, table=None,
+                 replicate_top=0, max_copies=0, replicas=None):
+        self.num_experts = num_experts
+        self.world_size  = world_size
+        self.comm_weight = comm_weight
+        self.max_experts_per_rank = max_experts_per_rank
+        self.min_gain = min_gain
+        self.stats = RoutingStats(num_experts, world_size, decay)
+        self.table = list(table) if table is not None else round_robin(num_experts, world_size)
+        self.replicate_top = replicate_top
+        self.max_copies = max_copies
+        self.replicas = [list(c) for c in replicas] if replicas is not None else None
+
+    def observe(self, load, traffic):
+        self.stats.observe(load, traffic)
+
+    def cost(self, table, replicas=None):
+        if replicas is not None:
+            return moe_native.replica_stats(self.stats.load, self.world_size, replicas,
+                                            self.stats.traffic, self.comm_weight)
+        return moe_native.placement_stats(self.stats.load, self.world_size, table,
+                                          self.stats.traffic, self.comm_weight)
+
+    def replan(self):
+        if self.stats.steps == 0:
+            return False
+        candidate = moe_native.plan_placement(self.stats.load, self.world_size,
+                                              self.stats.traffic, self.comm_weight,
+                                              self.max_experts_per_rank)
+        replicas = None
+        if self.replicate_top > 0:
+            replicas = moe_native.plan_replicas(self.stats.load, self.world_size, candidate,
+                                                self.stats.traffic, self.replicate_top,
+                                                self.max_copies, self.comm_weight)
+            if all(len(c) == 1 for c in replicas):
+                replicas = None
+        current = self.cost(self.table, self.replicas)["max_cost"]
+        if self.cost(candidate, replicas)["max_cost"] < current * (1.0 - self.min_gain):
+            self.table = candidate
+            self.replicas = replicas
+            return True
+        return False
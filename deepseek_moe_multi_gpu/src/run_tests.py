@@ -1,5 +1,10 @@
 """
 Test runner: checks all generated test cases against multi-rank EP MoE.
+
+    python run_tests.py [fp32|bf16|fp8]
+
+The argument picks the all-to-all wire format; reduced-precision formats
+are checked against the same fp32 goldens with a looser tolerance.
 """
 import os, sys, json
 sys.path.insert(0, os.path.dirname(__file__))
@@ -7,13 +12,16 @@ from moe_ep_distributed import run_case
 
 TESTS_DIR  = "tests"
 WORLD_SIZE = 2   # simulated ranks
-TOLERANCE  = 1e-5
+TOLERANCE  = {"fp32": 1e-5, "bf16": 5e-3, "fp8": 5e-2}
 
 def main():
+    wire = sys.argv[1] if len(sys.argv) > 1 else "fp32"
+    tol  = TOLERANCE[wire]
     with open(os.path.join(TESTS_DIR, "manifest.json")) as f:
         manifest = json.load(f)
 
-    print(f"Running {len(manifest)} test cases  (world_size={WORLD_SIZE})\n")
+    print(f"Running {len(manifest)} test cases  (world_size={WORLD_SIZE}, wire={wire}, "
+          f"tol={tol:g})\n")
     print(f"{'Case':<12} {'B':>4} {'S':>4} {'Max Err':>14}  Result")
     print("-" * 45)
 
@@ -23,8 +31,8 @@ def main():
     for entry in manifest:
         name     = entry["name"]
         test_dir = os.path.join(TESTS_DIR, name)
-        err      = run_case(test_dir, world_size=WORLD_SIZE)
-        ok       = err < TOLERANCE
+        err      = run_case(test_dir, world_size=WORLD_SIZE, wire=wire)
+        ok       = err < tol
         if err > global_max:
             global_max = err
         if not ok:
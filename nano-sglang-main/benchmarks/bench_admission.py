@@ -0,0 +1,204 @@
+"""Admission control and scheduling policy on a synthetic trace.
+
+    python benchmarks/bench_admission.py [--requests 400] [--rate 12]
+        [--kv-blocks 1024] [--model Qwen/Qwen3-0.6B]
+
+Trace: `requests` requests with Poisson arrivals at `rate` per second,
+log-normal prompt lengths (median 200 tokens), half short (16-64) and half
+long (128-512) outputs, priority 0/1/2 for 70/20/10% of them. The KV
+budget is `kv-blocks` blocks of 16 tokens. Runs compared:
+
+  prompt-only   FCFS, admit whenever the prompt fits (no decode
+                headroom, no watermark): the old behaviour plus a budget
+  fcfs          FCFS with admission control (64 tokens of headroom, 1% watermark)
+  spf           shortest prompt first, same admission control
+  priority      priority with aging (0.05 levels per second waited)
+
+Reported: output tokens per second, TTFT and end-to-end latency
+(mean / p99), p99 TTFT of priority-2 requests, preemptions and peak
+KV blocks in use.
+
+Without --model the real Scheduler runs against a simulated engine on a
+virtual clock, so no GPU is needed: a prefill forward takes
+4 ms + 50 us/token, a decode step 12 ms + 0.05 ms/sequence, and
+preempted sequences are recomputed. With --model the same trace is
+replayed in real time on the GPU (arrivals are honoured, so it takes
+as long as the trace).
+"""
+
+import argparse
+import math
+import os
+import random
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+
+from nano_sglang.sampling import SamplingParams      # noqa: E402
+from nano_sglang.scheduler import Scheduler          # noqa: E402
+from nano_sglang.sequence import SequenceStatus      # noqa: E402
+
+
+def make_trace(requests, rate, seed=0):
+    rng = random.Random(seed)
+    t, trace = 0.0, []
+    for _ in range(requests):
+        t += rng.expovariate(rate)
+        prompt = min(2000, max(16, int(rng.lognormvariate(math.log(200), 0.8))))
+        out = rng.randint(16, 64) if rng.random() < 0.5 else rng.randint(128, 512)
+        priority = rng.choices([0, 1, 2], [70, 20, 10])[0]
+        trace.append((t, prompt, out, priority))
+    return trace
+
+
+# ---------------------------------------------------------- simulated engine
+class SimTokenizer:
+    eos_token_id = -1
+
+    def encode(self, text):
+        return [1] * len(text.split())
+
+    def decode(self, token_ids):
+        return ""
+
+
+class SimKV:
+    def __init__(self, max_batch_size, max_seq_len):
+        self.max_seq_len = max_seq_len
+        self.lengths = [0] * max_batch_size
+        self._free = list(range(max_batch_size))
+
+    def allocate_slot(self):
+        self._free.sort()
+        return self._free.pop(0)
+
+    def free_slot(self, slot):
+        self.lengths[slot] = 0
+        self._free.append(slot)
+
+
+class SimEngine:
+    kv_bytes_per_token = 112 * 1024
+
+    def __init__(self):
+        self.tokenizer = SimTokenizer()
+        self.kv = None
+        self.now = 0.0
+
+    def enable_slot_kv(self, max_batch_size, max_seq_len):
+        self.kv = SimKV(max_batch_size, max_seq_len)
+
+    def release(self, seq):
+        if seq.slot >= 0:
+            self.kv.free_slot(seq.slot)
+            seq.slot = -1
+
+    def prefill_batch(self, seqs, sampling_params, max_tokens):
+        self.now += 4e-3 + 50e-6 * sum(max_tokens)
+        out = []
+        for seq, n in zip(seqs, max_tokens):
+            if seq.status == SequenceStatus.WAITING:
+                seq.slot = self.kv.allocate_slot()
+                seq.num_prefilled = 0
+                seq.status = SequenceStatus.PREFILLING
+            seq.num_prefilled = min(len(seq.prefill_token_ids), seq.num_prefilled + n)
+            self.kv.lengths[seq.slot] = seq.num_prefilled
+            done = seq.num_prefilled == len(seq.prefill_token_ids)
+            if done:
+                seq.status = SequenceStatus.DECODING
+            out.append(1 if done else None)
+        return out
+
+    def decode_batch(self, seqs, sampling_params):
+        self.now += 12e-3 + 0.05e-3 * len(seqs)
+        for seq in seqs:
+            self.kv.lengths[seq.slot] += 1
+        return [1] * len(seqs)
+
+
+# ------------------------------------------------------------------- driver
+def replay(sched, trace, clock, wait_until):
+    params = SamplingParams(temperature=0)
+    i = 0
+    while i < len(trace) or sched.waiting_queue or sched.prefilling or sched.running or sched.swapped:
+        while i < len(trace) and trace[i][0] <= clock():
+            _, prompt, out, priority = trace[i]
+            sched.add_request("w " * prompt, SamplingParams(temperature=0, max_tokens=out), priority)
+            sched.waiting_queue[-1].arrival_time = trace[i][0]
+            i += 1
+        if not (sched.waiting_queue or sched.prefilling or sched.running or sched.swapped):
+            wait_until(trace[i][0])
+            continue
+        sched.step(params)
+
+
+def pct(xs, q):
+    xs = sorted(xs)
+    return xs[min(len(xs) - 1, int(q * len(xs)))]
+
+
+def report(name, sched, trace):
+    done = sched.finished
+    start = trace[0][0]
+    end = max(s.token_times[-1] for s in done)
+    tokens = sum(len(s.output_token_ids) for s in done)
+    ttft = [s.token_times[0] - s.arrival_time for s in done]
+    e2e = [s.token_times[-1] - s.arrival_time for s in done]
+    hi = [s.token_times[0] - s.arrival_time for s in done if s.priority == 2]
+    pre = sum(sched.num_preempted.values())
+    print(f"{name:>12} {tokens / (end - start):>7.0f} {sum(ttft) / len(ttft):>9.2f} "
+          f"{pct(ttft, 0.99):>8.2f} {sum(e2e) / len(e2e):>8.2f} {pct(e2e, 0.99):>8.2f} "
+          f"{pct(hi, 0.99):>10.2f} {pre:>8} {sched.block_manager.peak_used_blocks:>6}")
+
+
+RUNS = [
+    ("prompt-only", dict(policy="fcfs", decode_headroom=0, kv_watermark=0.0)),
+    ("fcfs", dict(policy="fcfs")),
+    ("spf", dict(policy="spf")),
+    ("priority", dict(policy=None)),
+]
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--requests", type=int, default=400)
+    ap.add_argument("--rate", type=float, default=12.0)
+    ap.add_argument("--kv-blocks", type=int, default=1024)
+    ap.add_argument("--max-batch-size", type=int, default=64)
+    ap.add_argument("--model", default=None, help="replay on the GPU instead of simulating")
+    args = ap.parse_args()
+
+    from nano_sglang.policy import PriorityAging
+    trace = make_trace(args.requests, args.rate)
+    mode = args.model or "simulated engine"
+    print(f"{mode}: {args.requests} requests at {args.rate}/s, "
+          f"KV budget {args.kv_blocks} blocks x 16 tokens")
+    print(f"{'run':>12} {'tok/s':>7} {'TTFT mean':>9} {'p99':>8} {'e2e mean':>8} {'p99':>8} "
+          f"{'p99 TTFT@2':>10} {'preempt':>8} {'peak':>6}   (s)")
+    engine = None
+    if args.model:
+        from nano_sglang.engine import Engine
+        engine = Engine(args.model)
+    for name, kw in RUNS:
+        if kw["policy"] is None:
+            kw = dict(kw, policy=PriorityAging(aging_rate=0.05))
+        common = dict(slot_kv=True, max_batch_size=args.max_batch_size, max_seq_len=2600,
+                      kv_blocks=args.kv_blocks, **kw)
+        if args.model:
+            engine.kv = None
+            sched = Scheduler(args.model, engine=engine, **common)
+            t0 = time.perf_counter()
+            sched.clock = lambda: time.perf_counter() - t0
+            replay(sched, trace, sched.clock,
+                   lambda t: time.sleep(max(0.0, t - sched.clock())))
+        else:
+            sim = SimEngine()
+            sched = Scheduler(None, engine=sim, preemption="recompute", **common)
+            sched.clock = lambda: sim.now
+            replay(sched, trace, sched.clock, lambda t: setattr(sim, "now", max(sim.now, t)))
+        report(name, sched, trace)
+
+
+if __name__ == "__main__":
+    main()
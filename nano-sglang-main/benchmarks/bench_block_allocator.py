@@ -0,0 +1,114 @@
+"""Block allocator microbenchmark: allocate/free rates from Python.
+
+    python benchmarks/bench_block_allocator.py [--blocks 131072 1048576]
+                                               [--batch 1 16 256]
+
+Compares the old BlockManager free list (list.pop(0) / extend), the
+Python free stack (PyBlockAllocator) and the C++ allocator behind ctypes
+(BlockAllocator, when csrc/ is built). Two workloads per pool size:
+
+  fill   allocate every block in batches, then release them all
+  churn  with the pool 90% used by batch-sized sequences, release a random
+         sequence and allocate a new one, the steady state of serving
+
+Rates are block operations (one allocate or one release of one block) per
+second, best of three. pop(0) shifts the whole free list, so it is timed
+over at most 4k block operations per workload (a full run at 1M blocks
+would take hours).
+
+For the raw C++ rates without the ctypes call overhead see
+csrc/bench_block_allocator.
+"""
+
+import argparse
+import os
+import random
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+
+from nano_sglang import native                                         # noqa: E402
+from nano_sglang.block_allocator import BlockAllocator, PyBlockAllocator  # noqa: E402
+
+POP0_OPS = 4_000
+
+
+class ListPop0:
+    """The free list BlockManager used before the allocator."""
+
+    def __init__(self, num_blocks, watermark=0):
+        self.free_blocks = list(range(num_blocks))
+
+    def allocate(self, n):
+        return [self.free_blocks.pop(0) for _ in range(n)]
+
+    def release(self, ids):
+        self.free_blocks.extend(ids)
+
+
+def fill(cls, blocks, batch, cap=None):
+    a = cls(blocks)
+    limit = min(blocks, cap // 2) if cap else blocks
+    held = []
+    t0 = time.perf_counter()
+    for _ in range(limit // batch):
+        held.append(a.allocate(batch))
+    for ids in held:
+        a.release(ids)
+    dt = time.perf_counter() - t0
+    return 2 * len(held) * batch / dt
+
+
+def churn(cls, blocks, batch, rounds):
+    a = cls(blocks)
+    seqs = max(1, blocks // batch * 9 // 10)
+    if cls is ListPop0:
+        # Same starting state without a million pop(0)s
+        held = [list(range(s * batch, (s + 1) * batch)) for s in range(seqs)]
+        del a.free_blocks[:seqs * batch]
+    else:
+        held = [a.allocate(batch) for _ in range(seqs)]
+    rng = random.Random(0)
+    victims = [rng.randrange(seqs) for _ in range(rounds)]
+    t0 = time.perf_counter()
+    for v in victims:
+        a.release(held[v])
+        held[v] = a.allocate(batch)
+    dt = time.perf_counter() - t0
+    return 2 * rounds * batch / dt
+
+
+def best(fn, *args):
+    return max(fn(*args) for _ in range(3))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--blocks", type=int, nargs="+", default=[131072, 1048576])
+    ap.add_argument("--batch", type=int, nargs="+", default=[1, 16, 256])
+    ap.add_argument("--block-ops", type=int, default=400_000,
+                    help="block operations per churn run")
+    args = ap.parse_args()
+
+    impls = [("list.pop(0)", ListPop0), ("py stack", PyBlockAllocator)]
+    if native.available():
+        impls.append(("c++", BlockAllocator))
+    else:
+        print("libnano_native not built: skipping the C++ allocator")
+
+    print(f"{'blocks':>9} {'batch':>6} {'allocator':>12} "
+          f"{'fill Mops/s':>12} {'churn Mops/s':>13}")
+    for blocks in args.blocks:
+        for batch in args.batch:
+            rounds = max(1, args.block_ops // (2 * batch))
+            for name, cls in impls:
+                cap = POP0_OPS if cls is ListPop0 else None
+                f = best(fill, cls, blocks, batch, cap)
+                r = max(1, min(rounds, cap // (2 * batch))) if cap else rounds
+                c = best(churn, cls, blocks, batch, r)
+                print(f"{blocks:>9} {batch:>6} {name:>12} {f / 1e6:>12.3f} {c / 1e6:>13.3f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,82 @@
+"""Batched decode throughput: padded per-step re-batching vs the slot store.
+
+    python benchmarks/bench_decode_batch.py [--model Qwen/Qwen3-0.6B]
+        [--batch 8 32] [--prompt-tokens 64 512] [--steps 64]
+
+Prefills `batch` sequences with prompts of random length in
+[prompt-tokens[0], prompt-tokens[1]], then times `steps` calls to
+Engine.decode_batch over all of them (prefill excluded):
+
+  padded  the original path: every step pads and concatenates every
+          sequence's DynamicCache into a batch, then slices and clones
+          each sequence's cache back out (O(total KV) copies per token)
+  slot    Engine.enable_slot_kv(): sequences decode in place from their
+          slot of a preallocated store; no KV is copied per step
+
+Needs a CUDA GPU.
+"""
+
+import argparse
+import os
+import random
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+
+
+def run(engine, batch, lo, hi, steps, seed=0):
+    import torch
+    from nano_sglang.sampling import SamplingParams
+    from nano_sglang.sequence import Sequence
+
+    rng = random.Random(seed)
+    vocab = engine.model.vocab_size
+    params = SamplingParams(temperature=0)
+    seqs = []
+    for i in range(batch):
+        prompt = [rng.randrange(1000, vocab - 1000) for _ in range(rng.randint(lo, hi))]
+        seq = Sequence(seq_id=i, prompt_token_ids=prompt)
+        seq.output_token_ids.append(engine.prefill(seq, params))
+        seqs.append(seq)
+
+    engine.decode_batch(seqs, params)          # warm-up
+    torch.cuda.synchronize()
+    t0 = time.perf_counter()
+    for _ in range(steps):
+        for seq, tok in zip(seqs, engine.decode_batch(seqs, params)):
+            seq.output_token_ids.append(tok)
+    torch.cuda.synchronize()
+    dt = time.perf_counter() - t0
+    for seq in seqs:
+        engine.release(seq)
+    return batch * steps / dt, dt / steps * 1e3
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--model", default="Qwen/Qwen3-0.6B")
+    ap.add_argument("--batch", type=int, nargs="+", default=[8, 32])
+    ap.add_argument("--prompt-tokens", type=int, nargs=2, default=[64, 512])
+    ap.add_argument("--steps", type=int, default=64)
+    args = ap.parse_args()
+
+    from nano_sglang.engine import Engine
+    engine = Engine(args.model)
+    lo, hi = args.prompt_tokens
+    max_seq_len = hi + args.steps + 2
+
+    print(f"{args.model}, prompts {lo}-{hi} tokens, {args.steps} decode steps")
+    print(f"{'batch':>6} {'path':>7} {'tok/s':>9} {'ms/step':>8} {'speedup':>8}")
+    for batch in args.batch:
+        engine.kv = None
+        padded = run(engine, batch, lo, hi, args.steps)
+        engine.enable_slot_kv(batch, max_seq_len)
+        slot = run(engine, batch, lo, hi, args.steps)
+        engine.kv = None
+        print(f"{batch:>6} {'padded':>7} {padded[0]:>9.0f} {padded[1]:>8.2f}")
+        print(f"{'':>6} {'slot':>7} {slot[0]:>9.0f} {slot[1]:>8.2f} {slot[0] / padded[0]:>7.2f}x")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,79 @@
+#include "block_allocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace nano {
+
+BlockAllocator::BlockAllocator(int32_t num_blocks, int32_t watermark) {
+    if (num_blocks < 0) throw std::invalid_argument("BlockAllocator: negative block count");
+    ref_.assign(num_blocks, 0);
+    // Top of the stack is block 0, so a fresh allocator hands out 0, 1, 2, ...
+    free_.resize(num_blocks);
+    for (int32_t i = 0; i < num_blocks; ++i) free_[i] = num_blocks - 1 - i;
+    set_watermark(watermark);
+}
+
+void BlockAllocator::check_id(int32_t id) const {
+    if (id < 0 || id >= num_blocks())
+        throw std::out_of_range("BlockAllocator: block " + std::to_string(id) +
+                                " out of range [0, " + std::to_string(num_blocks()) + ")");
+}
+
+void BlockAllocator::allocate(int32_t n, int32_t* out) {
+    if (n < 0) throw std::invalid_argument("BlockAllocator: negative allocation");
+    if (n > num_free())
+        throw std::runtime_error("BlockAllocator: out of blocks: need " + std::to_string(n) +
+                                 ", " + std::to_string(num_free()) + " free");
+    const size_t top = free_.size();
+    for (int32_t i = 0; i < n; ++i) {
+        const int32_t id = free_[top - 1 - i];
+        ref_[id] = 1;
+        out[i] = id;
+    }
+    free_.resize(top - n);
+    peak_used_ = std::max(peak_used_, num_used());
+}
+
+void BlockAllocator::share(const int32_t* ids, int32_t n) {
+    for (int32_t i = 0; i < n; ++i) {
+        check_id(ids[i]);
+        if (ref_[ids[i]] == 0)
+            throw std::logic_error("BlockAllocator: cannot share free block " +
+                                   std::to_string(ids[i]));
+    }
+    for (int32_t i = 0; i < n; ++i) ++ref_[ids[i]];
+}
+
+void BlockAllocator::release(const int32_t* ids, int32_t n) {
+    for (int32_t i = 0; i < n; ++i) check_id(ids[i]);
+    for (int32_t i = 0; i < n; ++i) {
+        const int32_t id = ids[i];
+        if (ref_[id] == 0) {
+            // Released more often than held (a double free): undo this call
+            // in reverse, so the stack pops exactly what it pushed
+            for (int32_t j = i - 1; j >= 0; --j) {
+                if (ref_[ids[j]] == 0) free_.pop_back();
+                ++ref_[ids[j]];
+            }
+            throw std::logic_error("BlockAllocator: block " + std::to_string(id) +
+                                   " is already free");
+        }
+        if (--ref_[id] == 0) free_.push_back(id);
+    }
+}
+
+int32_t BlockAllocator::refcount(int32_t id) const {
+    check_id(id);
+    return ref_[id];
+}
+
+void BlockAllocator::set_watermark(int32_t blocks) {
+    if (blocks < 0 || blocks > num_blocks())
+        throw std::invalid_argument("BlockAllocator: watermark " + std::to_string(blocks) +
+                                    " outside [0, " + std::to_string(num_blocks()) + "]");
+    watermark_ = blocks;
+}
+
+}  // namespace nano
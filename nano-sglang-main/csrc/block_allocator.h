@@ -0,0 +1,54 @@
+#pragma once
+// Physical block allocator for the paged KV cache.
+//
+// Free block ids sit on a LIFO stack, so allocate and free are O(1) per
+// block and the most recently freed (cache-warm) blocks are reused first.
+// Every block carries a reference count: allocate() hands out blocks at
+// count 1, share() adds a holder, release() drops one and returns the
+// block to the stack when the last holder is gone. Bulk calls are
+// all-or-nothing: on error nothing has changed.
+//
+// The watermark is a number of blocks admission keeps in reserve for
+// running sequences to grow into; can_allocate(n) is true while n blocks
+// can be taken without dipping below it. peak_used() is the high-water
+// mark of blocks in use since the last reset_peak().
+
+#include <cstdint>
+#include <vector>
+
+namespace nano {
+
+class BlockAllocator {
+public:
+    explicit BlockAllocator(int32_t num_blocks, int32_t watermark = 0);
+
+    int32_t num_blocks() const { return static_cast<int32_t>(ref_.size()); }
+    int32_t num_free() const { return static_cast<int32_t>(free_.size()); }
+    int32_t num_used() const { return num_blocks() - num_free(); }
+
+    // Takes n free blocks at refcount 1; throws if fewer than n are free
+    void allocate(int32_t n, int32_t* out);
+    // One more holder per listed block (a block may appear more than once)
+    void share(const int32_t* ids, int32_t n);
+    // One holder fewer per listed block; blocks reaching 0 become free
+    void release(const int32_t* ids, int32_t n);
+
+    int32_t refcount(int32_t id) const;
+
+    int32_t watermark() const { return watermark_; }
+    void set_watermark(int32_t blocks);
+    bool can_allocate(int32_t n) const { return n <= num_free() - watermark_; }
+
+    int32_t peak_used() const { return peak_used_; }
+    void reset_peak() { peak_used_ = num_used(); }
+
+private:
+    void check_id(int32_t id) const;
+
+    std::vector<int32_t> free_;   // stack of free ids, top at back()
+    std::vector<int32_t> ref_;    // [num_blocks] holders per block
+    int32_t watermark_ = 0;
+    int32_t peak_used_ = 0;
+};
+
+}  // namespace nano
@@ -0,0 +1,115 @@
+// extern "C" wrappers over the C++ library; exceptions stop here.
+
+#include "nano_native.h"
+#include "block_allocator.h"
+#include "host_pool.h"
+
+#include <cstdint>
+#include <exception>
+#include <string>
+
+static_assert(sizeof(int) == sizeof(int32_t), "block ids cross the C API as int");
+
+struct nano_allocator {
+    nano::BlockAllocator alloc;
+};
+
+struct nano_host_pool {
+    nano::HostPool pool;
+};
+
+namespace {
+
+thread_local std::string g_last_error;
+
+template <class F>
+int guarded(F&& f) {
+    try {
+        f();
+        return 0;
+    } catch (const std::exception& e) {
+        g_last_error = e.what();
+    } catch (...) {
+        g_last_error = "unknown error";
+    }
+    return -1;
+}
+
+}  // namespace
+
+extern "C" {
+
+const char* nano_last_error(void) { return g_last_error.c_str(); }
+
+nano_allocator* nano_allocator_create(int num_blocks, int watermark) {
+    nano_allocator* a = nullptr;
+    guarded([&] { a = new nano_allocator{nano::BlockAllocator(num_blocks, watermark)}; });
+    return a;
+}
+
+void nano_allocator_destroy(nano_allocator* a) { delete a; }
+
+int nano_allocator_allocate(nano_allocator* a, int n, int* out) {
+    return guarded([&] { a->alloc.allocate(n, out); });
+}
+
+int nano_allocator_share(nano_allocator* a, const int* ids, int n) {
+    return guarded([&] { a->alloc.share(ids, n); });
+}
+
+int nano_allocator_release(nano_allocator* a, const int* ids, int n) {
+    return guarded([&] { a->alloc.release(ids, n); });
+}
+
+int nano_allocator_num_blocks(const nano_allocator* a) { return a->alloc.num_blocks(); }
+int nano_allocator_num_free(const nano_allocator* a) { return a->alloc.num_free(); }
+
+int nano_allocator_refcount(const nano_allocator* a, int id) {
+    int n = -1;
+    guarded([&] { n = a->alloc.refcount(id); });
+    return n;
+}
+
+int nano_allocator_set_watermark(nano_allocator* a, int blocks) {
+    return guarded([&] { a->alloc.set_watermark(blocks); });
+}
+
+int nano_allocator_watermark(const nano_allocator* a) { return a->alloc.watermark(); }
+
+int nano_allocator_can_allocate(const nano_allocator* a, int n) {
+    return a->alloc.can_allocate(n) ? 1 : 0;
+}
+
+int nano_allocator_peak_used(const nano_allocator* a) { return a->alloc.peak_used(); }
+void nano_allocator_reset_peak(nano_allocator* a) { a->alloc.reset_peak(); }
+
+nano_host_pool* nano_host_pool_create(int num_pages, long long page_bytes, int num_threads) {
+    nano_host_pool* p = nullptr;
+    guarded([&] { p = new nano_host_pool{nano::HostPool(num_pages, page_bytes, num_threads)}; });
+    return p;
+}
+
+void nano_host_pool_destroy(nano_host_pool* p) { delete p; }
+
+int nano_host_pool_num_pages(const nano_host_pool* p) { return p->pool.num_pages(); }
+int nano_host_pool_num_free(const nano_host_pool* p) { return p->pool.num_free(); }
+
+int nano_host_pool_pages_needed(const nano_host_pool* p, long long bytes) {
+    int n = -1;
+    guarded([&] { n = p->pool.pages_needed(bytes); });
+    return n;
+}
+
+int nano_host_pool_store(nano_host_pool* p, const void* src, long long bytes, int* pages_out) {
+    return guarded([&] { p->pool.store(src, bytes, pages_out); });
+}
+
+int nano_host_pool_load(const nano_host_pool* p, const int* pages, long long bytes, void* dst) {
+    return guarded([&] { p->pool.load(pages, bytes, dst); });
+}
+
+int nano_host_pool_release(nano_host_pool* p, const int* pages, int n) {
+    return guarded([&] { p->pool.release(pages, n); });
+}
+
+}  // extern "C"
@@ -0,0 +1,83 @@
+#include "host_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nano {
+
+namespace {
+
+constexpr int64_t kAlign = 4096;
+// Below this a copy stays on the calling thread: spawning costs more
+constexpr int64_t kParallelBytes = 4 << 20;
+
+}  // namespace
+
+void HostPool::Free::operator()(std::byte* p) const { std::free(p); }
+
+HostPool::HostPool(int32_t num_pages, int64_t page_bytes, int32_t num_threads)
+    : alloc_(num_pages), page_bytes_(page_bytes), num_threads_(std::max(1, num_threads)) {
+    if (page_bytes <= 0) throw std::invalid_argument("HostPool: page_bytes must be positive");
+    const int64_t total = (static_cast<int64_t>(num_pages) * page_bytes + kAlign - 1) / kAlign * kAlign;
+    if (total > 0) {
+        void* p = std::aligned_alloc(kAlign, static_cast<size_t>(total));
+        if (p == nullptr)
+            throw std::runtime_error("HostPool: cannot allocate " + std::to_string(total) +
+                                     " bytes");
+        base_.reset(static_cast<std::byte*>(p));
+    }
+}
+
+int32_t HostPool::pages_needed(int64_t bytes) const {
+    if (bytes < 0) throw std::invalid_argument("HostPool: negative size");
+    return static_cast<int32_t>((bytes + page_bytes_ - 1) / page_bytes_);
+}
+
+template <class F>
+void HostPool::for_pages(const int32_t* pages, int64_t bytes, F&& copy) const {
+    const int32_t n = pages_needed(bytes);
+    auto run = [&](int32_t lo, int32_t hi) {
+        for (int32_t i = lo; i < hi; ++i) {
+            const int64_t off = static_cast<int64_t>(i) * page_bytes_;
+            copy(base_.get() + static_cast<int64_t>(pages[i]) * page_bytes_, off,
+                 std::min(page_bytes_, bytes - off));
+        }
+    };
+    const int32_t threads = bytes < kParallelBytes ? 1 : std::min(num_threads_, n);
+    if (threads <= 1) {
+        run(0, n);
+        return;
+    }
+    std::vector<std::thread> workers;
+    const int32_t per = (n + threads - 1) / threads;
+    for (int32_t lo = per; lo < n; lo += per) workers.emplace_back(run, lo, std::min(n, lo + per));
+    run(0, std::min(n, per));
+    for (auto& w : workers) w.join();
+}
+
+void HostPool::store(const void* src, int64_t bytes, int32_t* pages_out) {
+    const int32_t n = pages_needed(bytes);
+    alloc_.allocate(n, pages_out);
+    const auto* in = static_cast<const std::byte*>(src);
+    for_pages(pages_out, bytes, [in](std::byte* page, int64_t off, int64_t len) {
+        std::memcpy(page, in + off, static_cast<size_t>(len));
+    });
+}
+
+void HostPool::load(const int32_t* pages, int64_t bytes, void* dst) const {
+    const int32_t n = pages_needed(bytes);
+    for (int32_t i = 0; i < n; ++i)
+        if (alloc_.refcount(pages[i]) == 0)
+            throw std::logic_error("HostPool: page " + std::to_string(pages[i]) + " is not held");
+    auto* out = static_cast<std::byte*>(dst);
+    for_pages(pages, bytes, [out](std::byte* page, int64_t off, int64_t len) {
+        std::memcpy(out + off, page, static_cast<size_t>(len));
+    });
+}
+
+}  // namespace nano
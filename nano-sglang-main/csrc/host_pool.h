@@ -0,0 +1,52 @@
+#pragma once
+// Paged host-memory pool for KV swapped out of the GPU.
+//
+// One aligned allocation of num_pages * page_bytes is handed out a page at
+// a time by a BlockAllocator, so swapping a sequence out never allocates
+// and the pool never fragments. store() copies a contiguous buffer (a
+// preempted sequence's KV, staged from the GPU) into freshly taken pages;
+// load() copies pages back into a contiguous buffer; release() returns
+// them. Copies spanning several pages are split over up to num_threads
+// threads, a run of pages each.
+
+#include "block_allocator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace nano {
+
+class HostPool {
+public:
+    HostPool(int32_t num_pages, int64_t page_bytes, int32_t num_threads = 4);
+
+    int32_t num_pages() const { return alloc_.num_blocks(); }
+    int32_t num_free() const { return alloc_.num_free(); }
+    int64_t page_bytes() const { return page_bytes_; }
+    int32_t pages_needed(int64_t bytes) const;
+
+    // Takes pages_needed(bytes) pages into pages_out and fills them from
+    // src; throws (taking nothing) if the pool is short
+    void store(const void* src, int64_t bytes, int32_t* pages_out);
+    // Copies bytes out of the listed pages (in order) into dst
+    void load(const int32_t* pages, int64_t bytes, void* dst) const;
+    void release(const int32_t* pages, int32_t n) { alloc_.release(pages, n); }
+
+private:
+    struct Free {
+        void operator()(std::byte* p) const;
+    };
+
+    // Calls copy(i, page_ptr, offset, len) for each of the n pages a
+    // bytes-long buffer spans, on up to num_threads_ threads
+    template <class F>
+    void for_pages(const int32_t* pages, int64_t bytes, F&& copy) const;
+
+    BlockAllocator alloc_;
+    int64_t page_bytes_;
+    int32_t num_threads_;
+    std::unique_ptr<std::byte[], Free> base_;
+};
+
+}  // namespace nano
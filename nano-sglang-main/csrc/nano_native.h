@@ -0,0 +1,58 @@
+/*
+ * nano_native.h
+ * C API of libnano_native, loaded from Python with ctypes
+ * (nano_sglang/native.py).
+ *
+ * Functions returning int return 0 on success and -1 on error;
+ * nano_last_error() then describes the failure. Block ids are int32.
+ */
+#ifndef NANO_NATIVE_H
+#define NANO_NATIVE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct nano_allocator nano_allocator;
+typedef struct nano_host_pool nano_host_pool;
+
+const char* nano_last_error(void);
+
+/* ---- Block allocator (block_allocator.h) ---- */
+nano_allocator* nano_allocator_create(int num_blocks, int watermark);
+void nano_allocator_destroy(nano_allocator* a);
+
+/* All-or-nothing: fills out[0..n) or fails with nothing taken */
+int nano_allocator_allocate(nano_allocator* a, int n, int* out);
+int nano_allocator_share(nano_allocator* a, const int* ids, int n);
+int nano_allocator_release(nano_allocator* a, const int* ids, int n);
+
+int nano_allocator_num_blocks(const nano_allocator* a);
+int nano_allocator_num_free(const nano_allocator* a);
+int nano_allocator_refcount(const nano_allocator* a, int id);   /* -1 if out of range */
+
+int nano_allocator_set_watermark(nano_allocator* a, int blocks);
+int nano_allocator_watermark(const nano_allocator* a);
+int nano_allocator_can_allocate(const nano_allocator* a, int n);   /* 1 or 0 */
+int nano_allocator_peak_used(const nano_allocator* a);
+void nano_allocator_reset_peak(nano_allocator* a);
+
+/* ---- Host swap pool (host_pool.h) ---- */
+nano_host_pool* nano_host_pool_create(int num_pages, long long page_bytes, int num_threads);
+void nano_host_pool_destroy(nano_host_pool* p);
+
+int nano_host_pool_num_pages(const nano_host_pool* p);
+int nano_host_pool_num_free(const nano_host_pool* p);
+int nano_host_pool_pages_needed(const nano_host_pool* p, long long bytes);
+
+/* store: takes pages_needed(bytes) pages into pages_out and copies src in;
+ * all-or-nothing like nano_allocator_allocate */
+int nano_host_pool_store(nano_host_pool* p, const void* src, long long bytes, int* pages_out);
+int nano_host_pool_load(const nano_host_pool* p, const int* pages, long long bytes, void* dst);
+int nano_host_pool_release(nano_host_pool* p, const int* pages, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NANO_NATIVE_H */
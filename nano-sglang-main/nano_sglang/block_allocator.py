@@ -0,0 +1,191 @@
+"""Physical block allocator for the paged KV cache.
+
+Free block ids live on a stack, so allocating or freeing a block is O(1)
+(the old free list popped from the front of a Python list, which shifts
+every remaining id). Each block has a reference count so several
+sequences can hold the same block: allocate() hands blocks out at
+count 1, share() adds a holder, release() drops one and the block goes
+back on the stack when nobody holds it. Bulk calls are all-or-nothing.
+
+watermark: blocks that admission keeps free for running sequences to
+grow into; can_allocate(n) is False if taking n blocks would dip below it.
+peak_used: high-water mark of blocks in use since reset_peak().
+
+BlockAllocator is the C++ implementation (csrc/block_allocator.h);
+PyBlockAllocator is the same contract in Python, used when the native
+library has not been built.
+"""
+
+import ctypes
+from array import array
+
+from . import native
+
+_SCRATCH_BLOCKS = 256   # allocations up to this size reuse one ctypes buffer
+
+
+class PyBlockAllocator:
+    def __init__(self, num_blocks: int, watermark: int = 0):
+        if num_blocks < 0:
+            raise ValueError("negative block count")
+        self.num_blocks = num_blocks
+        # Top of the stack is block 0, so a fresh allocator hands out 0, 1, 2, ...
+        self._free = list(range(num_blocks - 1, -1, -1))
+        self._ref = [0] * num_blocks
+        self._peak = 0
+        self.set_watermark(watermark)
+
+    @property
+    def num_free(self) -> int:
+        return len(self._free)
+
+    @property
+    def num_used(self) -> int:
+        return self.num_blocks - len(self._free)
+
+    def allocate(self, n: int) -> list[int]:
+        if n < 0:
+            raise ValueError("negative allocation")
+        if n > len(self._free):
+            raise RuntimeError(f"out of blocks: need {n}, {len(self._free)} free")
+        if n == 0:
+            return []
+        ids = self._free[-n:]
+        ids.reverse()
+        del self._free[-n:]
+        for b in ids:
+            self._ref[b] = 1
+        self._peak = max(self._peak, self.num_used)
+        return ids
+
+    def share(self, ids: list[int]):
+        for b in ids:
+            self._check_id(b)
+            if self._ref[b] == 0:
+                raise RuntimeError(f"cannot share free block {b}")
+        for b in ids:
+            self._ref[b] += 1
+
+    def release(self, ids: list[int]):
+        for b in ids:
+            self._check_id(b)
+        for i, b in enumerate(ids):
+            if self._ref[b] == 0:
+                # Double free: undo this call in reverse so the stack pops
+                # exactly what it pushed
+                for c in reversed(ids[:i]):
+                    if self._ref[c] == 0:
+                        self._free.pop()
+                    self._ref[c] += 1
+                raise RuntimeError(f"block {b} is already free")
+            self._ref[b] -= 1
+            if self._ref[b] == 0:
+                self._free.append(b)
+
+    def refcount(self, block_id: int) -> int:
+        if not 0 <= block_id < self.num_blocks:
+            raise IndexError(f"block {block_id} out of range [0, {self.num_blocks})")
+        return self._ref[block_id]
+
+    @property
+    def watermark(self) -> int:
+        return self._watermark
+
+    def set_watermark(self, blocks: int):
+        if not 0 <= blocks <= self.num_blocks:
+            raise ValueError(f"watermark {blocks} outside [0, {self.num_blocks}]")
+        self._watermark = blocks
+
+    def can_allocate(self, n: int) -> bool:
+        return n <= len(self._free) - self._watermark
+
+    @property
+    def peak_used(self) -> int:
+        return self._peak
+
+    def reset_peak(self):
+        self._peak = self.num_used
+
+    def _check_id(self, b: int):
+        if not 0 <= b < self.num_blocks:
+            raise RuntimeError(f"block {b} out of range [0, {self.num_blocks})")
+
+
+class BlockAllocator:
+    def __init__(self, num_blocks: int, watermark: int = 0):
+        lib = native.load()
+        self._lib = lib
+        self._handle = lib.nano_allocator_create(num_blocks, watermark)
+        if not self._handle:
+            raise ValueError(lib.nano_last_error().decode())
+        self.num_blocks = num_blocks
+        self._scratch = (ctypes.c_int * _SCRATCH_BLOCKS)()
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            self._lib.nano_allocator_destroy(self._handle)
+            self._handle = None
+
+    @property
+    def num_free(self) -> int:
+        return self._lib.nano_allocator_num_free(self._handle)
+
+    @property
+    def num_used(self) -> int:
+        return self.num_blocks - self.num_free
+
+    def allocate(self, n: int) -> list[int]:
+        if n < 0:
+            raise ValueError("negative allocation")
+        if n == 0:
+            return []
+        if n <= _SCRATCH_BLOCKS:
+            native.check(self._lib.nano_allocator_allocate(self._handle, n, self._scratch))
+            return self._scratch[:n]
+        out = array("i", bytes(4 * n))
+        native.check(self._lib.nano_allocator_allocate(self._handle, n, out.buffer_info()[0]))
+        return out.tolist()
+
+    def share(self, ids: list[int]):
+        buf = array("i", ids)
+        native.check(self._lib.nano_allocator_share(
+            self._handle, buf.buffer_info()[0], len(buf)))
+
+    def release(self, ids: list[int]):
+        buf = array("i", ids)
+        native.check(self._lib.nano_allocator_release(
+            self._handle, buf.buffer_info()[0], len(buf)))
+
+    def refcount(self, block_id: int) -> int:
+        n = self._lib.nano_allocator_refcount(self._handle, block_id)
+        if n < 0:
+            raise IndexError(self._lib.nano_last_error().decode())
+        return n
+
+    @property
+    def watermark(self) -> int:
+        return self._lib.nano_allocator_watermark(self._handle)
+
+    def set_watermark(self, blocks: int):
+        status = self._lib.nano_allocator_set_watermark(self._handle, blocks)
+        if status != 0:
+            raise ValueError(self._lib.nano_last_error().decode())
+
+    def can_allocate(self, n: int) -> bool:
+        return bool(self._lib.nano_allocator_can_allocate(self._handle, n))
+
+    @property
+    def peak_used(self) -> int:
+        return self._lib.nano_allocator_peak_used(self._handle)
+
+    def reset_peak(self):
+        self._lib.nano_allocator_reset_peak(self._handle)
+
+
+def create_allocator(num_blocks: int, watermark: int = 0, use_native: bool = None):
+    """BlockAllocator if libnano_native is built, else PyBlockAllocator.
+    use_native=True/False forces one (True raises if the library is missing)."""
+    if use_native is None:
+        use_native = native.available()
+    cls = BlockAllocator if use_native else PyBlockAllocator
+    return cls(num_blocks, watermark)
@@ -2,16 +2,22 @@
 
 Fixed-size blocks instead of contiguous allocation.
 Same idea as OS virtual memory pages.
+
+Block ids come from a BlockAllocator (block_allocator.py): an O(1) free
+stack with per-block reference counts, in C++ when libnano_native is built.
 """
 
 import torch
 import math
 
+from .block_allocator import create_allocator
+
 
 class BlockManager:
     def __init__(self, num_blocks: int, block_size: int, num_layers: int,
                  num_heads: int, head_dim: int, device: str = "cuda",
-                 dtype: torch.dtype = torch.float16):
+                 dtype: torch.dtype = torch.float16, watermark: int = 0,
+                 use_native: bool = None):
         self.num_blocks = num_blocks
         self.block_size = block_size
         self.num_layers = num_layers
@@ -30,14 +36,23 @@ class BlockManager:
             for _ in range(num_layers)
         ]
 
-        # Free block pool — block IDs available for allocation
-        self.free_blocks: list[int] = list(range(num_blocks))
+        # Free block ids and refcounts; `watermark` blocks are held back
+        # from admission (can_allocate) so running sequences can grow
+        self.allocator = create_allocator(num_blocks, watermark, use_native)
 
         # Maps seq_id → list of physical block IDs (the block table)
         # e.g. {0: [3, 7, 1], 1: [0, 5]}
         # Logical block 0 → physical block 3, logical block 1 → physical 7, etc.
         self.seq_to_blocks: dict[int, list[int]] = {}
 
+    def blocks_needed(self, num_tokens: int) -> int:
+        # Round up: 34 tokens at block_size=16 → 3 blocks (holds 48 slots)
+        return math.ceil(num_tokens / self.block_size)
+
+    def can_allocate(self, num_tokens: int) -> bool:
+        """True if a new sequence of num_tokens fits above the watermark."""
+        return self.allocator.can_allocate(self.blocks_needed(num_tokens))
+
     def allocate(self, seq_id: int, num_tokens: int) -> list[int]:
         """
         Allocate enough physical blocks to hold num_tokens for a sequence.
@@ -49,8 +64,7 @@ class BlockManager:
         Raises RuntimeError if there are not enough free blocks (OOM).
         Called during prefill when a new sequence is admitted.
         """
-        # How many blocks do we need? Round up to cover all tokens
-        num_blocks_needed = math.ceil(num_tokens / self.block_size)
+        num_blocks_needed = self.blocks_needed(num_tokens)
 
         if num_blocks_needed > self.num_free_blocks:
             raise RuntimeError(
@@ -59,11 +73,8 @@ class BlockManager:
                 f"(block_size={self.block_size})"
             )
 
-        # Pop block IDs from the front of the free list
-        allocated = []
-        for _ in range(num_blocks_needed):
-            block_id = self.free_blocks.pop(0)
-            allocated.append(block_id)
+        # One bulk call: O(1) per block off the free stack, refcount 1 each
+        allocated = self.allocator.allocate(num_blocks_needed)
 
         # Register the block table for this sequence
         self.seq_to_blocks[seq_id] = allocated
@@ -72,25 +83,27 @@ class BlockManager:
 
     def free(self, seq_id: int):
         """
-        Return all blocks owned by a finished sequence back to the free pool.
-        Called when a sequence hits EOS or max_tokens so its GPU memory
-        is immediately available for new sequences.
+        Drop a finished sequence's hold on its blocks. Blocks nobody else
+        holds go straight back to the free pool, so the GPU memory is
+        immediately available for new sequences.
 
         Safe to call on a seq_id that was never allocated (no-op).
         """
         if seq_id not in self.seq_to_blocks:
             return
 
-        # Reclaim every block this sequence was using
-        blocks_to_free = self.seq_to_blocks.pop(seq_id)
-        self.free_blocks.extend(blocks_to_free)
+        self.allocator.release(self.seq_to_blocks.pop(seq_id))
 
     def get_block_ids(self, seq_id: int) -> list[int]:
         return self.seq_to_blocks.get(seq_id, [])
 
     @property
     def num_free_blocks(self) -> int:
-        return len(self.free_blocks)
+        return self.allocator.num_free
+
+    @property
+    def peak_used_blocks(self) -> int:
+        return self.allocator.peak_used
 
     # -----------------------------------------------------------------------
     # Helper methods — used by the engine to read/write KV data into pages
@@ -158,6 +171,42 @@ class BlockManager:
 
         return keys, values
 
+    def gather_blocks(self, layer_idx: int, block_ids: list[int],
+                      num_tokens: int) -> tuple[torch.Tensor, torch.Tensor]:
+        """
+        K/V of the first num_tokens tokens stored in block_ids (in order),
+        one index_select per pool instead of a slice per block.
+
+        Returns:
+            keys:   shape [1, num_heads, num_tokens, head_dim]
+            values: shape [1, num_heads, num_tokens, head_dim]
+        """
+        idx = torch.tensor(block_ids, device=self.k_pool[layer_idx].device)
+
+        def gather(pool):
+            # [n, H, block_size, D] → [H, n * block_size, D]
+            pages = pool.index_select(0, idx).transpose(0, 1)
+            return pages.reshape(pages.shape[0], -1, pages.shape[-1])[:, :num_tokens].unsqueeze(0)
+
+        return gather(self.k_pool[layer_idx]), gather(self.v_pool[layer_idx])
+
+    def scatter_blocks(self, layer_idx: int, block_ids: list[int],
+                       keys: torch.Tensor, values: torch.Tensor):
+        """
+        Write K/V of len(block_ids) * block_size tokens into block_ids.
+        keys/values: [1, num_heads, len(block_ids) * block_size, head_dim]
+        """
+        idx = torch.tensor(block_ids, device=self.k_pool[layer_idx].device)
+        n = len(block_ids)
+
+        def scatter(pool, x):
+            # [H, n * block_size, D] → [n, H, block_size, D]
+            pages = x[0].reshape(x.shape[1], n, self.block_size, x.shape[-1]).transpose(0, 1)
+            pool.index_copy_(0, idx, pages.to(pool.dtype))
+
+        scatter(self.k_pool[layer_idx], keys)
+        scatter(self.v_pool[layer_idx], values)
+
     def append_slot(self, seq_id: int, current_seq_len: int) -> bool:
         """
         Ensure capacity exists for one more token during decode.
@@ -176,8 +225,7 @@ class BlockManager:
                     f"Out of KV cache memory during decode for seq {seq_id}: "
                     f"no free blocks available."
                 )
-            new_block_id = self.free_blocks.pop(0)
-            self.seq_to_blocks[seq_id].append(new_block_id)
+            self.seq_to_blocks[seq_id].extend(self.allocator.allocate(1))
             return True  # new block was appended
 
         return False  # existing last block still has space
\ No newline at end of file
@@ -9,51 +9,366 @@ import torch
 import torch.nn.functional as F
 from transformers.cache_utils import DynamicCache
 from .model import Model, Tokenizer
+from .block_manager import BlockManager
+from .kv_cache import KVCache
+from .radix_cache import RadixCache
 from .sampling import SamplingParams, sample_token
 from .sequence import Sequence, SequenceStatus
 
 
+class SlotCache(DynamicCache):
+    """
+    HuggingFace cache view of KVCache slots [0, num_slots) for one decode
+    step. update() writes the new token's K/V of each decoding slot in
+    place at that slot's length and hands attention the slots' K/V up to
+    the longest length, as views: no per-step copies. Rows of slots not
+    decoding this step are computed but not stored.
+    """
+
+    def __init__(self, kv: KVCache, num_slots: int, rows: torch.Tensor,
+                 positions: torch.Tensor, max_len: int):
+        super().__init__()
+        self.kv = kv
+        self.num_slots = num_slots
+        self.rows = rows            # [n] slots decoding this step
+        self.positions = positions  # [n] where their new token goes
+        self.max_len = max_len      # longest cached length among the slots
+
+    def update(self, key_states, value_states, layer_idx, cache_kwargs=None):
+        keys, values = self.kv.keys[layer_idx], self.kv.values[layer_idx]
+        # key_states: [num_slots, H, 1, D]
+        keys[self.rows, :, self.positions] = key_states[self.rows, :, 0]
+        values[self.rows, :, self.positions] = value_states[self.rows, :, 0]
+        end = self.max_len + 1
+        return keys[:self.num_slots, :, :end], values[:self.num_slots, :, :end]
+
+    def get_seq_length(self, layer_idx: int = 0) -> int:
+        return self.max_len
+
+    def get_mask_sizes(self, cache_position, layer_idx: int = 0):
+        return self.max_len + 1, 0
+
+
+class PackedCache(DynamicCache):
+    """
+    HuggingFace cache for a packed prefill forward: the next chunks of
+    several sequences laid back to back in one [1, T] row. update() stores
+    each sequence's share of the new K/V after its first `starts[i]`
+    tokens (in its KVCache slot, or appended to its own DynamicCache) and
+    hands attention each sequence's K/V up to the end of its chunk,
+    concatenated in the same order. Engine._packed_mask keeps the
+    sequences from attending to each other.
+    """
+
+    def __init__(self, kv: KVCache, seqs: list[Sequence], starts: list[int],
+                 ends: list[int]):
+        super().__init__()
+        self.kv = kv
+        self.seqs = seqs
+        self.starts = starts
+        self.ends = ends
+        self.outputs = []           # without slots: per layer, ([keys], [values]) per sequence
+
+    def update(self, key_states, value_states, layer_idx, cache_kwargs=None):
+        keys, values, pos = [], [], 0
+        for seq, start, end in zip(self.seqs, self.starts, self.ends):
+            k = key_states[:, :, pos:pos + end - start]
+            v = value_states[:, :, pos:pos + end - start]
+            pos += end - start
+            if seq.slot >= 0:
+                self.kv.update(layer_idx, seq.slot, k, v, start)
+                rows = slice(seq.slot, seq.slot + 1)
+                k = self.kv.keys[layer_idx][rows, :, :end]
+                v = self.kv.values[layer_idx][rows, :, :end]
+            elif seq.past_key_values is not None:
+                k = torch.cat([seq.past_key_values.key_cache[layer_idx], k], dim=2)
+                v = torch.cat([seq.past_key_values.value_cache[layer_idx], v], dim=2)
+            keys.append(k)
+            values.append(v)
+        if self.kv is None:
+            self.outputs.append((keys, values))
+        if len(keys) == 1:
+            return keys[0], values[0]
+        return torch.cat(keys, dim=2), torch.cat(values, dim=2)
+
+    def get_seq_length(self, layer_idx: int = 0) -> int:
+        return sum(self.starts)
+
+    def get_mask_sizes(self, cache_position, layer_idx: int = 0):
+        return sum(self.ends), 0
+
+
 class Engine:
     def __init__(self, model_path: str, device: str = "cuda"):
         self.model = Model(model_path, device=device)
         self.tokenizer = Tokenizer(model_path)
         self.device = device
 
+        # Prefix cache, off until enable_prefix_cache()
+        self.block_manager = None
+        self.prefix_cache = None
+
+        # Persistent batched KV store, off until enable_slot_kv()
+        self.kv = None
+        self._swap_staging = None   # pinned host buffer for swap_out/swap_in
+
+    def enable_slot_kv(self, max_batch_size: int, max_seq_len: int) -> KVCache:
+        """
+        Decode out of one preallocated [max_batch_size, H, max_seq_len, D]
+        store per layer. prefill() gives each sequence a slot and writes
+        its prompt KV straight into it; decode steps then append in place,
+        and release() frees the slot. Without it, decode_batch() re-pads and
+        re-concatenates every sequence's DynamicCache every step.
+        """
+        self.kv = KVCache(
+            self.model.num_layers, self.model.num_heads, self.model.head_dim,
+            max_seq_len, max_batch_size, device=self.device, dtype=self.model.dtype,
+        )
+        return self.kv
+
+    def release(self, seq: Sequence):
+        """Free seq's KV slot (no-op without the slot store)."""
+        if seq.slot >= 0:
+            self.kv.free_slot(seq.slot)
+            seq.slot = -1
+
+    @property
+    def kv_bytes_per_token(self) -> int:
+        """K and V of one token across all layers."""
+        m = self.model
+        return 2 * m.num_layers * m.num_heads * m.head_dim * torch.finfo(m.dtype).bits // 8
+
+    def swap_out(self, seq: Sequence, host_pool) -> int:
+        """
+        Preempt seq by copying its slot's KV to host_pool pages
+        (seq.host_pages) and freeing the slot. Returns the bytes moved.
+        """
+        n = self.kv.lengths[seq.slot]
+        staging = self._staging(n)
+        for layer_idx in range(self.model.num_layers):
+            staging[layer_idx, 0].copy_(self.kv.keys[layer_idx][seq.slot, :, :n], non_blocking=True)
+            staging[layer_idx, 1].copy_(self.kv.values[layer_idx][seq.slot, :, :n], non_blocking=True)
+        if self.kv.keys[0].is_cuda:
+            torch.cuda.synchronize()
+        seq.host_pages = host_pool.store(staging.data_ptr(), staging.nbytes)
+        seq.num_swapped_tokens = n
+        self.release(seq)
+        return staging.nbytes
+
+    def swap_in(self, seq: Sequence, host_pool) -> int:
+        """Give a swapped-out seq a slot again and copy its KV back from
+        host_pool, releasing the pages. Returns the bytes moved."""
+        n = seq.num_swapped_tokens
+        staging = self._staging(n)
+        host_pool.load(seq.host_pages, staging.data_ptr(), staging.nbytes)
+        host_pool.release(seq.host_pages)
+        seq.host_pages = []
+        seq.slot = self.kv.allocate_slot()
+        for layer_idx in range(self.model.num_layers):
+            self.kv.keys[layer_idx][seq.slot, :, :n].copy_(staging[layer_idx, 0], non_blocking=True)
+            self.kv.values[layer_idx][seq.slot, :, :n].copy_(staging[layer_idx, 1], non_blocking=True)
+        if self.kv.keys[0].is_cuda:
+            torch.cuda.synchronize()    # staging is reused by the next swap
+        self.kv.lengths[seq.slot] = n
+        return staging.nbytes
+
+    def _staging(self, num_tokens: int) -> torch.Tensor:
+        """[num_layers, 2, H, num_tokens, D] view of one pinned buffer,
+        allocated once at max_seq_len so swaps never allocate."""
+        m = self.model
+        shape = (m.num_layers, 2, m.num_heads, num_tokens, m.head_dim)
+        if self._swap_staging is None:
+            full = m.num_layers * 2 * m.num_heads * self.kv.max_seq_len * m.head_dim
+            self._swap_staging = torch.empty(full, dtype=m.dtype,
+                                             pin_memory=self.kv.keys[0].is_cuda)
+        return self._swap_staging[:torch.Size(shape).numel()].view(shape)
+
+    def enable_prefix_cache(self, num_blocks: int, block_size: int = 16) -> RadixCache:
+        """
+        Keep the KV of prompt prefixes in num_blocks paged blocks so later
+        prompts that start the same way prefill only their suffix. The
+        caller matches and locks a prefix into seq.cached_blocks before
+        prefill() (the scheduler does this at admission).
+        """
+        self.block_manager = BlockManager(
+            num_blocks, block_size, self.model.num_layers, self.model.num_heads,
+            self.model.head_dim, device=self.device, dtype=self.model.dtype,
+        )
+        self.prefix_cache = RadixCache(self.block_manager.allocator, block_size)
+        return self.prefix_cache
+
     def prefill(self, seq: Sequence, sampling_params: SamplingParams) -> int:
         """
         Process all prompt tokens in one forward pass, return first generated token.
-        Stores past_key_values in seq and sets status to DECODING.
+        Stores the KV (seq.past_key_values, or seq's slot) and sets status to DECODING.
+        """
+        return self.prefill_chunk(seq, sampling_params, len(seq.prefill_token_ids))
 
-        - Tokenizes the prompt
-        - Runs a single forward pass over ALL prompt tokens at once (compute-bound)
-        - Stores the resulting KV cache in seq.past_key_values
-        - Samples the first output token from the final logit position
-        - Sets seq.status = DECODING so the scheduler knows to move it to running
+    def prefill_chunk(self, seq: Sequence, sampling_params: SamplingParams,
+                      max_tokens: int):
+        """
+        Prefill the next (at most max_tokens) prompt tokens of seq.
+        Returns the first generated token once the whole prompt is done,
+        None while chunks remain.
         """
-        # Tokenize the prompt → [1, prompt_len]
-        input_ids = self.tokenizer.encode(seq.prompt)
-        input_ids = torch.tensor([input_ids], device=self.device)
+        return self.prefill_batch([seq], sampling_params, [max_tokens])[0]
 
-        # Single forward pass over the full prompt, no prior cache
-        logits, past_key_values = self.model.forward(
+    def prefill_batch(self, seqs: list[Sequence], sampling_params: SamplingParams,
+                      max_tokens: list[int]) -> list:
+        """
+        Prefill the next chunk (at most max_tokens[i] prompt tokens) of
+        every sequence in seqs in ONE forward pass. Returns, per sequence,
+        the first generated token once its whole prompt is done, None
+        while chunks remain.
+
+        - The chunks are packed back to back into a single row (no
+          padding), with per-sequence position ids and a block-diagonal
+          causal mask, so small prompts share one compute-bound forward
+        - The first chunk starts after the cached prefix: with the prefix
+          cache, the first seq.num_cached_tokens tokens come from
+          seq.cached_blocks and are never computed
+        - Each chunk attends to everything before it in its own sequence;
+          the KV accumulates in the sequence's slot of the persistent
+          store, or in seq.past_key_values
+        - After a sequence's last chunk: adds its prompt's full blocks to
+          the prefix cache, samples its first output token from its final
+          logit position and sets seq.status = DECODING
+        """
+        for seq in seqs:
+            if seq.status == SequenceStatus.WAITING:
+                self._begin_prefill(seq)
+
+        tokens = [seq.prefill_token_ids for seq in seqs]
+        starts = [seq.num_prefilled for seq in seqs]
+        ends = [min(len(toks), start + max(1, n))
+                for toks, start, n in zip(tokens, starts, max_tokens)]
+        input_ids = torch.tensor(
+            [[t for toks, s, e in zip(tokens, starts, ends) for t in toks[s:e]]],
+            device=self.device,
+        )
+        position_ids = torch.tensor(
+            [[p for s, e in zip(starts, ends) for p in range(s, e)]], device=self.device,
+        )
+
+        # One sequence: the model's own causal mask over [past | chunk] is right
+        cache = PackedCache(self.kv, seqs, starts, ends)
+        logits, _ = self.model.forward(
             input_ids,
-            past_key_values=None,
+            past_key_values=cache,
+            position_ids=position_ids,
+            attention_mask=self._packed_mask(starts, ends) if len(seqs) > 1 else None,
         )
 
-        # Sample the first output token from the LAST logit position
-        # logits shape: [1, prompt_len, vocab_size] → take [:, -1, :]
-        next_token = sample_token(logits[:, -1, :], sampling_params).item()
+        # Split the KV back per sequence; find the finished prompts' last rows
+        done, last_rows, pos = [], [], 0
+        for i, (seq, start, end) in enumerate(zip(seqs, starts, ends)):
+            pos += end - start
+            if seq.slot >= 0:
+                self.kv.lengths[seq.slot] = end
+            else:
+                seq.past_key_values = DynamicCache()
+                for layer_idx, (keys, values) in enumerate(cache.outputs):
+                    seq.past_key_values.update(keys[i], values[i], layer_idx)
+            seq.num_prefilled = end
+            if end == len(tokens[i]):
+                done.append(i)
+                last_rows.append(pos - 1)
 
-        # Store KV cache on the sequence object so decode_step can use it
-        seq.past_key_values = past_key_values
+        results = [None] * len(seqs)
+        if not done:
+            return results
 
-        # Transition sequence state: WAITING → DECODING
-        seq.status = SequenceStatus.DECODING
+        # Sample each finished prompt's first output token from ITS last logit
+        # logits shape: [1, total_chunk_tokens, vocab_size] → rows last_rows
+        sampled = sample_token(logits[0, last_rows, :], sampling_params).tolist()
+        for i, token in zip(done, sampled):
+            seq = seqs[i]
+            if self.prefix_cache is not None:
+                self._store_prefix(seq.prefill_token_ids, seq.cached_blocks,
+                                   self._prompt_kv(seq))
+            # Transition sequence state: PREFILLING → DECODING
+            seq.status = SequenceStatus.DECODING
+            results[i] = token
+        return results
 
-        return next_token
+    def _packed_mask(self, starts: list[int], ends: list[int]) -> torch.Tensor:
+        """
+        Additive [1, 1, T, K] mask for a packed forward: T chunk tokens
+        against K = sum(ends) keys, laid out per sequence as PackedCache
+        returns them. A token sees its own sequence's keys up to its
+        position, nothing of the other sequences.
+        """
+        dev = self.device
+        new = torch.tensor([e - s for s, e in zip(starts, ends)], device=dev)
+        total = torch.tensor(ends, device=dev)
+        ids = torch.arange(len(ends), device=dev)
+        q_seq = ids.repeat_interleave(new)
+        q_pos = torch.cat([torch.arange(s, e, device=dev) for s, e in zip(starts, ends)])
+        k_seq = ids.repeat_interleave(total)
+        k_pos = torch.cat([torch.arange(e, device=dev) for e in ends])
+        visible = (q_seq[:, None] == k_seq[None, :]) & (k_pos[None, :] <= q_pos[:, None])
+        mask = torch.zeros(visible.shape, device=dev, dtype=self.model.dtype)
+        mask.masked_fill_(~visible, torch.finfo(self.model.dtype).min)
+        return mask[None, None]
+
+    def _begin_prefill(self, seq: Sequence):
+        """Claim seq's slot and load its cached prefix, if any."""
+        cached = seq.num_cached_tokens
+        if self.kv is not None:
+            if len(seq.prefill_token_ids) >= self.kv.max_seq_len:
+                raise RuntimeError(f"prompt of {len(seq.prefill_token_ids)} tokens does "
+                                   f"not fit max_seq_len={self.kv.max_seq_len}")
+            seq.slot = self.kv.allocate_slot()
+            if cached:
+                for layer_idx in range(self.model.num_layers):
+                    k, v = self.block_manager.gather_blocks(layer_idx, seq.cached_blocks, cached)
+                    self.kv.update(layer_idx, seq.slot, k, v, start_pos=0)
+            self.kv.lengths[seq.slot] = cached
+        elif cached:
+            seq.past_key_values = self._load_prefix(seq.cached_blocks, cached)
+        seq.num_prefilled = cached
+        seq.status = SequenceStatus.PREFILLING
+
+    def _prompt_kv(self, seq: Sequence):
+        """layer_idx → (keys, values) [1, H, >= prompt_len, D] of seq's prompt."""
+        if seq.slot >= 0:
+            n = len(seq.prefill_token_ids)
+            return lambda l: (self.kv.keys[l][seq.slot:seq.slot + 1, :, :n],
+                              self.kv.values[l][seq.slot:seq.slot + 1, :, :n])
+        past = seq.past_key_values
+        return lambda l: (past.key_cache[l], past.value_cache[l])
+
+    def _load_prefix(self, block_ids: list[int], num_tokens: int) -> DynamicCache:
+        """DynamicCache holding the KV of a cached prefix."""
+        cache = DynamicCache()
+        for layer_idx in range(self.model.num_layers):
+            k, v = self.block_manager.gather_blocks(layer_idx, block_ids, num_tokens)
+            cache.update(k, v, layer_idx)
+        return cache
+
+    def _store_prefix(self, token_ids: list[int], cached_blocks: list[int], layer_kv):
+        """Copy the prompt's full blocks past the cached prefix into fresh
+        pages and add them to the prefix cache."""
+        bs = self.block_manager.block_size
+        num_full = len(token_ids) // bs
+        first = len(cached_blocks)
+        if num_full <= first:
+            return
+        try:
+            new_blocks = self.prefix_cache.allocate(num_full - first)
+        except RuntimeError:
+            return  # pool pinned by running requests' prefixes: skip caching
+        for layer_idx in range(self.model.num_layers):
+            k, v = layer_kv(layer_idx)
+            self.block_manager.scatter_blocks(layer_idx, new_blocks,
+                                              k[:, :, first * bs:num_full * bs],
+                                              v[:, :, first * bs:num_full * bs])
+        self.prefix_cache.insert(token_ids, cached_blocks + new_blocks)
 
     def decode_step(self, seq: Sequence, sampling_params: SamplingParams) -> int:
         """Generate one token for a single sequence using cached KV."""
+        if seq.slot >= 0:
+            return self._decode_slots([seq], sampling_params)[0]
         last_token = seq.output_token_ids[-1]
         input_ids = torch.tensor([[last_token]], device=self.device)
         logits, past_key_values = self.model.forward(
@@ -68,6 +383,8 @@ class Engine:
         """Generate one token for multiple sequences in a single GPU forward pass."""
         if not sequences:
             return []
+        if self.kv is not None:
+            return self._decode_slots(sequences, sampling_params)
         if len(sequences) == 1:
             return [self.decode_step(sequences[0], sampling_params)]
 
@@ -123,6 +440,48 @@ class Engine:
 
         return [t.item() for t in tokens]
 
+    def _decode_slots(self, sequences: list[Sequence],
+                      sampling_params: SamplingParams) -> list[int]:
+        """
+        One decode step over the persistent store. The forward covers
+        slots [0, highest used slot]; each sequence's cache is the left
+        part of its slot (right padding), so positions and the mask come
+        straight from the slot lengths and nothing is padded or copied.
+        """
+        kv = self.kv
+        slots = [seq.slot for seq in sequences]
+        for seq in sequences:
+            if kv.lengths[seq.slot] >= kv.max_seq_len:
+                raise RuntimeError(f"seq {seq.seq_id} reached max_seq_len={kv.max_seq_len}")
+        num_slots = max(slots) + 1
+
+        # Slots not decoding this step (free, or still in prefill) get a
+        # dummy token; their rows are discarded
+        tokens_in = [0] * num_slots
+        for seq in sequences:
+            tokens_in[seq.slot] = seq.output_token_ids[-1]
+        input_ids = torch.tensor(tokens_in, device=self.device).unsqueeze(1)
+
+        lengths = torch.tensor(kv.lengths[:num_slots], device=self.device)
+        max_len = int(max(kv.lengths[:num_slots]))
+        # Key j is visible to slot i if j <= lengths[i] (the new token sits at lengths[i])
+        attn_mask = (torch.arange(max_len + 1, device=self.device)[None, :]
+                     <= lengths[:, None]).long()
+        rows = torch.tensor(slots, device=self.device)
+
+        cache = SlotCache(kv, num_slots, rows, lengths[rows], max_len)
+        logits, _ = self.model.forward(
+            input_ids,
+            past_key_values=cache,
+            position_ids=lengths.unsqueeze(1),
+            attention_mask=attn_mask,
+        )
+        tokens = sample_token(logits[rows, -1, :], sampling_params)
+
+        for s in slots:
+            kv.lengths[s] += 1
+        return tokens.tolist()
+
     def generate(self, prompt: str,
                  sampling_params: SamplingParams = None) -> str:
         """
@@ -0,0 +1,119 @@
+"""Host-memory pool for KV swapped out of the GPU (preemption, swap mode).
+
+The pool is one preallocated host buffer cut into fixed-size pages, so
+swapping a sequence out never allocates and the pool never fragments.
+store(ptr, nbytes) copies a contiguous host buffer (a sequence's KV,
+staged from the GPU) into free pages and returns their ids; load(pages,
+ptr, nbytes) copies them back; release(pages) frees them. Buffers are
+passed as addresses (tensor.data_ptr()) so no copy is made on the way in.
+
+HostPool is the C++ copy engine (csrc/host_pool.h), which splits large
+copies over several threads; PyHostPool is the same contract in Python
+(one ctypes.memmove per page), used when the native library has not been
+built. Both raise RuntimeError when the pool is short. Both reserve the
+buffer without touching it, so host RAM is only committed as pages are
+first written.
+"""
+
+import ctypes
+import mmap
+from array import array
+
+from . import native
+from .block_allocator import PyBlockAllocator
+
+
+class PyHostPool:
+    def __init__(self, num_pages: int, page_bytes: int, num_threads: int = 4):
+        if page_bytes <= 0:
+            raise ValueError("page_bytes must be positive")
+        self.num_pages = num_pages
+        self.page_bytes = page_bytes
+        self._pages = PyBlockAllocator(num_pages)
+        # Anonymous mapping: a ctypes array would zero (and commit) it all
+        self._buf = mmap.mmap(-1, max(1, num_pages * page_bytes))
+        self._base = ctypes.addressof(ctypes.c_char.from_buffer(self._buf))
+
+    @property
+    def num_free(self) -> int:
+        return self._pages.num_free
+
+    def pages_needed(self, nbytes: int) -> int:
+        if nbytes < 0:
+            raise ValueError("negative size")
+        return -(-nbytes // self.page_bytes)
+
+    def store(self, ptr: int, nbytes: int) -> list[int]:
+        pages = self._pages.allocate(self.pages_needed(nbytes))
+        for i, page in enumerate(pages):
+            off = i * self.page_bytes
+            ctypes.memmove(self._base + page * self.page_bytes, ptr + off,
+                           min(self.page_bytes, nbytes - off))
+        return pages
+
+    def load(self, pages: list[int], ptr: int, nbytes: int):
+        pages = pages[:self.pages_needed(nbytes)]
+        for page in pages:
+            if self._pages.refcount(page) == 0:
+                raise RuntimeError(f"page {page} is not held")
+        for i, page in enumerate(pages):
+            off = i * self.page_bytes
+            ctypes.memmove(ptr + off, self._base + page * self.page_bytes,
+                           min(self.page_bytes, nbytes - off))
+
+    def release(self, pages: list[int]):
+        self._pages.release(pages)
+
+
+class HostPool:
+    def __init__(self, num_pages: int, page_bytes: int, num_threads: int = 4):
+        lib = native.load()
+        self._lib = lib
+        self._handle = lib.nano_host_pool_create(num_pages, page_bytes, num_threads)
+        if not self._handle:
+            raise ValueError(lib.nano_last_error().decode())
+        self.num_pages = num_pages
+        self.page_bytes = page_bytes
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            self._lib.nano_host_pool_destroy(self._handle)
+            self._handle = None
+
+    @property
+    def num_free(self) -> int:
+        return self._lib.nano_host_pool_num_free(self._handle)
+
+    def pages_needed(self, nbytes: int) -> int:
+        n = self._lib.nano_host_pool_pages_needed(self._handle, nbytes)
+        if n < 0:
+            raise ValueError(self._lib.nano_last_error().decode())
+        return n
+
+    def store(self, ptr: int, nbytes: int) -> list[int]:
+        out = array("i", bytes(4 * self.pages_needed(nbytes)))
+        native.check(self._lib.nano_host_pool_store(
+            self._handle, ptr, nbytes, out.buffer_info()[0]))
+        return out.tolist()
+
+    def load(self, pages: list[int], ptr: int, nbytes: int):
+        buf = array("i", pages)
+        if len(buf) < self.pages_needed(nbytes):
+            raise RuntimeError(f"{nbytes} bytes span more than {len(buf)} pages")
+        native.check(self._lib.nano_host_pool_load(
+            self._handle, buf.buffer_info()[0], nbytes, ptr))
+
+    def release(self, pages: list[int]):
+        buf = array("i", pages)
+        native.check(self._lib.nano_host_pool_release(
+            self._handle, buf.buffer_info()[0], len(buf)))
+
+
+def create_host_pool(num_pages: int, page_bytes: int, num_threads: int = 4,
+                     use_native: bool = None):
+    """HostPool if libnano_native is built, else PyHostPool.
+    use_native=True/False forces one (True raises if the library is missing)."""
+    if use_native is None:
+        use_native = native.available()
+    cls = HostPool if use_native else PyHostPool
+    return cls(num_pages, page_bytes, num_threads)
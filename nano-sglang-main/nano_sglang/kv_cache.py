@@ -2,8 +2,15 @@
 
 Stores key/value tensors from previous forward passes so we don't
 recompute them. Turns O(n^2) decode into O(n).
+
+The engine also uses it as the persistent store for batched decode: each
+running sequence owns a batch slot (allocate_slot / free_slot) and
+lengths[slot] tokens of KV in it, so joining or leaving the batch only
+changes the slot bookkeeping, never the tensors.
 """
 
+import heapq
+
 import torch
 
 
@@ -27,6 +34,27 @@ class KVCache:
             for _ in range(num_layers)
         ]
 
+        # Slot bookkeeping: free slots (lowest first, so the used slots
+        # stay packed at the front) and tokens cached per slot
+        self._free_slots = list(range(max_batch_size))
+        self.lengths = [0] * max_batch_size
+
+    def allocate_slot(self) -> int:
+        if not self._free_slots:
+            raise RuntimeError(f"all {self.max_batch_size} KV cache slots are in use")
+        slot = heapq.heappop(self._free_slots)
+        self.lengths[slot] = 0
+        return slot
+
+    def free_slot(self, slot: int):
+        """Return a slot; its stale K/V is overwritten by the next owner."""
+        self.lengths[slot] = 0
+        heapq.heappush(self._free_slots, slot)
+
+    @property
+    def num_free_slots(self) -> int:
+        return len(self._free_slots)
+
     def update(self, layer_idx: int, batch_idx: int,
                key: torch.Tensor, value: torch.Tensor, start_pos: int):
         """
@@ -12,7 +12,9 @@ class Model:
         self.config = AutoConfig.from_pretrained(model_path)
         self.num_layers = self.config.num_hidden_layers
         self.num_heads = self.config.num_key_value_heads
-        self.head_dim = self.config.hidden_size // self.config.num_attention_heads
+        # Qwen3 sets head_dim explicitly (128, not hidden_size / heads = 64)
+        self.head_dim = (getattr(self.config, "head_dim", None)
+                         or self.config.hidden_size // self.config.num_attention_heads)
         self.vocab_size = self.config.vocab_size
 
         self.model = AutoModelForCausalLM.from_pretrained(
@@ -0,0 +1,73 @@
+"""
+ctypes bindings for libnano_native (csrc/), the C++ side of nano-sglang.
+
+Build once:
+    cmake -S csrc -B csrc/build && cmake --build csrc/build
+
+The library is looked up at $NANO_NATIVE_LIB, then csrc/build/. Callers
+fall back to pure-Python code when it is missing (see available()).
+"""
+import ctypes
+import os
+
+_HERE = os.path.dirname(os.path.abspath(__file__))
+_DEFAULT_LIB = os.path.join(_HERE, "..", "csrc", "build", "libnano_native.so")
+
+_lib = None
+
+
+def load():
+    global _lib
+    if _lib is not None:
+        return _lib
+    path = os.environ.get("NANO_NATIVE_LIB", os.path.normpath(_DEFAULT_LIB))
+    if not os.path.exists(path):
+        raise OSError(f"{path} not found; build it with "
+                      f"'cmake -S csrc -B csrc/build && cmake --build csrc/build'")
+    lib = ctypes.CDLL(path)
+    _declare(lib)
+    _lib = lib
+    return lib
+
+
+def available():
+    try:
+        load()
+        return True
+    except OSError:
+        return False
+
+
+_p = ctypes.c_void_p
+_i = ctypes.c_int
+_ll = ctypes.c_longlong
+
+
+def _declare(lib):
+    lib.nano_last_error.restype = ctypes.c_char_p
+    lib.nano_allocator_create.restype = _p
+    lib.nano_allocator_create.argtypes = [_i, _i]
+    lib.nano_allocator_destroy.argtypes = [_p]
+    lib.nano_allocator_allocate.argtypes = [_p, _i, _p]
+    lib.nano_allocator_share.argtypes = [_p, _p, _i]
+    lib.nano_allocator_release.argtypes = [_p, _p, _i]
+    for name in ("num_blocks", "num_free", "watermark", "peak_used", "reset_peak"):
+        getattr(lib, "nano_allocator_" + name).argtypes = [_p]
+    lib.nano_allocator_reset_peak.restype = None
+    for name in ("refcount", "set_watermark", "can_allocate"):
+        getattr(lib, "nano_allocator_" + name).argtypes = [_p, _i]
+
+    lib.nano_host_pool_create.restype = _p
+    lib.nano_host_pool_create.argtypes = [_i, _ll, _i]
+    lib.nano_host_pool_destroy.argtypes = [_p]
+    lib.nano_host_pool_num_pages.argtypes = [_p]
+    lib.nano_host_pool_num_free.argtypes = [_p]
+    lib.nano_host_pool_pages_needed.argtypes = [_p, _ll]
+    lib.nano_host_pool_store.argtypes = [_p, _p, _ll, _p]
+    lib.nano_host_pool_load.argtypes = [_p, _p, _ll, _p]
+    lib.nano_host_pool_release.argtypes = [_p, _p, _i]
+
+
+def check(status):
+    if status != 0:
+        raise RuntimeError(_lib.nano_last_error().decode())
@@ -0,0 +1,43 @@
+"""Scheduling policies: the order in which waiting requests are admitted.
+
+A policy gives each waiting sequence a sort key at time `now` (smallest
+first). Every step the scheduler sorts the waiting queue by it and admits
+from the front until a request does not fit the batch or the KV budget;
+sequences preempted for recompute always go first.
+
+  fcfs      arrival order
+  spf       shortest prompt first: lowest mean time to first token, but
+            long prompts wait as long as shorter ones keep arriving
+  priority  highest Sequence.priority first; every second of waiting adds
+            aging_rate to it, so low-priority requests are not starved
+"""
+
+
+class FCFS:
+    def key(self, seq, now: float):
+        return (seq.arrival_time, seq.seq_id)
+
+
+class ShortestPromptFirst:
+    def key(self, seq, now: float):
+        return (len(seq.prompt_token_ids), seq.arrival_time, seq.seq_id)
+
+
+class PriorityAging:
+    def __init__(self, aging_rate: float = 0.1):
+        self.aging_rate = aging_rate
+
+    def effective_priority(self, seq, now: float) -> float:
+        return seq.priority + self.aging_rate * max(0.0, now - seq.arrival_time)
+
+    def key(self, seq, now: float):
+        return (-self.effective_priority(seq, now), seq.arrival_time, seq.seq_id)
+
+
+POLICIES = {"fcfs": FCFS, "spf": ShortestPromptFirst, "priority": PriorityAging}
+
+
+def make_policy(name: str, **kwargs):
+    if name not in POLICIES:
+        raise ValueError(f"unknown policy {name!r}; choose from {sorted(POLICIES)}")
+    return POLICIES[name](**kwargs)
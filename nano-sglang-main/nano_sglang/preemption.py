@@ -0,0 +1,50 @@
+"""Preemption: what to do with a running sequence when KV memory runs out.
+
+  swap       copy its KV to the host pool (host_pool.py) and copy it back
+             when memory frees up: two transfers of its KV, no compute
+  recompute  drop its KV and prefill prompt + output again on readmission:
+             one prefill over all its tokens, no host memory
+
+Both cost roughly linearly in the sequence's tokens, but swap also pays a
+fixed latency per transfer (synchronising, staging), so short sequences
+are cheaper to recompute and long ones to swap. CostModel compares the
+two with throughputs it measures as the scheduler runs, starting from
+defaults for a small model on one GPU.
+"""
+
+
+class CostModel:
+    def __init__(self, kv_bytes_per_token: int, swap_bytes_per_sec: float = 8e9,
+                 swap_latency_sec: float = 1e-3, prefill_tokens_per_sec: float = 20e3,
+                 smoothing: float = 0.2):
+        self.kv_bytes_per_token = kv_bytes_per_token
+        self.swap_bytes_per_sec = swap_bytes_per_sec
+        self.swap_latency_sec = swap_latency_sec
+        self.prefill_tokens_per_sec = prefill_tokens_per_sec
+        self.smoothing = smoothing      # weight of each new measurement
+
+    def swap_cost(self, num_tokens: int) -> float:
+        """Seconds to swap num_tokens of KV out and back in."""
+        nbytes = num_tokens * self.kv_bytes_per_token
+        return 2 * (self.swap_latency_sec + nbytes / self.swap_bytes_per_sec)
+
+    def recompute_cost(self, num_tokens: int) -> float:
+        """Seconds to prefill num_tokens again."""
+        return num_tokens / self.prefill_tokens_per_sec
+
+    def choose(self, num_tokens: int) -> str:
+        """"swap" or "recompute", whichever is cheaper for num_tokens of KV."""
+        if self.swap_cost(num_tokens) < self.recompute_cost(num_tokens):
+            return "swap"
+        return "recompute"
+
+    def observe_swap(self, nbytes: int, seconds: float):
+        """One measured transfer (either direction); latency stays fixed."""
+        if nbytes > 0 and seconds > self.swap_latency_sec:
+            rate = nbytes / (seconds - self.swap_latency_sec)
+            self.swap_bytes_per_sec += self.smoothing * (rate - self.swap_bytes_per_sec)
+
+    def observe_prefill(self, num_tokens: int, seconds: float):
+        if num_tokens > 0 and seconds > 0:
+            rate = num_tokens / seconds
+            self.prefill_tokens_per_sec += self.smoothing * (rate - self.prefill_tokens_per_sec)
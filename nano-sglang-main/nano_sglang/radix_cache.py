@@ -0,0 +1,194 @@
+"""Radix-tree prefix cache (RadixAttention).
+
+Maps token-id prefixes to paged KV blocks so that requests sharing a
+prefix (a system prompt, few-shot examples, earlier chat turns) only
+prefill the part after it.
+
+The tree works in whole blocks: every edge is a run of block_size-token
+blocks and carries the ids of the blocks holding their KV, so a prefix of
+k blocks is exactly k block ids. A partially filled last block is never
+cached (it is recomputed, at most block_size - 1 tokens). Edges split at
+block boundaries when a new prompt diverges inside one.
+
+Ownership: the tree holds one allocator reference per cached block. A
+request that matched a prefix lock()s its node until it finishes; the
+lock counts up the path to the root, and locked nodes are never evicted.
+When the allocator runs short, allocate() evicts least recently used
+unlocked leaves (a parent becomes a candidate once its last child is
+gone) and releases their blocks.
+"""
+
+import heapq
+
+
+class RadixNode:
+    __slots__ = ("key", "blocks", "children", "parent", "lock_ref", "last_access")
+
+    def __init__(self, key=(), blocks=None, parent=None):
+        self.key = key                  # tokens of this edge, len = len(blocks) * block_size
+        self.blocks = blocks or []      # KV block ids, one per block_size tokens
+        self.children = {}              # first block's tokens -> child
+        self.parent = parent
+        self.lock_ref = 0
+        self.last_access = 0
+
+
+class RadixCache:
+    def __init__(self, allocator, block_size: int):
+        self.allocator = allocator
+        self.block_size = block_size
+        self.root = RadixNode()
+        self.root.lock_ref = 1          # never evicted
+        self._clock = 0
+
+        # Totals since construction (or reset_stats)
+        self.queried_tokens = 0         # prompt tokens looked up
+        self.hit_tokens = 0             # of those, served from the cache
+        self.evicted_blocks = 0
+
+        self.num_cached_blocks = 0
+
+    # ---------------------------------------------------------------- lookup
+    def match_prefix(self, token_ids, max_tokens: int = None):
+        """
+        Longest cached prefix of token_ids, in whole blocks and at most
+        max_tokens long. Returns (block_ids, node): the KV blocks of the
+        prefix in order and the node it ends at, for lock()/unlock().
+        """
+        tokens = tuple(token_ids)
+        limit = len(tokens) if max_tokens is None else min(max_tokens, len(tokens))
+        bs = self.block_size
+        self._clock += 1
+        node, blocks, pos = self.root, [], 0
+        while pos + bs <= limit:
+            child = node.children.get(tokens[pos:pos + bs])
+            if child is None:
+                break
+            k = self._common_blocks(child, tokens, pos, limit)
+            if k < len(child.blocks):
+                child = self._split(child, k)
+            child.last_access = self._clock
+            blocks.extend(child.blocks)
+            pos += k * bs
+            node = child
+        self.queried_tokens += len(tokens)
+        self.hit_tokens += pos
+        return blocks, node
+
+    def insert(self, token_ids, block_ids) -> int:
+        """
+        Cache the KV of the first len(block_ids) blocks of token_ids. The
+        tree takes over the caller's reference on every block; blocks whose
+        tokens were already cached under another id are released. Returns
+        how many leading blocks were already cached.
+        """
+        bs = self.block_size
+        n = len(block_ids)
+        tokens = tuple(token_ids[:n * bs])
+        if len(tokens) < n * bs:
+            raise ValueError(f"{n} blocks need {n * bs} tokens, got {len(tokens)}")
+        self._clock += 1
+        node, pos, i = self.root, 0, 0
+        duplicates = []
+        already = 0
+        while i < n:
+            child = node.children.get(tokens[pos:pos + bs])
+            if child is None:
+                leaf = RadixNode(tokens[pos:], list(block_ids[i:]), node)
+                leaf.last_access = self._clock
+                node.children[tokens[pos:pos + bs]] = leaf
+                self.num_cached_blocks += n - i
+                break
+            k = self._common_blocks(child, tokens, pos, len(tokens))
+            if k < len(child.blocks):
+                child = self._split(child, k)
+            child.last_access = self._clock
+            duplicates.extend(b for b, c in zip(block_ids[i:i + k], child.blocks) if b != c)
+            already += k
+            pos += k * bs
+            i += k
+            node = child
+        if duplicates:
+            self.allocator.release(duplicates)
+        return already
+
+    # --------------------------------------------------------------- locking
+    def lock(self, node: RadixNode):
+        while node is not None:
+            node.lock_ref += 1
+            node = node.parent
+
+    def unlock(self, node: RadixNode):
+        while node is not None:
+            node.lock_ref -= 1
+            node = node.parent
+
+    # ---------------------------------------------------- memory / eviction
+    def allocate(self, n: int) -> list[int]:
+        """n blocks from the allocator, evicting cached prefixes if needed.
+        Raises RuntimeError if locked prefixes keep too many blocks."""
+        short = n - self.allocator.num_free
+        if short > 0:
+            self.evict(short)
+        return self.allocator.allocate(n)
+
+    def evict(self, num_blocks: int) -> int:
+        """Release at least num_blocks cached blocks, least recently used
+        leaves first; returns how many were released (fewer if the rest is
+        locked). Blocks still held by someone else stay allocated."""
+        heap = [(n.last_access, id(n), n) for n in self._leaves() if n.lock_ref == 0]
+        heapq.heapify(heap)
+        freed = 0
+        while freed < num_blocks and heap:
+            _, _, node = heapq.heappop(heap)
+            self.allocator.release(node.blocks)
+            freed += len(node.blocks)
+            self.num_cached_blocks -= len(node.blocks)
+            parent = node.parent
+            del parent.children[node.key[:self.block_size]]
+            if parent is not self.root and not parent.children and parent.lock_ref == 0:
+                heapq.heappush(heap, (parent.last_access, id(parent), parent))
+        self.evicted_blocks += freed
+        return freed
+
+    # ----------------------------------------------------------------- stats
+    @property
+    def hit_rate(self) -> float:
+        return self.hit_tokens / self.queried_tokens if self.queried_tokens else 0.0
+
+    def reset_stats(self):
+        self.queried_tokens = self.hit_tokens = self.evicted_blocks = 0
+
+    # ------------------------------------------------------------- internals
+    def _common_blocks(self, child: RadixNode, tokens, pos: int, limit: int) -> int:
+        """Leading blocks of child's edge that equal tokens[pos:limit]
+        (at least 1: the caller found child by its first block)."""
+        bs = self.block_size
+        k = 1
+        while (k < len(child.blocks) and pos + (k + 1) * bs <= limit
+               and child.key[k * bs:(k + 1) * bs] == tokens[pos + k * bs:pos + (k + 1) * bs]):
+            k += 1
+        return k
+
+    def _split(self, child: RadixNode, k: int) -> RadixNode:
+        """Cut child's edge after k blocks; returns the new upper node."""
+        bs = self.block_size
+        parent = child.parent
+        upper = RadixNode(child.key[:k * bs], child.blocks[:k], parent)
+        upper.lock_ref = child.lock_ref
+        upper.last_access = child.last_access
+        parent.children[upper.key[:bs]] = upper
+        child.key = child.key[k * bs:]
+        child.blocks = child.blocks[k:]
+        child.parent = upper
+        upper.children[child.key[:bs]] = child
+        return upper
+
+    def _leaves(self):
+        stack = list(self.root.children.values())
+        while stack:
+            node = stack.pop()
+            if node.children:
+                stack.extend(node.children.values())
+            else:
+                yield node
@@ -1,9 +1,36 @@
 """Part 3: Continuous Batching Scheduler
 
-Prefill each request one at a time, then batch all decodes together
-using engine.decode_batch() for GPU efficiency.
+Prefill the admitted requests packed into shared forwards (up to
+max_prefill_tokens each; packed_prefill=False: one forward per request),
+then batch all decodes together using engine.decode_batch() for GPU
+efficiency.
+
+Chunked prefill (chunk_size, token_budget): a long prompt is prefilled a
+chunk per step instead of in one forward, so it cannot stall the running
+batch for its whole prefill. Each step spends at most token_budget
+tokens: one per running sequence, the rest on prompt chunks.
+
+KV memory budget (kv_blocks): every admitted sequence holds blocks of
+block_size tokens in a BlockManager for its KV, one more each time it
+fills a block. When a decode step cannot get its blocks, the lowest-
+priority running sequences are preempted instead of raising: swapped to
+host memory or dropped for recompute (preemption.py), and resumed ahead
+of new requests once blocks free up.
+
+Admission control: with a KV budget, a waiting request is admitted only
+if its prompt plus decode_headroom output tokens fit above the
+allocator's watermark (kv_watermark of the blocks, kept for running
+sequences to grow into) and the headroom already promised to admitted
+sequences. The waiting queue is admitted in the order of a pluggable
+policy (policy.py: fcfs, spf, priority with aging).
 """
 
+import time
+
+from .block_manager import BlockManager
+from .host_pool import create_host_pool
+from .policy import make_policy
+from .preemption import CostModel
 from .sampling import SamplingParams
 from .sequence import Sequence, SequenceStatus
 from .engine import Engine
@@ -11,42 +38,324 @@ from .engine import Engine
 
 class Scheduler:
     def __init__(self, model_path: str, max_batch_size: int = 64,
-                 device: str = "cuda"):
-        self.engine = Engine(model_path, device=device)
+                 device: str = "cuda", prefix_cache_blocks: int = 0,
+                 block_size: int = 16, max_seq_len: int = 1024,
+                 slot_kv: bool = False, chunk_size: int = 0, token_budget: int = 0,
+                 packed_prefill: bool = True, max_prefill_tokens: int = 4096,
+                 kv_blocks: int = 0, preemption: str = "auto", swap_space_gb: float = 4.0,
+                 policy="fcfs", decode_headroom: int = 64, kv_watermark: float = 0.01,
+                 engine: Engine = None):
+        # An already built engine (model_path is then unused) lets several
+        # schedulers share one model
+        self.engine = engine if engine is not None else Engine(model_path, device=device)
         self.tokenizer = self.engine.tokenizer
         self.max_batch_size = max_batch_size
 
+        # Prefill chunk limit and per-step token budget (0: unlimited)
+        self.chunk_size = chunk_size
+        self.token_budget = token_budget
+
+        # Pack prefill chunks into one forward, up to max_prefill_tokens
+        # tokens per forward (0: unlimited)
+        self.packed_prefill = packed_prefill
+        self.max_prefill_tokens = max_prefill_tokens
+
+        # Persistent batched KV store: one slot per running sequence, so
+        # decode steps append in place instead of re-batching every cache.
+        # Opt-in: it preallocates max_batch_size × max_seq_len tokens of KV
+        if slot_kv:
+            self.engine.enable_slot_kv(max_batch_size, max_seq_len)
+
+        # Radix prefix cache over prefix_cache_blocks KV blocks (0: off)
+        self.prefix_cache = None
+        if prefix_cache_blocks > 0:
+            self.prefix_cache = self.engine.enable_prefix_cache(prefix_cache_blocks, block_size)
+
+        # KV memory budget of kv_blocks blocks (0: bounded by slots only).
+        # Bookkeeping only (no layers, no pools): the KV lives in the slots
+        self.block_manager = None
+        self.host_pool = None
+        if kv_blocks > 0:
+            if preemption not in ("auto", "swap", "recompute"):
+                raise ValueError(f"unknown preemption mode {preemption!r}")
+            self.block_manager = BlockManager(kv_blocks, block_size, num_layers=0,
+                                              num_heads=0, head_dim=0)
+            bytes_per_token = self.engine.kv_bytes_per_token
+            self.cost_model = CostModel(bytes_per_token)
+            if preemption != "recompute" and slot_kv and swap_space_gb > 0:
+                page_bytes = block_size * bytes_per_token
+                self.host_pool = create_host_pool(int(swap_space_gb * 2**30 // page_bytes),
+                                                  page_bytes)
+            self.block_manager.allocator.set_watermark(int(kv_watermark * kv_blocks))
+        self.preemption = preemption
+        self.num_preempted = {"swap": 0, "recompute": 0}
+
+        # Admission: order of the waiting queue (a name from policy.py or a
+        # policy object) and decode tokens a request must have room for
+        self.policy = make_policy(policy) if isinstance(policy, str) else policy
+        self.decode_headroom = decode_headroom
+        # seq_id → headroom blocks promised at admission, not yet allocated
+        self.reserved_blocks: dict[int, int] = {}
+        self.num_reserved_blocks = 0
+
+        # Timestamps for arrival, tokens and cost measurements
+        self.clock = time.perf_counter
+
         self.next_seq_id = 0
         self.waiting_queue: list[Sequence] = []
+        self.prefilling: list[Sequence] = []   # admitted, prompt partly prefilled
         self.running: list[Sequence] = []
+        self.swapped: list[Sequence] = []      # preempted, KV in host memory
         self.finished: list[Sequence] = []
 
-    def add_request(self, prompt: str, sampling_params: SamplingParams = None):
+    def add_request(self, prompt: str, sampling_params: SamplingParams = None,
+                    priority: int = 0):
         """Tokenize prompt, create Sequence, add to waiting queue."""
         if sampling_params is None:
             sampling_params = SamplingParams()
         token_ids = self.tokenizer.encode(prompt)
+        bm = self.block_manager
+        if bm is not None and bm.blocks_needed(len(token_ids) + 1) > bm.num_blocks:
+            raise ValueError(f"prompt of {len(token_ids)} tokens does not fit "
+                             f"kv_blocks={bm.num_blocks}")
+        kv = self.engine.kv
+        if kv is not None and len(token_ids) >= kv.max_seq_len:
+            raise ValueError(f"prompt of {len(token_ids)} tokens does not fit "
+                             f"max_seq_len={kv.max_seq_len}")
         seq = Sequence(
             seq_id=self.next_seq_id,
             prompt_token_ids=token_ids,
             max_tokens=sampling_params.max_tokens,
+            priority=priority,
+            arrival_time=self.clock(),
         )
         self.waiting_queue.append(seq)
         self.next_seq_id += 1
 
-    def _prefill_waiting(self, sampling_params: SamplingParams):
-        """Prefill one request from the waiting queue and move it to running."""
-        if not self.waiting_queue:
-            return
-        if len(self.running) >= self.max_batch_size:
+    def _prefill_waiting(self, sampling_params: SamplingParams, budget: float,
+                         admit: bool = True):
+        """
+        Spend up to `budget` prompt tokens on prefill. Sequences already
+        part-way through their prompt go first, then (if admit) waiting
+        requests are admitted while the batch and the KV budget have room.
+        Every sequence gets at most one chunk (chunk_size tokens, or the
+        rest of its prompt) per step and moves to running when its last
+        chunk yields the first token.
+        """
+        plan = []   # (seq, chunk tokens)
+        for seq in self.prefilling:
+            if budget <= 0:
+                break
+            plan.append((seq, self._chunk_tokens(seq, budget)))
+            budget -= plan[-1][1]
+
+        if admit:
+            now = self.clock()
+            # Preempted (recompute) sequences first, then policy order
+            self.waiting_queue.sort(key=lambda q: (q.num_preemptions == 0, self.policy.key(q, now)))
+        while (admit and budget > 0 and self.waiting_queue
+               and len(self.running) + len(self.prefilling) < self.max_batch_size):
+            seq = self.waiting_queue[0]
+            if not self._reserve(seq):
+                break
+            self.waiting_queue.pop(0)
+            self._match_prefix(seq)
+            self.prefilling.append(seq)
+            plan.append((seq, self._chunk_tokens(seq, budget)))
+            budget -= plan[-1][1]
+
+        # Group the chunks into forwards of at most max_prefill_tokens
+        # (a longer chunk runs alone)
+        group, tokens = [], 0
+        for seq, n in plan:
+            if group and (not self.packed_prefill or
+                          (self.max_prefill_tokens and tokens + n > self.max_prefill_tokens)):
+                self._prefill_group(group, sampling_params)
+                group, tokens = [], 0
+            group.append((seq, n))
+            tokens += n
+        if group:
+            self._prefill_group(group, sampling_params)
+
+    def _chunk_tokens(self, seq: Sequence, budget: float) -> int:
+        """Size of seq's next prefill chunk under the remaining budget."""
+        remaining = len(seq.prefill_token_ids) - max(seq.num_prefilled, seq.num_cached_tokens)
+        return min(remaining, self.chunk_size or remaining, budget)
+
+    def _prefill_group(self, group: list, sampling_params: SamplingParams):
+        """One prefill forward over the (seq, tokens) chunks in group."""
+        seqs = [seq for seq, _ in group]
+        t0 = self.clock()
+        first_tokens = self.engine.prefill_batch(seqs, sampling_params, [n for _, n in group])
+        now = self.clock()
+        if self.block_manager is not None and any(t is not None for t in first_tokens):
+            # Sampling synchronised, so the time is the forward's
+            self.cost_model.observe_prefill(sum(n for _, n in group), now - t0)
+        for seq, first_token in zip(seqs, first_tokens):
+            if first_token is None:
+                continue
+            self.prefilling.remove(seq)
+            if seq.output_token_ids:
+                # Recomputed after preemption: its next token is already known
+                seq.status = SequenceStatus.DECODING
+                self.running.append(seq)
+                continue
+            seq.output_token_ids.append(first_token)
+            seq.token_times.append(now)
+            if first_token == self.tokenizer.eos_token_id:
+                self._finish(seq, "eos")
+            elif len(seq.output_token_ids) >= seq.max_tokens:
+                self._finish(seq, "max_tokens")
+            else:
+                self.running.append(seq)
+
+    def _match_prefix(self, seq: Sequence):
+        """
+        Look up the longest cached prefix of the prompt and lock it so it
+        cannot be evicted while seq runs; prefill then computes only the
+        rest. The last prompt token is always computed: its logits give
+        the first output token.
+        """
+        if self.prefix_cache is None:
             return
-        seq = self.waiting_queue.pop(0)
-        first_token = self.engine.prefill(seq, sampling_params)
-        seq.output_token_ids.append(first_token)
-        if first_token == self.tokenizer.eos_token_id:
-            seq.status = SequenceStatus.FINISHED
-            self.finished.append(seq)
+        prompt = seq.prefill_token_ids
+        blocks, node = self.prefix_cache.match_prefix(prompt, max_tokens=len(prompt) - 1)
+        self.prefix_cache.lock(node)
+        seq.cached_blocks = blocks
+        seq.num_cached_tokens = len(blocks) * self.prefix_cache.block_size
+        seq.prefix_node = node
+
+    def _finish(self, seq: Sequence, reason: str):
+        seq.status = SequenceStatus.FINISHED
+        seq.finish_reason = reason
+        self.engine.release(seq)
+        self._unlock_prefix(seq)
+        if self.block_manager is not None:
+            self.block_manager.free(seq.seq_id)
+            self._release_headroom(seq)
+        self.finished.append(seq)
+
+    def _unlock_prefix(self, seq: Sequence):
+        if seq.prefix_node is not None:
+            self.prefix_cache.unlock(seq.prefix_node)
+            seq.prefix_node = None
+
+    # ------------------------------------------------- KV budget / preemption
+    @staticmethod
+    def _rank(seq: Sequence):
+        """Sort key: higher priority first, then earlier arrival."""
+        return (-seq.priority, seq.arrival_time, seq.seq_id)
+
+    def _reserve(self, seq: Sequence, num_tokens: int = None) -> bool:
+        """
+        Admission control: take the blocks for seq's num_tokens of KV (its
+        prefill; a swapped sequence's KV) from the KV budget if they plus
+        up to decode_headroom output tokens (at least the next one) fit
+        above the watermark and the headroom reserved for the sequences
+        already admitted; the new headroom is then reserved too. An idle
+        pool admits anything that fits at all, so a large request cannot
+        wait forever.
+        """
+        bm = self.block_manager
+        if bm is None:
+            return True
+        n = len(seq.prefill_token_ids) if num_tokens is None else num_tokens
+        headroom = max(1, min(self.decode_headroom, seq.max_tokens - len(seq.output_token_ids)))
+        need = bm.blocks_needed(n + headroom)
+        available = bm.num_free_blocks - bm.allocator.watermark - self.num_reserved_blocks
+        idle = not (self.running or self.prefilling or self.swapped)
+        if not (need <= available or (idle and bm.blocks_needed(n + 1) <= bm.num_free_blocks)):
+            return False
+        reserved = need - len(bm.allocate(seq.seq_id, n))
+        self.reserved_blocks[seq.seq_id] = reserved
+        self.num_reserved_blocks += reserved
+        return True
+
+    def _release_headroom(self, seq: Sequence, blocks: int = None):
+        """Return `blocks` (default: all) of seq's reserved headroom."""
+        held = self.reserved_blocks.get(seq.seq_id, 0)
+        blocks = held if blocks is None else min(blocks, held)
+        self.num_reserved_blocks -= blocks
+        if held - blocks:
+            self.reserved_blocks[seq.seq_id] = held - blocks
+        else:
+            self.reserved_blocks.pop(seq.seq_id, None)
+
+    def _grow_running(self) -> int:
+        """
+        Give every running sequence room for the token this step writes
+        (BlockManager.append_slot), in rank order. While the pool is
+        short, the lowest-ranked running sequence is preempted, as a last
+        resort the one asking. A new block comes out of the sequence's
+        reserved headroom. Returns how many were preempted.
+        """
+        bm = self.block_manager
+        if bm is None:
+            return 0
+        preempted = 0
+        queue = sorted(self.running, key=self._rank)
+        self.running = []
+        while queue:
+            seq = queue.pop(0)
+            num_kv = len(seq.output_token_ids) + len(seq.prompt_token_ids) - 1
+            while num_kv % bm.block_size == 0 and bm.num_free_blocks == 0:
+                self._preempt(queue.pop() if queue else seq)
+                preempted += 1
+                if seq.status != SequenceStatus.DECODING:
+                    break
+            if seq.status == SequenceStatus.DECODING:
+                if bm.append_slot(seq.seq_id, num_kv):
+                    self._release_headroom(seq, 1)
+                self.running.append(seq)
+        return preempted
+
+    def _preempt(self, seq: Sequence):
+        """Free seq's KV blocks: swap its KV to host memory, or drop it to
+        recompute later, as configured (auto: the cost model's pick)."""
+        num_kv = len(seq.output_token_ids) + len(seq.prompt_token_ids) - 1
+        mode = self.preemption
+        if mode == "auto":
+            mode = self.cost_model.choose(num_kv)
+        if mode == "swap" and (self.host_pool is None or seq.slot < 0 or self.host_pool.num_free
+                               < self.host_pool.pages_needed(num_kv * self.engine.kv_bytes_per_token)):
+            mode = "recompute"
+
+        self.block_manager.free(seq.seq_id)
+        self._release_headroom(seq)
+        if mode == "swap":
+            t0 = self.clock()
+            nbytes = self.engine.swap_out(seq, self.host_pool)
+            self.cost_model.observe_swap(nbytes, self.clock() - t0)
+            seq.status = SequenceStatus.SWAPPED
+            self.swapped.append(seq)
         else:
+            self.engine.release(seq)
+            self._unlock_prefix(seq)
+            seq.past_key_values = None
+            seq.cached_blocks = []
+            seq.num_cached_tokens = 0
+            seq.num_prefilled = 0
+            seq.status = SequenceStatus.WAITING
+            self.waiting_queue.insert(0, seq)
+        seq.num_preemptions += 1
+        self.num_preempted[mode] += 1
+
+    def _swap_in(self):
+        """Bring swapped sequences back, best ranked first, while the batch
+        has room and the KV budget admits them (_reserve: their KV plus
+        decode headroom, which is reserved again)."""
+        if not self.swapped:
+            return
+        self.swapped.sort(key=self._rank)
+        while self.swapped and len(self.running) + len(self.prefilling) < self.max_batch_size:
+            seq = self.swapped.pop(0)
+            if not self._reserve(seq, seq.num_swapped_tokens):
+                self.swapped.insert(0, seq)
+                break
+            t0 = self.clock()
+            nbytes = self.engine.swap_in(seq, self.host_pool)
+            self.cost_model.observe_swap(nbytes, self.clock() - t0)
+            seq.status = SequenceStatus.DECODING
             self.running.append(seq)
 
     def _decode_running(self, sampling_params: SamplingParams):
@@ -59,7 +368,9 @@ class Scheduler:
 
         After getting the new tokens:
           - Append each token to its sequence's output_token_ids
-          - Check termination: EOS token OR reached max_tokens
+          - Check termination: EOS token, reached max_tokens, or its KV
+            cannot grow (slot full, or larger than the whole KV budget);
+            seq.finish_reason tells them apart
           - Move finished sequences out of self.running into self.finished
         """
         if not self.running:
@@ -68,17 +379,29 @@ class Scheduler:
         # Single batched GPU forward pass for ALL running sequences
         next_tokens = self.engine.decode_batch(self.running, sampling_params)
 
+        now = self.clock()
         still_running = []
         for seq, token in zip(self.running, next_tokens):
             seq.output_token_ids.append(token)
+            seq.token_times.append(now)
 
-            # Termination condition: EOS token or hit max_tokens budget
-            is_eos = (token == self.tokenizer.eos_token_id)
-            is_max = (len(seq.output_token_ids) >= seq.max_tokens)
+            # Termination condition: EOS token, max_tokens budget, or no
+            # room for the next token's KV
+            kv = self.engine.kv
+            bm = self.block_manager
+            reason = None
+            if token == self.tokenizer.eos_token_id:
+                reason = "eos"
+            elif len(seq.output_token_ids) >= seq.max_tokens:
+                reason = "max_tokens"
+            elif seq.slot >= 0 and kv.lengths[seq.slot] >= kv.max_seq_len:
+                reason = "max_seq_len"
+            elif bm is not None and bm.blocks_needed(len(seq.all_token_ids)) > bm.num_blocks:
+                # With a KV budget: its next step would not fit even alone
+                reason = "kv_blocks"
 
-            if is_eos or is_max:
-                seq.status = SequenceStatus.FINISHED
-                self.finished.append(seq)
+            if reason is not None:
+                self._finish(seq, reason)
             else:
                 still_running.append(seq)
 
@@ -96,18 +419,31 @@ class Scheduler:
         its batch slot is immediately available for a waiting request
         in the SAME step, maximising GPU utilisation.
 
-        We prefill one waiting request per step (not all of them) because
-        prefill is expensive — doing one at a time keeps decode latency
-        predictable and avoids stalling the running batch.
+        Decode tokens come first in the token budget (one per running
+        sequence) and prefill gets the rest, so with chunking a step's
+        prefill work — and with it the running sequences' inter-token
+        latency — stays bounded however long the waiting prompts are.
+        Without a budget or chunk limit, every admitted prompt is
+        prefilled whole.
         """
         if sampling_params is None:
             sampling_params = SamplingParams()
 
+        # With a KV budget: resume swapped sequences, then make room for
+        # this step's tokens, preempting if the pool is exhausted
+        self._swap_in()
+        preempted = self._grow_running()
+
+        budget = self.token_budget or float("inf")
+        budget -= len(self.running)
+
         # Step 1: advance all running sequences by one token (batched)
-        _decode_running(self, sampling_params)
+        self._decode_running(sampling_params)
 
-        # Step 2: admit one new request from the waiting queue
-        self._prefill_waiting(sampling_params)
+        # Step 2: prompt chunks with what is left of the budget. No new
+        # admissions while preempted sequences wait to resume
+        admit = not preempted and not self.swapped
+        self._prefill_waiting(sampling_params, budget, admit)
 
     def run_to_completion(self,
                           sampling_params: SamplingParams = None) -> list[str]:
@@ -115,21 +451,17 @@ class Scheduler:
         Drive the scheduler loop until every request is finished.
         Returns generated texts in the original submission order (by seq_id).
 
-        Loop continues as long as there are requests in either:
-          - waiting_queue  (not yet prefilled)
+        Loop continues as long as there are requests in any of:
+          - waiting_queue  (not yet admitted, or preempted to recompute)
+          - prefilling     (prompt partly prefilled)
           - running        (prefilled, still generating)
+          - swapped        (preempted, KV in host memory)
         """
         if sampling_params is None:
             sampling_params = SamplingParams()
 
-        while self.waiting_queue or self.running:
-            # Step 1: decode all running sequences
-            self._decode_running(sampling_params)
-
-            # Step 2: promote as many waiting requests as batch allows
-            # Keep prefilling until the batch is full or queue is empty
-            while self.waiting_queue and len(self.running) < self.max_batch_size:
-                self._prefill_waiting(sampling_params)
+        while self.waiting_queue or self.prefilling or self.running or self.swapped:
+            self.step(sampling_params)
 
         # Sort finished sequences by seq_id to preserve submission order
         self.finished.sort(key=lambda s: s.seq_id)
@@ -138,4 +470,4 @@ class Scheduler:
         return [
             self.tokenizer.decode(seq.output_token_ids)
             for seq in self.finished
-        ]
\ No newline at end of file
+        ]
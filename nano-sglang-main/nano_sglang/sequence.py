@@ -12,7 +12,8 @@ class SequenceStatus(Enum):
     WAITING = "waiting"      # queued, not yet prefilled
     PREFILLING = "prefilling" # currently being prefilled
     DECODING = "decoding"    # prefill done, generating tokens
-    FINISHED = "finished"    # hit EOS or max_tokens
+    SWAPPED = "swapped"      # preempted, KV parked in host memory
+    FINISHED = "finished"    # see Sequence.finish_reason
 
 
 @dataclass
@@ -22,8 +23,35 @@ class Sequence:
     output_token_ids: list[int] = field(default_factory=list)  # generated tokens so far
     status: SequenceStatus = SequenceStatus.WAITING
     max_tokens: int = 256
+    priority: int = 0               # higher runs first; lowest is preempted first
     past_key_values: object = None  # HuggingFace past_key_values (set after prefill)
 
+    # Prefix cache (radix_cache.py): KV blocks of the longest cached prompt
+    # prefix, set at admission, and the locked tree node they end at
+    cached_blocks: list[int] = field(default_factory=list)
+    num_cached_tokens: int = 0
+    prefix_node: object = None
+
+    # Slot in the engine's persistent KV store (kv_cache.py), -1 if none
+    slot: int = -1
+
+    # Prompt tokens whose KV exists (cached prefix + prefilled chunks)
+    num_prefilled: int = 0
+
+    # Timing (time.perf_counter()): arrival and the time each output token
+    # was produced, for TTFT and inter-token latency
+    arrival_time: float = 0.0
+    token_times: list[float] = field(default_factory=list)
+
+    # Preemption: host pool pages and token count of swapped-out KV
+    host_pages: list[int] = field(default_factory=list)
+    num_swapped_tokens: int = 0
+    num_preemptions: int = 0
+
+    # Why it finished: "eos", "max_tokens", or cut off because its KV
+    # outgrew "max_seq_len" (its slot) or "kv_blocks" (the KV budget)
+    finish_reason: str = ""
+
     @property
     def num_generated(self) -> int:
         return len(self.output_token_ids)
@@ -32,6 +60,17 @@ class Sequence:
     def all_token_ids(self) -> list[int]:
         return self.prompt_token_ids + self.output_token_ids
 
+    @property
+    def prefill_token_ids(self) -> list[int]:
+        """
+        Tokens prefill computes KV for: the prompt, or after a recompute
+        preemption everything but the last output token (the next decode
+        step's input).
+        """
+        if self.output_token_ids:
+            return self.prompt_token_ids + self.output_token_ids[:-1]
+        return self.prompt_token_ids
+
     @property
     def is_finished(self) -> bool:
         return self.status == SequenceStatus.FINISHED
@@ -0,0 +1,108 @@
+"""Tests for the paged-KV block allocator (local, no GPU).
+
+Every case runs against the Python allocator and, when libnano_native has
+been built (csrc/), the C++ one.
+"""
+
+import pytest
+
+from nano_sglang import native
+from nano_sglang.block_allocator import BlockAllocator, PyBlockAllocator
+
+IMPLS = [PyBlockAllocator]
+if native.available():
+    IMPLS.append(BlockAllocator)
+
+
+@pytest.fixture(params=IMPLS, ids=lambda c: c.__name__)
+def make(request):
+    return request.param
+
+
+def test_allocate_in_order_and_reuse_lifo(make):
+    a = make(8)
+    assert a.allocate(3) == [0, 1, 2]
+    assert a.num_free == 5
+    a.release([1])
+    # The most recently freed block comes back first
+    assert a.allocate(2) == [1, 3]
+    assert a.num_used == 4
+
+
+def test_all_or_nothing_allocate(make):
+    a = make(4)
+    a.allocate(3)
+    with pytest.raises(RuntimeError):
+        a.allocate(2)
+    assert a.num_free == 1
+    assert a.allocate(0) == []
+
+
+def test_refcounts(make):
+    a = make(4)
+    ids = a.allocate(2)
+    a.share(ids)
+    a.share([ids[0]])
+    assert [a.refcount(b) for b in ids] == [3, 2]
+    a.release(ids)
+    assert a.num_free == 2
+    a.release(ids)
+    assert a.refcount(ids[0]) == 1 and a.refcount(ids[1]) == 0
+    assert a.num_free == 3
+    with pytest.raises(RuntimeError):
+        a.share([ids[1]])           # free blocks cannot gain holders
+
+
+def test_double_free_changes_nothing(make):
+    a = make(4)
+    ids = a.allocate(3)
+    with pytest.raises(RuntimeError):
+        a.release([ids[0], ids[1], ids[1]])
+    assert [a.refcount(b) for b in ids] == [1, 1, 1]
+    assert a.num_free == 1
+    with pytest.raises(RuntimeError):
+        a.release([ids[2], 99])     # out of range
+    assert a.refcount(ids[2]) == 1
+    with pytest.raises(IndexError):
+        a.refcount(-1)
+    a.release(ids)
+    assert a.num_free == 4
+    assert sorted(a.allocate(4)) == [0, 1, 2, 3]
+
+
+def test_watermark_and_peak(make):
+    a = make(10, 2)
+    assert a.watermark == 2
+    assert a.can_allocate(8) and not a.can_allocate(9)
+    ids = a.allocate(6)
+    assert not a.can_allocate(3)
+    a.release(ids[:4])
+    assert a.peak_used == 6
+    a.reset_peak()
+    assert a.peak_used == 2
+    a.set_watermark(0)
+    assert a.can_allocate(8)
+    with pytest.raises(ValueError):
+        a.set_watermark(11)
+
+
+def test_churn_matches_reference():
+    # The two implementations agree block for block on a random workload
+    if len(IMPLS) < 2:
+        pytest.skip("libnano_native not built")
+    import random
+    rng = random.Random(0)
+    py, cc = PyBlockAllocator(512), BlockAllocator(512)
+    held = []
+    for _ in range(2000):
+        if held and (rng.random() < 0.5 or not py.can_allocate(16)):
+            ids = held.pop(rng.randrange(len(held)))
+            py.release(ids)
+            cc.release(ids)
+        else:
+            n = rng.randint(1, 16)
+            got = py.allocate(n)
+            assert cc.allocate(n) == got
+            held.append(got)
+        assert py.num_free == cc.num_free
+    assert py.peak_used == cc.peak_used
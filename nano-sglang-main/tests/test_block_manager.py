@@ -0,0 +1,54 @@
+"""Tests for Part 5: Paged KV cache block manager (local, no GPU)"""
+
+import pytest
+import torch
+from nano_sglang.block_manager import BlockManager
+
+
+def make_manager(num_blocks=8, block_size=4, **kw):
+    return BlockManager(num_blocks=num_blocks, block_size=block_size, num_layers=1,
+                        num_heads=2, head_dim=8, device="cpu", dtype=torch.float32, **kw)
+
+
+def test_allocate_and_free():
+    bm = make_manager()
+    assert bm.allocate(0, 9) == [0, 1, 2]        # ceil(9 / 4) blocks
+    assert bm.allocate(1, 4) == [3]
+    assert bm.num_free_blocks == 4
+    bm.free(0)
+    bm.free(0)                                   # no-op
+    assert bm.num_free_blocks == 7
+    assert bm.get_block_ids(0) == []
+    assert bm.peak_used_blocks == 4
+
+
+def test_out_of_memory():
+    bm = make_manager(num_blocks=2)
+    with pytest.raises(RuntimeError):
+        bm.allocate(0, 9)
+    assert bm.num_free_blocks == 2
+
+
+def test_append_slot_grows_table():
+    bm = make_manager()
+    bm.allocate(0, 4)
+    assert bm.append_slot(0, 3) is False
+    assert bm.append_slot(0, 4) is True
+    assert len(bm.get_block_ids(0)) == 2
+
+
+def test_write_read_across_blocks():
+    bm = make_manager()
+    bm.allocate(0, 6)
+    keys = torch.randn(6, 2, 8)
+    for pos in range(6):
+        bm.write_kv(0, 0, pos, keys[pos], -keys[pos])
+    k, v = bm.read_kv(0, 0, 6)
+    assert torch.allclose(k[0], keys.transpose(0, 1))
+    assert torch.allclose(v[0], -keys.transpose(0, 1))
+
+
+def test_watermark_admission():
+    bm = make_manager(num_blocks=8, watermark=2)
+    assert bm.can_allocate(24)                   # 6 blocks leave 2 free
+    assert not bm.can_allocate(25)
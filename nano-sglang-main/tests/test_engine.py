@@ -59,4 +59,63 @@ def test_generate_deterministic(engine):
     params = SamplingParams(temperature=0, max_tokens=10)
     text1 = engine.generate("Once upon a time", params)
     text2 = engine.generate("Once upon a time", params)
-    assert text1 == text2
\ No newline at end of file
+    assert text1 == text2
+
+def test_slot_kv_decode_matches_padded_batch(engine):
+    """The persistent slot store decodes the same tokens as the pad-and-concat path."""
+    from nano_sglang.sequence import Sequence
+    from nano_sglang.sampling import SamplingParams
+    params = SamplingParams(temperature=0)
+    prompts = ["Hello", "The capital of France is", "One two three four five six"]
+
+    def run():
+        seqs = [Sequence(seq_id=i, prompt_token_ids=engine.tokenizer.encode(p))
+                for i, p in enumerate(prompts)]
+        for seq in seqs:
+            seq.output_token_ids.append(engine.prefill(seq, params))
+        for _ in range(6):
+            for seq, tok in zip(seqs, engine.decode_batch(seqs, params)):
+                seq.output_token_ids.append(tok)
+        for seq in seqs:
+            engine.release(seq)
+        return [seq.output_token_ids for seq in seqs]
+
+    padded = run()
+    engine.enable_slot_kv(max_batch_size=4, max_seq_len=64)
+    try:
+        slotted = run()
+        assert engine.kv.num_free_slots == 4
+    finally:
+        engine.kv = None
+    assert slotted == padded
+
+
+def test_packed_prefill_matches_one_at_a_time(engine):
+    """Prompts packed into one forward (block-diagonal mask) give the same tokens."""
+    from nano_sglang.sequence import Sequence
+    from nano_sglang.sampling import SamplingParams
+    params = SamplingParams(temperature=0)
+    prompts = ["Hello", "The capital of France is", "One two three four five six"]
+
+    def run(packed):
+        seqs = [Sequence(seq_id=i, prompt_token_ids=engine.tokenizer.encode(p))
+                for i, p in enumerate(prompts)]
+        if packed:
+            firsts = engine.prefill_batch(seqs, params, [len(s.prompt_token_ids) for s in seqs])
+        else:
+            firsts = [engine.prefill(seq, params) for seq in seqs]
+        for seq, tok in zip(seqs, firsts):
+            seq.output_token_ids.append(tok)
+        for _ in range(4):
+            for seq, tok in zip(seqs, engine.decode_batch(seqs, params)):
+                seq.output_token_ids.append(tok)
+        for seq in seqs:
+            engine.release(seq)
+        return [seq.output_token_ids for seq in seqs]
+
+    assert run(packed=True) == run(packed=False)
+    engine.enable_slot_kv(max_batch_size=4, max_seq_len=64)
+    try:
+        assert run(packed=True) == run(packed=False)
+    finally:
+        engine.kv = None
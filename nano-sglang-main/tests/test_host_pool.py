@@ -0,0 +1,85 @@
+"""Tests for the host swap pool (local, no GPU).
+
+Every case runs against the Python pool and, when libnano_native has been
+built (csrc/), the C++ one.
+"""
+
+import ctypes
+
+import pytest
+
+from nano_sglang import native
+from nano_sglang.host_pool import HostPool, PyHostPool
+
+IMPLS = [PyHostPool]
+if native.available():
+    IMPLS.append(HostPool)
+
+
+@pytest.fixture(params=IMPLS, ids=lambda c: c.__name__)
+def make(request):
+    return request.param
+
+
+def buffer(data: bytes):
+    buf = ctypes.create_string_buffer(data, len(data))
+    return buf, ctypes.addressof(buf)
+
+
+def test_round_trip_partial_last_page(make):
+    pool = make(8, 64)
+    data = bytes(range(200))                    # 3 full pages + 8 bytes
+    src, src_ptr = buffer(data)
+    pages = pool.store(src_ptr, len(data))
+    assert len(pages) == 4 and pool.num_free == 4
+    dst, dst_ptr = buffer(bytes(len(data)))
+    pool.load(pages, dst_ptr, len(data))
+    assert dst.raw == data
+    pool.release(pages)
+    assert pool.num_free == 8
+
+
+def test_store_is_all_or_nothing(make):
+    pool = make(4, 16)
+    _, ptr = buffer(bytes(48))
+    pool.store(ptr, 48)
+    with pytest.raises(RuntimeError):
+        pool.store(ptr, 32)
+    assert pool.num_free == 1
+    assert pool.store(ptr, 0) == []
+
+
+def test_many_sequences_interleaved(make):
+    pool = make(64, 32)
+    stored = []
+    for i in range(6):
+        data = bytes([i]) * (40 + 30 * i)
+        _, ptr = buffer(data)
+        stored.append((data, pool.store(ptr, len(data))))
+    pool.release(stored.pop(2)[1])              # leave a hole
+    data = b"x" * 150
+    _, ptr = buffer(data)
+    stored.append((data, pool.store(ptr, len(data))))
+    for data, pages in stored:
+        dst, dst_ptr = buffer(bytes(len(data)))
+        pool.load(pages, dst_ptr, len(data))
+        assert dst.raw == data
+
+
+def test_large_copy_uses_threads(make):
+    pool = make(40, 1 << 18, num_threads=4)     # 10 MiB, above the parallel cutoff
+    data = bytes(range(256)) * (9 << 12)        # 9 MiB
+    src, src_ptr = buffer(data)
+    pages = pool.store(src_ptr, len(data))
+    dst, dst_ptr = buffer(bytes(len(data)))
+    pool.load(pages, dst_ptr, len(data))
+    assert dst.raw == data
+
+
+def test_load_of_released_pages_fails(make):
+    pool = make(4, 16)
+    _, ptr = buffer(bytes(16))
+    pages = pool.store(ptr, 16)
+    pool.release(pages)
+    with pytest.raises(RuntimeError):
+        pool.load(pages, ptr, 16)
@@ -48,4 +48,17 @@ def test_independent_slots():
     k_out_0, _ = cache.get(0, 0, seq_len=3)
     k_out_1, _ = cache.get(0, 1, seq_len=3)
     assert torch.allclose(k_out_0, k0)
-    assert torch.allclose(k_out_1, k1)
\ No newline at end of file
+    assert torch.allclose(k_out_1, k1)
+
+def test_slots():
+    cache = KVCache(num_layers=1, num_heads=2, head_dim=16,
+                    max_seq_len=64, max_batch_size=3, device="cpu", dtype=torch.float32)
+    assert [cache.allocate_slot() for _ in range(3)] == [0, 1, 2]
+    assert cache.num_free_slots == 0
+    cache.lengths[0] = 5
+    cache.free_slot(0)
+    cache.free_slot(2)
+    # Lowest free slot first keeps the used slots packed at the front
+    assert cache.allocate_slot() == 0
+    assert cache.lengths[0] == 0
+    assert cache.num_free_slots == 1
@@ -0,0 +1,50 @@
+"""Tests for the admission scheduling policies (local, no GPU)"""
+
+import pytest
+
+from nano_sglang.policy import FCFS, PriorityAging, ShortestPromptFirst, make_policy
+from nano_sglang.sequence import Sequence
+
+
+def seqs():
+    return [
+        Sequence(seq_id=0, prompt_token_ids=[1] * 50, priority=0, arrival_time=0.0),
+        Sequence(seq_id=1, prompt_token_ids=[1] * 10, priority=0, arrival_time=1.0),
+        Sequence(seq_id=2, prompt_token_ids=[1] * 30, priority=2, arrival_time=2.0),
+        Sequence(seq_id=3, prompt_token_ids=[1] * 10, priority=1, arrival_time=3.0),
+    ]
+
+
+def order(policy, now):
+    return [s.seq_id for s in sorted(seqs(), key=lambda s: policy.key(s, now))]
+
+
+def test_fcfs():
+    assert order(FCFS(), now=10.0) == [0, 1, 2, 3]
+
+
+def test_shortest_prompt_first_breaks_ties_by_arrival():
+    assert order(ShortestPromptFirst(), now=10.0) == [1, 3, 2, 0]
+
+
+def test_priority_with_aging():
+    policy = PriorityAging(aging_rate=0.1)
+    assert order(policy, now=4.0) == [2, 3, 0, 1]
+    # Against a priority-2 request that just arrived, seq 0 (priority 0,
+    # waiting since 0 s) loses at 10 s but wins at 30 s, aged 3 levels;
+    # without aging it would lose forever
+    def fresh(now):
+        return Sequence(seq_id=4, prompt_token_ids=[1], priority=2, arrival_time=now)
+
+    old = seqs()[0]
+    assert policy.key(old, 10.0) > policy.key(fresh(10.0), 10.0)
+    assert policy.key(old, 30.0) < policy.key(fresh(30.0), 30.0)
+    no_aging = PriorityAging(aging_rate=0.0)
+    assert no_aging.key(old, 1e6) > no_aging.key(fresh(1e6), 1e6)
+
+
+def test_make_policy():
+    assert isinstance(make_policy("spf"), ShortestPromptFirst)
+    assert make_policy("priority", aging_rate=0.5).aging_rate == 0.5
+    with pytest.raises(ValueError):
+        make_policy("lifo")
@@ -0,0 +1,35 @@
+"""Tests for the preemption cost model (local, no GPU)"""
+
+from nano_sglang.preemption import CostModel
+
+
+def test_short_sequences_recompute_long_ones_swap():
+    cm = CostModel(kv_bytes_per_token=112 * 1024, swap_bytes_per_sec=8e9,
+                   swap_latency_sec=1e-3, prefill_tokens_per_sec=20e3)
+    assert cm.choose(16) == "recompute"
+    assert cm.choose(4096) == "swap"
+    # Crossover where 2 * (latency + n * bytes / bw) = n / tps
+    n = 2 * cm.swap_latency_sec / (1 / 20e3 - 2 * 112 * 1024 / 8e9)
+    assert cm.choose(int(n) - 1) == "recompute" and cm.choose(int(n) + 1) == "swap"
+
+
+def test_measurements_move_the_choice():
+    cm = CostModel(kv_bytes_per_token=112 * 1024)
+    assert cm.choose(4096) == "swap"
+    for _ in range(50):                         # PCIe far slower than assumed
+        cm.observe_swap(nbytes=1 << 30, seconds=1.0)
+    assert cm.swap_bytes_per_sec < 2e9
+    assert cm.choose(4096) == "recompute"
+    for _ in range(50):                         # and prefill slower still
+        cm.observe_prefill(num_tokens=1000, seconds=1.0)
+    assert cm.choose(4096) == "swap"
+
+
+def test_ignores_degenerate_measurements():
+    cm = CostModel(kv_bytes_per_token=1024)
+    before = (cm.swap_bytes_per_sec, cm.prefill_tokens_per_sec)
+    cm.observe_swap(0, 1.0)
+    cm.observe_swap(1 << 20, cm.swap_latency_sec / 2)
+    cm.observe_prefill(0, 1.0)
+    cm.observe_prefill(100, 0.0)
+    assert (cm.swap_bytes_per_sec, cm.prefill_tokens_per_sec) == before
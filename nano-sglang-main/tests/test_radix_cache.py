@@ -0,0 +1,97 @@
+"""Tests for the radix-tree prefix cache (local, no GPU)"""
+
+import pytest
+
+from nano_sglang.block_allocator import PyBlockAllocator
+from nano_sglang.radix_cache import RadixCache
+
+BS = 4
+
+
+def make_cache(num_blocks=16):
+    alloc = PyBlockAllocator(num_blocks)
+    return RadixCache(alloc, BS), alloc
+
+
+def cache_prompt(cache, tokens):
+    """What the engine does after prefill: match, allocate the rest, insert."""
+    blocks, node = cache.match_prefix(tokens)
+    new = cache.allocate(len(tokens) // BS - len(blocks))
+    cache.insert(tokens, blocks + new)
+    return blocks + new
+
+
+def test_miss_then_hit():
+    cache, alloc = make_cache()
+    prompt = list(range(10))                    # 2 full blocks + 2 tokens
+    blocks = cache_prompt(cache, prompt)
+    assert len(blocks) == 2 and cache.num_cached_blocks == 2
+    got, node = cache.match_prefix(prompt + [99])
+    assert got == blocks
+    assert cache.match_prefix(prompt, max_tokens=7)[0] == blocks[:1]
+    assert cache.match_prefix([5] + prompt)[0] == []
+    assert alloc.num_free == 14
+
+
+def test_shared_prefix_splits_edge():
+    cache, _ = make_cache()
+    a = cache_prompt(cache, [1] * 4 + [2] * 4 + [3] * 4)
+    b = cache_prompt(cache, [1] * 4 + [2] * 4 + [7] * 4)
+    assert b[:2] == a[:2] and b[2] != a[2]
+    assert cache.num_cached_blocks == 4
+    assert cache.match_prefix([1] * 4 + [2] * 4 + [7] * 4)[0] == b
+    assert cache.match_prefix([1] * 4 + [9] * 4)[0] == a[:1]
+
+
+def test_insert_releases_duplicate_blocks():
+    cache, alloc = make_cache()
+    tokens = list(range(8))
+    first = cache_prompt(cache, tokens)
+    dup = alloc.allocate(2)                     # same tokens computed again
+    assert cache.insert(tokens, dup) == 2
+    assert all(alloc.refcount(b) == 0 for b in dup)
+    assert all(alloc.refcount(b) == 1 for b in first)
+
+
+def test_eviction_skips_locked():
+    cache, alloc = make_cache(num_blocks=4)
+    old = cache_prompt(cache, [1] * 8)
+    hot = cache_prompt(cache, [2] * 8)
+    _, node = cache.match_prefix([1] * 8)
+    cache.lock(node)
+    cache.match_prefix([2] * 8)                 # most recent, but unlocked
+    new = cache.allocate(2)
+    assert sorted(new) == sorted(hot)
+    assert cache.evicted_blocks == 2
+    assert cache.match_prefix([2] * 8)[0] == []
+    assert cache.match_prefix([1] * 8)[0] == old
+    with pytest.raises(RuntimeError):
+        cache.allocate(1)                       # the rest is locked
+    cache.unlock(node)
+    alloc.release(new)
+    cache.allocate(4)
+    assert cache.num_cached_blocks == 0
+
+
+def test_eviction_order_and_parents():
+    cache, alloc = make_cache(num_blocks=8)
+    cache_prompt(cache, [1] * 4 + [2] * 4)      # root - [1] - [2]
+    cache_prompt(cache, [1] * 4 + [3] * 4)      #          \- [3]
+    cache_prompt(cache, [5] * 4)
+    cache.match_prefix([1] * 4 + [3] * 4)       # touch the [3] branch
+    assert alloc.num_free == 4
+    cache.evict(1)                              # LRU leaf: [2]
+    assert len(cache.match_prefix([1] * 4 + [2] * 4)[0]) == 1
+    cache.evict(3)                              # [5], then [3], then its parent [1]
+    assert cache.num_cached_blocks == 0
+    assert alloc.num_free == 8
+
+
+def test_hit_rate():
+    cache, _ = make_cache()
+    system = list(range(100, 108))
+    cache_prompt(cache, system + [1, 2, 3, 4])
+    cache.reset_stats()
+    cache.match_prefix(system + [5, 6, 7, 8])
+    assert cache.hit_tokens == 8 and cache.queried_tokens == 12
+    assert cache.hit_rate == pytest.approx(8 / 12)
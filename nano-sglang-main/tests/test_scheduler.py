@@ -72,4 +72,92 @@ def test_scheduler_throughput(scheduler):
     total_tokens = sum(len(scheduler.tokenizer.encode(r)) for r in results)
     throughput = total_tokens / elapsed
     print(f"\n8 requests: {elapsed:.2f}s, {total_tokens} tokens, {throughput:.1f} tok/s")
-    assert len(results) == 8
\ No newline at end of file
+    assert len(results) == 8
+
+def test_prefix_cache_matches_full_prefill(scheduler):
+    from nano_sglang.sampling import SamplingParams
+    from nano_sglang.scheduler import Scheduler
+    system = "You are a helpful assistant. Answer briefly and precisely. " * 8
+    prompts = [system + q for q in ("What is 2+2?", "Name a color.", "Say hi.")]
+    params = SamplingParams(temperature=0, max_tokens=8)
+    cached = Scheduler(MODEL_PATH, prefix_cache_blocks=256)
+    for p in prompts:
+        scheduler.add_request(p)
+        cached.add_request(p)
+    assert cached.run_to_completion(params) == scheduler.run_to_completion(params)
+    # Requests after the first reuse the system prompt's blocks
+    assert cached.prefix_cache.hit_tokens > 0
+
+
+def test_chunked_prefill_matches_full_prefill(scheduler):
+    from nano_sglang.sampling import SamplingParams
+    from nano_sglang.scheduler import Scheduler
+    long_prompt = "The history of the printing press begins in " * 30
+    prompts = [long_prompt, "Hello", "The weather is"]
+    params = SamplingParams(temperature=0, max_tokens=8)
+    chunked = Scheduler(MODEL_PATH, chunk_size=32, token_budget=48)
+    for p in prompts:
+        scheduler.add_request(p)
+        chunked.add_request(p)
+    assert chunked.run_to_completion(params) == scheduler.run_to_completion(params)
+    assert all(len(s.token_times) == len(s.output_token_ids) for s in chunked.finished)
+
+
+@pytest.mark.parametrize("mode", ["swap", "recompute"])
+def test_preemption_matches_unconstrained(scheduler, mode):
+    from nano_sglang.sampling import SamplingParams
+    from nano_sglang.scheduler import Scheduler
+    prompts = [f"Write a long story about topic {i}." for i in range(6)]
+    params = SamplingParams(temperature=0, max_tokens=40)
+    # 6 sequences of ~48 tokens need 18 blocks of 16 at once: 12 forces
+    # preemption once admission stops reserving decode headroom
+    tight = Scheduler(MODEL_PATH, slot_kv=True, max_batch_size=8, max_seq_len=256,
+                      kv_blocks=12, preemption=mode, swap_space_gb=0.5,
+                      decode_headroom=0, kv_watermark=0.0)
+    for p in prompts:
+        scheduler.add_request(p, params)
+        tight.add_request(p, params)
+    assert tight.run_to_completion(params) == scheduler.run_to_completion(params)
+    assert tight.num_preempted[mode] > 0
+    assert tight.block_manager.num_free_blocks == 12
+    assert {s.finish_reason for s in tight.finished} <= {"eos", "max_tokens"}
+
+
+def test_prompt_longer_than_slot_is_rejected(scheduler):
+    from nano_sglang.scheduler import Scheduler
+    sched = Scheduler(MODEL_PATH, engine=scheduler.engine, slot_kv=True,
+                      max_batch_size=2, max_seq_len=16)
+    with pytest.raises(ValueError):
+        sched.add_request("word " * 64)
+    assert not sched.waiting_queue
+
+
+def test_sequence_larger_than_kv_budget_is_cut_off(scheduler, monkeypatch):
+    from nano_sglang.sampling import SamplingParams
+    from nano_sglang.scheduler import Scheduler
+    params = SamplingParams(temperature=0, max_tokens=100)
+    # 4 blocks of 16 hold the KV of 64 tokens: the sequence stops once its
+    # next token would need a fifth block, and says so. No token is EOS,
+    # so it runs into the budget well before max_tokens
+    sched = Scheduler(MODEL_PATH, engine=scheduler.engine, kv_blocks=4)
+    monkeypatch.setattr(type(sched.tokenizer), "eos_token_id", -1)
+    sched.add_request("Write a long story about a lighthouse keeper.", params)
+    sched.run_to_completion(params)
+    (seq,) = sched.finished
+    assert seq.finish_reason == "kv_blocks"
+    assert len(seq.all_token_ids) == 64 + 1     # the last token has no KV yet
+
+
+def test_admission_with_full_headroom_never_preempts(scheduler):
+    from nano_sglang.sampling import SamplingParams
+    from nano_sglang.scheduler import Scheduler
+    params = SamplingParams(temperature=0, max_tokens=40)
+    # Each request is admitted only with room for all 40 output tokens
+    sched = Scheduler(MODEL_PATH, engine=scheduler.engine, kv_blocks=12,
+                      decode_headroom=40, kv_watermark=0.0, policy="spf")
+    for i in range(6):
+        sched.add_request(f"Write a long story about topic {i}.", params)
+    results = sched.run_to_completion(params)
+    assert len(results) == 6
+    assert sum(sched.num_preempted.values()) == 0
+    assert sched.block_manager.peak_used_blocks <= 12